@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench {
+/// Throughput of one benchmark
+struct Result {
+  std::string name;
+  double seconds = 0;
+  uint64_t iterations = 0;
+  uint64_t items = 0;       // Items processed over all iterations, e.g. instructions
+  uint64_t bytes = 0;       // Bytes processed over all iterations
+  uint64_t allocations = 0; // Calls to operator new over all iterations
+};
+
+/// Options shared by every suite, set from the command line
+struct Options {
+  double min_seconds = 0.5; // Minimum run time of each benchmark
+  std::string filter;       // Only run benchmarks whose name contains this
+  std::string database;     // Mock database fixture for the creation suite, e.g. from fusion-synth
+};
+
+inline Options options;
+
+/// Keep a computed value alive so the work producing it is not optimized away
+inline volatile uint64_t sink = 0;
+
+/// Calls to operator new since the program started, counted in main.cpp
+uint64_t allocation_count();
+
+/// Run `body` until at least `options.min_seconds` have passed.
+/// `body` returns the number of items it processed; each call covers `bytes_per_call` bytes.
+template <typename Body>
+Result run(const std::string& name, uint64_t bytes_per_call, Body&& body) {
+  using clock = std::chrono::steady_clock;
+  Result result;
+  result.name = name;
+
+  const uint64_t allocations = allocation_count();
+  const auto start = clock::now();
+  do {
+    result.items += body();
+    result.bytes += bytes_per_call;
+    ++result.iterations;
+    result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+  } while (result.seconds < options.min_seconds);
+  result.allocations = allocation_count() - allocations;
+
+  return result;
+}
+
+/// Run `body` and append its result, unless the filter excludes `name`
+template <typename Body>
+void add(std::vector<Result>& results, const std::string& name, uint64_t bytes_per_call,
+    Body&& body) {
+  if (name.find(options.filter) == std::string::npos) return;
+  results.push_back(run(name, bytes_per_call, body));
+}
+
+/// Print one result line: time per call, per item and per byte, and allocations per call
+void report(std::FILE* out, const Result& result);
+
+/// Write all results as a JSON array of objects to `out`
+void write_json(std::FILE* out, const std::vector<Result>& results);
+
+/// Instructions of a decoder test corpus, one entry per fixture line
+std::vector<std::vector<uint8_t>> load_instructions(const char* path);
+
+/// `size` bytes of code: corpus instructions in a seeded random order
+std::vector<uint8_t> make_code(
+    const std::vector<std::vector<uint8_t>>& instructions, size_t size, uint32_t seed);
+
+/// Benchmark suites, one per translation unit
+void decoder_benchmarks(std::vector<Result>& results);
+void pattern_benchmarks(std::vector<Result>& results);
+void scan_benchmarks(std::vector<Result>& results);
+void create_benchmarks(std::vector<Result>& results);
+void engine_benchmarks(std::vector<Result>& results);
+} // namespace bench
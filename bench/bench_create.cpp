@@ -0,0 +1,130 @@
+﻿#include "bench.h"
+
+#include "fusion/common_pattern.h"
+#include "fusion/corpus.h"
+#include "fusion/signature.h"
+#include "fusion/tokens.h"
+
+#include <algorithm>
+
+namespace bench {
+namespace {
+constexpr size_t targets_per_call = 16;
+constexpr size_t common_pattern_functions = 256;
+
+/// Function starts spread evenly over the database
+std::vector<uint64_t> pick_targets(const fusion::MockDatabase& db, size_t count) {
+  std::vector<uint64_t> targets;
+  const size_t stride = std::max<size_t>(db.functions.size() / count, 1);
+  for (size_t i = stride / 2; i < db.functions.size() && targets.size() < count; i += stride) {
+    targets.push_back(db.functions[i].start);
+  }
+  return targets;
+}
+
+/// Create a signature for each target, then search for every signature created
+void run_database(std::vector<Result>& results, const std::string& name, fusion::MockDatabase& db) {
+  const auto targets = pick_targets(db, targets_per_call);
+
+  // Items are signatures; ns/byte is per byte of signature created
+  std::vector<std::string> signatures;
+  size_t signature_bytes = 0;
+  for (const uint64_t target : targets) {
+    db.cursor_ea = target;
+    const auto created = fusion::create_signature(db, {});
+    if (created.status != fusion::CreateStatus::Unique) continue;
+    signature_bytes += created.builder.size();
+    signatures.push_back(created.builder.render(fusion::SignatureStyle::IDA));
+  }
+
+  add(results, "create_signature/" + name, signature_bytes, [&] {
+    size_t created = 0;
+    for (const uint64_t target : targets) {
+      db.cursor_ea = target;
+      created += fusion::create_signature(db, {}).status == fusion::CreateStatus::Unique;
+    }
+    return created;
+  });
+
+  add(results, "find_signature/" + name, db.snapshot.total_size() * signatures.size(), [&] {
+    size_t found = 0;
+    for (const auto& signature : signatures) {
+      found += fusion::find_signature(db, signature, {})->size();
+    }
+    return found;
+  });
+
+  // Token signatures: the index is built once, then creation and search only look it up
+  add(results, "build_token_index/" + name, db.snapshot.total_size(), [&] {
+    fusion::TokenIndex built;
+    built.build(db.image(), db.decoder());
+    return built.size();
+  });
+
+  fusion::TokenIndex index;
+  index.build(db.image(), db.decoder());
+
+  std::vector<std::string> token_signatures;
+  for (const uint64_t target : targets) {
+    db.cursor_ea = target;
+    const auto created = fusion::create_token_signature(db, index, {});
+    if (created.status != fusion::CreateStatus::Unique) continue;
+    token_signatures.push_back(fusion::format_token_signature(created.tokens));
+  }
+
+  add(results, "create_token_signature/" + name, 0, [&] {
+    size_t created = 0;
+    for (const uint64_t target : targets) {
+      db.cursor_ea = target;
+      created += fusion::create_token_signature(db, index, {}).status
+                 == fusion::CreateStatus::Unique;
+    }
+    return created;
+  });
+
+  // Per byte of image, like find_signature, though only the index is read
+  const uint64_t searched = db.snapshot.total_size() * token_signatures.size();
+  add(results, "find_token_signature/" + name, searched, [&] {
+    size_t found = 0;
+    for (const auto& signature : token_signatures) {
+      found += fusion::find_token_signature(index, signature, {})->size();
+    }
+    return found;
+  });
+
+  std::vector<fusion::AddressRange> functions;
+  uint64_t function_bytes = 0;
+  for (const uint64_t start : pick_targets(db, common_pattern_functions)) {
+    const auto function = db.function_at(start);
+    functions.push_back({function->start, function->end});
+    function_bytes += function->end - function->start;
+  }
+
+  add(results, "find_common_pattern/" + name, function_bytes, [&] {
+    const auto common = fusion::find_common_pattern(db.image(), db.decoder(), functions);
+    return common ? common->instructions : 0;
+  });
+}
+} // namespace
+
+void create_benchmarks(std::vector<Result>& results) {
+  if (!options.database.empty()) {
+    fusion::MockDatabase db;
+    if (fusion::load_mock_database(options.database, db)) {
+      run_database(results, "fixture", db);
+    } else {
+      std::fprintf(stderr, "fusion_bench: cannot read %s\n", options.database.c_str());
+    }
+    return;
+  }
+
+  const std::pair<const char*, size_t> sizes[] = {{"1MiB", 1 << 20}, {"16MiB", 16 << 20}};
+  for (const auto& [size_name, size] : sizes) {
+    fusion::CorpusSettings settings;
+    settings.size = size;
+    fusion::MockDatabase db;
+    fusion::generate_corpus(settings, db);
+    run_database(results, std::string("synthetic/") + size_name, db);
+  }
+}
+} // namespace bench
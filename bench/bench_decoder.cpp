@@ -0,0 +1,81 @@
+﻿#include "bench.h"
+
+#include "fusion/x86_decoder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace bench {
+namespace {
+/// Instruction stream of the decoder test corpus, repeated to `size` bytes
+std::vector<uint8_t> load_code(const char* path, size_t size) {
+  std::vector<uint8_t> corpus;
+  for (const auto& insn : load_instructions(path)) {
+    corpus.insert(corpus.end(), insn.begin(), insn.end());
+  }
+
+  std::vector<uint8_t> code;
+  code.reserve(size + corpus.size());
+  while (!corpus.empty() && code.size() < size) {
+    code.insert(code.end(), corpus.begin(), corpus.end());
+  }
+  return code;
+}
+
+/// Decode `code` front to back, returning the instruction count
+size_t decode_all(const std::vector<uint8_t>& code, bool x64) {
+  size_t count = 0, checksum = 0;
+  fusion::X86Insn insn;
+  for (size_t pos = 0; pos < code.size(); ++count) {
+    if (!fusion::decode_x86(code.data() + pos, code.size() - pos, x64, insn)) break;
+    checksum += insn.operand_offset();
+    pos += insn.size;
+  }
+  sink = sink + checksum;
+  return count;
+}
+} // namespace
+
+std::vector<std::vector<uint8_t>> load_instructions(const char* path) {
+  std::vector<std::vector<uint8_t>> instructions;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<uint8_t> insn;
+    std::istringstream hex(line.substr(0, line.find('#')));
+    for (std::string token; hex >> token;) {
+      insn.push_back(static_cast<uint8_t>(std::stoul(token, nullptr, 16)));
+    }
+    if (!insn.empty()) {
+      instructions.push_back(std::move(insn));
+    }
+  }
+  return instructions;
+}
+
+std::vector<uint8_t> make_code(
+    const std::vector<std::vector<uint8_t>>& instructions, size_t size, uint32_t seed) {
+  std::vector<uint8_t> code;
+  code.reserve(size + 16);
+  while (!instructions.empty() && code.size() < size) {
+    seed = seed * 1103515245 + 12345;
+    const auto& insn = instructions[(seed >> 8) % instructions.size()];
+    code.insert(code.end(), insn.begin(), insn.end());
+  }
+  code.resize(std::min(code.size(), size));
+  return code;
+}
+
+void decoder_benchmarks(std::vector<Result>& results) {
+  constexpr size_t code_size = 16 << 20;
+  for (const bool x64 : {true, false}) {
+    const auto code = load_code(
+        x64 ? FUSION_BENCH_FIXTURES "/x86_64.txt" : FUSION_BENCH_FIXTURES "/x86_32.txt", code_size);
+    if (code.empty()) continue;
+
+    add(results, x64 ? "decode_x86/64-bit" : "decode_x86/32-bit", code.size(),
+        [&] { return decode_all(code, x64); });
+  }
+}
+} // namespace bench
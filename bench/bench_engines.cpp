@@ -0,0 +1,99 @@
+﻿#include "bench.h"
+
+#include "fusion/corpus.h"
+#include "fusion/differential.h"
+#include "fusion/rng.h"
+
+namespace bench {
+namespace {
+/// `count` signatures cut from the code region at seeded offsets, with random masks
+std::vector<fusion::SignatureRecord> cut_patterns(
+    const fusion::ImageSnapshot& image, size_t count, bool nibbles, uint64_t seed) {
+  const auto& bytes = image.regions.front().bytes;
+  fusion::Rng rng(seed);
+  std::vector<fusion::SignatureRecord> records(count);
+  for (auto& record : records) {
+    const size_t length = 8 + rng.below(17);
+    const size_t offset = rng.below(static_cast<uint32_t>(bytes.size() - length));
+    for (size_t i = 0; i < length; ++i) {
+      // Mostly exact bytes, then wildcards and, if asked for, single-nibble wildcards
+      const uint32_t kind = i == 0 ? 0 : rng.below(8);
+      uint8_t mask = 0xFF;
+      if (kind >= 5) {
+        mask = !nibbles || kind == 5 ? 0x00 : kind == 6 ? 0xF0 : 0x0F;
+      }
+      record.pattern.add_byte(bytes[offset + i], mask);
+    }
+  }
+  return records;
+}
+} // namespace
+
+void engine_benchmarks(std::vector<Result>& results) {
+  fusion::CorpusSettings settings;
+  settings.size = 16 << 20;
+  fusion::MockDatabase db;
+  fusion::generate_corpus(settings, db);
+
+  struct Workload {
+    const char* name;
+    size_t patterns;
+    bool nibbles;
+    fusion::FindSettings find;
+  };
+  const Workload workloads[] = {
+      {"1-pattern", 1, false, {}},
+      {"16-patterns", 16, true, {}},
+      {"64-patterns", 64, true, {}},
+      {"16-patterns/stop-at-first", 16, true, {.stop_at_first = true}},
+  };
+
+  const auto engines = fusion::scan_engines();
+  for (const auto& workload : workloads) {
+    const std::string prefix = std::string("engines/16MiB/") + workload.name + "/";
+    bool selected = false;
+    for (const auto& engine : engines) {
+      selected |= (prefix + engine.name).find(options.filter) != std::string::npos;
+    }
+    if (!selected) continue;
+
+    fusion::DiffWorkload diff;
+    diff.image = db.snapshot;
+    diff.patterns = cut_patterns(diff.image, workload.patterns, workload.nibbles, 0xD1FF);
+    diff.settings = workload.find;
+
+    // Timings are only meaningful if every engine returns the same matches
+    const auto report = fusion::diff_engines(diff, engines);
+    if (!report.agree()) {
+      std::fprintf(stderr, "%s: engines disagree\n%s", workload.name,
+          fusion::describe_mismatches(diff, report).c_str());
+      continue;
+    }
+
+    // The naive reference already ran once in the diff and is far slower than the rest
+    const size_t first = results.size();
+    for (const auto& engine : engines) {
+      if (&engine == &engines.front()) continue;
+      add(results, prefix + engine.name, diff.image.total_size(), [&] {
+        size_t matches = 0;
+        for (const auto& list : engine.scan(diff.image, diff.patterns, diff.settings)) {
+          matches += list.size();
+        }
+        return matches;
+      });
+    }
+
+    const Result* fastest = nullptr;
+    for (size_t i = first; i < results.size(); ++i) {
+      const double per_call = results[i].seconds / results[i].iterations;
+      if (!fastest || per_call < fastest->seconds / fastest->iterations) {
+        fastest = &results[i];
+      }
+    }
+    if (fastest) {
+      std::fprintf(stderr, "%s: fastest engine is %s\n", workload.name,
+          fastest->name.substr(prefix.size()).c_str());
+    }
+  }
+}
+} // namespace bench
@@ -0,0 +1,83 @@
+﻿#include "bench.h"
+
+#include "fusion/crc32.h"
+#include "fusion/pattern.h"
+#include "fusion/signature.h"
+
+namespace bench {
+namespace {
+// The same 24-byte signature in every accepted spelling
+constexpr const char* ida_pattern =
+    "48 89 5C 24 ? 57 48 83 EC 20 48 8B 05 ? ? ? ? 48 85 C0 74 ? 8B 40";
+constexpr const char* code_pattern = "\\x48\\x89\\x5C\\x24\\x00\\x57\\x48\\x83\\xEC\\x20\\x48\\x8B"
+                                     "\\x05\\x00\\x00\\x00\\x00\\x48\\x85\\xC0\\x74\\x00\\x8B\\x40";
+constexpr const char* code_masked = "\\x48\\x89\\x5C\\x24\\x00\\x57\\x48\\x83\\xEC\\x20\\x48\\x8B"
+                                    "\\x05\\x00\\x00\\x00\\x00\\x48\\x85\\xC0\\x74\\x00\\x8B\\x40 "
+                                    "xxxx?xxxxxxxx????xxxx?xx";
+
+size_t compile(const char* text) {
+  fusion::CompiledPattern pattern;
+  const bool ok = fusion::compile_pattern(text, pattern);
+  sink = sink + pattern.size();
+  return ok;
+}
+
+fusion::SignatureBuilder make_builder(size_t size) {
+  fusion::SignatureBuilder builder;
+  uint32_t seed = 0x46555349;
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    builder.add_byte(static_cast<uint8_t>(seed >> 16), (seed >> 8) % 5 == 0);
+  }
+  return builder;
+}
+} // namespace
+
+void pattern_benchmarks(std::vector<Result>& results) {
+  add(results, "compile_pattern/ida", std::char_traits<char>::length(ida_pattern),
+      [] { return compile(ida_pattern); });
+  add(results, "compile_pattern/code", std::char_traits<char>::length(code_pattern),
+      [] { return compile(code_pattern); });
+  add(results, "compile_pattern/code+mask", std::char_traits<char>::length(code_masked),
+      [] { return compile(code_masked); });
+
+  for (const size_t size : {16, 64}) {
+    const auto builder = make_builder(size);
+    const std::string suffix = "/" + std::to_string(size);
+    const std::pair<const char*, fusion::SignatureStyle> styles[] = {
+        {"render/ida", fusion::SignatureStyle::IDA},
+        {"render/code", fusion::SignatureStyle::Code},
+        {"render/crc32", fusion::SignatureStyle::CRC32},
+        {"render/fnv1a", fusion::SignatureStyle::FNV1A},
+    };
+    for (const auto& [name, style] : styles) {
+      add(results, name + suffix, size, [&, style = style] {
+        sink = sink + builder.render(style).size();
+        return 1;
+      });
+    }
+
+    add(results, "hash_crc32" + suffix, size, [&] {
+      sink = sink + builder.hash_crc32();
+      return 1;
+    });
+    add(results, "hash_fnv1a" + suffix, size, [&] {
+      sink = sink + builder.hash_fnv1a();
+      return 1;
+    });
+    add(results, "SignatureBuilder::compile" + suffix, size, [&] {
+      sink = sink + builder.compile().size();
+      return 1;
+    });
+  }
+
+  std::vector<uint8_t> block(64 << 10);
+  for (size_t i = 0; i < block.size(); ++i) {
+    block[i] = static_cast<uint8_t>(i * 131);
+  }
+  add(results, "crc32/64KiB", block.size(), [&] {
+    sink = sink + fusion::crc32(block.data(), block.size());
+    return 1;
+  });
+}
+} // namespace bench
@@ -0,0 +1,111 @@
+﻿#include "bench.h"
+
+#include "fusion/library.h"
+#include "fusion/scanner.h"
+
+namespace bench {
+namespace {
+/// Signature planted into the images at a fixed stride
+constexpr const char* planted_pattern = "48 89 5C 24 ? 57 48 83 EC 20 48 8B 05 ? ? ? ? 48 85 C0";
+
+/// Code image of `size` bytes with `pattern` written every `stride` bytes (never if 0)
+fusion::ImageSnapshot make_image(const std::vector<std::vector<uint8_t>>& instructions,
+    size_t size, const fusion::CompiledPattern& pattern, size_t stride) {
+  fusion::SnapshotRegion region;
+  region.start = 0x140001000;
+  region.bytes = make_code(instructions, size, 0x5EED);
+  for (size_t offset = stride / 2; stride && offset + pattern.size() <= size; offset += stride) {
+    std::copy(pattern.bytes.begin(), pattern.bytes.end(), region.bytes.begin() + offset);
+  }
+
+  fusion::ImageSnapshot image;
+  image.regions.push_back(std::move(region));
+  return image;
+}
+
+/// `count` 16-byte signatures cut from `image` at seeded offsets, with their middle dword
+/// wildcarded like a relocated operand
+std::vector<fusion::SignatureRecord> cut_signatures(
+    const fusion::ImageSnapshot& image, size_t count) {
+  const auto& bytes = image.regions.front().bytes;
+  std::vector<fusion::SignatureRecord> records(count);
+  uint32_t seed = 0xC0DE;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const size_t offset = (static_cast<size_t>(seed) * 2654435761u) % (bytes.size() - 16);
+    records[i].name = "sig_" + std::to_string(i);
+    for (size_t j = 0; j < 16; ++j) {
+      records[i].pattern.add_byte(bytes[offset + j], j >= 6 && j < 10 ? 0x00 : 0xFF);
+    }
+  }
+  return records;
+}
+} // namespace
+
+void scan_benchmarks(std::vector<Result>& results) {
+  const auto instructions = load_instructions(FUSION_BENCH_FIXTURES "/x86_64.txt");
+  if (instructions.empty()) return;
+
+  fusion::CompiledPattern pattern;
+  fusion::compile_pattern(planted_pattern, pattern);
+
+  // Match density: no match, one per 64 KiB, one per 256 bytes
+  const std::pair<const char*, size_t> densities[] = {
+      {"none", 0}, {"sparse", 64 << 10}, {"dense", 256}};
+  const std::pair<const char*, size_t> sizes[] = {
+      {"1MiB", 1 << 20}, {"16MiB", 16 << 20}, {"64MiB", 64 << 20}};
+
+  for (const auto& [size_name, size] : sizes) {
+    for (const auto& [density_name, stride] : densities) {
+      const auto image = make_image(instructions, size, pattern, stride);
+      const std::string name = std::string("scan_pattern/") + size_name + "/" + density_name;
+
+      add(results, name + "/1-thread", size,
+          [&] { return fusion::scan_pattern(image, pattern.view(), 1).size(); });
+      add(results, name + "/all-threads", size,
+          [&] { return fusion::scan_pattern(image, pattern.view()).size(); });
+    }
+  }
+
+  // Many signatures at once: one library pass against one scan per signature
+  const auto image = make_image(instructions, 16 << 20, pattern, 64 << 10);
+
+  // Approximate search tolerating up to k changed bytes
+  for (const uint32_t k : {1u, 2u, 4u}) {
+    const std::string name = "fuzzy_scan/16MiB/k" + std::to_string(k);
+    add(results, name + "/1-thread", image.total_size(),
+        [&] { return fusion::fuzzy_scan(image, pattern.view(), k, 1).size(); });
+    add(results, name + "/all-threads", image.total_size(),
+        [&] { return fusion::fuzzy_scan(image, pattern.view(), k).size(); });
+  }
+
+  // The planted signature with its middle instruction as a variable gap
+  fusion::CompositePattern composite;
+  fusion::compile_composite_pattern(
+      "48 89 5C 24 ? 57 [0-64] 48 8B 05 ? ? ? ? 48 85 C0", composite);
+  add(results, "scan_composite/16MiB/1-thread", image.total_size(),
+      [&] { return fusion::scan_composite(image, composite, 1).size(); });
+  add(results, "scan_composite/16MiB/all-threads", image.total_size(),
+      [&] { return fusion::scan_composite(image, composite).size(); });
+
+  for (const size_t count : {16, 256}) {
+    const auto records = cut_signatures(image, count);
+    std::vector<uint8_t> data;
+    fusion::SignatureLibrary library;
+    if (!fusion::build_library(records, data) || !library.attach(data.data(), data.size())) {
+      continue;
+    }
+
+    const std::string name = "multi/16MiB/" + std::to_string(count);
+    add(results, name + "/scan_library", image.total_size(),
+        [&] { return fusion::scan_library(image, library, 1).size(); });
+    add(results, name + "/scan_pattern-each", image.total_size(), [&] {
+      size_t matches = 0;
+      for (const auto& record : records) {
+        matches += fusion::scan_pattern(image, record.pattern.view(), 1).size();
+      }
+      return matches;
+    });
+  }
+}
+} // namespace bench
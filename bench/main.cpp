@@ -0,0 +1,133 @@
+﻿// fusion_bench: throughput of the IDA-independent core
+
+#include "bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+
+void print_usage() {
+  std::fprintf(stderr,
+      "usage: fusion_bench [options]\n"
+      "\n"
+      "options:\n"
+      "  --json <file>        write results as JSON to <file>, or to stdout for -\n"
+      "  --filter <text>      only run benchmarks whose name contains <text>\n"
+      "  --min-time <sec>     minimum run time of each benchmark (default: 0.5)\n"
+      "  --database <file>    create and find signatures in a mock database fixture\n"
+      "                       instead of generated code\n");
+}
+} // namespace
+
+// Count every allocation; the array and nothrow forms forward to these by default
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace bench {
+uint64_t allocation_count() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void report(std::FILE* out, const Result& result) {
+  const double ns = result.seconds * 1e9;
+  std::fprintf(out, "%-44s %14.1f ns/op", result.name.c_str(), ns / result.iterations);
+  if (result.items) {
+    std::fprintf(out, " %12.2f ns/item", ns / result.items);
+  } else {
+    std::fprintf(out, " %20s", "");
+  }
+  if (result.bytes) {
+    std::fprintf(out, " %10.4f ns/byte", ns / result.bytes);
+  } else {
+    std::fprintf(out, " %18s", "");
+  }
+  std::fprintf(
+      out, " %8.1f allocs/op\n", static_cast<double>(result.allocations) / result.iterations);
+}
+
+void write_json(std::FILE* out, const std::vector<Result>& results) {
+  std::fprintf(out, "[\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    const double ns = result.seconds * 1e9;
+    std::fprintf(out,
+        "  {\"name\": \"%s\", \"iterations\": %llu, \"seconds\": %.6f, \"ns_per_op\": %.3f, "
+        "\"items_per_op\": %.3f, \"bytes_per_op\": %.3f, \"ns_per_item\": %.6f, ",
+        result.name.c_str(), static_cast<unsigned long long>(result.iterations), result.seconds,
+        ns / result.iterations, static_cast<double>(result.items) / result.iterations,
+        static_cast<double>(result.bytes) / result.iterations,
+        result.items ? ns / result.items : 0.0);
+    if (result.bytes) {
+      std::fprintf(out, "\"ns_per_byte\": %.6f, ", ns / result.bytes);
+    } else {
+      std::fprintf(out, "\"ns_per_byte\": null, ");
+    }
+    std::fprintf(out, "\"allocations_per_op\": %.3f}%s\n",
+        static_cast<double>(result.allocations) / result.iterations,
+        i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "]\n");
+}
+} // namespace bench
+
+int main(int argc, char** argv) {
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (arg == "--filter" && i + 1 < argc) {
+      bench::options.filter = argv[++i];
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      bench::options.min_seconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--database" && i + 1 < argc) {
+      bench::options.database = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage();
+      return 0;
+    } else {
+      std::fprintf(stderr, "fusion_bench: unknown option %s\n", arg.c_str());
+      print_usage();
+      return 1;
+    }
+  }
+
+  // Text goes to stderr when the JSON takes stdout
+  const bool json_to_stdout = json_path == "-";
+  std::vector<bench::Result> results;
+  for (auto suite : {bench::decoder_benchmarks, bench::pattern_benchmarks,
+           bench::scan_benchmarks, bench::create_benchmarks, bench::engine_benchmarks}) {
+    const size_t first = results.size();
+    suite(results);
+    for (size_t i = first; i < results.size(); ++i) {
+      bench::report(json_to_stdout ? stderr : stdout, results[i]);
+    }
+  }
+
+  if (json_to_stdout) {
+    bench::write_json(stdout, results);
+  } else if (!json_path.empty()) {
+    std::FILE* out = std::fopen(json_path.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "fusion_bench: cannot write %s\n", json_path.c_str());
+      return 1;
+    }
+    bench::write_json(out, results);
+    std::fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+﻿// libFuzzer entry: every scan engine must report the same matches as the naive reference
+// for any image, pattern set and search filter the input decodes to.
+//
+//   cmake -S . -B build/fuzz -DCMAKE_CXX_COMPILER=clang++ -DFUSION_BUILD_FUZZERS=ON
+//   build/fuzz/fusion_fuzz_scan -max_len=4096
+
+#include "fusion/differential.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static const auto engines = fusion::scan_engines();
+
+  const auto workload = fusion::make_diff_workload(data, size);
+  const auto report = fusion::diff_engines(workload, engines);
+  if (!report.agree()) {
+    std::fputs(fusion::describe_mismatches(workload, report).c_str(), stderr);
+    std::abort();
+  }
+  return 0;
+}
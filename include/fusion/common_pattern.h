@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "pattern.h"
+#include "snapshot.h"
+#include "source.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace fusion {
+/// The longest run of instructions that several functions share
+struct CommonPattern {
+  CompiledPattern pattern;         // Leading and trailing wildcards already trimmed
+  std::vector<uint64_t> addresses; // Where `pattern` starts in each function, in input order
+  size_t instructions = 0;         // Instructions in the shared run
+};
+
+/// Find the longest run of instructions, in bytes, that occurs in every one of `functions`.
+/// Each function is decoded by linear sweep, and instructions are compared by their token and
+/// length (see InsnInfo::token), so copies that differ only in registers or operands still
+/// line up. Bits that differ between the copies become wildcards, a nibble at a time. A
+/// generalized suffix array over all instruction streams keeps this fast for hundreds of
+/// functions. Returns nullopt for fewer than two functions or if they share nothing.
+[[nodiscard]] std::optional<CommonPattern> find_common_pattern(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    const std::vector<AddressRange>& functions);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+#include <pro.h>
+
+namespace fusion {
+/// Print the longest pattern the functions starting at `functions` share, and where it matches
+void find_common_pattern(const std::vector<ea_t>& functions);
+} // namespace fusion
+#endif
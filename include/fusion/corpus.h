@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "database.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fusion {
+/// Relative weights of the instruction kinds in generated function bodies
+struct OpcodeMix {
+  uint32_t mov_reg = 12;    // mov r64, r64
+  uint32_t mov_imm = 6;     // mov r32, imm32
+  uint32_t load_store = 20; // mov r64, [base + disp8] and back, including rsp-relative
+  uint32_t rip_load = 10;   // mov / lea r64, [rip + disp32]
+  uint32_t call = 8;        // call rel32 to an earlier function, or call [rip + disp32]
+  uint32_t branch = 10;     // jcc / jmp, rel8 or rel32
+  uint32_t alu = 20;        // add / sub / and / or / xor / cmp / test, register or imm8
+  uint32_t sse = 4;         // movups / movaps / xorps
+};
+
+/// Alignment filler between functions
+enum class CorpusPadding { Int3, Nop };
+
+/// Shape of a synthetic x86-64 code image
+struct CorpusSettings {
+  uint64_t seed = 1;
+  size_t size = 1 << 20;       // Bytes of code, filled exactly
+  uint64_t base = 0x140001000; // Address of the first function
+  OpcodeMix mix;
+  uint32_t min_instructions = 8; // Body length of each function
+  uint32_t max_instructions = 160;
+  /// Share of functions that copy an earlier one, as identical template instantiations do
+  double duplicate_rate = 0.04;
+  /// Share of functions with the body of an earlier function inlined somewhere
+  double inline_rate = 0.10;
+  CorpusPadding padding = CorpusPadding::Int3;
+  uint32_t alignment = 16; // Function start alignment
+};
+
+/// What a generated image contains
+struct CorpusStats {
+  size_t functions = 0;
+  size_t duplicates = 0;
+  size_t inlined = 0;
+  size_t instructions = 0;
+};
+
+/// Generate seeded x86-64 code: functions with prologues, calls, RIP-relative loads, branches
+/// and epilogues, some duplicated or partly inlined, padded to `alignment`.
+/// Fills `db` with one code region, a data region the RIP-relative operands point into and
+/// the function list. The same settings always produce the same bytes.
+CorpusStats generate_corpus(const CorpusSettings& settings, MockDatabase& db);
+} // namespace fusion
@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fusion {
+/// Compute the CRC-32 (IEEE 802.3, reflected) of a byte range
+[[nodiscard]] uint32_t crc32(const uint8_t* data, size_t size);
+
+/// Find the start address of every window of `length` bytes whose CRC-32 equals `hash`.
+/// Windows never straddle two regions. Results are sorted by address.
+[[nodiscard]] std::vector<uint64_t> find_crc32(
+    const ImageSnapshot& snapshot, uint32_t hash, size_t length, unsigned max_threads = 0);
+} // namespace fusion
@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include "snapshot.h"
+#include "source.h"
+#include "x86_decoder.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// A function known to the database
+struct FunctionInfo {
+  uint64_t start = 0;
+  uint64_t end = 0;
+  std::string name;
+
+  bool operator==(const FunctionInfo&) const = default;
+};
+
+/// Everything signature creation and search read from a disassembler database
+class Database {
+public:
+  virtual ~Database() = default;
+
+  /// Loaded bytes, one region per segment
+  [[nodiscard]] virtual const ImageSnapshot& image() const = 0;
+  [[nodiscard]] virtual const InsnDecoder& decoder() const = 0;
+
+  /// Function containing `address`
+  [[nodiscard]] virtual std::optional<FunctionInfo> function_at(uint64_t address) const = 0;
+  /// Start of every function, ascending
+  [[nodiscard]] virtual std::vector<uint64_t> function_starts() const = 0;
+
+  /// Range the user selected, if any
+  [[nodiscard]] virtual std::optional<AddressRange> selection() const = 0;
+  [[nodiscard]] virtual uint64_t cursor() const = 0;
+};
+
+/// In-memory database for tests, benchmarks and tools that run without IDA
+class MockDatabase : public Database {
+public:
+  ImageSnapshot snapshot;
+  std::vector<FunctionInfo> functions; // Sorted by start, non-overlapping
+  std::optional<AddressRange> selected;
+  uint64_t cursor_ea = 0;
+  bool x64 = true;
+
+  [[nodiscard]] const ImageSnapshot& image() const override {
+    return snapshot;
+  }
+  [[nodiscard]] const InsnDecoder& decoder() const override {
+    return x64 ? decoder64_ : decoder32_;
+  }
+  [[nodiscard]] std::optional<FunctionInfo> function_at(uint64_t address) const override;
+  [[nodiscard]] std::vector<uint64_t> function_starts() const override;
+  [[nodiscard]] std::optional<AddressRange> selection() const override {
+    return selected;
+  }
+  [[nodiscard]] uint64_t cursor() const override {
+    return cursor_ea;
+  }
+
+private:
+  X86Decoder decoder64_{true};
+  X86Decoder decoder32_{false};
+};
+
+/// Version written into mock database fixtures; bump when the layout changes
+inline constexpr uint32_t mock_database_version = 1;
+
+/// Write `db` as a fixture file ("FMDB": cursor, selection, regions, functions)
+bool save_mock_database(const std::string& path, const MockDatabase& db);
+
+/// Read a fixture written by save_mock_database
+bool load_mock_database(const std::string& path, MockDatabase& db);
+
+/// Bytes of another build to check signatures against: a mock database fixture, an ELF, PE or
+/// Mach-O file laid out at its load addresses, or any other file as one region at address 0.
+/// False only if the file cannot be read or is empty.
+bool load_reference_image(const std::string& path, ImageSnapshot& out);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// The open IDA database, with its bytes copied when constructed
+class IdaDatabase : public Database {
+public:
+  IdaDatabase();
+
+  [[nodiscard]] const ImageSnapshot& image() const override {
+    return snapshot_;
+  }
+  [[nodiscard]] const InsnDecoder& decoder() const override {
+    return signature_decoder();
+  }
+  [[nodiscard]] std::optional<FunctionInfo> function_at(uint64_t address) const override;
+  [[nodiscard]] std::vector<uint64_t> function_starts() const override;
+  [[nodiscard]] std::optional<AddressRange> selection() const override;
+  [[nodiscard]] uint64_t cursor() const override;
+
+private:
+  ImageSnapshot snapshot_;
+};
+
+/// Save the open database as a mock database fixture
+void export_mock_database(const char* path);
+
+/// Start counting byte patches and segment changes in the database; called when the plugin
+/// loads, and undone by unwatch_database_changes before it unloads
+void watch_database_changes();
+void unwatch_database_changes();
+
+/// Changes counted so far, so caches of database contents know when to rebuild
+[[nodiscard]] uint64_t database_changes();
+} // namespace fusion
+#endif
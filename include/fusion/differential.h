@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include "serialize.h"
+#include "snapshot.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// Matches of each pattern of a workload, one address list per pattern in address order
+using PatternMatches = std::vector<std::vector<uint64_t>>;
+
+/// One way of searching an image. Every engine applies the FindSettings filters itself.
+struct ScanEngine {
+  std::string name;
+  std::function<PatternMatches(
+      const ImageSnapshot&, const std::vector<SignatureRecord>&, const FindSettings&)>
+      scan;
+};
+
+/// Engines in the core, starting with the naive reference: scan_pattern on one and on all
+/// threads, scan_library, the runtime PatternSet and find_signature on a mock database.
+/// Every pattern must have an exact byte, as the library and runtime formats require.
+[[nodiscard]] std::vector<ScanEngine> scan_engines();
+
+/// Test every position of every region; the reference the other engines are diffed against
+[[nodiscard]] std::vector<uint64_t> naive_scan(
+    const ImageSnapshot& image, const PatternView& pattern, const FindSettings& settings = {});
+
+/// Image, patterns and search filters to run every engine on
+struct DiffWorkload {
+  ImageSnapshot image;
+  std::vector<SignatureRecord> patterns;
+  FindSettings settings;
+};
+
+/// Derive a workload from arbitrary bytes, e.g. fuzzer input: adjacent regions, patterns cut
+/// from the image (some straddling region ends) with exact, nibble and wildcard masks, and
+/// start and ignore filters. A four-byte header picks the shape, a fixed number of trailing
+/// bytes per pattern make each later decision and the bytes between are the image, so one
+/// mutated byte changes one decision. The same bytes always give the same workload.
+[[nodiscard]] DiffWorkload make_diff_workload(const uint8_t* data, size_t size);
+
+/// An engine whose matches differ from the reference for one pattern
+struct DiffMismatch {
+  std::string engine;
+  size_t pattern = 0;
+  std::vector<uint64_t> expected;
+  std::vector<uint64_t> actual;
+};
+
+/// Outcome of running every engine on one workload
+struct DiffReport {
+  std::vector<std::pair<std::string, double>> seconds; // Run time per engine, in engine order
+  std::vector<DiffMismatch> mismatches;
+
+  [[nodiscard]] bool agree() const {
+    return mismatches.empty();
+  }
+
+  /// Name of the engine that finished first, the reference excluded
+  [[nodiscard]] std::string fastest() const;
+};
+
+/// Run every engine on `workload` and diff each against the first
+[[nodiscard]] DiffReport diff_engines(
+    const DiffWorkload& workload, const std::vector<ScanEngine>& engines = scan_engines());
+
+/// One line per mismatch: engine, pattern and the first differing address
+[[nodiscard]] std::string describe_mismatches(
+    const DiffWorkload& workload, const DiffReport& report);
+} // namespace fusion
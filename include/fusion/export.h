@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include "serialize.h"
+
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// Render signatures as a C++ header defining a fusion::runtime::PatternSet named `set` inside
+/// `namespace_name`, plus an index constant per signature.
+/// Returns false if `records` is empty or a signature has no exact byte to anchor on.
+bool render_cpp_header(const std::vector<SignatureRecord>& records,
+    const std::string& namespace_name,
+    std::string& out);
+
+/// Render a pattern in IDA style, e.g. `48 8B ? 4?`
+[[nodiscard]] std::string render_ida_pattern(const CompiledPattern& pattern);
+
+/// Render a composite pattern in IDA style with its gaps, e.g. `55 8B EC [12-20] E8 ? ? ? ?`
+[[nodiscard]] std::string render_composite_pattern(const CompositePattern& pattern);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Write a C++ header for signatures of the selected functions, or of every signature
+/// created this session
+void export_cpp_header(const char* path, bool from_session);
+} // namespace fusion
+#endif
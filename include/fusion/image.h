@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include "source.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// Executable formats understood by parse_image
+enum class ImageFormat { ELF, PE, MachO };
+
+/// File-backed section and the virtual address it loads at
+struct ImageSection {
+  std::string name;
+  uint64_t address = 0;
+  uint64_t file_offset = 0;
+  uint64_t size = 0;
+
+  [[nodiscard]] uint64_t end() const {
+    return address + size;
+  }
+};
+
+/// Where the sections of an executable file end up in memory
+struct ImageLayout {
+  ImageFormat format = ImageFormat::ELF;
+  /// Address RVAs are relative to: the PE image base, the Mach-O __TEXT segment,
+  /// or the lowest ELF load address
+  uint64_t image_base = 0;
+  /// Sections with file data, in address order
+  std::vector<ImageSection> sections;
+
+  /// Section holding `address`, or nullptr
+  [[nodiscard]] const ImageSection* find_section(uint64_t address) const;
+
+  /// File offset of the byte loaded at `address`
+  [[nodiscard]] std::optional<uint64_t> file_offset(uint64_t address) const;
+};
+
+/// Lay out a little-endian ELF, PE or Mach-O (thin or fat) file.
+/// Zero-fill sections such as .bss are left out. Returns false if the format is not recognized
+/// or the headers are truncated.
+bool parse_image(const uint8_t* data, size_t size, ImageLayout& out);
+
+/// Function entry points the file records, ascending: the .pdata unwind table of a PE file or
+/// the defined function symbols of an ELF file. Only starts inside `layout`'s sections are kept.
+/// Empty for Mach-O files and files with neither.
+[[nodiscard]] std::vector<uint64_t> read_function_starts(
+    const uint8_t* data, size_t size, const ImageLayout& layout);
+
+/// Bytes of an executable file as they are laid out in memory.
+/// `data` and `layout` must outlive the source.
+class FileImageSource : public ByteSource {
+public:
+  FileImageSource(const uint8_t* data, size_t size, const ImageLayout& layout)
+      : data_(data), size_(size), layout_(layout) {}
+
+  [[nodiscard]] std::vector<AddressRange> segments() const override;
+  size_t read(uint64_t address, uint8_t* out, size_t size) const override;
+
+private:
+  const uint8_t* data_;
+  size_t size_;
+  const ImageLayout& layout_;
+};
+} // namespace fusion
@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include "mapped_file.h"
+#include "pattern.h"
+#include "serialize.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fusion {
+/// Fixed-size header at the start of a signature library file.
+/// The file is little-endian and laid out so it can be used straight from a memory mapping:
+/// header, anchor table, entries, pattern bytes/masks, names.
+struct LibraryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t anchored_count; // Entries [0, anchored_count) are reachable through the anchor table
+  uint32_t reserved;
+  uint64_t anchor_table_offset; // uint32_t[65537] bucket starts, indexed by anchor byte pair
+  uint64_t entries_offset;      // LibraryEntry[entry_count], anchored entries sorted by anchor
+  uint64_t pattern_offset;      // Pattern bytes followed by mask for each entry
+  uint64_t string_offset;       // Entry names, not null-terminated
+  uint64_t file_size;
+};
+
+/// One named signature in a library file
+struct LibraryEntry {
+  uint32_t pattern_offset; // Relative to LibraryHeader::pattern_offset
+  uint32_t name_offset;    // Relative to LibraryHeader::string_offset
+  uint16_t pattern_size;
+  uint16_t anchor_offset; // Position of the two-byte anchor inside the pattern
+  uint32_t name_size;
+  int64_t target_offset;
+};
+
+static_assert(sizeof(LibraryHeader) == 64);
+static_assert(sizeof(LibraryEntry) == 24);
+
+/// Version written into library headers; bump when the layout changes
+inline constexpr uint32_t library_format_version = 1;
+
+/// Read-only signature library, used in place from a file mapping or memory buffer
+class SignatureLibrary {
+public:
+  /// Map `path` and validate it; returns false if missing or malformed
+  bool open(const std::string& path);
+
+  /// Validate and use an in-memory library image, which must outlive this object
+  bool attach(const uint8_t* data, size_t size);
+
+  [[nodiscard]] size_t size() const {
+    return header_ ? header_->entry_count : 0;
+  }
+  [[nodiscard]] size_t anchored_count() const {
+    return header_ ? header_->anchored_count : 0;
+  }
+
+  [[nodiscard]] std::string_view name(size_t index) const;
+  [[nodiscard]] PatternView pattern(size_t index) const;
+  [[nodiscard]] const LibraryEntry& entry(size_t index) const {
+    return entries_[index];
+  }
+
+  /// Range of anchored entries whose anchor is the byte pair `value` (first byte in the low bits)
+  [[nodiscard]] std::pair<uint32_t, uint32_t> bucket(uint16_t value) const {
+    return {anchors_[value], anchors_[value + 1]};
+  }
+
+private:
+  MappedFile file_;
+  const uint8_t* data_ = nullptr;
+  const LibraryHeader* header_ = nullptr;
+  const uint32_t* anchors_ = nullptr;
+  const LibraryEntry* entries_ = nullptr;
+};
+
+/// Lay out `records` as a library image.
+/// Returns false if a record is empty, all wildcards or longer than 65535 bytes.
+bool build_library(const std::vector<SignatureRecord>& records, std::vector<uint8_t>& out);
+
+/// Build a library from `records` and write it to `path`
+bool write_library(const std::string& path, const std::vector<SignatureRecord>& records);
+
+/// Parse a text signature list: one `name pattern [+offset]` per line, `#` starts a comment.
+/// On failure `error_line` receives the 1-based number of the first bad line.
+bool read_signature_list(
+    const std::string& path, std::vector<SignatureRecord>& out, size_t* error_line = nullptr);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Scan the database for every signature in a library file and report the matches
+void apply_signature_library(const char* path);
+
+/// Convert a text signature list into a library file
+void build_signature_library(const char* list_path, const char* library_path);
+} // namespace fusion
+#endif
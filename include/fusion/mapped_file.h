@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fusion {
+/// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  /// Map `path`; returns false if it cannot be opened or is empty
+  bool open(const std::string& path);
+  void close();
+
+  [[nodiscard]] bool is_open() const {
+    return data_ != nullptr;
+  }
+  [[nodiscard]] const uint8_t* data() const {
+    return data_;
+  }
+  [[nodiscard]] size_t size() const {
+    return size_;
+  }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+} // namespace fusion
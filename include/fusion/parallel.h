@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace fusion {
+/// Number of worker threads to use for `tasks` work items (0 = one per core)
+inline unsigned worker_count(size_t tasks, unsigned max_threads = 0) {
+  unsigned threads = max_threads ? max_threads : std::thread::hardware_concurrency();
+  return static_cast<unsigned>(std::clamp<size_t>(tasks, 1, std::max(threads, 1u)));
+}
+
+/// Run `task(i)` for every i in [0, count), pulling indices from a shared counter.
+/// The calling thread participates, so a single-threaded run spawns nothing.
+template <typename Task>
+void parallel_for(size_t count, unsigned max_threads, Task&& task) {
+  if (count == 0) return;
+
+  std::atomic<size_t> next{0};
+  auto worker = [&] {
+    for (size_t i = next++; i < count; i = next++) {
+      task(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < worker_count(count, max_threads); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+} // namespace fusion
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// Non-owning view of pattern bytes and mask, e.g. straight from a mapped signature library
+struct PatternView {
+  const uint8_t* bytes = nullptr;
+  const uint8_t* mask = nullptr;
+  size_t size = 0;
+
+  /// Check the pattern against `size` bytes at `data`
+  [[nodiscard]] bool matches(const uint8_t* data) const {
+    for (size_t i = 0; i < size; ++i) {
+      if ((data[i] & mask[i]) != bytes[i]) return false;
+    }
+    return true;
+  }
+
+  /// Bytes that are not full wildcards
+  [[nodiscard]] size_t fixed_bytes() const {
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+      count += mask[i] != 0;
+    }
+    return count;
+  }
+};
+
+/// Signature parsed into raw bytes and a per-byte match mask.
+/// A mask of 0xFF must match exactly, 0x00 is a wildcard, 0xF0/0x0F match a single nibble.
+/// Masked-out bits of `bytes` are always zero.
+struct CompiledPattern {
+  std::vector<uint8_t> bytes;
+  std::vector<uint8_t> mask;
+
+  [[nodiscard]] bool empty() const {
+    return bytes.empty();
+  }
+  [[nodiscard]] size_t size() const {
+    return bytes.size();
+  }
+
+  void add_byte(uint8_t byte, uint8_t byte_mask = 0xFF) {
+    bytes.push_back(byte & byte_mask);
+    mask.push_back(byte_mask);
+  }
+
+  [[nodiscard]] PatternView view() const {
+    return {bytes.data(), mask.data(), bytes.size()};
+  }
+
+  /// Check the pattern against `size()` bytes at `data`
+  [[nodiscard]] bool matches(const uint8_t* data) const {
+    return view().matches(data);
+  }
+
+  bool operator==(const CompiledPattern&) const = default;
+};
+
+/// Parse an IDA-style (`48 8B ? 4?`) or CODE-style (`\x48\x8B\x00 xx?`) signature.
+/// CODE-style signatures without a mask treat `\x00` (or `\x2A` with UseAltWildcard) as wildcards.
+/// Returns false if the text is not a valid signature.
+bool compile_pattern(const std::string& text, CompiledPattern& out);
+
+/// Run of `min` to `max` arbitrary bytes between two fragments of a composite signature
+struct PatternGap {
+  uint32_t min = 0;
+  uint32_t max = 0;
+
+  bool operator==(const PatternGap&) const = default;
+};
+
+/// Largest gap a composite signature may have between two fragments
+inline constexpr uint32_t max_pattern_gap = 1 << 16;
+
+/// Contiguous fragments separated by variable gaps, written `55 48 8B EC [16-64] E8 ? ? ? ?`.
+/// A match is where the first fragment starts.
+struct CompositePattern {
+  std::vector<CompiledPattern> fragments;
+  std::vector<PatternGap> gaps; // gaps[i] lies between fragments[i] and fragments[i + 1]
+
+  /// Bytes in all fragments, not counting the gaps
+  [[nodiscard]] size_t fragment_bytes() const {
+    size_t total = 0;
+    for (const auto& fragment : fragments) {
+      total += fragment.size();
+    }
+    return total;
+  }
+
+  bool operator==(const CompositePattern&) const = default;
+};
+
+/// Whether `text` contains a gap and needs compile_composite_pattern
+[[nodiscard]] bool has_pattern_gaps(const std::string& text);
+
+/// Parse an IDA-style signature whose fragments may be separated by `[min-max]` or `[n]` gaps.
+/// Text without gaps gives a single fragment. Returns false if the text is not a valid
+/// signature, a fragment is empty, or a gap is reversed or longer than max_pattern_gap.
+bool compile_composite_pattern(const std::string& text, CompositePattern& out);
+} // namespace fusion
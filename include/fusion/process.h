@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "source.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// One line of /proc/<pid>/maps
+struct ProcessMapping {
+  uint64_t start = 0;
+  uint64_t end = 0;
+  std::string permissions; // "r-xp" etc.
+  uint64_t file_offset = 0;
+  std::string path; // File path, "[heap]", "[stack]", or empty for anonymous memory
+
+  [[nodiscard]] bool readable() const {
+    return !permissions.empty() && permissions[0] == 'r';
+  }
+};
+
+/// Parse the text of /proc/<pid>/maps; false if a line is malformed
+bool parse_process_maps(const std::string& text, std::vector<ProcessMapping>& out);
+
+/// Read and parse /proc/<pid>/maps; false if the process does not exist or cannot be inspected
+bool read_process_maps(int pid, std::vector<ProcessMapping>& out);
+
+/// Address expressed relative to the lowest mapping of the file it belongs to
+struct ModuleAddress {
+  std::string module; // File name without directories
+  uint64_t offset = 0;
+};
+
+/// Module and offset for `address`; nullopt for anonymous memory and pseudo files like [heap]
+[[nodiscard]] std::optional<ModuleAddress> module_address(
+    const std::vector<ProcessMapping>& mappings, uint64_t address);
+
+/// Memory of a running Linux process, read with process_vm_readv.
+/// Needs the same permissions as ptrace: the same user and a permissive ptrace_scope, or root.
+class ProcessByteSource : public ByteSource {
+public:
+  /// `mappings` are the readable regions to expose, usually from read_process_maps
+  ProcessByteSource(int pid, std::vector<ProcessMapping> mappings);
+
+  [[nodiscard]] std::vector<AddressRange> segments() const override;
+  /// Stops at the first page that cannot be read, so may return less than `size`
+  size_t read(uint64_t address, uint8_t* out, size_t size) const override;
+
+private:
+  int pid_;
+  std::vector<ProcessMapping> mappings_;
+};
+} // namespace fusion
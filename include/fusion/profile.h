@@ -0,0 +1,92 @@
+﻿#pragma once
+
+// Per-phase timers and counters for finding out where an operation spends its time.
+// Built in when FUSION_PROFILE is defined (CMake option FUSION_PROFILING); otherwise the
+// FUSION_PHASE and FUSION_COUNT macros compile to nothing.
+// Totals are process-wide: reset at the start of an operation, read at its end.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fusion {
+/// Where time goes in signature creation and search
+enum class Phase : uint8_t { Fetch, Decode, Parse, Scan, Render, Ui };
+inline constexpr size_t phase_count = 6;
+
+/// Work done, independent of time
+enum class Counter : uint8_t { BytesScanned, Candidates, Scans, Instructions, Matches };
+inline constexpr size_t counter_count = 5;
+
+/// Totals since the last profile_reset
+struct ProfileSnapshot {
+  std::array<uint64_t, phase_count> nanoseconds{};
+  std::array<uint64_t, phase_count> calls{};
+  std::array<uint64_t, counter_count> counters{};
+  uint64_t elapsed_ns = 0; // Wall time since the reset
+
+  [[nodiscard]] uint64_t time(Phase phase) const {
+    return nanoseconds[static_cast<size_t>(phase)];
+  }
+  [[nodiscard]] uint64_t count(Counter counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+};
+
+[[nodiscard]] const char* phase_name(Phase phase);
+[[nodiscard]] const char* counter_name(Counter counter);
+
+/// Clear every timer and counter and restart the wall clock
+void profile_reset();
+[[nodiscard]] ProfileSnapshot profile_snapshot();
+
+/// Thread-safe; called by the macros below
+void profile_add_time(Phase phase, uint64_t nanoseconds);
+void profile_add(Counter counter, uint64_t value);
+
+/// One line: total time, time per phase that ran, then the non-zero counters
+[[nodiscard]] std::string format_profile(const ProfileSnapshot& snapshot);
+
+/// One JSON object for `operation`, with every phase and counter
+[[nodiscard]] std::string profile_json(
+    const std::string& operation, const ProfileSnapshot& snapshot);
+
+/// Append profile_json plus a newline to `path`, for collecting batch runs as JSON lines
+bool append_profile_json(
+    const std::string& path, const std::string& operation, const ProfileSnapshot& snapshot);
+
+/// Adds the time between construction and destruction to a phase
+class ScopedPhase {
+public:
+  explicit ScopedPhase(Phase phase) : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedPhase() {
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    profile_add_time(
+        phase_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+  Phase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+} // namespace fusion
+
+#define FUSION_PROFILE_CONCAT2(a, b) a##b
+#define FUSION_PROFILE_CONCAT(a, b) FUSION_PROFILE_CONCAT2(a, b)
+
+#ifdef FUSION_PROFILE
+/// Time the rest of the enclosing scope as `phase`, e.g. FUSION_PHASE(Scan)
+#define FUSION_PHASE(phase)                                                                        \
+  const ::fusion::ScopedPhase FUSION_PROFILE_CONCAT(fusion_phase_, __LINE__)(                      \
+      ::fusion::Phase::phase)
+/// Add `value` to `counter`, e.g. FUSION_COUNT(Scans, 1)
+#define FUSION_COUNT(counter, value) ::fusion::profile_add(::fusion::Counter::counter, (value))
+#else
+#define FUSION_PHASE(phase) static_cast<void>(0)
+#define FUSION_COUNT(counter, value) static_cast<void>(0)
+#endif
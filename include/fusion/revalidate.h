@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include "database.h"
+#include "library.h"
+#include "serialize.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fusion {
+/// What a library signature matches in a new build
+enum class EntryStatus { Unique, Multiple, Missing };
+
+/// Finds the address a library entry identifies without using its signature, e.g. by name in
+/// the new build's database; nullopt if it cannot be found
+using EntryLocator = std::function<std::optional<uint64_t>(std::string_view name)>;
+
+/// One library entry checked against a new build
+struct RevalidatedEntry {
+  SignatureRecord original;
+  EntryStatus status = EntryStatus::Missing;
+  size_t matches = 0;
+  /// The address the entry identifies: its match plus offset when Unique, or where the locator
+  /// found it otherwise
+  std::optional<uint64_t> target;
+  /// Replacement signature, grown at `target`, when the entry is no longer unique
+  std::optional<SignatureRecord> regenerated;
+};
+
+struct RevalidationReport {
+  std::vector<RevalidatedEntry> entries; // In library order
+
+  [[nodiscard]] size_t count(EntryStatus status) const;
+  [[nodiscard]] size_t regenerated() const;
+
+  /// Entries for the updated library: regenerated signatures replace the originals, everything
+  /// else is kept so that a failed regeneration never silently drops a signature
+  [[nodiscard]] std::vector<SignatureRecord> updated_records() const;
+};
+
+/// Scan `db` once for every entry of `library`, then regenerate in parallel the entries that
+/// are no longer unique but that `locate` can still find. Only entries with a target offset of
+/// zero are regenerated, since the start of an offset signature cannot be derived from its
+/// target.
+[[nodiscard]] RevalidationReport revalidate_library(const SignatureLibrary& library,
+    const Database& db,
+    const EntryLocator& locate = {},
+    unsigned max_threads = 0);
+
+/// Summary line followed by every entry that is not unique, with the old and new signature
+/// of regenerated entries as `-`/`+` lines
+[[nodiscard]] std::string format_revalidation_report(const RevalidationReport& report);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Revalidate a library against the open database, locating broken entries by name, and write
+/// the updated library to `output_path` with a diff report next to it
+void revalidate_signature_library(const char* library_path, const char* output_path);
+} // namespace fusion
+#endif
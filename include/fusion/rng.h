@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fusion {
+/// splitmix64: tiny, seedable and identical on every platform, unlike <random> distributions.
+/// Used wherever generated data must be reproducible from a seed.
+class Rng {
+public:
+  explicit Rng(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t x = (state_ += 0x9E3779B97F4A7C15);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+    return x ^ (x >> 31);
+  }
+
+  /// Uniform in [0, n); 0 if n is 0
+  uint32_t below(uint32_t n) {
+    return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+  }
+
+  /// True with probability `p`
+  bool chance(double p) {
+    return static_cast<double>(next() >> 11) * 0x1.0p-53 < p;
+  }
+
+private:
+  uint64_t state_;
+};
+} // namespace fusion
@@ -0,0 +1,360 @@
+﻿#pragma once
+
+// Header-only scanner for shipping code that consumes Fusion signatures.
+// Signatures are parsed at compile time and scanned with kernels specialised for their length
+// and anchor bytes. No dependency on the rest of Fusion or on IDA.
+//
+//   using namespace fusion::runtime::literals;
+//   constexpr auto update = "48 89 5C 24 ? 57"_sig;
+//   const uint8_t* hit = fusion::runtime::find<update>(begin, end);
+//
+// Whole signature sets exported by the plugin as a C++ header are scanned in one pass with
+// PatternSet.
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__)
+#define FUSION_RUNTIME_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FUSION_RUNTIME_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fusion::runtime {
+/// Signature parsed at compile time. A mask of 0xFF must match exactly and 0x00 is a wildcard;
+/// nibble wildcards use 0xF0/0x0F. Masked-out bits of `bytes` are zero.
+template <size_t N>
+struct Pattern {
+  std::array<uint8_t, N> bytes{};
+  std::array<uint8_t, N> mask{};
+  size_t anchor = 0; // Rarest exact byte, checked first by the SIMD kernels
+  size_t guard = 0;  // Exact byte furthest from the anchor, checked second
+
+  [[nodiscard]] static constexpr size_t size() {
+    return N;
+  }
+
+  [[nodiscard]] constexpr bool matches(const uint8_t* data) const {
+    for (size_t i = 0; i < N; ++i) {
+      if ((data[i] & mask[i]) != bytes[i]) return false;
+    }
+    return true;
+  }
+};
+
+/// String literal usable as a template argument
+template <size_t L>
+struct FixedString {
+  char value[L]{};
+
+  consteval FixedString(const char (&str)[L]) {
+    for (size_t i = 0; i < L; ++i) {
+      value[i] = str[i];
+    }
+  }
+
+  [[nodiscard]] consteval std::string_view view() const {
+    return {value, L - 1};
+  }
+};
+
+namespace detail {
+consteval int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+consteval bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Parse IDA (`48 8B ? 4?`) or CODE (`\x48\x8B\x00 xx?`) text. Returns the byte count and, when
+// `bytes`/`mask` are non-null, writes the pattern. CODE text without a mask treats \x00 as a
+// wildcard. Invalid text is a compile error.
+consteval size_t parse(std::string_view text, uint8_t* bytes, uint8_t* mask) {
+  size_t count = 0;
+  auto emit = [&](uint8_t byte, uint8_t byte_mask) {
+    if (bytes) {
+      bytes[count] = byte & byte_mask;
+      mask[count] = byte_mask;
+    }
+    ++count;
+  };
+
+  size_t pos = 0;
+  while (pos < text.size() && is_space(text[pos])) {
+    ++pos;
+  }
+
+  if (text.find("\\x") != std::string_view::npos) {
+    while (text.substr(pos, 2) == "\\x") {
+      if (pos + 3 >= text.size()) throw "truncated \\x escape";
+      const int hi = hex_value(text[pos + 2]);
+      const int lo = hex_value(text[pos + 3]);
+      if (hi < 0 || lo < 0) throw "invalid \\x escape";
+      emit(static_cast<uint8_t>(hi << 4 | lo), 0xFF);
+      pos += 4;
+    }
+
+    std::string_view rest = text.substr(pos);
+    while (!rest.empty() && is_space(rest.front())) {
+      rest.remove_prefix(1);
+    }
+    while (!rest.empty() && is_space(rest.back())) {
+      rest.remove_suffix(1);
+    }
+
+    if (rest.empty()) {
+      if (bytes) {
+        for (size_t i = 0; i < count; ++i) {
+          if (bytes[i] == 0) mask[i] = 0x00;
+        }
+      }
+      return count;
+    }
+
+    if (rest.size() != count) throw "mask length does not match the pattern";
+    for (size_t i = 0; i < count; ++i) {
+      if (rest[i] == '?') {
+        if (bytes) bytes[i] = mask[i] = 0;
+      } else if (rest[i] != 'x') {
+        throw "mask may only contain 'x' and '?'";
+      }
+    }
+    return count;
+  }
+
+  while (pos < text.size()) {
+    if (is_space(text[pos])) {
+      ++pos;
+      continue;
+    }
+
+    size_t end = pos;
+    while (end < text.size() && !is_space(text[end])) {
+      ++end;
+    }
+    const std::string_view token = text.substr(pos, end - pos);
+    pos = end;
+
+    if (token == "?" || token == "??") {
+      emit(0, 0x00);
+      continue;
+    }
+    if (token.size() > 2) throw "bytes must be separated by spaces";
+
+    uint8_t byte = 0, byte_mask = 0;
+    for (char c : token) {
+      byte = static_cast<uint8_t>(byte << 4);
+      byte_mask = static_cast<uint8_t>(byte_mask << 4);
+      if (c == '?') continue;
+      const int value = hex_value(c);
+      if (value < 0) throw "invalid hex digit";
+      byte |= static_cast<uint8_t>(value);
+      byte_mask |= 0x0F;
+    }
+    emit(byte, token.size() == 1 ? 0xFF : byte_mask);
+  }
+  return count;
+}
+
+// Rough frequency of common x86-64 code bytes; anchors avoid these
+consteval int byte_weight(uint8_t byte) {
+  switch (byte) {
+  case 0x00:
+    return 8;
+  case 0x48:
+    return 7;
+  case 0xFF:
+  case 0x8B:
+  case 0xCC:
+    return 6;
+  case 0x89:
+    return 5;
+  case 0x24:
+  case 0x4C:
+  case 0x0F:
+  case 0xE8:
+  case 0x8D:
+  case 0x90:
+    return 4;
+  case 0x85:
+  case 0xC0:
+  case 0x44:
+  case 0x83:
+  case 0x41:
+  case 0x01:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+template <FixedString S>
+consteval auto make_pattern() {
+  constexpr size_t n = parse(S.view(), nullptr, nullptr);
+  static_assert(n > 0, "empty signature");
+
+  Pattern<n> pattern;
+  parse(S.view(), pattern.bytes.data(), pattern.mask.data());
+
+  bool found = false;
+  for (size_t i = 0; i < n; ++i) {
+    if (pattern.mask[i] != 0xFF) continue;
+    if (!found || byte_weight(pattern.bytes[i]) < byte_weight(pattern.bytes[pattern.anchor])) {
+      pattern.anchor = i;
+    }
+    found = true;
+  }
+  if (!found) throw "signature needs at least one exact byte";
+
+  const auto distance = [&](size_t pos) {
+    return pos > pattern.anchor ? pos - pattern.anchor : pattern.anchor - pos;
+  };
+  pattern.guard = pattern.anchor;
+  for (size_t i = 0; i < n; ++i) {
+    if (pattern.mask[i] == 0xFF && distance(i) > distance(pattern.guard)) {
+      pattern.guard = i;
+    }
+  }
+  return pattern;
+}
+
+// Shared kernel: `Anchor` and `Guard` are compile-time positions of two exact bytes
+template <size_t N, size_t Anchor, size_t Guard>
+const uint8_t* find_from(const uint8_t* cur, const uint8_t* end, const Pattern<N>& pattern) {
+  if (cur > end || static_cast<size_t>(end - cur) < N) return nullptr;
+  const uint8_t* const last = end - N;
+
+#if defined(FUSION_RUNTIME_AVX2)
+  const __m256i anchor = _mm256_set1_epi8(static_cast<char>(pattern.bytes[Anchor]));
+  const __m256i guard = _mm256_set1_epi8(static_cast<char>(pattern.bytes[Guard]));
+  for (; last - cur >= 31; cur += 32) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur + Anchor));
+    const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur + Guard));
+    auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(a, anchor), _mm256_cmpeq_epi8(g, guard))));
+    for (; bits; bits &= bits - 1) {
+      const uint8_t* candidate = cur + std::countr_zero(bits);
+      if (pattern.matches(candidate)) return candidate;
+    }
+  }
+#elif defined(FUSION_RUNTIME_SSE2)
+  const __m128i anchor = _mm_set1_epi8(static_cast<char>(pattern.bytes[Anchor]));
+  const __m128i guard = _mm_set1_epi8(static_cast<char>(pattern.bytes[Guard]));
+  for (; last - cur >= 15; cur += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + Anchor));
+    const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + Guard));
+    auto bits = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, anchor), _mm_cmpeq_epi8(g, guard))));
+    for (; bits; bits &= bits - 1) {
+      const uint8_t* candidate = cur + std::countr_zero(bits);
+      if (pattern.matches(candidate)) return candidate;
+    }
+  }
+#endif
+
+  for (; cur <= last; ++cur) {
+    if (cur[Anchor] == pattern.bytes[Anchor] && pattern.matches(cur)) return cur;
+  }
+  return nullptr;
+}
+} // namespace detail
+
+namespace literals {
+/// Parse a signature at compile time: `"48 89 ? ?"_sig` or `"\\x48\\x89\\x00 xx?"_sig`
+template <FixedString S>
+consteval auto operator""_sig() {
+  return detail::make_pattern<S>();
+}
+} // namespace literals
+
+/// One signature in a PatternSet
+struct PatternEntry {
+  uint32_t offset; // Into PatternSet::bytes / PatternSet::masks
+  uint16_t size;
+  uint16_t anchor; // Position of the exact byte used to bucket this entry
+  int64_t target_offset; // Displacement from the match to the address the signature identifies
+  const char* name;
+};
+
+/// Signatures exported together for a single-pass scan.
+/// Entries are sorted by anchor byte value; entries anchored on byte `b` are
+/// [buckets[b], buckets[b + 1]).
+struct PatternSet {
+  const uint8_t* bytes;
+  const uint8_t* masks;
+  const PatternEntry* entries;
+  size_t count;
+  const uint32_t* buckets; // 257 entries
+
+  [[nodiscard]] bool matches(size_t index, const uint8_t* data) const {
+    const PatternEntry& entry = entries[index];
+    const uint8_t* b = bytes + entry.offset;
+    const uint8_t* m = masks + entry.offset;
+    for (size_t i = 0; i < entry.size; ++i) {
+      if ((data[i] & m[i]) != b[i]) return false;
+    }
+    return true;
+  }
+
+  /// Call `callback(index, match)` for every match of every entry, ordered by anchor position
+  template <typename Callback>
+  void for_each_match(const uint8_t* begin, const uint8_t* end, Callback&& callback) const {
+    const auto size = static_cast<size_t>(end - begin);
+    for (size_t pos = 0; pos < size; ++pos) {
+      const uint8_t byte = begin[pos];
+      for (uint32_t index = buckets[byte]; index < buckets[byte + 1]; ++index) {
+        const PatternEntry& entry = entries[index];
+        if (pos < entry.anchor || pos - entry.anchor + entry.size > size) continue;
+
+        const uint8_t* start = begin + (pos - entry.anchor);
+        if (matches(index, start)) callback(static_cast<size_t>(index), start);
+      }
+    }
+  }
+
+  /// First match of every entry; `results` must hold `count` pointers and receives nullptr for
+  /// entries that were not found. Returns the number of entries found.
+  size_t find_first(const uint8_t* begin, const uint8_t* end, const uint8_t** results) const {
+    for (size_t i = 0; i < count; ++i) {
+      results[i] = nullptr;
+    }
+
+    size_t found = 0;
+    for_each_match(begin, end, [&](size_t index, const uint8_t* match) {
+      if (!results[index]) {
+        results[index] = match;
+        ++found;
+      }
+    });
+    return found;
+  }
+};
+
+/// First match of `P` in [begin, end), or nullptr
+template <auto P>
+const uint8_t* find(const uint8_t* begin, const uint8_t* end) {
+  return detail::find_from<P.size(), P.anchor, P.guard>(begin, end, P);
+}
+
+/// Every match of `P` in [begin, end), including overlapping ones
+template <auto P>
+std::vector<const uint8_t*> find_all(const uint8_t* begin, const uint8_t* end) {
+  std::vector<const uint8_t*> matches;
+  for (const uint8_t* cur = begin;; ++cur) {
+    cur = detail::find_from<P.size(), P.anchor, P.guard>(cur, end, P);
+    if (!cur) break;
+    matches.push_back(cur);
+  }
+  return matches;
+}
+} // namespace fusion::runtime
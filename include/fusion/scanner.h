@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include "library.h"
+#include "pattern.h"
+#include "snapshot.h"
+#include "source.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace fusion {
+/// A library signature matching at an address
+struct LibraryMatch {
+  uint32_t entry;
+  uint64_t address;
+
+  bool operator==(const LibraryMatch&) const = default;
+};
+
+/// Position of the exact byte least likely to occur in x86 code; nullopt if there is none
+[[nodiscard]] std::optional<size_t> choose_anchor_byte(const PatternView& pattern);
+
+/// Position of the adjacent exact byte pair least likely to occur in x86 code;
+/// nullopt if the pattern has no two adjacent exact bytes
+[[nodiscard]] std::optional<size_t> choose_anchor_pair(const PatternView& pattern);
+
+/// Find every address where `pattern` matches, in address order.
+/// Matches never straddle two regions.
+[[nodiscard]] std::vector<uint64_t> scan_pattern(
+    const ImageSnapshot& snapshot, const PatternView& pattern, unsigned max_threads = 0);
+
+/// Find every address where all fragments of `pattern` match with gaps in their bounds, in
+/// address order. Scans for the fragment least likely to occur in x86 code, then verifies
+/// the others in the window the gaps allow around each hit. Matches never straddle two regions.
+[[nodiscard]] std::vector<uint64_t> scan_composite(
+    const ImageSnapshot& snapshot, const CompositePattern& pattern, unsigned max_threads = 0);
+
+/// Those of `candidates` where `pattern` matches, in the same order. Checks each one directly
+/// instead of scanning, for when only known addresses such as function starts count.
+[[nodiscard]] std::vector<uint64_t> match_at(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    const std::vector<uint64_t>& candidates);
+
+/// Those of `candidates` where the first fragment of `pattern` starts a match
+[[nodiscard]] std::vector<uint64_t> match_at(const ImageSnapshot& snapshot,
+    const CompositePattern& pattern,
+    const std::vector<uint64_t>& candidates);
+
+/// An approximate match and how many of the pattern's non-wildcard bytes differ there
+struct FuzzyMatch {
+  uint64_t address;
+  uint32_t distance;
+
+  bool operator==(const FuzzyMatch&) const = default;
+};
+
+/// Find every address where at most `max_distance` non-wildcard bytes of `pattern` differ,
+/// sorted by distance and then address. A byte with a nibble wildcard differs if its fixed
+/// nibble does. Compares eight bytes per step and stops at the first `max_distance` + 1
+/// differences, so most positions are rejected after one or two steps.
+/// Only the closest `max_matches` at or after `start_addr` are kept: each chunk of work keeps
+/// its best ones in a bounded heap and lowers its cutoff once the heap is full, so the work
+/// and memory stay bounded however many positions are within `max_distance`.
+[[nodiscard]] std::vector<FuzzyMatch> fuzzy_scan(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    uint32_t max_distance,
+    unsigned max_threads = 0,
+    size_t max_matches = SIZE_MAX,
+    uint64_t start_addr = 0);
+
+/// Those of `candidates` where at most `max_distance` non-wildcard bytes of `pattern` differ,
+/// measured only there and sorted like fuzzy_scan; for when only known addresses count
+[[nodiscard]] std::vector<FuzzyMatch> fuzzy_match_at(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    uint32_t max_distance,
+    const std::vector<uint64_t>& candidates);
+
+/// Bytes read from the source per step of scan_source
+inline constexpr size_t default_stream_chunk = 64 << 20;
+
+/// Scan `source` for every pattern without copying all of it into memory. Each segment is read
+/// `chunk_size` bytes at a time, overlapping the next chunk by the longest pattern minus one
+/// byte so matches across chunk edges are found exactly once. Pages that cannot be read are
+/// skipped. Returns the matches of each pattern in address order.
+[[nodiscard]] std::vector<std::vector<uint64_t>> scan_source(const ByteSource& source,
+    const std::vector<PatternView>& patterns,
+    size_t chunk_size = default_stream_chunk,
+    unsigned max_threads = 0);
+
+/// Match every library signature in a single pass, sorted by entry then address
+[[nodiscard]] std::vector<LibraryMatch> scan_library(
+    const ImageSnapshot& snapshot, const SignatureLibrary& library, unsigned max_threads = 0);
+} // namespace fusion
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "pattern.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// A signature with its optional name and target offset, as stored in signature sets
+struct SignatureRecord {
+  std::string name;
+  CompiledPattern pattern;
+  int64_t offset = 0; // Displacement from the match to the address the signature identifies
+
+  bool operator==(const SignatureRecord&) const = default;
+};
+
+/// Version written into signature set headers; bump when the record layout changes
+inline constexpr uint8_t signature_format_version = 1;
+
+/// Append the binary encoding of one signature to `out`
+void serialize_signature(const SignatureRecord& record, std::vector<uint8_t>& out);
+
+/// Decode one signature from [`data`, `end`) and advance `data` past it
+bool deserialize_signature(const uint8_t*& data, const uint8_t* end, SignatureRecord& out);
+
+/// Encode a whole signature set as one contiguous blob with a versioned header
+[[nodiscard]] std::vector<uint8_t> serialize_signatures(const std::vector<SignatureRecord>& records);
+
+/// Decode a blob written by serialize_signatures; returns false on truncated or foreign data
+bool deserialize_signatures(const uint8_t* data, size_t size, std::vector<SignatureRecord>& out);
+} // namespace fusion
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <cstdint>
+#include <string>
 
 namespace fusion {
 /// Configuration flags for plugin behavior
@@ -14,11 +15,27 @@ enum SettingsFlag : uint32_t {
   StopAtFirst = 1 << 6,
   UseDoubleWildcard = 1 << 7,
   UseAltWildcard = 1 << 8,
+  UseBuiltinDecoder = 1 << 9,
+  ShowTimings = 1 << 10, // Only has an effect in builds with FUSION_PROFILE
+  AllowComposite = 1 << 11,
+  FunctionStartsOnly = 1 << 12,
+};
+
+/// Part of the database that searches and uniqueness checks cover
+enum class SearchScope : uint8_t {
+  All,      // Every segment
+  Code,     // Code segments only
+  Segments, // Segments named in Settings::scope_segments
+  Range,    // [Settings::scope_start, Settings::scope_end)
 };
 
 /// Global settings state
 struct Settings {
   uint32_t flags = AutoJumpToFound | UseSelectedRange | ShowMnemonics | CopyToClipboard;
+  SearchScope scope = SearchScope::All;
+  std::string scope_segments; // Names separated by spaces or commas, like ".text, .init"
+  uint64_t scope_start = 0;
+  uint64_t scope_end = 0;
 
   [[nodiscard]] bool has(SettingsFlag flag) const {
     return (flags & flag) != 0;
@@ -1,9 +1,16 @@
 ﻿#pragma once
 
+#include "database.h"
+#include "pattern.h"
+#include "scanner.h"
+#include "serialize.h"
 #include "settings.h"
+#include "source.h"
 #include "types.h"
 
 #include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -25,6 +32,9 @@ public:
   /// Render signature in the specified format
   [[nodiscard]] std::string render(SignatureStyle style) const;
 
+  /// Convert to a pattern that can be matched or serialized without re-parsing
+  [[nodiscard]] CompiledPattern compile() const;
+
   /// Generate hash of the signature bytes (non-wildcard only)
   [[nodiscard]] uint32_t hash_fnv1a() const;
   [[nodiscard]] uint32_t hash_crc32() const;
@@ -37,6 +47,158 @@ private:
   std::vector<bool> wildcards_;
 };
 
+/// Called with the address of each instruction added to a signature
+using InsnCallback = std::function<void(uint64_t address)>;
+
+/// Append the bytes of one decoded instruction, wildcarding its relocatable operands
+void add_instruction(SignatureBuilder& builder, const uint8_t* bytes, const InsnInfo& insn);
+
+/// Grow `builder` from `target` instruction by instruction until the signature matches nowhere
+/// else in `image`. Returns false if decoding fails or the region ends before it became unique.
+/// `max_threads` limits the scan, for callers that build several signatures in parallel.
+bool build_unique_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    SignatureBuilder& builder,
+    const InsnCallback& on_instruction = {},
+    unsigned max_threads = 0);
+
+/// Like build_unique_signature, but only `starts` (ascending) can be other matches, and they are
+/// checked directly instead of scanning `image`. For entry signatures searched for only at
+/// function starts, which can be much shorter.
+bool build_unique_signature_among(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    const std::vector<uint64_t>& starts,
+    SignatureBuilder& builder,
+    const InsnCallback& on_instruction = {});
+
+/// How a signature fares in one reference image, such as another build of the program
+enum class ReferenceStatus {
+  Unique,    // Matches exactly once
+  Missing,   // Never matched exactly once: the function is absent or changed at its start
+  Lost,      // Matched once, then the signature grew into bytes that differ in this build
+  Ambiguous, // Matches more than once
+};
+
+struct ReferenceResult {
+  ReferenceStatus status = ReferenceStatus::Missing;
+  uint64_t address = 0; // The match, when Unique
+};
+
+/// Grow `builder` from `target` until the signature matches nowhere else in `image` and at
+/// most once in every reference image, scanning all images concurrently. Fills `results` with
+/// one entry per reference. Returns false if decoding fails, the region ends first, or a
+/// reference loses its only match, since growing further cannot bring that match back.
+bool build_multi_image_signature(const ImageSnapshot& image,
+    const std::vector<const ImageSnapshot*>& references,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    SignatureBuilder& builder,
+    std::vector<ReferenceResult>& results,
+    const InsnCallback& on_instruction = {});
+
+/// Match `pattern` against every reference image concurrently
+[[nodiscard]] std::vector<ReferenceResult> check_references(
+    const PatternView& pattern, const std::vector<const ImageSnapshot*>& references);
+
+/// Longest contiguous signature create_signature keeps before it tries a composite one
+inline constexpr size_t composite_threshold = 32;
+
+/// Build a composite signature for `target` from two fragments of whole instructions, each at
+/// most 16 bytes: the first instructions from `target`, and the shortest later run before `end`
+/// and within 4 KiB that does not follow any other match of the first. The gap between them
+/// may shrink or grow by a quarter. Returns false if the first fragment alone is unique or no
+/// such pair is.
+bool build_composite_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    uint64_t end,
+    CompositePattern& out);
+
+/// Grow one signature from all `targets` at once, following the instructions at the first,
+/// until it matches exactly those addresses. Bits that differ between the targets become
+/// wildcards, a nibble at a time. Returns false if a target is outside `image`, decoding fails,
+/// or a region ends before the signature matched nothing else.
+bool build_group_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    std::vector<uint64_t> targets,
+    CompiledPattern& out,
+    const InsnCallback& on_instruction = {});
+
+/// Append every instruction in [start, end), stopping early at the first that fails to decode
+void build_range_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t start,
+    uint64_t end,
+    SignatureBuilder& builder);
+
+/// Options for creating a signature, taken from the plugin settings
+struct CreateSettings {
+  bool use_selection = true;
+  bool allow_dangerous_regions = false;
+  bool allow_composite = false; // Try two fragments with a gap when contiguous ones are long
+  bool function_starts_only = false; // Only other function starts count against a function start
+};
+
+/// How create_signature ended
+enum class CreateStatus {
+  Unique,        // Grown from the cursor until it matched nowhere else
+  NotUnique,     // Ran out of instructions first; the signature still matches elsewhere
+  FromSelection, // Built from the selected range without checking uniqueness
+  NotInFunction, // The cursor is outside any function and dangerous regions are not allowed
+};
+
+struct CreateResult {
+  CreateStatus status = CreateStatus::NotInFunction;
+  SignatureBuilder builder; // Leading and trailing wildcards already trimmed
+  std::vector<ReferenceResult> references; // One per reference image, if any were given
+  /// Set when a composite signature is unique and shorter than `builder`; `status` then
+  /// describes it
+  std::optional<CompositePattern> composite;
+};
+
+/// Create a signature for the cursor of `db`, or for its selection if enabled. With
+/// `function_starts_only`, a signature for a function start only has to differ from the others.
+[[nodiscard]] CreateResult create_signature(
+    const Database& db, const CreateSettings& settings, const InsnCallback& on_instruction = {});
+
+/// Like create_signature, but the signature is only Unique once it is also unique in every
+/// reference image and still matches those it matched once. Signatures from a selection are
+/// not grown; `references` then only reports where they match.
+[[nodiscard]] CreateResult create_multi_image_signature(const Database& db,
+    const std::vector<const ImageSnapshot*>& references,
+    const CreateSettings& settings,
+    const InsnCallback& on_instruction = {});
+
+struct GroupResult {
+  CreateStatus status = CreateStatus::NotInFunction; // Never FromSelection
+  CompiledPattern pattern; // Trailing wildcards already trimmed
+  uint64_t outside = 0;    // The first target outside any function, when NotInFunction
+};
+
+/// Create one signature that matches every address in `targets` and nothing else, such as all
+/// inlined copies of a routine
+[[nodiscard]] GroupResult create_group_signature(const Database& db,
+    const std::vector<uint64_t>& targets,
+    const CreateSettings& settings,
+    const InsnCallback& on_instruction = {});
+
+/// Drop matches outside the address filters of `settings`
+[[nodiscard]] std::vector<uint64_t> filter_matches(
+    const std::vector<uint64_t>& matches, const FindSettings& settings);
+
+/// Every filtered match of an IDA- or CODE-style `pattern`, which may have `[min-max]` gaps;
+/// nullopt if the pattern is invalid
+[[nodiscard]] std::optional<std::vector<uint64_t>> find_signature(
+    const Database& db, const std::string& pattern, const FindSettings& settings);
+
+/// Like find_signature, but also finds positions where up to `settings.max_distance`
+/// non-wildcard bytes differ, closest first. For re-anchoring signatures broken by an update.
+/// `max_distance` is clamped below the number of non-wildcard bytes, so at least one has to
+/// match, and at most `settings.max_matches` matches are returned.
+[[nodiscard]] std::optional<std::vector<FuzzyMatch>> find_fuzzy_signature(
+    const Database& db, const std::string& pattern, const FindSettings& settings);
 } // namespace fusion
 
 // IDA-dependent declarations (only when building with IDA SDK)
@@ -48,7 +210,25 @@ namespace fusion {
 /// Find all occurrences of a signature pattern
 std::vector<ea_t> find_signature(const std::string& pattern, const FindSettings& settings);
 
+/// Find all windows of `length` bytes whose CRC-32 equals `hash`
+std::vector<ea_t> find_crc32_signature(
+    uint32_t hash, size_t length, const FindSettings& settings);
+
 /// Create a unique signature for the current cursor location
 std::string create_signature(SignatureStyle style);
+
+/// Create a signature for the cursor that is also unique in each reference image (see
+/// load_reference_image), and report where it matches in each
+std::string create_multi_image_signature(
+    SignatureStyle style, const std::vector<std::string>& reference_paths);
+
+/// Create one IDA signature that matches every address in `targets` and nothing else
+std::string create_group_signature(const std::vector<ea_t>& targets);
+
+/// Name to store a signature for `ea` under: its label, or function name plus offset
+std::string signature_name(ea_t ea);
+
+/// Signatures created this session, in creation order
+std::vector<SignatureRecord>& session_signatures();
 } // namespace fusion
 #endif
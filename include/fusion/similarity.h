@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fusion {
+/// MinHash signature of a function's normalized instruction n-grams
+struct MinHashSketch {
+  static constexpr size_t size = 64;
+  static constexpr size_t bands = 16;
+  static constexpr size_t rows = size / bands;
+
+  std::array<uint32_t, size> values;
+
+  MinHashSketch() {
+    values.fill(UINT32_MAX);
+  }
+
+  /// Estimated Jaccard similarity of the two n-gram sets (0.0 - 1.0)
+  [[nodiscard]] double similarity(const MinHashSketch& other) const;
+  [[nodiscard]] bool empty() const;
+};
+
+/// Builds a MinHash sketch from an instruction stream, masked like SignatureBuilder
+class SketchBuilder {
+public:
+  /// Instructions per shingle
+  static constexpr size_t ngram = 3;
+
+  void clear();
+  void add_byte(uint8_t byte, bool is_wildcard = false);
+  void end_instruction();
+
+  [[nodiscard]] size_t instruction_count() const {
+    return instructions_.size();
+  }
+
+  [[nodiscard]] MinHashSketch finish() const;
+
+private:
+  std::vector<uint64_t> instructions_;
+  uint64_t current_ = 0;
+  size_t current_size_ = 0;
+};
+
+/// A sketched function, identified by address and name
+struct FunctionSketch {
+  uint64_t address = 0;
+  std::string name;
+  MinHashSketch sketch;
+};
+
+/// A query hit returned by SimilarityIndex
+struct SimilarityMatch {
+  const FunctionSketch* function;
+  double similarity;
+};
+
+/// Banded LSH table over function sketches
+class SimilarityIndex {
+public:
+  void clear();
+  void add(FunctionSketch function);
+
+  [[nodiscard]] size_t size() const {
+    return functions_.size();
+  }
+
+  /// Find indexed functions whose estimated similarity is at least `min_similarity`,
+  /// most similar first
+  [[nodiscard]] std::vector<SimilarityMatch> query(
+      const MinHashSketch& sketch, double min_similarity, size_t max_results) const;
+
+private:
+  std::vector<FunctionSketch> functions_;
+  std::array<std::unordered_map<uint64_t, std::vector<uint32_t>>, MinHashSketch::bands> buckets_;
+};
+
+/// Write sketches to a file that another database can query against
+bool save_sketches(const std::string& path, const std::vector<FunctionSketch>& sketches);
+
+/// Read sketches written by save_sketches; returns false on I/O or format errors
+bool load_sketches(const std::string& path, std::vector<FunctionSketch>& sketches);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+#include <pro.h>
+
+namespace fusion {
+/// Sketch every function in the database
+std::vector<FunctionSketch> sketch_functions();
+
+/// Report functions similar to the one at the cursor, from this database or a sketch file
+void find_similar_functions(const char* sketch_path);
+
+/// Sketch every function and write the result to `path`
+void export_function_sketches(const char* path);
+} // namespace fusion
+#endif
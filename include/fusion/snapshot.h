@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fusion {
+/// Contiguous run of loaded bytes starting at a fixed address
+struct SnapshotRegion {
+  uint64_t start = 0;
+  std::vector<uint8_t> bytes;
+
+  [[nodiscard]] uint64_t end() const {
+    return start + bytes.size();
+  }
+};
+
+/// In-memory copy of the loaded image, one region per segment
+struct ImageSnapshot {
+  std::vector<SnapshotRegion> regions;
+
+  [[nodiscard]] size_t total_size() const {
+    size_t total = 0;
+    for (const auto& region : regions) {
+      total += region.bytes.size();
+    }
+    return total;
+  }
+};
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Copy the segments of the current database inside the search scope into memory
+ImageSnapshot take_snapshot();
+} // namespace fusion
+#endif
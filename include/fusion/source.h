@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include "settings.h"
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fusion {
+/// Half-open address range [start, end)
+struct AddressRange {
+  uint64_t start = 0;
+  uint64_t end = 0;
+
+  [[nodiscard]] uint64_t size() const {
+    return end - start;
+  }
+
+  bool operator==(const AddressRange&) const = default;
+};
+
+/// A segment and what a search scope selects it by
+struct SegmentInfo {
+  AddressRange range;
+  std::string name;
+  bool code = false;
+};
+
+/// Parts of `segments` inside the search scope of `settings`, in address order
+[[nodiscard]] std::vector<AddressRange> scope_ranges(
+    const std::vector<SegmentInfo>& segments, const Settings& settings);
+
+/// Where the bytes of an image come from: an IDA database, a file on disk, a live process
+class ByteSource {
+public:
+  virtual ~ByteSource() = default;
+
+  /// Loaded ranges in address order
+  [[nodiscard]] virtual std::vector<AddressRange> segments() const = 0;
+
+  /// Copy up to `size` bytes at `address` into `out`; returns how many were copied
+  virtual size_t read(uint64_t address, uint8_t* out, size_t size) const = 0;
+};
+
+/// Length of one instruction and the operand bytes that change between builds
+struct InsnInfo {
+  uint32_t size = 0;
+  /// Bytes [wildcard_begin, wildcard_end) are relocatable operands; empty if begin == end
+  uint32_t wildcard_begin = 0;
+  uint32_t wildcard_end = 0;
+  /// Operation and operand kinds without register numbers or values, so it survives register
+  /// reallocation; 0 if the decoder does not provide one
+  uint32_t token = 0;
+
+  [[nodiscard]] bool is_wildcard(size_t offset) const {
+    return offset >= wildcard_begin && offset < wildcard_end;
+  }
+};
+
+/// Instruction length decoder
+class InsnDecoder {
+public:
+  virtual ~InsnDecoder() = default;
+
+  /// Decode the instruction at `address`, whose bytes start at `bytes` with `available` of them
+  /// readable. Returns false if there is no valid instruction there.
+  virtual bool decode(
+      uint64_t address, const uint8_t* bytes, size_t available, InsnInfo& out) const = 0;
+};
+
+/// Instruction token for the `size` key bytes at `data`: their FNV-1a hash, never 0
+[[nodiscard]] uint32_t make_token(const uint8_t* data, size_t size);
+
+/// Copy every segment of `source` into memory
+[[nodiscard]] ImageSnapshot read_snapshot(const ByteSource& source);
+
+/// Region of `snapshot` holding `address`, or nullptr
+[[nodiscard]] const SnapshotRegion* find_region(const ImageSnapshot& snapshot, uint64_t address);
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Every segment of the current database
+[[nodiscard]] std::vector<SegmentInfo> ida_segments();
+
+/// Segments and bytes of the current database, limited to the search scope if `scoped`
+class IdaByteSource : public ByteSource {
+public:
+  explicit IdaByteSource(bool scoped = false) : scoped_(scoped) {}
+
+  [[nodiscard]] std::vector<AddressRange> segments() const override;
+  size_t read(uint64_t address, uint8_t* out, size_t size) const override;
+
+private:
+  bool scoped_;
+};
+
+/// IDA's processor module; immediates and displacements to the end of the instruction
+/// are wildcards
+class IdaInsnDecoder : public InsnDecoder {
+public:
+  bool decode(
+      uint64_t address, const uint8_t* bytes, size_t available, InsnInfo& out) const override;
+};
+} // namespace fusion
+#endif
@@ -0,0 +1,103 @@
+﻿#pragma once
+
+#include "database.h"
+#include "signature.h"
+#include "snapshot.h"
+#include "source.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fusion {
+/// Instruction tokens of an image (see InsnInfo::token) with a hash index of every n-gram, so
+/// token sequences are found by verifying the positions of their rarest n-gram instead of
+/// decoding the image again
+class TokenIndex {
+public:
+  /// Instructions per indexed n-gram; unique token signatures are at least this long
+  static constexpr size_t ngram = 4;
+
+  /// Tokenize every region of `image` by linear sweep, restarting one byte later after bytes
+  /// that do not decode. Pass only code regions; data decodes into noise.
+  void build(const ImageSnapshot& image, const InsnDecoder& decoder);
+
+  /// Same, over regions that stay owned by their snapshot, such as the code regions of a
+  /// database image, so they are not copied first
+  void build(std::span<const SnapshotRegion* const> regions, const InsnDecoder& decoder);
+
+  [[nodiscard]] size_t size() const {
+    return addresses_.size();
+  }
+
+  /// Addresses where `tokens` occur, in address order, at most `max_matches` of them
+  [[nodiscard]] std::vector<uint64_t> find(
+      const std::vector<uint32_t>& tokens, size_t max_matches = SIZE_MAX) const;
+
+  /// Shortest sequence starting at the instruction at `address` that occurs nowhere else, at
+  /// most `max_tokens` long. Empty if the sweep has no instruction at `address`, or the
+  /// sequence runs into undecodable bytes or `max_tokens` while still matching elsewhere.
+  [[nodiscard]] std::vector<uint32_t> unique_sequence(uint64_t address, size_t max_tokens) const;
+
+  /// Tokens of the instructions starting in `range`, up to the first undecodable bytes
+  [[nodiscard]] std::vector<uint32_t> sequence(const AddressRange& range) const;
+
+private:
+  void add_break(uint64_t address);
+
+  /// Positions of the n-grams in the hash bucket of the n-gram at `tokens`, ascending
+  [[nodiscard]] std::span<const uint32_t> bucket(const uint32_t* tokens) const;
+
+  std::vector<uint32_t> tokens_;    // 0 separates regions and undecodable bytes
+  std::vector<uint64_t> addresses_; // Address of each token, ascending
+  std::vector<uint32_t> bucket_offsets_; // Start of each bucket in positions_, plus the end
+  std::vector<uint32_t> positions_;      // N-gram positions grouped by bucket
+  unsigned bucket_shift_ = 32;           // Hash bits dropped to get a bucket
+};
+
+/// Longest token signature create_token_signature tries
+inline constexpr size_t max_token_signature = 64;
+
+/// Token signatures are written as "T:" and hex tokens: "T:1A2B3C4D 5E6F7A8B ..."
+[[nodiscard]] std::string format_token_signature(const std::vector<uint32_t>& tokens);
+
+[[nodiscard]] bool is_token_signature(std::string_view text);
+
+/// Tokens of a signature written by format_token_signature; nullopt if it is malformed
+[[nodiscard]] std::optional<std::vector<uint32_t>> parse_token_signature(std::string_view text);
+
+struct TokenSignature {
+  CreateStatus status = CreateStatus::NotInFunction;
+  std::vector<uint32_t> tokens; // Empty unless Unique or FromSelection
+};
+
+/// Token signature for the cursor of `db`, or for its selection if enabled. `index` must be
+/// built from the same database with the same decoder.
+[[nodiscard]] TokenSignature create_token_signature(
+    const Database& db, const TokenIndex& index, const CreateSettings& settings);
+
+/// Every filtered match of a token signature; nullopt if `pattern` is not a valid one.
+/// With `settings.function_starts_only`, only matches in the sorted `function_starts` count.
+[[nodiscard]] std::optional<std::vector<uint64_t>> find_token_signature(const TokenIndex& index,
+    std::string_view pattern,
+    const FindSettings& settings,
+    std::span<const uint64_t> function_starts = {});
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+#include <pro.h>
+
+namespace fusion {
+/// Token signature for the current cursor location, matched against the code segments
+std::string create_token_signature();
+
+/// Find all occurrences of a token signature in the code segments
+std::vector<ea_t> find_token_signature(const std::string& pattern, const FindSettings& settings);
+} // namespace fusion
+#endif
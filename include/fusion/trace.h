@@ -0,0 +1,91 @@
+﻿#pragma once
+
+// Event trace for parallel and batch operations, written as Chrome trace-event JSON that
+// chrome://tracing and Perfetto can load. Every thread records into its own ring buffer
+// without locking; the buffers are only read after the traced operation has finished.
+// Like the profile counters, FUSION_TRACE compiles to nothing unless FUSION_PROFILE is defined.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fusion {
+/// Events kept per thread before the oldest are overwritten
+inline constexpr size_t default_trace_capacity = 1 << 16;
+
+/// Discard earlier events and start recording
+void trace_start(size_t capacity_per_thread = default_trace_capacity);
+/// Stop recording; recorded events stay available until the next trace_start
+void trace_stop();
+[[nodiscard]] bool trace_enabled();
+
+/// Record a complete event on the calling thread; `name` and `arg_name` must be string literals
+void trace_event(const char* name, const char* arg_name, uint64_t arg, int64_t begin_ns,
+    int64_t end_ns);
+[[nodiscard]] int64_t trace_clock();
+
+/// Events overwritten because a thread's ring buffer was full
+[[nodiscard]] uint64_t trace_dropped();
+
+/// Recorded events as a Chrome trace-event JSON document
+[[nodiscard]] std::string chrome_trace_json();
+bool write_chrome_trace(const std::string& path);
+
+/// Records its lifetime as one event while tracing is enabled
+class ScopedTrace {
+public:
+  explicit ScopedTrace(const char* name, const char* arg_name = nullptr, uint64_t arg = 0)
+      : name_(trace_enabled() ? name : nullptr), arg_name_(arg_name), arg_(arg),
+        begin_(name_ ? trace_clock() : 0) {}
+  ~ScopedTrace() {
+    if (name_) trace_event(name_, arg_name_, arg_, begin_, trace_clock());
+  }
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+  const char* name_;
+  const char* arg_name_;
+  uint64_t arg_;
+  int64_t begin_;
+};
+
+/// Traces everything between construction and destruction into `path`; does nothing when
+/// `path` is empty. For tools and batch operations that trace a whole run.
+class TraceSession {
+public:
+  explicit TraceSession(std::string path) : path_(std::move(path)) {
+    if (!path_.empty()) trace_start();
+  }
+  ~TraceSession() {
+    finish();
+  }
+
+  /// Stop recording and write the file; false if it could not be written
+  bool finish() {
+    if (path_.empty()) return true;
+    trace_stop();
+    const bool written = write_chrome_trace(path_);
+    path_.clear();
+    return written;
+  }
+
+  TraceSession(const TraceSession&) = delete;
+  TraceSession& operator=(const TraceSession&) = delete;
+
+private:
+  std::string path_;
+};
+} // namespace fusion
+
+#ifdef FUSION_PROFILE
+/// Trace the rest of the enclosing scope, e.g. FUSION_TRACE("scan_chunk", "bytes", count)
+#define FUSION_TRACE(...)                                                                          \
+  const ::fusion::ScopedTrace FUSION_TRACE_CONCAT(fusion_trace_, __LINE__)(__VA_ARGS__)
+#define FUSION_TRACE_CONCAT2(a, b) a##b
+#define FUSION_TRACE_CONCAT(a, b) FUSION_TRACE_CONCAT2(a, b)
+#else
+#define FUSION_TRACE(...) static_cast<void>(0)
+#endif
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace fusion {
@@ -18,5 +19,8 @@ struct FindSettings {
   uint64_t ignore_addr = 0;
   uint64_t start_addr = 0;
   bool jump_to_found = false;
+  uint32_t max_distance = 0; // Non-wildcard bytes allowed to differ; 0 finds exact matches only
+  size_t max_matches = 0;    // Approximate searches keep only the closest ones; 0 keeps all
+  bool function_starts_only = false; // Only match at the start of a function
 };
 } // namespace fusion
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "source.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fusion {
+/// Byte layout of one x86 instruction. Offsets count from the first prefix byte;
+/// a field size of 0 means the instruction has no such field.
+struct X86Insn {
+  uint8_t size = 0;
+  uint8_t opcode_offset = 0; // Opcode byte, after legacy/REX/VEX/EVEX/XOP prefixes
+  uint8_t modrm_offset = 0;  // ModRM byte; 0 if there is none, since the opcode comes first
+  uint8_t disp_offset = 0;
+  uint8_t disp_size = 0;
+  uint8_t imm_offset = 0; // Immediate, or the displacement of a relative branch
+  uint8_t imm_size = 0;
+  bool relative = false;     // The immediate is relative to the next instruction
+  bool rip_relative = false; // The displacement is relative to the next instruction
+
+  /// First displacement or immediate byte, or `size` if there is none
+  [[nodiscard]] uint8_t operand_offset() const {
+    if (disp_size) return disp_offset;
+    if (imm_size) return imm_offset;
+    return size;
+  }
+};
+
+/// Decode the length and operand layout of the instruction at `bytes`, in 64-bit mode or
+/// 32-bit protected mode. Handles legacy, REX, VEX, EVEX and XOP encodings.
+/// Returns false for invalid or truncated instructions.
+bool decode_x86(const uint8_t* bytes, size_t available, bool x64, X86Insn& out);
+
+/// Built-in decoder for signature creation. Wildcards run from the first displacement or
+/// immediate to the end of the instruction, like IDA's operand offsets. Tokens keep the
+/// prefixes, opcode, group extension and whether operands are registers or memory.
+class X86Decoder : public InsnDecoder {
+public:
+  explicit X86Decoder(bool x64 = true) : x64_(x64) {}
+
+  bool decode(
+      uint64_t address, const uint8_t* bytes, size_t available, InsnInfo& out) const override;
+
+private:
+  bool x64_;
+};
+} // namespace fusion
+
+// IDA-dependent declarations (only when building with IDA SDK)
+#ifdef __IDP__
+namespace fusion {
+/// Whether the database is x86 and the built-in decoder can stand in for IDA's
+bool builtin_decoder_available();
+
+/// Decoder for signature creation: the built-in one if enabled in the settings and available,
+/// IDA's otherwise
+const InsnDecoder& signature_decoder();
+
+/// Compare the built-in decoder with IDA on every instruction in the database and report
+/// where their lengths or wildcard offsets differ
+void verify_builtin_decoder();
+} // namespace fusion
+#endif
@@ -0,0 +1,253 @@
+﻿#include "fusion/common_pattern.h"
+#include "fusion/parallel.h"
+#include "fusion/profile.h"
+#include "fusion/trace.h"
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <utility>
+
+namespace fusion {
+namespace {
+// One position of the combined instruction stream
+struct StreamInsn {
+  uint64_t address = 0;
+  const uint8_t* bytes = nullptr;
+  InsnInfo info;         // size 0 for breaks
+  uint32_t function = 0; // Index into the functions, or their count for breaks
+};
+
+// Decode [range.start, range.end) by linear sweep. Bytes that do not decode, or decode without
+// a token to compare, become breaks that no run can span.
+std::vector<StreamInsn> decode_function(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    const AddressRange& range,
+    uint32_t function,
+    uint32_t break_function) {
+  std::vector<StreamInsn> stream;
+  const SnapshotRegion* region = find_region(image, range.start);
+  if (!region) return stream;
+
+  const uint64_t end = std::min(range.end, region->end());
+  for (uint64_t addr = range.start; addr < end;) {
+    const size_t offset = addr - region->start;
+    StreamInsn insn{addr, region->bytes.data() + offset, {}, function};
+    if (decoder.decode(addr, insn.bytes, end - addr, insn.info) && insn.info.size
+        && insn.info.token) {
+      addr += insn.info.size;
+      stream.push_back(insn);
+    } else {
+      insn.info = {};
+      insn.function = break_function;
+      if (stream.empty() || stream.back().function != break_function) stream.push_back(insn);
+      ++addr;
+    }
+  }
+  FUSION_COUNT(Instructions, stream.size());
+  return stream;
+}
+
+// Suffix array of `symbols`, each below `alphabet`, by prefix doubling: suffixes are sorted by
+// their first 2k symbols from the ranks of the first k, with two counting sorts per round
+std::vector<uint32_t> suffix_array(const std::vector<uint32_t>& symbols, uint32_t alphabet) {
+  const size_t n = symbols.size();
+  std::vector<uint32_t> sa(n), rank(symbols), next(n);
+  std::vector<uint32_t> counts(std::max<size_t>(alphabet, n) + 1);
+
+  const auto sort_by_rank = [&](size_t classes) {
+    std::fill(counts.begin(), counts.begin() + classes + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      ++counts[rank[i] + 1];
+    }
+    for (size_t c = 1; c <= classes; ++c) {
+      counts[c] += counts[c - 1];
+    }
+    // `next` holds the suffixes in order of their second half; the sort keeps it for ties
+    for (const uint32_t suffix : next) {
+      sa[counts[rank[suffix]]++] = suffix;
+    }
+  };
+
+  std::iota(next.begin(), next.end(), 0u);
+  sort_by_rank(alphabet);
+  for (size_t k = 1;; k <<= 1) {
+    // Suffixes too short for a second half come first
+    size_t p = 0;
+    for (size_t i = n - std::min(k, n); i < n; ++i) {
+      next[p++] = static_cast<uint32_t>(i);
+    }
+    for (const uint32_t suffix : sa) {
+      if (suffix >= k) next[p++] = static_cast<uint32_t>(suffix - k);
+    }
+    sort_by_rank(k == 1 ? alphabet : rank[sa[n - 1]] + 1);
+
+    const auto second = [&](uint32_t i) { return i + k < n ? int64_t{rank[i + k]} : -1; };
+    next[sa[0]] = 0;
+    for (size_t i = 1; i < n; ++i) {
+      const uint32_t a = sa[i - 1], b = sa[i];
+      next[b] = next[a] + (rank[a] != rank[b] || second(a) != second(b));
+    }
+    rank.swap(next);
+    if (rank[sa[n - 1]] == n - 1) break;
+  }
+  return sa;
+}
+
+// lcp[i] is the number of symbols the suffixes at sa[i - 1] and sa[i] share (Kasai et al.)
+std::vector<uint32_t> lcp_array(
+    const std::vector<uint32_t>& symbols, const std::vector<uint32_t>& sa) {
+  const size_t n = symbols.size();
+  std::vector<uint32_t> rank(n), lcp(n);
+  for (size_t i = 0; i < n; ++i) {
+    rank[sa[i]] = static_cast<uint32_t>(i);
+  }
+
+  size_t shared = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (rank[i] == 0) {
+      shared = 0;
+      continue;
+    }
+    const size_t j = sa[rank[i] - 1];
+    while (i + shared < n && j + shared < n && symbols[i + shared] == symbols[j + shared]) {
+      ++shared;
+    }
+    lcp[rank[i]] = static_cast<uint32_t>(shared);
+    if (shared > 0) --shared;
+  }
+  return lcp;
+}
+} // namespace
+
+std::optional<CommonPattern> find_common_pattern(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    const std::vector<AddressRange>& functions) {
+  FUSION_TRACE("find_common_pattern", "functions", functions.size());
+  const auto count = static_cast<uint32_t>(functions.size());
+  if (count < 2) return std::nullopt;
+
+  std::vector<std::vector<StreamInsn>> decoded(count);
+  {
+    FUSION_PHASE(Decode);
+    parallel_for(count, 0, [&](size_t i) {
+      decoded[i] = decode_function(image, decoder, functions[i], static_cast<uint32_t>(i), count);
+    });
+  }
+
+  // One stream of every function, each followed by a break. Instructions with the same token
+  // and length share a symbol; every break gets its own, so no shared run crosses one.
+  std::vector<StreamInsn> stream;
+  for (auto& function : decoded) {
+    stream.insert(stream.end(), function.begin(), function.end());
+    if (stream.empty() || stream.back().function != count) {
+      stream.push_back({0, nullptr, {}, count});
+    }
+  }
+
+  const auto shape = [](const StreamInsn& insn) {
+    return uint64_t{insn.info.token} << 8 | insn.info.size;
+  };
+  std::vector<uint64_t> shapes;
+  for (const auto& insn : stream) {
+    if (insn.function != count) shapes.push_back(shape(insn));
+  }
+  std::sort(shapes.begin(), shapes.end());
+  shapes.erase(std::unique(shapes.begin(), shapes.end()), shapes.end());
+
+  const size_t n = stream.size();
+  std::vector<uint32_t> symbols(n);
+  std::vector<uint64_t> offsets(n + 1); // Bytes before each position
+  auto next_break = static_cast<uint32_t>(shapes.size());
+  for (size_t i = 0; i < n; ++i) {
+    symbols[i] = stream[i].function == count
+                     ? next_break++
+                     : static_cast<uint32_t>(
+                           std::lower_bound(shapes.begin(), shapes.end(), shape(stream[i]))
+                           - shapes.begin());
+    offsets[i + 1] = offsets[i] + stream[i].info.size;
+  }
+
+  std::vector<uint32_t> sa, lcp;
+  {
+    FUSION_PHASE(Scan);
+    sa = suffix_array(symbols, next_break);
+    lcp = lcp_array(symbols, sa);
+  }
+
+  // Every smallest window of the suffix array with a suffix from each function shares its
+  // minimum LCP; the longest such prefix in bytes is the answer
+  std::vector<uint32_t> seen(count + 1);
+  std::deque<size_t> minimum; // Window positions with increasing LCP
+  uint32_t covered = 0;
+  uint64_t best_bytes = 0;
+  size_t best_left = 0, best_right = 0, best_length = 0;
+  for (size_t left = 0, right = 0; right < n; ++right) {
+    const uint32_t added = stream[sa[right]].function;
+    if (added != count && seen[added]++ == 0) ++covered;
+    while (!minimum.empty() && lcp[minimum.back()] >= lcp[right]) {
+      minimum.pop_back();
+    }
+    minimum.push_back(right);
+
+    for (; covered == count; ++left) {
+      while (minimum.front() <= left) {
+        minimum.pop_front();
+      }
+      const size_t length = lcp[minimum.front()];
+      const uint64_t bytes = offsets[sa[right] + length] - offsets[sa[right]];
+      if (bytes > best_bytes) {
+        best_bytes = bytes;
+        best_left = left;
+        best_right = right;
+        best_length = length;
+      }
+
+      const uint32_t removed = stream[sa[left]].function;
+      if (removed != count && --seen[removed] == 0) --covered;
+    }
+  }
+  if (best_bytes == 0) return std::nullopt;
+
+  // One copy per function, all of the same shape, merged into a single pattern
+  std::vector<size_t> copies(count, SIZE_MAX);
+  for (size_t i = best_left; i <= best_right; ++i) {
+    const uint32_t function = stream[sa[i]].function;
+    if (function != count && copies[function] == SIZE_MAX) copies[function] = sa[i];
+  }
+
+  CommonPattern result;
+  result.instructions = best_length;
+  for (size_t k = 0; k < best_length; ++k) {
+    const StreamInsn& first = stream[copies[0] + k];
+    for (uint32_t i = 0; i < first.info.size; ++i) {
+      uint8_t mask = 0xFF;
+      for (const size_t copy : copies) {
+        const StreamInsn& insn = stream[copy + k];
+        const uint8_t differ = insn.bytes[i] ^ first.bytes[i];
+        if (insn.info.is_wildcard(i)) mask = 0x00;
+        if (differ & 0xF0) mask &= 0x0F;
+        if (differ & 0x0F) mask &= 0xF0;
+      }
+      result.pattern.add_byte(first.bytes[i], mask);
+    }
+  }
+
+  CompiledPattern& pattern = result.pattern;
+  while (!pattern.empty() && pattern.mask.back() == 0x00) {
+    pattern.bytes.pop_back();
+    pattern.mask.pop_back();
+  }
+  const auto leading = std::find_if(
+      pattern.mask.begin(), pattern.mask.end(), [](uint8_t mask) { return mask != 0x00; });
+  const auto leading_wildcards = static_cast<size_t>(leading - pattern.mask.begin());
+  pattern.bytes.erase(pattern.bytes.begin(), pattern.bytes.begin() + leading_wildcards);
+  pattern.mask.erase(pattern.mask.begin(), leading);
+  if (pattern.empty()) return std::nullopt;
+
+  for (const size_t copy : copies) {
+    result.addresses.push_back(stream[copy].address + leading_wildcards);
+  }
+  return result;
+}
+} // namespace fusion
@@ -0,0 +1,441 @@
+﻿#include "fusion/corpus.h"
+#include "fusion/rng.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <initializer_list>
+
+namespace fusion {
+namespace {
+// General-purpose registers bodies use. rsp/rbp hold the frame, and r12/r13 would need
+// SIB or displacement special cases as a base.
+constexpr std::array<uint8_t, 12> data_registers = {0, 1, 2, 3, 6, 7, 8, 9, 10, 11, 14, 15};
+
+/// rel32/disp32 operand whose target is an absolute address, re-encoded when its code moves
+struct Fixup {
+  size_t disp_offset; // Offset of the 4-byte operand in the code region
+  size_t insn_end;    // Offset of the next instruction; the operand is relative to it
+  uint64_t target;
+};
+
+struct Function {
+  size_t start = 0;
+  size_t end = 0;        // After the final ret, before padding
+  size_t body_start = 0; // After the prologue
+  size_t body_end = 0;   // Before the epilogue
+  size_t fixup_begin = 0;
+  size_t fixup_end = 0;
+  size_t instructions = 0;
+  size_t body_instructions = 0;
+};
+
+class Generator {
+public:
+  explicit Generator(const CorpusSettings& settings) : settings_(settings), rng_(settings.seed) {
+    mix_ = {settings.mix.mov_reg, settings.mix.mov_imm, settings.mix.load_store,
+        settings.mix.rip_load, settings.mix.call, settings.mix.branch, settings.mix.alu,
+        settings.mix.sse};
+    for (size_t i = 1; i < mix_.size(); ++i) {
+      mix_[i] += mix_[i - 1];
+    }
+
+    // Data follows the code on the next page, like .rdata after .text
+    const uint64_t code_end = settings.base + settings.size;
+    data_base_ = (code_end + 0xFFF) & ~uint64_t{0xFFF};
+    data_size_ = std::max<uint64_t>(64 << 10, settings.size / 16) & ~uint64_t{7};
+  }
+
+  CorpusStats run(MockDatabase& db) {
+    code_.reserve(settings_.size);
+    while (code_.size() < settings_.size) {
+      const Checkpoint mark = checkpoint();
+      emit_function(false);
+
+      // Retry the last function short, then pad out whatever is left
+      if (code_.size() > settings_.size) {
+        rollback(mark);
+        emit_function(true);
+        if (code_.size() > settings_.size) {
+          rollback(mark);
+          pad(settings_.size - code_.size());
+          break;
+        }
+      }
+      pad(std::min<size_t>(align_gap(), settings_.size - code_.size()));
+    }
+
+    finish(db);
+    return stats_;
+  }
+
+private:
+  enum Kind { MovReg, MovImm, LoadStore, RipLoad, Call, Branch, Alu, Sse };
+
+  uint64_t address() const {
+    return settings_.base + code_.size();
+  }
+
+  void byte(uint8_t value) {
+    code_.push_back(value);
+  }
+
+  void emit(std::initializer_list<uint8_t> bytes) {
+    code_.insert(code_.end(), bytes);
+  }
+
+  void dword(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      byte(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void patch_dword(size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      code_[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+  }
+
+  /// REX prefix for a ModRM instruction, left out when no bit is set
+  void rex(bool wide, uint8_t reg, uint8_t rm) {
+    const uint8_t value = 0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | (rm >> 3);
+    if (value != 0x40) byte(value);
+  }
+
+  void modrm(uint8_t mod, uint8_t reg, uint8_t rm) {
+    byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+  }
+
+  uint8_t data_register() {
+    return data_registers[rng_.below(data_registers.size())];
+  }
+
+  /// Placeholder rel32 ending the current instruction, resolved to `target`
+  void rel32(uint64_t target) {
+    fixups_.push_back({code_.size(), code_.size() + 4, target});
+    dword(0);
+    apply(fixups_.back());
+  }
+
+  void apply(const Fixup& fixup) {
+    const uint64_t next = settings_.base + fixup.insn_end;
+    patch_dword(fixup.disp_offset, static_cast<uint32_t>(fixup.target - next));
+  }
+
+  uint64_t data_address() {
+    return data_base_ + rng_.below(static_cast<uint32_t>(data_size_ / 8)) * 8;
+  }
+
+  struct Checkpoint {
+    size_t code;
+    size_t fixups;
+    size_t functions;
+    CorpusStats stats;
+  };
+
+  Checkpoint checkpoint() const {
+    return {code_.size(), fixups_.size(), functions_.size(), stats_};
+  }
+
+  /// Drop everything emitted since `mark`
+  void rollback(const Checkpoint& mark) {
+    code_.resize(mark.code);
+    fixups_.resize(mark.fixups);
+    functions_.resize(mark.functions);
+    stats_ = mark.stats;
+  }
+
+  size_t align_gap() const {
+    const size_t align = std::max<uint32_t>(settings_.alignment, 1);
+    return (align - code_.size() % align) % align;
+  }
+
+  void pad(size_t count) {
+    if (settings_.padding == CorpusPadding::Int3) {
+      code_.insert(code_.end(), count, 0xCC);
+      return;
+    }
+
+    // The multi-byte nops compilers align with, longest first
+    static constexpr uint8_t nops[][9] = {
+        {0x90},
+        {0x66, 0x90},
+        {0x0F, 0x1F, 0x00},
+        {0x0F, 0x1F, 0x40, 0x00},
+        {0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    };
+    while (count) {
+      const size_t size = std::min<size_t>(count, 9);
+      code_.insert(code_.end(), nops[size - 1], nops[size - 1] + size);
+      count -= size;
+    }
+  }
+
+  void emit_function(bool shortest) {
+    Function function;
+    function.start = code_.size();
+    function.fixup_begin = fixups_.size();
+
+    if (!functions_.empty() && !shortest && rng_.chance(settings_.duplicate_rate)) {
+      copy_function(functions_[rng_.below(static_cast<uint32_t>(functions_.size()))], function);
+      ++stats_.duplicates;
+    } else {
+      const uint32_t variant = rng_.below(4);
+      function.instructions = emit_prologue(variant);
+      function.body_start = code_.size();
+
+      const uint32_t span = settings_.max_instructions > settings_.min_instructions
+                                ? settings_.max_instructions - settings_.min_instructions + 1
+                                : 1;
+      const uint32_t count = shortest ? settings_.min_instructions
+                                      : settings_.min_instructions + rng_.below(span);
+      const uint32_t inline_at =
+          !functions_.empty() && !shortest && rng_.chance(settings_.inline_rate)
+              ? rng_.below(count + 1)
+              : UINT32_MAX;
+      for (uint32_t i = 0; i <= count; ++i) {
+        if (i == inline_at) {
+          const auto& callee = functions_[rng_.below(static_cast<uint32_t>(functions_.size()))];
+          copy_code(callee.body_start, callee.body_end, callee);
+          function.body_instructions += callee.body_instructions;
+          ++stats_.inlined;
+        }
+        if (i < count) {
+          emit_instruction();
+          ++function.body_instructions;
+        }
+      }
+
+      function.body_end = code_.size();
+      function.instructions += function.body_instructions + emit_epilogue(variant);
+    }
+
+    function.end = code_.size();
+    function.fixup_end = fixups_.size();
+    functions_.push_back(function);
+    ++stats_.functions;
+    stats_.instructions += function.instructions;
+  }
+
+  /// Copy the bytes in [begin, end) of earlier code to the end, keeping absolute targets
+  void copy_code(size_t begin, size_t end, const Function& source) {
+    const size_t offset = code_.size();
+    // Grow first: inserting a range of code_ into itself would read through invalidated iterators
+    code_.resize(offset + (end - begin));
+    std::copy(code_.begin() + begin, code_.begin() + end, code_.begin() + offset);
+
+    for (size_t i = source.fixup_begin; i < source.fixup_end; ++i) {
+      const Fixup fixup = fixups_[i];
+      if (fixup.disp_offset < begin || fixup.insn_end > end) continue;
+      fixups_.push_back(
+          {fixup.disp_offset - begin + offset, fixup.insn_end - begin + offset, fixup.target});
+      apply(fixups_.back());
+    }
+  }
+
+  void copy_function(const Function& source, Function& copy) {
+    const size_t offset = code_.size();
+    copy_code(source.start, source.end, source);
+    copy.body_start = source.body_start - source.start + offset;
+    copy.body_end = source.body_end - source.start + offset;
+    copy.instructions = source.instructions;
+    copy.body_instructions = source.body_instructions;
+  }
+
+  /// Frame setup in one of the shapes MSVC, GCC and Clang emit; returns its instruction count
+  size_t emit_prologue(uint32_t variant) {
+    switch (variant) {
+    case 0: // push rbp; mov rbp, rsp; sub rsp, imm8
+      emit({0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC});
+      byte(static_cast<uint8_t>(0x10 + rng_.below(7) * 0x10));
+      return 3;
+    case 1: // mov [rsp+8], rbx; push rdi; sub rsp, 0x20
+      emit({0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20});
+      return 3;
+    case 2: // push rbx; sub rsp, imm32
+      emit({0x53, 0x48, 0x81, 0xEC});
+      dword(0x100 + rng_.below(64) * 0x10);
+      return 2;
+    default: // sub rsp, 0x28
+      emit({0x48, 0x83, 0xEC, 0x28});
+      return 1;
+    }
+  }
+
+  /// Frame teardown matching emit_prologue, ending in ret; returns its instruction count
+  size_t emit_epilogue(uint32_t variant) {
+    switch (variant) {
+    case 0: // leave; ret
+      emit({0xC9, 0xC3});
+      return 2;
+    case 1: // mov rbx, [rsp+0x30]; add rsp, 0x20; pop rdi; ret
+      emit({0x48, 0x8B, 0x5C, 0x24, 0x30, 0x48, 0x83, 0xC4, 0x20, 0x5F, 0xC3});
+      return 4;
+    case 2: // add rsp, imm32; pop rbx; ret
+      emit({0x48, 0x81, 0xC4});
+      dword(0x100);
+      emit({0x5B, 0xC3});
+      return 3;
+    default: // add rsp, 0x28; ret
+      emit({0x48, 0x83, 0xC4, 0x28, 0xC3});
+      return 2;
+    }
+  }
+
+  void emit_instruction() {
+    const uint32_t total = mix_.back();
+    const uint32_t pick = total ? rng_.below(total) : 0;
+    const Kind kind = total ? static_cast<Kind>(std::upper_bound(mix_.begin(), mix_.end(), pick)
+                                                - mix_.begin())
+                            : Alu;
+
+    const uint8_t reg = data_register();
+    const uint8_t rm = data_register();
+    switch (kind) {
+    case MovReg:
+      rex(true, reg, rm);
+      byte(0x89);
+      modrm(3, reg, rm);
+      break;
+
+    case MovImm:
+      if (reg >= 8) byte(0x41);
+      byte(static_cast<uint8_t>(0xB8 + (reg & 7)));
+      dword(static_cast<uint32_t>(rng_.next()));
+      break;
+
+    case LoadStore: {
+      const uint8_t opcode = rng_.chance(0.6) ? 0x8B : 0x89;
+      const auto disp = static_cast<uint8_t>(rng_.below(16) * 8);
+      if (rng_.chance(0.5)) {
+        // [rsp + disp8] needs a SIB byte
+        rex(true, reg, 0);
+        byte(opcode);
+        modrm(1, reg, 4);
+        emit({0x24, disp});
+      } else {
+        rex(true, reg, rm);
+        byte(opcode);
+        modrm(1, reg, rm);
+        byte(disp);
+      }
+      break;
+    }
+
+    case RipLoad:
+      rex(true, reg, 0);
+      byte(rng_.chance(0.7) ? 0x8B : 0x8D);
+      modrm(0, reg, 5);
+      rel32(data_address());
+      break;
+
+    case Call:
+      if (!functions_.empty() && rng_.chance(0.75)) {
+        byte(0xE8);
+        const auto& callee = functions_[rng_.below(static_cast<uint32_t>(functions_.size()))];
+        rel32(settings_.base + callee.start);
+      } else {
+        // Import call through a pointer in the data region
+        emit({0xFF, 0x15});
+        rel32(data_address());
+      }
+      break;
+
+    case Branch: {
+      const uint32_t form = rng_.below(4);
+      const auto cc = static_cast<uint8_t>(rng_.below(16));
+      if (form == 0) {
+        emit({static_cast<uint8_t>(0x70 + cc), static_cast<uint8_t>(2 + rng_.below(48))});
+      } else if (form == 1) {
+        emit({0xEB, static_cast<uint8_t>(2 + rng_.below(48))});
+      } else if (form == 2) {
+        emit({0x0F, static_cast<uint8_t>(0x80 + cc)});
+        dword(0x80 + rng_.below(0x400));
+      } else {
+        byte(0xE9);
+        dword(0x80 + rng_.below(0x400));
+      }
+      break;
+    }
+
+    case Alu:
+      if (rng_.chance(0.5)) {
+        static constexpr uint8_t opcodes[] = {0x01, 0x29, 0x21, 0x09, 0x31, 0x39, 0x85};
+        rex(true, reg, rm);
+        byte(opcodes[rng_.below(7)]);
+        modrm(3, reg, rm);
+      } else {
+        static constexpr uint8_t extensions[] = {0, 5, 4, 1, 6, 7};
+        rex(true, 0, rm);
+        byte(0x83);
+        modrm(3, extensions[rng_.below(6)], rm);
+        byte(static_cast<uint8_t>(rng_.below(0x80)));
+      }
+      break;
+
+    case Sse: {
+      const uint8_t xmm = static_cast<uint8_t>(rng_.below(16));
+      const uint32_t form = rng_.below(3);
+      rex(false, xmm, form == 2 ? xmm : 0);
+      if (form == 2) {
+        // xorps xmm, xmm
+        emit({0x0F, 0x57});
+        modrm(3, xmm, xmm);
+      } else {
+        // movups xmm, [rsp + disp8] / movaps [rsp + disp8], xmm
+        emit({0x0F, static_cast<uint8_t>(form == 0 ? 0x10 : 0x29)});
+        modrm(1, xmm, 4);
+        emit({0x24, static_cast<uint8_t>(0x20 + rng_.below(6) * 0x10)});
+      }
+      break;
+    }
+    }
+  }
+
+  void finish(MockDatabase& db) {
+    db.snapshot.regions.clear();
+    db.snapshot.regions.push_back({settings_.base, std::move(code_)});
+
+    SnapshotRegion& data = db.snapshot.regions.emplace_back();
+    data.start = data_base_;
+    data.bytes.resize(data_size_);
+    for (size_t i = 0; i < data.bytes.size(); i += 8) {
+      const uint64_t value = rng_.next();
+      std::copy_n(reinterpret_cast<const uint8_t*>(&value), 8, data.bytes.begin() + i);
+    }
+
+    db.functions.clear();
+    db.functions.reserve(functions_.size());
+    for (const auto& function : functions_) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "sub_%llX",
+          static_cast<unsigned long long>(settings_.base + function.start));
+      db.functions.push_back(
+          {settings_.base + function.start, settings_.base + function.end, name});
+    }
+
+    db.x64 = true;
+    db.selected.reset();
+    db.cursor_ea = db.functions.empty() ? settings_.base : db.functions.front().start;
+  }
+
+  const CorpusSettings& settings_;
+  Rng rng_;
+  std::vector<uint8_t> code_;
+  std::array<uint32_t, 8> mix_{};
+  uint64_t data_base_ = 0;
+  uint64_t data_size_ = 0;
+  std::vector<Function> functions_;
+  std::vector<Fixup> fixups_;
+  CorpusStats stats_;
+};
+} // namespace
+
+CorpusStats generate_corpus(const CorpusSettings& settings, MockDatabase& db) {
+  return Generator(settings).run(db);
+}
+} // namespace fusion
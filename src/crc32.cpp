@@ -0,0 +1,194 @@
+﻿#include "fusion/crc32.h"
+#include "fusion/parallel.h"
+#include "fusion/profile.h"
+#include "fusion/trace.h"
+
+#include <algorithm>
+#include <array>
+
+namespace fusion {
+namespace {
+constexpr std::array<uint32_t, 256> make_crc_table() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr auto crc_table = make_crc_table();
+
+// Windows per work item; small enough to balance threads, large enough to amortize the
+// initial full CRC of each chunk
+constexpr size_t chunk_windows = 1 << 20;
+
+// Chunks shorter than this are rolled as a single lane
+constexpr size_t min_lane_windows = 256;
+
+constexpr size_t lane_count = 4;
+
+inline uint32_t crc_step(uint32_t reg, uint8_t byte) {
+  return (reg >> 8) ^ crc_table[(reg ^ byte) & 0xFF];
+}
+
+/// Lookup table for sliding a fixed-length CRC window one byte forward.
+/// CRC-32 is affine over GF(2), so the byte leaving the window contributes a fixed value that
+/// only depends on the window length. The init vector's drift is folded into the same table.
+struct RollingTable {
+  explicit RollingTable(size_t length) {
+    uint32_t init_n = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; ++i) {
+      init_n = crc_step(init_n, 0);
+    }
+    const uint32_t init_drift = init_n ^ crc_step(init_n, 0);
+
+    // Contribution of each single-bit byte after it has been shifted through the window
+    uint32_t bit_contrib[8];
+    for (int bit = 0; bit < 8; ++bit) {
+      uint32_t reg = crc_step(0, static_cast<uint8_t>(1 << bit));
+      for (size_t i = 0; i < length; ++i) {
+        reg = crc_step(reg, 0);
+      }
+      bit_contrib[bit] = reg;
+    }
+
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+      uint32_t contrib = 0;
+      for (int bit = 0; bit < 8; ++bit) {
+        if (byte & (1u << bit)) contrib ^= bit_contrib[bit];
+      }
+      out[byte] = contrib ^ init_drift;
+    }
+  }
+
+  uint32_t out[256];
+};
+
+struct Chunk {
+  const SnapshotRegion* region;
+  size_t first;
+  size_t count;
+};
+
+inline uint32_t window_register(const uint8_t* data, size_t length) {
+  uint32_t reg = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; ++i) {
+    reg = crc_step(reg, data[i]);
+  }
+  return reg;
+}
+
+// Roll `count` consecutive windows starting at `first`, appending matching offsets
+void roll_lane(const uint8_t* data,
+    size_t first,
+    size_t count,
+    size_t length,
+    uint32_t target,
+    const RollingTable& table,
+    std::vector<size_t>& matches) {
+  uint32_t reg = window_register(data + first, length);
+  for (size_t pos = first;; ++pos) {
+    if (reg == target) matches.push_back(pos);
+    if (pos + 1 >= first + count) break;
+    reg = crc_step(reg, data[pos + length]) ^ table.out[data[pos]];
+  }
+}
+
+void scan_chunk(const Chunk& chunk,
+    size_t length,
+    uint32_t target,
+    const RollingTable& table,
+    std::vector<uint64_t>& results) {
+  const uint8_t* data = chunk.region->bytes.data();
+  std::vector<size_t> matches;
+
+  if (chunk.count < min_lane_windows * lane_count) {
+    roll_lane(data, chunk.first, chunk.count, length, target, table, matches);
+  } else {
+    // Roll several independent stripes in lockstep so the table lookups of different lanes can
+    // overlap instead of forming one long dependency chain
+    const size_t stripe = chunk.count / lane_count;
+    size_t pos[lane_count];
+    uint32_t reg[lane_count];
+    std::vector<size_t> lane_matches[lane_count];
+
+    for (size_t lane = 0; lane < lane_count; ++lane) {
+      pos[lane] = chunk.first + lane * stripe;
+      reg[lane] = window_register(data + pos[lane], length);
+    }
+
+    for (size_t step = 0;; ++step) {
+      for (size_t lane = 0; lane < lane_count; ++lane) {
+        if (reg[lane] == target) lane_matches[lane].push_back(pos[lane]);
+      }
+      if (step + 1 == stripe) break;
+      for (size_t lane = 0; lane < lane_count; ++lane) {
+        reg[lane] = crc_step(reg[lane], data[pos[lane] + length]) ^ table.out[data[pos[lane]]];
+        ++pos[lane];
+      }
+    }
+
+    // The last lane also owns the remainder of the chunk
+    const size_t tail_end = chunk.first + chunk.count;
+    size_t& tail_pos = pos[lane_count - 1];
+    uint32_t& tail_reg = reg[lane_count - 1];
+    while (tail_pos + 1 < tail_end) {
+      tail_reg = crc_step(tail_reg, data[tail_pos + length]) ^ table.out[data[tail_pos]];
+      ++tail_pos;
+      if (tail_reg == target) lane_matches[lane_count - 1].push_back(tail_pos);
+    }
+
+    for (const auto& lane : lane_matches) {
+      matches.insert(matches.end(), lane.begin(), lane.end());
+    }
+  }
+
+  for (size_t offset : matches) {
+    results.push_back(chunk.region->start + offset);
+  }
+}
+} // namespace
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+  return ~window_register(data, size);
+}
+
+std::vector<uint64_t> find_crc32(
+    const ImageSnapshot& snapshot, uint32_t hash, size_t length, unsigned max_threads) {
+  std::vector<uint64_t> results;
+  if (length == 0) return results;
+
+  FUSION_PHASE(Scan);
+  FUSION_TRACE("find_crc32", "window", length);
+  FUSION_COUNT(Scans, 1);
+
+  std::vector<Chunk> chunks;
+  for (const auto& region : snapshot.regions) {
+    FUSION_COUNT(BytesScanned, region.bytes.size());
+    if (region.bytes.size() < length) continue;
+    const size_t windows = region.bytes.size() - length + 1;
+    for (size_t first = 0; first < windows; first += chunk_windows) {
+      chunks.push_back({&region, first, std::min(chunk_windows, windows - first)});
+    }
+  }
+  if (chunks.empty()) return results;
+
+  const RollingTable table(length);
+  const uint32_t target = ~hash;
+
+  std::vector<std::vector<uint64_t>> chunk_results(chunks.size());
+  parallel_for(chunks.size(), max_threads, [&](size_t i) {
+    FUSION_TRACE("crc32_chunk", "windows", chunks[i].count);
+    scan_chunk(chunks[i], length, target, table, chunk_results[i]);
+  });
+
+  for (const auto& chunk : chunk_results) {
+    results.insert(results.end(), chunk.begin(), chunk.end());
+  }
+  return results;
+}
+} // namespace fusion
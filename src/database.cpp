@@ -0,0 +1,173 @@
+﻿#include "fusion/database.h"
+
+#include "fusion/image.h"
+#include "fusion/mapped_file.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fusion {
+namespace {
+constexpr char mock_database_magic[4] = {'F', 'M', 'D', 'B'};
+
+template <typename T>
+void write_value(std::ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool read_value(std::ifstream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+void write_string(std::ofstream& out, const std::string& text) {
+  write_value(out, static_cast<uint32_t>(text.size()));
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+// Whether `count` items of at least `item_size` bytes each fit before `end`, so counts from a
+// damaged file are rejected before anything is allocated for them
+bool fits(std::ifstream& in, uint64_t end, uint64_t count, uint64_t item_size) {
+  const auto position = in.tellg();
+  if (position < 0 || static_cast<uint64_t>(position) > end) return false;
+  return count <= (end - static_cast<uint64_t>(position)) / item_size;
+}
+
+bool read_string(std::ifstream& in, uint64_t end, std::string& text) {
+  uint32_t size = 0;
+  if (!read_value(in, size) || !fits(in, end, size, 1)) return false;
+  text.resize(size);
+  return static_cast<bool>(in.read(text.data(), size));
+}
+} // namespace
+
+std::optional<FunctionInfo> MockDatabase::function_at(uint64_t address) const {
+  // First function starting after `address`; its predecessor is the only candidate
+  auto it = std::upper_bound(functions.begin(), functions.end(), address,
+      [](uint64_t value, const FunctionInfo& function) { return value < function.start; });
+  if (it == functions.begin()) return std::nullopt;
+
+  --it;
+  if (address >= it->end) return std::nullopt;
+  return *it;
+}
+
+std::vector<uint64_t> MockDatabase::function_starts() const {
+  std::vector<uint64_t> starts;
+  starts.reserve(functions.size());
+  for (const auto& function : functions) {
+    starts.push_back(function.start);
+  }
+  return starts;
+}
+
+bool save_mock_database(const std::string& path, const MockDatabase& db) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+
+  out.write(mock_database_magic, sizeof(mock_database_magic));
+  write_value(out, mock_database_version);
+  write_value(out, static_cast<uint8_t>(db.x64));
+  write_value(out, db.cursor_ea);
+  write_value(out, static_cast<uint8_t>(db.selected.has_value()));
+  if (db.selected) {
+    write_value(out, db.selected->start);
+    write_value(out, db.selected->end);
+  }
+
+  write_value(out, static_cast<uint32_t>(db.snapshot.regions.size()));
+  for (const auto& region : db.snapshot.regions) {
+    write_value(out, region.start);
+    write_value(out, static_cast<uint64_t>(region.bytes.size()));
+    out.write(reinterpret_cast<const char*>(region.bytes.data()),
+        static_cast<std::streamsize>(region.bytes.size()));
+  }
+
+  write_value(out, static_cast<uint32_t>(db.functions.size()));
+  for (const auto& function : db.functions) {
+    write_value(out, function.start);
+    write_value(out, function.end);
+    write_string(out, function.name);
+  }
+  return static_cast<bool>(out);
+}
+
+bool load_mock_database(const std::string& path, MockDatabase& db) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  const auto end = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+
+  char magic[sizeof(mock_database_magic)];
+  uint32_t version = 0;
+  if (!in.read(magic, sizeof(magic))
+      || !std::equal(magic, magic + sizeof(magic), mock_database_magic)) {
+    return false;
+  }
+  if (!read_value(in, version) || version != mock_database_version) return false;
+
+  uint8_t x64 = 0, has_selection = 0;
+  if (!read_value(in, x64) || !read_value(in, db.cursor_ea) || !read_value(in, has_selection)) {
+    return false;
+  }
+  db.x64 = x64 != 0;
+
+  db.selected.reset();
+  if (has_selection) {
+    AddressRange range;
+    if (!read_value(in, range.start) || !read_value(in, range.end)) return false;
+    db.selected = range;
+  }
+
+  uint32_t region_count = 0;
+  // Each region has at least its start and size, each function its bounds and name length
+  if (!read_value(in, region_count) || !fits(in, end, region_count, 16)) return false;
+  db.snapshot.regions.clear();
+  db.snapshot.regions.reserve(region_count);
+  for (uint32_t i = 0; i < region_count; ++i) {
+    SnapshotRegion region;
+    uint64_t size = 0;
+    if (!read_value(in, region.start) || !read_value(in, size) || !fits(in, end, size, 1)) {
+      return false;
+    }
+
+    region.bytes.resize(size);
+    if (!in.read(reinterpret_cast<char*>(region.bytes.data()), static_cast<std::streamsize>(size))) {
+      return false;
+    }
+    db.snapshot.regions.push_back(std::move(region));
+  }
+
+  uint32_t function_count = 0;
+  if (!read_value(in, function_count) || !fits(in, end, function_count, 20)) return false;
+  db.functions.clear();
+  db.functions.reserve(function_count);
+  for (uint32_t i = 0; i < function_count; ++i) {
+    FunctionInfo function;
+    if (!read_value(in, function.start) || !read_value(in, function.end)
+        || !read_string(in, end, function.name)) {
+      return false;
+    }
+    db.functions.push_back(std::move(function));
+  }
+  return true;
+}
+
+bool load_reference_image(const std::string& path, ImageSnapshot& out) {
+  out = {};
+  if (MockDatabase db; load_mock_database(path, db)) {
+    out = std::move(db.snapshot);
+    return true;
+  }
+
+  MappedFile file;
+  if (!file.open(path) || file.size() == 0) return false;
+
+  if (ImageLayout layout; parse_image(file.data(), file.size(), layout)) {
+    out = read_snapshot(FileImageSource(file.data(), file.size(), layout));
+  } else {
+    out.regions.push_back({0, std::vector<uint8_t>(file.data(), file.data() + file.size())});
+  }
+  return true;
+}
+} // namespace fusion
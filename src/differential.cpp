@@ -0,0 +1,376 @@
+﻿#include "fusion/differential.h"
+#include "fusion/database.h"
+#include "fusion/export.h"
+#include "fusion/library.h"
+#include "fusion/runtime_scan.h"
+#include "fusion/scanner.h"
+#include "fusion/signature.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <span>
+#include <string_view>
+
+namespace fusion {
+namespace {
+/// Database over an image owned by the caller, for engines that search through find_signature
+class ImageDatabase : public Database {
+public:
+  explicit ImageDatabase(const ImageSnapshot& image) : image_(image) {}
+
+  [[nodiscard]] const ImageSnapshot& image() const override {
+    return image_;
+  }
+  [[nodiscard]] const InsnDecoder& decoder() const override {
+    return decoder_;
+  }
+  [[nodiscard]] std::optional<FunctionInfo> function_at(uint64_t) const override {
+    return std::nullopt;
+  }
+  [[nodiscard]] std::vector<uint64_t> function_starts() const override {
+    return {};
+  }
+  [[nodiscard]] std::optional<AddressRange> selection() const override {
+    return std::nullopt;
+  }
+  [[nodiscard]] uint64_t cursor() const override {
+    return 0;
+  }
+
+private:
+  const ImageSnapshot& image_;
+  X86Decoder decoder_;
+};
+
+PatternMatches scan_each(const ImageSnapshot& image,
+    const std::vector<SignatureRecord>& patterns,
+    const FindSettings& settings,
+    unsigned max_threads) {
+  PatternMatches matches;
+  matches.reserve(patterns.size());
+  for (const auto& record : patterns) {
+    matches.push_back(
+        filter_matches(scan_pattern(image, record.pattern.view(), max_threads), settings));
+  }
+  return matches;
+}
+
+PatternMatches scan_with_library(const ImageSnapshot& image,
+    const std::vector<SignatureRecord>& patterns,
+    const FindSettings& settings) {
+  // Names carry the pattern index through the library's own entry order
+  std::vector<SignatureRecord> records = patterns;
+  for (size_t i = 0; i < records.size(); ++i) {
+    records[i].name = std::to_string(i);
+  }
+
+  PatternMatches matches(patterns.size());
+  std::vector<uint8_t> data;
+  SignatureLibrary library;
+  if (!build_library(records, data) || !library.attach(data.data(), data.size())) return matches;
+
+  for (const auto& match : scan_library(image, library)) {
+    const std::string_view name = library.name(match.entry);
+    matches[std::stoul(std::string(name))].push_back(match.address);
+  }
+  for (auto& list : matches) {
+    list = filter_matches(list, settings);
+  }
+  return matches;
+}
+
+PatternMatches scan_with_pattern_set(const ImageSnapshot& image,
+    const std::vector<SignatureRecord>& patterns,
+    const FindSettings& settings) {
+  // Lay the patterns out the way render_cpp_header does, bucketed by anchor byte value
+  std::vector<std::pair<size_t, size_t>> order; // Pattern index, anchor
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    order.emplace_back(i, choose_anchor_byte(patterns[i].pattern.view()).value_or(0));
+  }
+  std::stable_sort(order.begin(), order.end(), [&](const auto& a, const auto& b) {
+    return patterns[a.first].pattern.bytes[a.second] < patterns[b.first].pattern.bytes[b.second];
+  });
+
+  std::vector<uint8_t> bytes, masks;
+  std::vector<runtime::PatternEntry> entries;
+  std::vector<uint32_t> buckets(257, 0);
+  for (const auto& [index, anchor] : order) {
+    const auto& pattern = patterns[index].pattern;
+    entries.push_back({static_cast<uint32_t>(bytes.size()), static_cast<uint16_t>(pattern.size()),
+        static_cast<uint16_t>(anchor), 0, nullptr});
+    bytes.insert(bytes.end(), pattern.bytes.begin(), pattern.bytes.end());
+    masks.insert(masks.end(), pattern.mask.begin(), pattern.mask.end());
+    ++buckets[pattern.bytes[anchor] + 1];
+  }
+  for (size_t i = 1; i < buckets.size(); ++i) {
+    buckets[i] += buckets[i - 1];
+  }
+
+  const runtime::PatternSet set = {
+      bytes.data(), masks.data(), entries.data(), entries.size(), buckets.data()};
+  PatternMatches matches(patterns.size());
+  for (const auto& region : image.regions) {
+    const uint8_t* begin = region.bytes.data();
+    set.for_each_match(begin, begin + region.bytes.size(), [&](size_t entry, const uint8_t* at) {
+      matches[order[entry].first].push_back(region.start + static_cast<uint64_t>(at - begin));
+    });
+  }
+  for (auto& list : matches) {
+    list = filter_matches(list, settings);
+  }
+  return matches;
+}
+
+PatternMatches scan_with_find_signature(const ImageSnapshot& image,
+    const std::vector<SignatureRecord>& patterns,
+    const FindSettings& settings) {
+  // Round-trips every pattern through its IDA-style text as well
+  const ImageDatabase db(image);
+  PatternMatches matches;
+  for (const auto& record : patterns) {
+    const auto found = find_signature(db, render_ida_pattern(record.pattern), settings);
+    matches.push_back(found.value_or(std::vector<uint64_t>{}));
+  }
+  return matches;
+}
+
+// Input bytes consumed as decisions, in order; reads past the end give zeros
+class Choices {
+public:
+  Choices(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  /// Little-endian value of the next `bytes` (at most 4) input bytes
+  uint32_t take(size_t bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; ++i, ++next_) {
+      if (next_ < size_) value |= uint32_t{data_[next_]} << (8 * i);
+    }
+    return value;
+  }
+
+private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t next_ = 0;
+};
+
+// Decision bytes of a workload: two region splits and the start filter
+constexpr size_t workload_choice_bytes = 2 * 2 + 2;
+// Three mask bits for each of up to 24 pattern bytes
+constexpr size_t pattern_mask_bytes = 9;
+// Decision bytes of a pattern: length, offset, placement, tweak, forced exact byte and masks
+constexpr size_t pattern_choice_bytes = 1 + 2 + 1 + 1 + 1 + pattern_mask_bytes;
+} // namespace
+
+std::vector<uint64_t> naive_scan(
+    const ImageSnapshot& image, const PatternView& pattern, const FindSettings& settings) {
+  std::vector<uint64_t> matches;
+  if (pattern.size == 0) return matches;
+
+  for (const auto& region : image.regions) {
+    for (size_t pos = 0; pos + pattern.size <= region.bytes.size(); ++pos) {
+      bool match = true;
+      for (size_t i = 0; i < pattern.size && match; ++i) {
+        match = (region.bytes[pos + i] & pattern.mask[i]) == pattern.bytes[i];
+      }
+
+      const uint64_t address = region.start + pos;
+      if (!match || address < settings.start_addr || address == settings.ignore_addr) continue;
+
+      matches.push_back(address);
+      if (settings.stop_at_first) return matches;
+    }
+  }
+  return matches;
+}
+
+std::vector<ScanEngine> scan_engines() {
+  return {
+      {"naive",
+          [](const ImageSnapshot& image, const std::vector<SignatureRecord>& patterns,
+              const FindSettings& settings) {
+            PatternMatches matches;
+            for (const auto& record : patterns) {
+              matches.push_back(naive_scan(image, record.pattern.view(), settings));
+            }
+            return matches;
+          }},
+      {"scan_pattern/1-thread",
+          [](const ImageSnapshot& image, const std::vector<SignatureRecord>& patterns,
+              const FindSettings& settings) { return scan_each(image, patterns, settings, 1); }},
+      {"scan_pattern",
+          [](const ImageSnapshot& image, const std::vector<SignatureRecord>& patterns,
+              const FindSettings& settings) { return scan_each(image, patterns, settings, 0); }},
+      {"scan_library", scan_with_library},
+      {"runtime::PatternSet", scan_with_pattern_set},
+      {"find_signature", scan_with_find_signature},
+  };
+}
+
+DiffWorkload make_diff_workload(const uint8_t* data, size_t size) {
+  // The first bytes pick the shape and the last bytes every later decision, a fixed number per
+  // pattern. The bytes between become the image. A mutated byte changes one decision or one
+  // image byte rather than reseeding the whole workload.
+  uint8_t header[4] = {};
+  std::copy_n(data, std::min<size_t>(size, sizeof(header)), header);
+  const size_t skip = std::min<size_t>(size, sizeof(header));
+  data += skip;
+  size -= skip;
+
+  const size_t pattern_count = 1 + header[2] % 16;
+  const size_t tail = std::min(size, workload_choice_bytes + pattern_count * pattern_choice_bytes);
+  Choices choices(data + size - tail, tail);
+  size -= tail;
+
+  // A small alphabet makes overlapping matches common
+  std::vector<uint8_t> content(data, data + size);
+  if (content.empty()) content.push_back(header[0]);
+  switch (header[1] % 4) {
+  case 1:
+    for (auto& byte : content) byte = 0x40 | (byte & 0x07);
+    break;
+  case 2:
+    for (auto& byte : content) byte = 0x90 | (byte & 0x01);
+    break;
+  default:
+    break;
+  }
+
+  // Regions are usually adjacent, so patterns cut across a boundary are contiguous in address
+  // space but must still not match there
+  DiffWorkload workload;
+  const size_t region_count = std::min<size_t>(1 + header[0] % 3, content.size());
+  std::vector<size_t> splits = {0, content.size()};
+  for (size_t i = 1; i < 3; ++i) {
+    const size_t split = choices.take(2);
+    if (i < region_count) splits.push_back(1 + split % (content.size() - 1));
+  }
+  std::sort(splits.begin(), splits.end());
+  splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+
+  uint64_t address = 0x10000;
+  for (size_t i = 0; i + 1 < splits.size(); ++i) {
+    SnapshotRegion region;
+    region.start = address;
+    region.bytes.assign(content.begin() + splits[i], content.begin() + splits[i + 1]);
+    address = region.end() + (header[3] & 0x08 ? 0x1000 : 0);
+    workload.image.regions.push_back(std::move(region));
+  }
+  const auto address_of = [&](size_t offset) {
+    const auto next = std::upper_bound(splits.begin(), splits.end(), offset);
+    const size_t region = static_cast<size_t>(next - splits.begin()) - 1;
+    return workload.image.regions[region].start + (offset - splits[region]);
+  };
+  const size_t start_choice = choices.take(2);
+
+  size_t first_cut = 0;
+  for (size_t i = 0; i < pattern_count; ++i) {
+    const size_t length = 1 + choices.take(1) % std::min<size_t>(24, content.size());
+    size_t offset = choices.take(2) % (content.size() - length + 1);
+    if (const uint8_t place = choices.take(1); splits.size() > 2 && place % 4 == 0) {
+      // Straddle a region boundary
+      const size_t boundary = splits[1 + (place >> 2) % (splits.size() - 2)];
+      offset = std::min(boundary - std::min(boundary, length / 2), content.size() - length);
+    }
+    if (i == 0) first_cut = offset;
+    const uint8_t tweak = choices.take(1);
+    const uint8_t exact_at = choices.take(1);
+
+    // Three bits pick each byte's mask: mostly exact, sometimes a nibble or a wildcard
+    uint8_t mask_bits[pattern_mask_bytes + 1] = {};
+    for (auto& byte : std::span(mask_bits, pattern_mask_bytes)) {
+      byte = choices.take(1);
+    }
+
+    SignatureRecord record;
+    record.name = "pattern_" + std::to_string(i);
+    bool exact = false;
+    for (size_t j = 0; j < length; ++j) {
+      static constexpr uint8_t masks[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xF0, 0x0F, 0x00, 0x00};
+      const size_t bit = j * 3;
+      const unsigned bits = mask_bits[bit / 8] | mask_bits[bit / 8 + 1] << 8;
+      const uint8_t mask = masks[(bits >> bit % 8) & 7];
+      exact |= mask == 0xFF;
+      record.pattern.add_byte(content[offset + j], mask);
+    }
+    if (!exact) {
+      const size_t j = exact_at % length;
+      record.pattern.bytes[j] = content[offset + j];
+      record.pattern.mask[j] = 0xFF;
+    }
+    // Sometimes change an exact byte, so the cut no longer matches where it came from
+    if (tweak % 8 == 0) {
+      for (size_t j = 0; j < length; ++j) {
+        if (record.pattern.mask[j] == 0xFF) {
+          record.pattern.bytes[j] ^= 0x01;
+          break;
+        }
+      }
+    }
+    workload.patterns.push_back(std::move(record));
+  }
+
+  workload.settings.stop_at_first = header[3] & 0x01;
+  if (header[3] & 0x02) {
+    workload.settings.start_addr = address_of(start_choice % content.size());
+  }
+  if (header[3] & 0x04) {
+    workload.settings.ignore_addr = address_of(first_cut);
+  }
+  return workload;
+}
+
+std::string DiffReport::fastest() const {
+  if (seconds.size() < 2) return {};
+  return std::min_element(seconds.begin() + 1, seconds.end(), [](const auto& a, const auto& b) {
+    return a.second < b.second;
+  })->first;
+}
+
+DiffReport diff_engines(const DiffWorkload& workload, const std::vector<ScanEngine>& engines) {
+  using clock = std::chrono::steady_clock;
+  DiffReport report;
+  PatternMatches expected;
+
+  for (size_t e = 0; e < engines.size(); ++e) {
+    const auto start = clock::now();
+    PatternMatches actual = engines[e].scan(workload.image, workload.patterns, workload.settings);
+    report.seconds.emplace_back(
+        engines[e].name, std::chrono::duration<double>(clock::now() - start).count());
+
+    if (e == 0) {
+      expected = std::move(actual);
+      continue;
+    }
+    actual.resize(expected.size());
+    for (size_t p = 0; p < expected.size(); ++p) {
+      if (actual[p] != expected[p]) {
+        report.mismatches.push_back({engines[e].name, p, expected[p], actual[p]});
+      }
+    }
+  }
+  return report;
+}
+
+std::string describe_mismatches(const DiffWorkload& workload, const DiffReport& report) {
+  std::string text;
+  for (const auto& mismatch : report.mismatches) {
+    const auto& expected = mismatch.expected;
+    const auto& actual = mismatch.actual;
+    const auto [e, a] =
+        std::mismatch(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    // The first differing address is either missing from the engine's list or extra in it
+    const bool missing = e != expected.end() && (a == actual.end() || *e < *a);
+    char line[160];
+    std::snprintf(line, sizeof(line), "%s: pattern %zu %s 0x%llX (%zu matches, expected %zu) for ",
+        mismatch.engine.c_str(), mismatch.pattern, missing ? "misses" : "reports",
+        static_cast<unsigned long long>(missing ? *e : *a), actual.size(), expected.size());
+    text += line;
+    text += render_ida_pattern(workload.patterns[mismatch.pattern].pattern);
+    text += '\n';
+  }
+  return text;
+}
+} // namespace fusion
@@ -0,0 +1,175 @@
+﻿#include "fusion/export.h"
+#include "fusion/scanner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+namespace fusion {
+namespace {
+// Array values per line in generated headers
+constexpr size_t values_per_line = 12;
+
+struct ExportItem {
+  const SignatureRecord* record;
+  size_t anchor;
+};
+
+std::string make_identifier(const std::string& name, std::set<std::string>& used) {
+  std::string id;
+  for (char c : name) {
+    id += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0]))) id.insert(0, "sig_");
+
+  std::string unique = id;
+  for (int suffix = 2; used.count(unique); ++suffix) {
+    unique = id + "_" + std::to_string(suffix);
+  }
+  used.insert(unique);
+  return unique;
+}
+
+std::string escape_string(const std::string& text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (std::isprint(static_cast<unsigned char>(c))) {
+      escaped += c;
+    } else {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\x%02X", static_cast<uint8_t>(c));
+      escaped += buf;
+    }
+  }
+  return escaped;
+}
+
+template <typename T>
+void write_array(std::ostringstream& ss, const char* declaration, const std::vector<T>& values) {
+  ss << "inline constexpr " << declaration << " = {";
+  for (size_t i = 0; i < values.size(); ++i) {
+    ss << (i % values_per_line == 0 ? "\n    " : " ");
+    if constexpr (sizeof(T) == 1) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "0x%02X,", values[i]);
+      ss << buf;
+    } else {
+      ss << values[i] << ',';
+    }
+  }
+  ss << "\n};\n\n";
+}
+} // namespace
+
+std::string render_ida_pattern(const CompiledPattern& pattern) {
+  std::ostringstream ss;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (i > 0) ss << ' ';
+
+    const uint8_t mask = pattern.mask[i];
+    if (mask == 0x00) {
+      ss << '?';
+      continue;
+    }
+
+    char buf[4];
+    snprintf(buf, sizeof(buf), "%02X", pattern.bytes[i]);
+    if (!(mask & 0xF0)) buf[0] = '?';
+    if (!(mask & 0x0F)) buf[1] = '?';
+    ss << buf;
+  }
+  return ss.str();
+}
+
+std::string render_composite_pattern(const CompositePattern& pattern) {
+  std::string text;
+  for (size_t i = 0; i < pattern.fragments.size(); ++i) {
+    if (i > 0) {
+      const PatternGap gap = pattern.gaps[i - 1];
+      text += gap.min == gap.max ? " [" + std::to_string(gap.min) + "] "
+                                 : " [" + std::to_string(gap.min) + "-"
+                                       + std::to_string(gap.max) + "] ";
+    }
+    text += render_ida_pattern(pattern.fragments[i]);
+  }
+  return text;
+}
+
+bool render_cpp_header(const std::vector<SignatureRecord>& records,
+    const std::string& namespace_name,
+    std::string& out) {
+  if (records.empty()) return false;
+
+  std::vector<ExportItem> items;
+  items.reserve(records.size());
+  for (const auto& record : records) {
+    const auto anchor = choose_anchor_byte(record.pattern.view());
+    if (!anchor || record.pattern.size() > UINT16_MAX) return false;
+    items.push_back({&record, *anchor});
+  }
+
+  // The runtime scanner buckets entries by the value of their anchor byte
+  std::stable_sort(items.begin(), items.end(), [](const auto& a, const auto& b) {
+    return a.record->pattern.bytes[a.anchor] < b.record->pattern.bytes[b.anchor];
+  });
+
+  std::vector<uint8_t> bytes, masks;
+  std::vector<uint32_t> buckets(257, 0);
+  for (const auto& item : items) {
+    const auto& pattern = item.record->pattern;
+    bytes.insert(bytes.end(), pattern.bytes.begin(), pattern.bytes.end());
+    masks.insert(masks.end(), pattern.mask.begin(), pattern.mask.end());
+    ++buckets[pattern.bytes[item.anchor] + 1];
+  }
+  for (size_t i = 1; i < buckets.size(); ++i) {
+    buckets[i] += buckets[i - 1];
+  }
+
+  std::ostringstream ss;
+  ss << "// Generated by IDA-Fusion. Scan with fusion::runtime::PatternSet from "
+        "fusion/runtime_scan.h.\n"
+     << "#pragma once\n\n"
+     << "#include <fusion/runtime_scan.h>\n\n"
+     << "#include <cstddef>\n"
+     << "#include <cstdint>\n\n"
+     << "namespace " << namespace_name << " {\n";
+
+  write_array(ss, "uint8_t bytes[]", bytes);
+  write_array(ss, "uint8_t masks[]", masks);
+
+  ss << "inline constexpr fusion::runtime::PatternEntry entries[] = {\n";
+  size_t offset = 0;
+  for (const auto& item : items) {
+    const auto& record = *item.record;
+    ss << "    {" << offset << ", " << record.pattern.size() << ", " << item.anchor << ", "
+       << record.offset << ", \"" << escape_string(record.name) << "\"}, // "
+       << render_ida_pattern(record.pattern) << '\n';
+    offset += record.pattern.size();
+  }
+  ss << "};\n\n";
+
+  write_array(ss, "uint32_t buckets[257]", buckets);
+
+  ss << "inline constexpr fusion::runtime::PatternSet set = {bytes, masks, entries, "
+     << items.size() << ", buckets};\n\n";
+
+  ss << "/// Index of each signature in `entries`\n"
+     << "enum Signature : size_t {\n";
+  // Enumerators share the namespace with the arrays above
+  std::set<std::string> used = {"bytes", "masks", "entries", "buckets", "set", "Signature"};
+  for (size_t i = 0; i < items.size(); ++i) {
+    ss << "  " << make_identifier(items[i].record->name, used) << " = " << i << ",\n";
+  }
+  ss << "};\n"
+     << "} // namespace " << namespace_name << '\n';
+
+  out = ss.str();
+  return true;
+}
+} // namespace fusion
+
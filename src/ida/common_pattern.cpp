@@ -0,0 +1,44 @@
+﻿#include "fusion/common_pattern.h"
+#include "fusion/database.h"
+#include "fusion/export.h"
+#include "fusion/scanner.h"
+#include "fusion/settings.h"
+#include "fusion/utils.h"
+
+#include <funcs.hpp>
+#include <kernwin.hpp>
+
+namespace fusion {
+void find_common_pattern(const std::vector<ea_t>& functions) {
+  std::vector<AddressRange> ranges;
+  for (const ea_t start : functions) {
+    if (const func_t* func = get_func(start)) ranges.push_back({func->start_ea, func->end_ea});
+  }
+
+  const IdaDatabase db;
+  const auto common = find_common_pattern(db.image(), db.decoder(), ranges);
+  if (!common) {
+    hide_wait_box();
+    msg("[Fusion] The %zu functions share no instructions\n", ranges.size());
+    beep(beep_default);
+    return;
+  }
+
+  // The shared run may also occur outside the compared functions
+  const std::string result = render_ida_pattern(common->pattern);
+  const size_t matches = scan_pattern(db.image(), common->pattern.view()).size();
+  hide_wait_box();
+
+  for (size_t i = 0; i < common->addresses.size(); ++i) {
+    msg("[Fusion] %zu. 0x%llX\n", i + 1, common->addresses[i]);
+  }
+  msg("[Fusion] %s (%zu instructions, %zu matches in the database)\n",
+      result.c_str(),
+      common->instructions,
+      matches);
+  if (g_settings.has(CopyToClipboard)) {
+    utils::copy_to_clipboard(result.c_str());
+  }
+  beep(beep_default);
+}
+} // namespace fusion
@@ -0,0 +1,106 @@
+﻿#include "fusion/database.h"
+
+#include <funcs.hpp>
+#include <ida.hpp>
+#include <idp.hpp>
+#include <kernwin.hpp>
+
+namespace fusion {
+namespace {
+uint64_t g_database_changes = 0;
+
+ssize_t idaapi on_idb_event(void* /*user_data*/, int code, va_list /*va*/) {
+  switch (code) {
+  case idb_event::byte_patched:
+  case idb_event::segm_added:
+  case idb_event::segm_deleted:
+  case idb_event::segm_start_changed:
+  case idb_event::segm_end_changed:
+  case idb_event::segm_moved:
+  case idb_event::segm_attrs_updated:
+    ++g_database_changes;
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
+
+FunctionInfo function_info(const func_t* func) {
+  FunctionInfo function{func->start_ea, func->end_ea, {}};
+  qstring name;
+  if (get_func_name(&name, func->start_ea) > 0) {
+    function.name = name.c_str();
+  }
+  return function;
+}
+} // namespace
+
+IdaDatabase::IdaDatabase() : snapshot_(take_snapshot()) {}
+
+void watch_database_changes() {
+  hook_to_notification_point(HT_IDB, on_idb_event);
+}
+
+void unwatch_database_changes() {
+  unhook_from_notification_point(HT_IDB, on_idb_event);
+}
+
+uint64_t database_changes() {
+  return g_database_changes;
+}
+
+std::optional<FunctionInfo> IdaDatabase::function_at(uint64_t address) const {
+  const func_t* func = get_func(static_cast<ea_t>(address));
+  if (!func) return std::nullopt;
+  return function_info(func);
+}
+
+std::vector<uint64_t> IdaDatabase::function_starts() const {
+  // Functions are numbered in address order
+  std::vector<uint64_t> starts;
+  const size_t count = get_func_qty();
+  starts.reserve(count);
+  for (size_t n = 0; n < count; ++n) {
+    if (const func_t* func = getn_func(n)) starts.push_back(func->start_ea);
+  }
+  return starts;
+}
+
+std::optional<AddressRange> IdaDatabase::selection() const {
+  ea_t start = 0, end = 0;
+  if (!read_range_selection(nullptr, &start, &end)) return std::nullopt;
+  return AddressRange{start, end};
+}
+
+uint64_t IdaDatabase::cursor() const {
+  return get_screen_ea();
+}
+
+void export_mock_database(const char* path) {
+  show_wait_box("[Fusion] Exporting mock database...");
+
+  const IdaDatabase ida;
+  MockDatabase db;
+  db.snapshot = ida.image();
+  db.selected = ida.selection();
+  db.cursor_ea = ida.cursor();
+  db.x64 = inf_is_64bit();
+
+  const size_t count = get_func_qty();
+  db.functions.reserve(count);
+  for (size_t n = 0; n < count; ++n) {
+    if (const func_t* func = getn_func(n)) {
+      db.functions.push_back(function_info(func));
+    }
+  }
+
+  hide_wait_box();
+  if (!save_mock_database(path, db)) {
+    warning("[Fusion] Failed to write %s", path);
+    return;
+  }
+  msg("[Fusion] Exported %zu bytes and %zu functions to %s\n", db.snapshot.total_size(),
+      db.functions.size(), path);
+}
+} // namespace fusion
@@ -0,0 +1,75 @@
+﻿#include "fusion/export.h"
+#include "fusion/signature.h"
+#include "fusion/trace.h"
+#include "fusion/x86_decoder.h"
+
+#include <funcs.hpp>
+#include <kernwin.hpp>
+
+#include <cstdlib>
+#include <fstream>
+
+namespace fusion {
+static std::vector<SignatureRecord> signatures_for_selection() {
+  std::vector<SignatureRecord> records;
+
+  ea_t start = 0, end = 0;
+  if (!read_range_selection(nullptr, &start, &end)) {
+    start = get_screen_ea();
+    end = start + 1;
+  }
+
+  const ImageSnapshot image = take_snapshot();
+  const InsnDecoder& decoder = signature_decoder();
+
+  func_t* func = get_func(start);
+  if (!func || func->start_ea < start) func = get_next_func(start);
+
+  for (; func && func->start_ea < end; func = get_next_func(func->start_ea)) {
+    if (user_cancelled()) break;
+    replace_wait_box("[Fusion] Creating signature for 0x%llX", static_cast<uint64_t>(func->start_ea));
+
+    SignatureBuilder builder;
+    if (!build_unique_signature(image, decoder, func->start_ea, builder)) {
+      msg("[Fusion] No unique signature for 0x%llX, skipped\n",
+          static_cast<uint64_t>(func->start_ea));
+      continue;
+    }
+
+    builder.trim_wildcards();
+    records.push_back({signature_name(func->start_ea), builder.compile(), 0});
+  }
+
+  return records;
+}
+
+void export_cpp_header(const char* path, bool from_session) {
+  std::vector<SignatureRecord> records;
+  if (from_session) {
+    records = session_signatures();
+  } else {
+    // Batch creation can be traced for Perfetto by pointing $FUSION_TRACE at an output file
+    const char* trace_path = std::getenv("FUSION_TRACE");
+    TraceSession trace(trace_path ? trace_path : "");
+
+    show_wait_box("[Fusion] Creating signatures...");
+    records = signatures_for_selection();
+    hide_wait_box();
+    if (!trace.finish()) msg("[Fusion] Failed to write trace to %s\n", trace_path);
+  }
+
+  std::string header;
+  if (!render_cpp_header(records, "signatures", header)) {
+    warning("[Fusion] No signatures to export.");
+    return;
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  out << header;
+  if (!out) {
+    warning("[Fusion] Failed to write %s", path);
+    return;
+  }
+  msg("[Fusion] Exported %zu signatures to %s\n", records.size(), path);
+}
+} // namespace fusion
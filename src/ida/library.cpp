@@ -0,0 +1,79 @@
+﻿#include "fusion/library.h"
+#include "fusion/scanner.h"
+#include "fusion/snapshot.h"
+#include "fusion/trace.h"
+
+#include <cstdlib>
+
+#include <kernwin.hpp>
+#include <name.hpp>
+
+namespace fusion {
+void apply_signature_library(const char* path) {
+  SignatureLibrary library;
+  if (!library.open(path)) {
+    warning("[Fusion] %s is not a valid signature library.", path);
+    return;
+  }
+
+  const char* trace_path = std::getenv("FUSION_TRACE");
+  TraceSession trace(trace_path ? trace_path : "");
+
+  show_wait_box("[Fusion] Scanning for %zu signatures...", library.size());
+  const auto matches = scan_library(take_snapshot(), library);
+  hide_wait_box();
+  if (!trace.finish()) msg("[Fusion] Failed to write trace to %s\n", trace_path);
+
+  // Matches are grouped by entry; only signatures with exactly one hit are trusted
+  std::vector<std::pair<ea_t, size_t>> unique;
+  size_t multiple = 0;
+  for (size_t i = 0; i < matches.size();) {
+    size_t end = i;
+    while (end < matches.size() && matches[end].entry == matches[i].entry) {
+      ++end;
+    }
+
+    const LibraryEntry& entry = library.entry(matches[i].entry);
+    const std::string name(library.name(matches[i].entry));
+    if (end - i == 1) {
+      const auto target = static_cast<ea_t>(matches[i].address + entry.target_offset);
+      unique.emplace_back(target, matches[i].entry);
+      msg("[Fusion] %s at 0x%llX\n", name.c_str(), static_cast<uint64_t>(target));
+    } else {
+      ++multiple;
+      msg("[Fusion] %s matches %zu times\n", name.c_str(), end - i);
+    }
+    i = end;
+  }
+
+  const size_t missing = library.size() - unique.size() - multiple;
+  msg("[Fusion] %zu unique, %zu multiple, %zu missing\n", unique.size(), multiple, missing);
+  beep(beep_default);
+
+  if (!unique.empty()
+      && ask_yn(ASKBTN_NO, "Rename %zu uniquely matched addresses?", unique.size()) == ASKBTN_YES) {
+    for (const auto& [target, index] : unique) {
+      set_name(target, std::string(library.name(index)).c_str(), SN_NOCHECK | SN_NOWARN | SN_FORCE);
+    }
+  }
+}
+
+void build_signature_library(const char* list_path, const char* library_path) {
+  std::vector<SignatureRecord> records;
+  size_t error_line = 0;
+  if (!read_signature_list(list_path, records, &error_line)) {
+    if (error_line) {
+      warning("[Fusion] Invalid signature on line %zu of %s", error_line, list_path);
+    } else {
+      warning("[Fusion] Failed to read %s", list_path);
+    }
+    return;
+  }
+
+  if (!write_library(library_path, records)) {
+    warning("[Fusion] Failed to write signature library to %s", library_path);
+    return;
+  }
+  msg("[Fusion] Wrote %zu signatures to %s\n", records.size(), library_path);
+}
+} // namespace fusion
@@ -0,0 +1,49 @@
+﻿#include "fusion/revalidate.h"
+
+#include <kernwin.hpp>
+#include <name.hpp>
+
+#include <fstream>
+
+namespace fusion {
+void revalidate_signature_library(const char* library_path, const char* output_path) {
+  SignatureLibrary library;
+  if (!library.open(library_path)) {
+    warning("[Fusion] %s is not a valid signature library.", library_path);
+    return;
+  }
+
+  // Entries that no longer match are found again through the names they were created under
+  const EntryLocator locate = [](std::string_view name) -> std::optional<uint64_t> {
+    const ea_t ea = get_name_ea(BADADDR, std::string(name).c_str());
+    if (ea == BADADDR) return std::nullopt;
+    return static_cast<uint64_t>(ea);
+  };
+
+  show_wait_box("[Fusion] Revalidating %zu signatures...", library.size());
+  const IdaDatabase db;
+  const RevalidationReport report = revalidate_library(library, db, locate);
+  hide_wait_box();
+
+  if (!write_library(output_path, report.updated_records())) {
+    warning("[Fusion] Failed to write signature library to %s", output_path);
+    return;
+  }
+
+  const std::string report_path = std::string(output_path) + ".txt";
+  std::ofstream out(report_path, std::ios::binary);
+  out << format_revalidation_report(report);
+  if (!out) {
+    warning("[Fusion] Failed to write %s", report_path.c_str());
+    return;
+  }
+
+  msg("[Fusion] %zu unique, %zu multiple, %zu missing; regenerated %zu\n",
+      report.count(EntryStatus::Unique),
+      report.count(EntryStatus::Multiple),
+      report.count(EntryStatus::Missing),
+      report.regenerated());
+  msg("[Fusion] Wrote %s and the diff report %s\n", output_path, report_path.c_str());
+  beep(beep_default);
+}
+} // namespace fusion
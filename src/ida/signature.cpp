@@ -0,0 +1,448 @@
+﻿#include "fusion/signature.h"
+#include "fusion/crc32.h"
+#include "fusion/database.h"
+#include "fusion/export.h"
+#include "fusion/profile.h"
+#include "fusion/scanner.h"
+#include "fusion/settings.h"
+#include "fusion/snapshot.h"
+#include "fusion/source.h"
+#include "fusion/tokens.h"
+#include "fusion/utils.h"
+#include "fusion/x86_decoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <bytes.hpp>
+#include <funcs.hpp>
+#include <kernwin.hpp>
+#include <name.hpp>
+
+namespace fusion {
+// Print where `operation` spent its time since the last profile_reset, and append it as a
+// JSON line to $FUSION_PROFILE_JSON when set, for collecting batch runs
+static void report_profile([[maybe_unused]] const char* operation) {
+#ifdef FUSION_PROFILE
+  if (!g_settings.has(ShowTimings)) return;
+
+  const ProfileSnapshot snapshot = profile_snapshot();
+  msg("[Fusion] %s: %s\n", operation, format_profile(snapshot).c_str());
+  if (const char* path = std::getenv("FUSION_PROFILE_JSON"); path && *path) {
+    if (!append_profile_json(path, operation, snapshot)) {
+      msg("[Fusion] Failed to append timings to %s\n", path);
+    }
+  }
+#endif
+}
+
+// Filter and report scan results according to `settings`
+static std::vector<ea_t> report_matches(
+    const std::vector<uint64_t>& found, const FindSettings& settings) {
+  const std::vector<uint64_t> matches = filter_matches(found, settings);
+  const std::vector<ea_t> results(matches.begin(), matches.end());
+
+  if (settings.jump_to_found && !results.empty()) {
+    jumpto(results.front());
+  }
+
+  if (!settings.silent) {
+    FUSION_PHASE(Ui);
+    for (size_t i = 0; i < results.size(); ++i) {
+      msg("[Fusion] %zu. Found at 0x%llX\n", i + 1, static_cast<uint64_t>(results[i]));
+    }
+
+    hide_wait_box();
+    if (results.empty()) {
+      msg("[Fusion] No matches found\n");
+    } else if (results.size() > 1) {
+      msg("[Fusion] Found %zu matches\n", results.size());
+    }
+    beep(beep_default);
+  }
+
+  return results;
+}
+
+// Report approximate matches, closest first, with how many bytes differ at each
+static std::vector<ea_t> report_fuzzy_matches(
+    const std::vector<FuzzyMatch>& matches, const FindSettings& settings) {
+  std::vector<ea_t> results;
+  for (const auto& match : matches) {
+    results.push_back(static_cast<ea_t>(match.address));
+  }
+
+  if (settings.jump_to_found && !results.empty()) {
+    jumpto(results.front());
+  }
+
+  if (!settings.silent) {
+    FUSION_PHASE(Ui);
+    for (size_t i = 0; i < matches.size(); ++i) {
+      msg("[Fusion] %zu. Found at 0x%llX, %u bytes differ\n",
+          i + 1,
+          matches[i].address,
+          matches[i].distance);
+    }
+
+    hide_wait_box();
+    if (results.empty()) {
+      msg("[Fusion] No matches with at most %u bytes differing\n", settings.max_distance);
+    } else if (results.size() == settings.max_matches) {
+      msg("[Fusion] Showing only the closest %zu matches\n", results.size());
+    } else if (results.size() > 1) {
+      msg("[Fusion] Found %zu matches\n", results.size());
+    }
+    beep(beep_default);
+  }
+
+  return results;
+}
+
+std::vector<ea_t> find_signature(const std::string& pattern, const FindSettings& settings) {
+  if (is_token_signature(pattern)) {
+    return find_token_signature(pattern, settings);
+  }
+
+  profile_reset();
+  CompiledPattern compiled;
+  CompositePattern composite;
+  const bool gaps = has_pattern_gaps(pattern);
+  if (gaps ? !compile_composite_pattern(pattern, composite) : !compile_pattern(pattern, compiled)) {
+    if (!settings.silent) {
+      warning("[Fusion] Invalid signature: %s", pattern.c_str());
+    }
+    return {};
+  }
+
+  if (!settings.silent) {
+    hide_wait_box();
+    show_wait_box("[Fusion] Searching...");
+  }
+
+  if (settings.max_distance > 0 && !gaps) {
+    const IdaDatabase db;
+    auto results = report_fuzzy_matches(*find_fuzzy_signature(db, pattern, settings), settings);
+    if (!settings.silent) report_profile("find_fuzzy");
+    return results;
+  }
+  if (settings.max_distance > 0 && !settings.silent) {
+    msg("[Fusion] Signatures with gaps are only matched exactly\n");
+  }
+
+  // Same scanner as fusion-scan, so both report identical matches
+  const IdaDatabase db;
+  const ImageSnapshot& snapshot = db.image();
+  std::vector<uint64_t> found;
+  if (settings.function_starts_only) {
+    const std::vector<uint64_t> starts = db.function_starts();
+    found = gaps ? match_at(snapshot, composite, starts)
+                 : match_at(snapshot, compiled.view(), starts);
+  } else {
+    found = gaps ? scan_composite(snapshot, composite) : scan_pattern(snapshot, compiled.view());
+  }
+  auto results = report_matches(found, settings);
+  FUSION_COUNT(Matches, results.size());
+  if (!settings.silent) report_profile("find");
+  return results;
+}
+
+std::vector<ea_t> find_crc32_signature(
+    uint32_t hash, size_t length, const FindSettings& settings) {
+  profile_reset();
+  if (!settings.silent) {
+    hide_wait_box();
+    show_wait_box("[Fusion] Searching...");
+  }
+
+  auto results = report_matches(find_crc32(take_snapshot(), hash, length), settings);
+  FUSION_COUNT(Matches, results.size());
+  if (!settings.silent) report_profile("find_crc32");
+  return results;
+}
+
+std::string signature_name(ea_t ea) {
+  qstring name;
+  if (get_name(&name, ea) > 0) {
+    return name.c_str();
+  }
+
+  char buf[32];
+  if (func_t* func = get_func(ea); func && get_func_name(&name, func->start_ea) > 0) {
+    qsnprintf(buf, sizeof(buf), "+0x%llX", static_cast<uint64_t>(ea - func->start_ea));
+    return std::string(name.c_str()) + buf;
+  }
+
+  qsnprintf(buf, sizeof(buf), "sig_%llX", static_cast<uint64_t>(ea));
+  return buf;
+}
+
+std::vector<SignatureRecord>& session_signatures() {
+  static std::vector<SignatureRecord> signatures;
+  return signatures;
+}
+
+// Name of a reference image in messages: its file name without directories
+static std::string reference_name(const std::string& path) {
+  const size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static void report_references(
+    const std::vector<std::string>& paths, const std::vector<ReferenceResult>& results) {
+  for (size_t i = 0; i < results.size(); ++i) {
+    const std::string name = reference_name(paths[i]);
+    switch (results[i].status) {
+    case ReferenceStatus::Unique:
+      msg("[Fusion] %s: unique at 0x%llX\n", name.c_str(), results[i].address);
+      break;
+    case ReferenceStatus::Missing:
+      msg("[Fusion] %s: not found\n", name.c_str());
+      break;
+    case ReferenceStatus::Lost:
+      msg("[Fusion] %s: found until the signature reached code that differs\n", name.c_str());
+      break;
+    case ReferenceStatus::Ambiguous:
+      msg("[Fusion] %s: matches more than once\n", name.c_str());
+      break;
+    }
+  }
+}
+
+// Whether `address` is inside the search scope of `db`; warns if not
+static bool check_scope(const Database& db, uint64_t address) {
+  if (find_region(db.image(), address)) return true;
+
+  hide_wait_box();
+  warning("[Fusion] 0x%llX is outside the search scope.\n"
+          "Change the scope in settings to create a signature here.",
+      address);
+  return false;
+}
+
+std::string create_signature(SignatureStyle style) {
+  return create_multi_image_signature(style, {});
+}
+
+std::string create_multi_image_signature(
+    SignatureStyle style, const std::vector<std::string>& reference_paths) {
+  profile_reset();
+
+  std::vector<ImageSnapshot> images(reference_paths.size());
+  std::vector<const ImageSnapshot*> references;
+  for (size_t i = 0; i < reference_paths.size(); ++i) {
+    if (!load_reference_image(reference_paths[i], images[i])) {
+      hide_wait_box();
+      warning("[Fusion] Failed to read %s", reference_paths[i].c_str());
+      return {};
+    }
+    references.push_back(&images[i]);
+  }
+
+  const IdaDatabase db;
+  const uint64_t target = db.cursor();
+  if (!check_scope(db, target)) return {};
+
+  CreateSettings settings;
+  settings.use_selection = g_settings.has(UseSelectedRange);
+  settings.allow_dangerous_regions = g_settings.has(AllowDangerousRegions);
+  // Gaps only have a notation in IDA style
+  settings.allow_composite = g_settings.has(AllowComposite) && style == SignatureStyle::IDA;
+  settings.function_starts_only = g_settings.has(FunctionStartsOnly);
+
+  // Show the mnemonic of each instruction as the signature grows
+  std::string mnemonics;
+  InsnCallback on_instruction;
+  if (g_settings.has(ShowMnemonics)) {
+    on_instruction = [&](uint64_t address) {
+      FUSION_PHASE(Ui);
+      insn_t insn;
+      if (decode_insn(&insn, static_cast<ea_t>(address)) <= 0) return;
+      mnemonics += "+ ";
+      mnemonics += insn.get_canon_mnem(PH);
+      mnemonics += "\n";
+      replace_wait_box(
+          "[Fusion] Creating signature for 0x%llX\n\n%s", target, mnemonics.c_str());
+    };
+  }
+
+  const CreateResult created =
+      create_multi_image_signature(db, references, settings, on_instruction);
+  if (created.status == CreateStatus::NotInFunction) {
+    hide_wait_box();
+    warning("[Fusion] 0x%llX is not in a valid function.\n"
+            "Enable 'Allow dangerous regions' in settings to override.",
+        target);
+    return {};
+  }
+
+  const SignatureBuilder& builder = created.builder;
+  report_references(reference_paths, created.references);
+  if (builder.empty()) {
+    return {};
+  }
+  if (!references.empty() && created.status == CreateStatus::NotUnique) {
+    msg("[Fusion] No signature is unique in every build; this one is the longest tried\n");
+  }
+
+  std::string result;
+  if (created.composite) {
+    // Session signatures feed libraries and headers, which only hold contiguous patterns
+    result = render_composite_pattern(*created.composite);
+  } else {
+    result = builder.render(style);
+    session_signatures().push_back(
+        {signature_name(static_cast<ea_t>(target)), builder.compile(), 0});
+  }
+
+  // Hashes are only searchable together with the window length they cover
+  if (style == SignatureStyle::CRC32 || style == SignatureStyle::FNV1A) {
+    msg("[Fusion] %s (%zu bytes)\n", result.c_str(), builder.size());
+  } else {
+    msg("[Fusion] %s\n", result.c_str());
+  }
+
+  const auto function = db.function_at(target);
+  if (settings.function_starts_only && references.empty() && created.status == CreateStatus::Unique
+      && !created.composite && function && function->start == target) {
+    msg("[Fusion] Checked for uniqueness among function starts only\n");
+  }
+
+  if (g_settings.has(CopyToClipboard)) {
+    utils::copy_to_clipboard(result.c_str());
+  }
+
+  beep(beep_default);
+  report_profile("create");
+  return result;
+}
+
+std::string create_group_signature(const std::vector<ea_t>& targets) {
+  profile_reset();
+  const IdaDatabase db;
+  for (const ea_t target : targets) {
+    if (!check_scope(db, target)) return {};
+  }
+
+  CreateSettings settings;
+  settings.allow_dangerous_regions = g_settings.has(AllowDangerousRegions);
+
+  const GroupResult created = create_group_signature(
+      db, std::vector<uint64_t>(targets.begin(), targets.end()), settings);
+  hide_wait_box();
+  if (created.status == CreateStatus::NotInFunction) {
+    warning("[Fusion] 0x%llX is not in a valid function.\n"
+            "Enable 'Allow dangerous regions' in settings to override.",
+        created.outside);
+    return {};
+  }
+  if (created.status == CreateStatus::NotUnique) {
+    msg("[Fusion] No signature from these %zu addresses matches only them\n", targets.size());
+    beep(beep_default);
+    return {};
+  }
+
+  // Nibble wildcards only have a notation in IDA style. Session signatures each name a single
+  // address, so group signatures are not kept there.
+  std::string result = render_ida_pattern(created.pattern);
+  msg("[Fusion] %s (matches %zu addresses)\n", result.c_str(), targets.size());
+  if (g_settings.has(CopyToClipboard)) {
+    utils::copy_to_clipboard(result.c_str());
+  }
+
+  beep(beep_default);
+  report_profile("create_group");
+  return result;
+}
+
+// Token index of the code segments of `db`, kept until the indexed ranges, the decoder or the
+// count of database changes differ. Comparing those is cheap, unlike the code bytes.
+static const TokenIndex& code_token_index(const Database& db) {
+  static TokenIndex index;
+  static std::vector<AddressRange> indexed;
+  static uint64_t indexed_changes = 0;
+  static const InsnDecoder* indexed_decoder = nullptr;
+
+  // Same notion of code as the Code search scope: typed as code or executable
+  const std::vector<SegmentInfo> segments = ida_segments();
+  std::vector<const SnapshotRegion*> code;
+  std::vector<AddressRange> ranges;
+  for (const auto& region : db.image().regions) {
+    const auto segment = std::upper_bound(segments.begin(), segments.end(), region.start,
+        [](uint64_t address, const SegmentInfo& info) { return address < info.range.start; });
+    if (segment == segments.begin() || !std::prev(segment)->code) continue;
+
+    code.push_back(&region);
+    ranges.push_back({region.start, region.end()});
+  }
+
+  if (!indexed_decoder || ranges != indexed || database_changes() != indexed_changes
+      || &db.decoder() != indexed_decoder) {
+    index.build(code, db.decoder());
+    indexed = std::move(ranges);
+    indexed_changes = database_changes();
+    indexed_decoder = &db.decoder();
+  }
+  return index;
+}
+
+std::string create_token_signature() {
+  profile_reset();
+  const IdaDatabase db;
+  const uint64_t target = db.cursor();
+  if (!check_scope(db, target)) return {};
+
+  CreateSettings settings;
+  settings.use_selection = g_settings.has(UseSelectedRange);
+  settings.allow_dangerous_regions = g_settings.has(AllowDangerousRegions);
+
+  const TokenSignature created = create_token_signature(db, code_token_index(db), settings);
+  hide_wait_box();
+  if (created.status == CreateStatus::NotInFunction) {
+    warning("[Fusion] 0x%llX is not in a valid function.\n"
+            "Enable 'Allow dangerous regions' in settings to override.",
+        target);
+    return {};
+  }
+  if (created.tokens.empty()) {
+    msg("[Fusion] No instruction sequence from 0x%llX within %zu instructions is unique\n",
+        target,
+        max_token_signature);
+    beep(beep_default);
+    return {};
+  }
+
+  std::string result = format_token_signature(created.tokens);
+  msg("[Fusion] %s (%zu instructions)\n", result.c_str(), created.tokens.size());
+  if (g_settings.has(CopyToClipboard)) {
+    utils::copy_to_clipboard(result.c_str());
+  }
+
+  beep(beep_default);
+  report_profile("create_tokens");
+  return result;
+}
+
+std::vector<ea_t> find_token_signature(const std::string& pattern, const FindSettings& settings) {
+  profile_reset();
+  if (!parse_token_signature(pattern)) {
+    if (!settings.silent) {
+      warning("[Fusion] Invalid token signature: %s", pattern.c_str());
+    }
+    return {};
+  }
+
+  if (!settings.silent) {
+    hide_wait_box();
+    show_wait_box("[Fusion] Searching...");
+  }
+
+  const IdaDatabase db;
+  std::vector<uint64_t> starts;
+  if (settings.function_starts_only) starts = db.function_starts();
+  auto results = report_matches(
+      *find_token_signature(code_token_index(db), pattern, settings, starts), settings);
+  if (!settings.silent) report_profile("find_tokens");
+  return results;
+}
+} // namespace fusion
@@ -0,0 +1,121 @@
+﻿#include "fusion/similarity.h"
+#include "fusion/settings.h"
+#include "fusion/utils.h"
+
+#include <bytes.hpp>
+#include <funcs.hpp>
+#include <kernwin.hpp>
+
+namespace fusion {
+// Matches below this estimated similarity are not worth reporting
+static constexpr double min_reported_similarity = 0.5;
+static constexpr size_t max_reported_matches = 20;
+
+static MinHashSketch sketch_function(func_t* func) {
+  SketchBuilder builder;
+  func_item_iterator_t iter;
+
+  for (bool ok = iter.set(func); ok; ok = iter.next_code()) {
+    const ea_t addr = iter.current();
+    insn_t insn;
+    if (!decode_insn(&insn, addr)) continue;
+
+    uint8_t bytes[16];
+    const size_t size = std::min<size_t>(insn.size, sizeof(bytes));
+    get_bytes(bytes, static_cast<ssize_t>(size), addr);
+
+    const int imm_offset = utils::get_immediate_offset(insn);
+    for (size_t i = 0; i < size; ++i) {
+      builder.add_byte(bytes[i], imm_offset > 0 && i >= static_cast<size_t>(imm_offset));
+    }
+    builder.end_instruction();
+  }
+
+  return builder.finish();
+}
+
+std::vector<FunctionSketch> sketch_functions() {
+  std::vector<FunctionSketch> sketches;
+  const size_t count = get_func_qty();
+  sketches.reserve(count);
+
+  for (size_t n = 0; n < count; ++n) {
+    if ((n & 0xFF) == 0) {
+      if (user_cancelled()) break;
+      replace_wait_box("[Fusion] Sketching functions (%zu/%zu)", n, count);
+    }
+
+    func_t* func = getn_func(n);
+    if (!func) continue;
+
+    FunctionSketch function;
+    function.address = func->start_ea;
+    qstring name;
+    if (get_func_name(&name, func->start_ea) > 0) {
+      function.name = name.c_str();
+    }
+    function.sketch = sketch_function(func);
+    sketches.push_back(std::move(function));
+  }
+
+  return sketches;
+}
+
+void find_similar_functions(const char* sketch_path) {
+  const ea_t target = get_screen_ea();
+  func_t* func = get_func(target);
+  if (!func) {
+    warning("[Fusion] 0x%llX is not in a function.", static_cast<uint64_t>(target));
+    return;
+  }
+
+  show_wait_box("[Fusion] Sketching functions...");
+  const MinHashSketch sketch = sketch_function(func);
+
+  SimilarityIndex index;
+  std::vector<FunctionSketch> sketches;
+  if (sketch_path) {
+    if (!load_sketches(sketch_path, sketches)) {
+      hide_wait_box();
+      warning("[Fusion] Failed to load function sketches from %s", sketch_path);
+      return;
+    }
+  } else {
+    sketches = sketch_functions();
+  }
+
+  for (auto& function : sketches) {
+    if (!sketch_path && function.address == func->start_ea) continue;
+    index.add(std::move(function));
+  }
+
+  const auto matches = index.query(sketch, min_reported_similarity, max_reported_matches);
+  hide_wait_box();
+
+  for (const auto& match : matches) {
+    msg("[Fusion] %3.0f%% 0x%llX %s\n",
+        match.similarity * 100.0,
+        static_cast<uint64_t>(match.function->address),
+        match.function->name.c_str());
+  }
+
+  if (matches.empty()) {
+    msg("[Fusion] No similar functions found\n");
+  } else if (!sketch_path && g_settings.has(AutoJumpToFound)) {
+    jumpto(static_cast<ea_t>(matches.front().function->address));
+  }
+  beep(beep_default);
+}
+
+void export_function_sketches(const char* path) {
+  show_wait_box("[Fusion] Sketching functions...");
+  const auto sketches = sketch_functions();
+  hide_wait_box();
+
+  if (!save_sketches(path, sketches)) {
+    warning("[Fusion] Failed to write function sketches to %s", path);
+    return;
+  }
+  msg("[Fusion] Exported %zu function sketches to %s\n", sketches.size(), path);
+}
+} // namespace fusion
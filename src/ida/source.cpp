@@ -0,0 +1,76 @@
+﻿#include "fusion/source.h"
+#include "fusion/settings.h"
+#include "fusion/utils.h"
+
+#include <bytes.hpp>
+#include <segment.hpp>
+#include <ua.hpp>
+
+#include <string>
+
+namespace fusion {
+std::vector<SegmentInfo> ida_segments() {
+  std::vector<SegmentInfo> segments;
+  const int count = get_segm_qty();
+  segments.reserve(count);
+
+  for (int i = 0; i < count; ++i) {
+    const segment_t* seg = getnseg(i);
+    if (!seg) continue;
+
+    const bool code = seg->type == SEG_CODE || (seg->perm & SEGPERM_EXEC) != 0;
+    SegmentInfo segment{{seg->start_ea, seg->end_ea}, {}, code};
+    qstring name;
+    if (get_segm_name(&name, seg) > 0) segment.name = name.c_str();
+    segments.push_back(std::move(segment));
+  }
+
+  return segments;
+}
+
+std::vector<AddressRange> IdaByteSource::segments() const {
+  const std::vector<SegmentInfo> segments = ida_segments();
+  if (scoped_) return scope_ranges(segments, g_settings);
+
+  std::vector<AddressRange> ranges;
+  ranges.reserve(segments.size());
+  for (const auto& segment : segments) {
+    ranges.push_back(segment.range);
+  }
+  return ranges;
+}
+
+size_t IdaByteSource::read(uint64_t address, uint8_t* out, size_t size) const {
+  // Uninitialized bytes read back as 0xFF, matching what bin_search sees
+  const ssize_t read =
+      get_bytes(out, static_cast<ssize_t>(size), static_cast<ea_t>(address), GMB_READALL);
+  return read > 0 ? static_cast<size_t>(read) : 0;
+}
+
+bool IdaInsnDecoder::decode(
+    uint64_t address, const uint8_t* /*bytes*/, size_t available, InsnInfo& out) const {
+  insn_t insn;
+  if (decode_insn(&insn, static_cast<ea_t>(address)) <= 0) return false;
+  if (insn.size > available) return false;
+
+  out.size = insn.size;
+  const int imm_offset = utils::get_immediate_offset(insn);
+  out.wildcard_begin = imm_offset > 0 ? static_cast<uint32_t>(imm_offset) : 0;
+  out.wildcard_end = imm_offset > 0 ? out.size : 0;
+
+  // Canonical mnemonic and the kind and size of each operand, without registers or values
+  std::string key;
+  if (const char* mnemonic = insn.get_canon_mnem(PH)) key = mnemonic;
+  for (const auto& op : insn.ops) {
+    if (op.type == o_void) break;
+    key += static_cast<char>(op.type);
+    key += static_cast<char>(op.dtype);
+  }
+  out.token = make_token(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+  return true;
+}
+
+ImageSnapshot take_snapshot() {
+  return read_snapshot(IdaByteSource{true});
+}
+} // namespace fusion
@@ -0,0 +1,98 @@
+﻿#include "fusion/x86_decoder.h"
+#include "fusion/settings.h"
+
+#include <bytes.hpp>
+#include <funcs.hpp>
+#include <idp.hpp>
+#include <kernwin.hpp>
+
+#include <chrono>
+
+namespace fusion {
+// Enough mismatches to spot a pattern without flooding the output window
+static constexpr size_t max_reported_mismatches = 50;
+
+bool builtin_decoder_available() {
+  return PH.id == PLFM_386;
+}
+
+const InsnDecoder& signature_decoder() {
+  static const IdaInsnDecoder ida;
+  static const X86Decoder x64(true);
+  static const X86Decoder x86(false);
+
+  if (!g_settings.has(UseBuiltinDecoder) || !builtin_decoder_available()) return ida;
+  return inf_is_64bit() ? x64 : x86;
+}
+
+// Wildcard ranges are equal if they cover the same bytes; empty ranges may start anywhere
+static bool same_layout(const InsnInfo& a, const InsnInfo& b) {
+  if (a.size != b.size) return false;
+  const bool a_empty = a.wildcard_begin >= a.wildcard_end;
+  const bool b_empty = b.wildcard_begin >= b.wildcard_end;
+  if (a_empty || b_empty) return a_empty == b_empty;
+  return a.wildcard_begin == b.wildcard_begin && a.wildcard_end == b.wildcard_end;
+}
+
+void verify_builtin_decoder() {
+  if (!builtin_decoder_available()) {
+    warning("[Fusion] The built-in decoder only supports x86 databases.");
+    return;
+  }
+
+  using clock = std::chrono::steady_clock;
+  const IdaInsnDecoder ida;
+  const X86Decoder builtin(inf_is_64bit());
+  clock::duration ida_time{}, builtin_time{};
+  size_t checked = 0, mismatched = 0;
+
+  show_wait_box("[Fusion] Verifying built-in decoder...");
+  const size_t count = get_func_qty();
+  for (size_t n = 0; n < count; ++n) {
+    if ((n & 0xFF) == 0) {
+      if (user_cancelled()) break;
+      replace_wait_box("[Fusion] Verifying built-in decoder (%zu/%zu)", n, count);
+    }
+
+    func_t* func = getn_func(n);
+    func_item_iterator_t iter;
+    for (bool ok = func && iter.set(func); ok; ok = iter.next_code()) {
+      const ea_t ea = iter.current();
+      uint8_t bytes[16];
+      const ssize_t read = get_bytes(bytes, sizeof(bytes), ea, GMB_READALL);
+      if (read <= 0) continue;
+
+      InsnInfo expected, actual;
+      auto start = clock::now();
+      if (!ida.decode(ea, bytes, static_cast<size_t>(read), expected)) continue;
+      ida_time += clock::now() - start;
+
+      start = clock::now();
+      const bool decoded = builtin.decode(ea, bytes, static_cast<size_t>(read), actual);
+      builtin_time += clock::now() - start;
+
+      ++checked;
+      if (decoded && same_layout(expected, actual)) continue;
+
+      if (++mismatched > max_reported_mismatches) continue;
+      if (!decoded) {
+        msg("[Fusion] 0x%llX: built-in decoder failed, IDA decodes %u bytes\n",
+            static_cast<uint64_t>(ea), expected.size);
+      } else {
+        msg("[Fusion] 0x%llX: IDA %u bytes, wildcards %u-%u; "
+            "built-in %u bytes, wildcards %u-%u\n",
+            static_cast<uint64_t>(ea), expected.size, expected.wildcard_begin,
+            expected.wildcard_end, actual.size, actual.wildcard_begin, actual.wildcard_end);
+      }
+    }
+  }
+  hide_wait_box();
+
+  const auto ms = [](clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  };
+  msg("[Fusion] Checked %zu instructions, %zu differ. decode_insn %.1f ms, built-in %.1f ms\n",
+      checked, mismatched, ms(ida_time), ms(builtin_time));
+  beep(beep_default);
+}
+} // namespace fusion
@@ -0,0 +1,381 @@
+﻿#include "fusion/image.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fusion {
+namespace {
+constexpr uint32_t elf_shf_alloc = 0x2;
+constexpr uint32_t elf_sht_nobits = 8;
+constexpr uint32_t elf_pt_load = 1;
+constexpr uint32_t elf_sht_symtab = 2;
+constexpr uint32_t elf_sht_dynsym = 11;
+constexpr uint8_t elf_stt_func = 2;
+constexpr uint32_t pe_runtime_function_size = 12;
+
+constexpr uint32_t macho_magic_32 = 0xFEEDFACE;
+constexpr uint32_t macho_magic_64 = 0xFEEDFACF;
+constexpr uint32_t macho_fat_magic = 0xCAFEBABE;
+constexpr uint32_t macho_lc_segment = 0x1;
+constexpr uint32_t macho_lc_segment_64 = 0x19;
+constexpr uint32_t macho_cpu_x86_64 = 0x01000007;
+
+/// Bounds-checked little-endian reads from a file image
+struct Reader {
+  const uint8_t* data;
+  size_t size;
+
+  template <typename T>
+  bool get(uint64_t offset, T& out) const {
+    if (offset > size || size - offset < sizeof(T)) return false;
+    std::memcpy(&out, data + offset, sizeof(T));
+    return true;
+  }
+
+  /// Narrow or widen a 32/64-bit field to uint64_t
+  bool get_word(uint64_t offset, bool wide, uint64_t& out) const {
+    if (wide) return get(offset, out);
+    uint32_t value = 0;
+    if (!get(offset, value)) return false;
+    out = value;
+    return true;
+  }
+
+  bool get_be32(uint64_t offset, uint32_t& out) const {
+    uint8_t bytes[4];
+    if (!get(offset, bytes)) return false;
+    out = uint32_t{bytes[0]} << 24 | uint32_t{bytes[1]} << 16 | uint32_t{bytes[2]} << 8 | bytes[3];
+    return true;
+  }
+
+  /// Fixed-size name field, which is only null-terminated when shorter than the field
+  std::string get_name(uint64_t offset, size_t length) const {
+    if (offset > size) return {};
+    length = std::min<size_t>(length, size - offset);
+    const auto* begin = reinterpret_cast<const char*>(data + offset);
+    return std::string(begin, strnlen(begin, length));
+  }
+};
+
+/// Add a section, clipped to the file; sections without file data are dropped
+void add_section(const Reader& file,
+    ImageLayout& out,
+    std::string name,
+    uint64_t address,
+    uint64_t file_offset,
+    uint64_t size) {
+  if (file_offset >= file.size) return;
+  size = std::min<uint64_t>(size, file.size - file_offset);
+  if (size == 0) return;
+  out.sections.push_back({std::move(name), address, file_offset, size});
+}
+
+bool parse_elf(const Reader& file, ImageLayout& out) {
+  uint8_t ident[6];
+  if (!file.get(0, ident)) return false;
+  if (ident[4] != 1 && ident[4] != 2) return false;
+  if (ident[5] != 1) return false; // Big-endian
+
+  const bool wide = ident[4] == 2;
+  uint64_t phoff = 0, shoff = 0;
+  uint16_t phentsize = 0, phnum = 0, shentsize = 0, shnum = 0, shstrndx = 0;
+  const uint64_t fields = wide ? 0x20 : 0x1C;
+  const uint64_t counts = wide ? 0x36 : 0x2A;
+  if (!file.get_word(fields, wide, phoff) || !file.get_word(fields + (wide ? 8 : 4), wide, shoff)
+      || !file.get(counts, phentsize) || !file.get(counts + 2, phnum)
+      || !file.get(counts + 4, shentsize) || !file.get(counts + 6, shnum)
+      || !file.get(counts + 8, shstrndx)) {
+    return false;
+  }
+
+  out.format = ImageFormat::ELF;
+
+  // The lowest load address serves as the base RVAs are reported against
+  bool have_base = false;
+  std::vector<ImageSection> segments;
+  for (uint16_t i = 0; i < phnum; ++i) {
+    const uint64_t ph = phoff + uint64_t{i} * phentsize;
+    uint32_t type = 0;
+    uint64_t offset = 0, vaddr = 0, filesz = 0;
+    if (!file.get(ph, type)) return false;
+    if (type != elf_pt_load) continue;
+    if (!file.get_word(ph + (wide ? 0x08 : 0x04), wide, offset)
+        || !file.get_word(ph + (wide ? 0x10 : 0x08), wide, vaddr)
+        || !file.get_word(ph + (wide ? 0x20 : 0x10), wide, filesz)) {
+      return false;
+    }
+    if (!have_base || vaddr < out.image_base) out.image_base = vaddr;
+    have_base = true;
+    segments.push_back({"LOAD", vaddr, offset, filesz});
+  }
+
+  uint64_t strtab = 0;
+  if (shstrndx < shnum) {
+    file.get_word(shoff + uint64_t{shstrndx} * shentsize + (wide ? 0x18 : 0x10), wide, strtab);
+  }
+
+  for (uint16_t i = 0; i < shnum; ++i) {
+    const uint64_t sh = shoff + uint64_t{i} * shentsize;
+    uint32_t name = 0, type = 0;
+    uint64_t flags = 0, addr = 0, offset = 0, size = 0;
+    if (!file.get(sh, name) || !file.get(sh + 4, type) || !file.get_word(sh + 8, wide, flags)
+        || !file.get_word(sh + (wide ? 0x10 : 0x0C), wide, addr)
+        || !file.get_word(sh + (wide ? 0x18 : 0x10), wide, offset)
+        || !file.get_word(sh + (wide ? 0x20 : 0x14), wide, size)) {
+      return false;
+    }
+    if (!(flags & elf_shf_alloc) || type == elf_sht_nobits || addr == 0) continue;
+    add_section(file, out, file.get_name(strtab + name, 64), addr, offset, size);
+  }
+
+  // Stripped section headers: fall back to the loadable segments
+  if (out.sections.empty()) {
+    for (const auto& segment : segments) {
+      add_section(file, out, segment.name, segment.address, segment.file_offset, segment.size);
+    }
+  }
+
+  if (!have_base && !out.sections.empty()) {
+    out.image_base = std::min_element(out.sections.begin(), out.sections.end(),
+        [](const auto& a, const auto& b) { return a.address < b.address; })->address;
+  }
+  return true;
+}
+
+bool parse_pe(const Reader& file, ImageLayout& out) {
+  uint32_t pe_offset = 0, signature = 0;
+  if (!file.get(0x3C, pe_offset) || !file.get(pe_offset, signature)) return false;
+  if (signature != 0x00004550) return false; // "PE\0\0"
+
+  const uint64_t coff = pe_offset + 4;
+  uint16_t section_count = 0, optional_size = 0, magic = 0;
+  if (!file.get(coff + 2, section_count) || !file.get(coff + 16, optional_size)) return false;
+
+  const uint64_t optional = coff + 20;
+  if (!file.get(optional, magic)) return false;
+  if (magic == 0x20B) {
+    if (!file.get(optional + 24, out.image_base)) return false;
+  } else if (magic == 0x10B) {
+    uint32_t base = 0;
+    if (!file.get(optional + 28, base)) return false;
+    out.image_base = base;
+  } else {
+    return false;
+  }
+
+  out.format = ImageFormat::PE;
+  const uint64_t table = optional + optional_size;
+  for (uint16_t i = 0; i < section_count; ++i) {
+    const uint64_t header = table + uint64_t{i} * 40;
+    uint32_t virtual_size = 0, rva = 0, raw_size = 0, raw_offset = 0;
+    if (!file.get(header + 8, virtual_size) || !file.get(header + 12, rva)
+        || !file.get(header + 16, raw_size) || !file.get(header + 20, raw_offset)) {
+      return false;
+    }
+
+    // Raw data past the virtual size is file alignment padding and is not loaded
+    const uint32_t size = virtual_size ? std::min(virtual_size, raw_size) : raw_size;
+    add_section(file, out, file.get_name(header, 8), out.image_base + rva, raw_offset, size);
+  }
+  return true;
+}
+
+bool parse_macho(const Reader& file, uint64_t base_offset, ImageLayout& out) {
+  uint32_t magic = 0, command_count = 0;
+  if (!file.get(base_offset, magic)) return false;
+  if (magic != macho_magic_32 && magic != macho_magic_64) return false;
+
+  const bool wide = magic == macho_magic_64;
+  if (!file.get(base_offset + 16, command_count)) return false;
+
+  out.format = ImageFormat::MachO;
+  uint64_t command = base_offset + (wide ? 32 : 28);
+  for (uint32_t i = 0; i < command_count; ++i) {
+    uint32_t type = 0, command_size = 0;
+    if (!file.get(command, type) || !file.get(command + 4, command_size)) return false;
+    if (command_size < 8) return false;
+
+    if (type == (wide ? macho_lc_segment_64 : macho_lc_segment)) {
+      const std::string segment = file.get_name(command + 8, 16);
+      uint64_t vmaddr = 0, fileoff = 0, filesize = 0;
+      uint32_t section_count = 0;
+      if (!file.get_word(command + 24, wide, vmaddr)
+          || !file.get_word(command + (wide ? 40 : 32), wide, fileoff)
+          || !file.get_word(command + (wide ? 48 : 36), wide, filesize)
+          || !file.get(command + (wide ? 64 : 48), section_count)) {
+        return false;
+      }
+
+      // The segment mapping the file header (normally __TEXT) is the image base
+      if (fileoff == 0 && filesize > 0) out.image_base = vmaddr;
+
+      const uint64_t section_size = wide ? 80 : 68;
+      uint64_t section = command + (wide ? 72 : 56);
+      for (uint32_t n = 0; n < section_count; ++n, section += section_size) {
+        uint64_t addr = 0, size = 0;
+        uint32_t offset = 0, flags = 0;
+        if (!file.get_word(section + 32, wide, addr)
+            || !file.get_word(section + (wide ? 40 : 36), wide, size)
+            || !file.get(section + (wide ? 48 : 40), offset)
+            || !file.get(section + (wide ? 64 : 56), flags)) {
+          return false;
+        }
+
+        // S_ZEROFILL, S_GB_ZEROFILL and S_THREAD_LOCAL_ZEROFILL have no file data
+        const uint32_t kind = flags & 0xFF;
+        if (kind == 0x01 || kind == 0x0C || kind == 0x12) continue;
+
+        add_section(file, out, segment + "," + file.get_name(section, 16), addr,
+            base_offset + offset, size);
+      }
+    }
+
+    command += command_size;
+  }
+  return true;
+}
+
+bool parse_fat_macho(const Reader& file, ImageLayout& out) {
+  uint32_t arch_count = 0;
+  if (!file.get_be32(4, arch_count) || arch_count == 0) return false;
+
+  // Prefer the x86-64 slice, otherwise take the first one
+  uint64_t slice = 0;
+  for (uint32_t i = 0; i < arch_count; ++i) {
+    uint32_t cpu = 0, offset = 0;
+    if (!file.get_be32(8 + i * 20, cpu) || !file.get_be32(8 + i * 20 + 8, offset)) return false;
+    if (i == 0 || cpu == macho_cpu_x86_64) slice = offset;
+    if (cpu == macho_cpu_x86_64) break;
+  }
+  return parse_macho(file, slice, out);
+}
+// Values of the defined function symbols in .symtab and .dynsym
+void elf_function_starts(const Reader& file, std::vector<uint64_t>& out) {
+  uint8_t ident[5];
+  if (!file.get(0, ident)) return;
+  const bool wide = ident[4] == 2;
+
+  uint64_t shoff = 0;
+  uint16_t shentsize = 0, shnum = 0;
+  if (!file.get_word(wide ? 0x28 : 0x20, wide, shoff) || !file.get(wide ? 0x3A : 0x2E, shentsize)
+      || !file.get(wide ? 0x3C : 0x30, shnum)) {
+    return;
+  }
+
+  const uint64_t symbol_size = wide ? 24 : 16;
+  for (uint16_t i = 0; i < shnum; ++i) {
+    const uint64_t sh = shoff + uint64_t{i} * shentsize;
+    uint32_t type = 0;
+    uint64_t offset = 0, size = 0;
+    if (!file.get(sh + 4, type) || !file.get_word(sh + (wide ? 0x18 : 0x10), wide, offset)
+        || !file.get_word(sh + (wide ? 0x20 : 0x14), wide, size)) {
+      return;
+    }
+    if (type != elf_sht_symtab && type != elf_sht_dynsym) continue;
+
+    for (uint64_t symbol = offset; symbol + symbol_size <= offset + size; symbol += symbol_size) {
+      uint8_t info = 0;
+      uint16_t section = 0;
+      uint64_t value = 0;
+      if (!file.get(symbol + (wide ? 4 : 12), info) || !file.get(symbol + (wide ? 6 : 14), section)
+          || !file.get_word(symbol + (wide ? 8 : 4), wide, value)) {
+        break;
+      }
+      if ((info & 0xF) == elf_stt_func && section != 0 && value != 0) out.push_back(value);
+    }
+  }
+}
+
+// Begin addresses of the RUNTIME_FUNCTION entries in .pdata
+void pe_function_starts(const Reader& file, const ImageLayout& layout, std::vector<uint64_t>& out) {
+  for (const auto& section : layout.sections) {
+    if (section.name != ".pdata") continue;
+
+    const uint64_t end = section.file_offset + section.size;
+    for (uint64_t entry = section.file_offset; entry + pe_runtime_function_size <= end;
+         entry += pe_runtime_function_size) {
+      uint32_t begin = 0;
+      if (!file.get(entry, begin) || begin == 0) break;
+      out.push_back(layout.image_base + begin);
+    }
+  }
+}
+} // namespace
+
+const ImageSection* ImageLayout::find_section(uint64_t address) const {
+  auto it = std::upper_bound(sections.begin(), sections.end(), address,
+      [](uint64_t value, const ImageSection& section) { return value < section.address; });
+  if (it == sections.begin()) return nullptr;
+
+  --it;
+  return address < it->end() ? &*it : nullptr;
+}
+
+std::optional<uint64_t> ImageLayout::file_offset(uint64_t address) const {
+  const ImageSection* section = find_section(address);
+  if (!section) return std::nullopt;
+  return section->file_offset + (address - section->address);
+}
+
+bool parse_image(const uint8_t* data, size_t size, ImageLayout& out) {
+  out = {};
+  const Reader file{data, size};
+
+  uint32_t magic = 0;
+  if (!file.get(0, magic)) return false;
+
+  bool parsed = false;
+  if (magic == 0x464C457F) { // "\x7FELF"
+    parsed = parse_elf(file, out);
+  } else if ((magic & 0xFFFF) == 0x5A4D) { // "MZ"
+    parsed = parse_pe(file, out);
+  } else if (magic == macho_magic_32 || magic == macho_magic_64) {
+    parsed = parse_macho(file, 0, out);
+  } else if (uint32_t fat = 0; file.get_be32(0, fat) && fat == macho_fat_magic) {
+    parsed = parse_fat_macho(file, out);
+  }
+  if (!parsed) return false;
+
+  std::sort(out.sections.begin(), out.sections.end(),
+      [](const auto& a, const auto& b) { return a.address < b.address; });
+  return true;
+}
+
+std::vector<uint64_t> read_function_starts(
+    const uint8_t* data, size_t size, const ImageLayout& layout) {
+  const Reader file{data, size};
+  std::vector<uint64_t> starts;
+  if (layout.format == ImageFormat::ELF) {
+    elf_function_starts(file, starts);
+  } else if (layout.format == ImageFormat::PE) {
+    pe_function_starts(file, layout, starts);
+  }
+
+  std::erase_if(starts, [&](uint64_t start) { return !layout.find_section(start); });
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+  return starts;
+}
+
+std::vector<AddressRange> FileImageSource::segments() const {
+  std::vector<AddressRange> ranges;
+  ranges.reserve(layout_.sections.size());
+  for (const auto& section : layout_.sections) {
+    ranges.push_back({section.address, section.end()});
+  }
+  return ranges;
+}
+
+size_t FileImageSource::read(uint64_t address, uint8_t* out, size_t size) const {
+  const ImageSection* section = layout_.find_section(address);
+  if (!section) return 0;
+
+  const uint64_t offset = section->file_offset + (address - section->address);
+  if (offset >= size_) return 0;
+
+  const size_t count = static_cast<size_t>(
+      std::min<uint64_t>({size, section->end() - address, size_ - offset}));
+  std::memcpy(out, data_ + offset, count);
+  return count;
+}
+} // namespace fusion
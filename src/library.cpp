@@ -0,0 +1,229 @@
+﻿#include "fusion/library.h"
+#include "fusion/scanner.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace fusion {
+namespace {
+constexpr char library_magic[8] = {'F', 'U', 'S', 'I', 'O', 'N', 'L', 'B'};
+constexpr size_t anchor_table_size = 0x10000 + 1;
+
+size_t align8(size_t value) {
+  return (value + 7) & ~size_t{7};
+}
+
+template <typename T>
+bool is_aligned(const uint8_t* ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) % alignof(T) == 0;
+}
+
+struct PendingEntry {
+  const SignatureRecord* record;
+  size_t anchor;
+  uint16_t anchor_value;
+  bool anchored;
+};
+} // namespace
+
+bool SignatureLibrary::open(const std::string& path) {
+  MappedFile file;
+  if (!file.open(path)) return false;
+  if (!attach(file.data(), file.size())) return false;
+  file_ = std::move(file);
+  return true;
+}
+
+bool SignatureLibrary::attach(const uint8_t* data, size_t size) {
+  header_ = nullptr;
+  if (size < sizeof(LibraryHeader) || !is_aligned<LibraryHeader>(data)) return false;
+
+  const auto* header = reinterpret_cast<const LibraryHeader*>(data);
+  if (std::memcmp(header->magic, library_magic, sizeof(library_magic)) != 0) return false;
+  if (header->version != library_format_version || header->file_size != size) return false;
+  if (header->anchored_count > header->entry_count) return false;
+
+  // Sections must be in order and inside the file
+  const uint64_t entries_end =
+      header->entries_offset + uint64_t{header->entry_count} * sizeof(LibraryEntry);
+  if (header->anchor_table_offset < sizeof(LibraryHeader)
+      || header->anchor_table_offset + anchor_table_size * sizeof(uint32_t)
+             > header->entries_offset
+      || entries_end > header->pattern_offset || header->pattern_offset > header->string_offset
+      || header->string_offset > size) {
+    return false;
+  }
+
+  const uint8_t* anchor_data = data + header->anchor_table_offset;
+  const uint8_t* entry_data = data + header->entries_offset;
+  if (!is_aligned<uint32_t>(anchor_data) || !is_aligned<LibraryEntry>(entry_data)) return false;
+
+  const auto* anchors = reinterpret_cast<const uint32_t*>(anchor_data);
+  if (anchors[0] != 0 || anchors[anchor_table_size - 1] != header->anchored_count) return false;
+  for (size_t i = 1; i < anchor_table_size; ++i) {
+    if (anchors[i] < anchors[i - 1]) return false;
+  }
+
+  const auto* entries = reinterpret_cast<const LibraryEntry*>(entry_data);
+  const uint64_t pattern_size = header->string_offset - header->pattern_offset;
+  const uint64_t string_size = size - header->string_offset;
+  for (uint32_t i = 0; i < header->entry_count; ++i) {
+    const LibraryEntry& entry = entries[i];
+    if (uint64_t{entry.pattern_offset} + 2 * uint64_t{entry.pattern_size} > pattern_size) {
+      return false;
+    }
+    if (uint64_t{entry.name_offset} + entry.name_size > string_size) return false;
+    if (i < header->anchored_count && entry.anchor_offset + 2u > entry.pattern_size) return false;
+  }
+
+  data_ = data;
+  header_ = header;
+  anchors_ = anchors;
+  entries_ = entries;
+  return true;
+}
+
+std::string_view SignatureLibrary::name(size_t index) const {
+  const LibraryEntry& e = entries_[index];
+  return {reinterpret_cast<const char*>(data_ + header_->string_offset + e.name_offset),
+      e.name_size};
+}
+
+PatternView SignatureLibrary::pattern(size_t index) const {
+  const LibraryEntry& e = entries_[index];
+  const uint8_t* bytes = data_ + header_->pattern_offset + e.pattern_offset;
+  return {bytes, bytes + e.pattern_size, e.pattern_size};
+}
+
+bool build_library(const std::vector<SignatureRecord>& records, std::vector<uint8_t>& out) {
+  std::vector<PendingEntry> pending;
+  pending.reserve(records.size());
+
+  for (const auto& record : records) {
+    const PatternView view = record.pattern.view();
+    if (view.size == 0 || view.size > UINT16_MAX || !choose_anchor_byte(view)) return false;
+
+    if (const auto anchor = choose_anchor_pair(view)) {
+      const auto value = static_cast<uint16_t>(view.bytes[*anchor] | view.bytes[*anchor + 1] << 8);
+      pending.push_back({&record, *anchor, value, true});
+    } else {
+      pending.push_back({&record, 0, 0, false});
+    }
+  }
+
+  // Anchored entries first, grouped by anchor; patterns sharing a bucket are kept adjacent so
+  // verifying one bucket touches contiguous memory
+  std::stable_sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+    if (a.anchored != b.anchored) return a.anchored;
+    if (a.anchor_value != b.anchor_value) return a.anchor_value < b.anchor_value;
+    return a.record->pattern.bytes < b.record->pattern.bytes;
+  });
+
+  size_t pattern_bytes = 0, string_bytes = 0;
+  for (const auto& record : records) {
+    pattern_bytes += 2 * record.pattern.size();
+    string_bytes += record.name.size();
+  }
+
+  LibraryHeader header{};
+  std::memcpy(header.magic, library_magic, sizeof(library_magic));
+  header.version = library_format_version;
+  header.entry_count = static_cast<uint32_t>(pending.size());
+  header.anchored_count = static_cast<uint32_t>(
+      std::count_if(pending.begin(), pending.end(), [](const auto& p) { return p.anchored; }));
+  header.anchor_table_offset = sizeof(LibraryHeader);
+  header.entries_offset =
+      align8(header.anchor_table_offset + anchor_table_size * sizeof(uint32_t));
+  header.pattern_offset = header.entries_offset + pending.size() * sizeof(LibraryEntry);
+  header.string_offset = header.pattern_offset + pattern_bytes;
+  header.file_size = header.string_offset + string_bytes;
+
+  if (pattern_bytes > UINT32_MAX || string_bytes > UINT32_MAX) return false;
+
+  out.assign(header.file_size, 0);
+  std::memcpy(out.data(), &header, sizeof(header));
+
+  auto* anchors = reinterpret_cast<uint32_t*>(out.data() + header.anchor_table_offset);
+  auto* entries = reinterpret_cast<LibraryEntry*>(out.data() + header.entries_offset);
+  uint8_t* patterns = out.data() + header.pattern_offset;
+  uint8_t* strings = out.data() + header.string_offset;
+
+  uint32_t pattern_pos = 0, string_pos = 0;
+  for (size_t i = 0; i < pending.size(); ++i) {
+    const SignatureRecord& record = *pending[i].record;
+    const auto size = static_cast<uint16_t>(record.pattern.size());
+
+    LibraryEntry& entry = entries[i];
+    entry.pattern_offset = pattern_pos;
+    entry.name_offset = string_pos;
+    entry.pattern_size = size;
+    entry.anchor_offset = static_cast<uint16_t>(pending[i].anchor);
+    entry.name_size = static_cast<uint32_t>(record.name.size());
+    entry.target_offset = record.offset;
+
+    std::memcpy(patterns + pattern_pos, record.pattern.bytes.data(), size);
+    std::memcpy(patterns + pattern_pos + size, record.pattern.mask.data(), size);
+    std::memcpy(strings + string_pos, record.name.data(), record.name.size());
+    pattern_pos += 2u * size;
+    string_pos += entry.name_size;
+
+    // Count entries per anchor; turned into bucket starts below
+    if (pending[i].anchored) ++anchors[pending[i].anchor_value + 1];
+  }
+
+  for (size_t i = 1; i < anchor_table_size; ++i) {
+    anchors[i] += anchors[i - 1];
+  }
+  return true;
+}
+
+bool write_library(const std::string& path, const std::vector<SignatureRecord>& records) {
+  std::vector<uint8_t> image;
+  if (!build_library(records, image)) return false;
+
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+  return static_cast<bool>(out);
+}
+
+bool read_signature_list(
+    const std::string& path, std::vector<SignatureRecord>& out, size_t* error_line) {
+  std::ifstream in(path);
+  if (!in) return false;
+
+  out.clear();
+  std::string line;
+  for (size_t number = 1; std::getline(in, line); ++number) {
+    if (const size_t comment = line.find('#'); comment != std::string::npos) {
+      line.erase(comment);
+    }
+
+    std::istringstream tokens(line);
+    SignatureRecord record;
+    if (!(tokens >> record.name)) continue; // Blank line
+
+    std::string pattern, token;
+    while (tokens >> token) {
+      if (token[0] == '+' || token[0] == '-') {
+        char* end = nullptr;
+        record.offset = std::strtoll(token.c_str(), &end, 0);
+        if (*end != '\0' || (tokens >> token)) pattern.clear(); // Offset must be last
+        break;
+      }
+      if (!pattern.empty()) pattern += ' ';
+      pattern += token;
+    }
+
+    if (pattern.empty() || !compile_pattern(pattern, record.pattern)) {
+      if (error_line) *error_line = number;
+      return false;
+    }
+    out.push_back(std::move(record));
+  }
+  return true;
+}
+} // namespace fusion
+
@@ -0,0 +1,175 @@
+﻿#include "fusion/pattern.h"
+#include "fusion/profile.h"
+#include "fusion/settings.h"
+
+#include <cctype>
+
+namespace fusion {
+namespace {
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool compile_ida(const std::string& text, CompiledPattern& out) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    if (std::isspace(static_cast<unsigned char>(text[pos]))) {
+      ++pos;
+      continue;
+    }
+
+    size_t end = pos;
+    while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+      ++end;
+    }
+    const std::string token = text.substr(pos, end - pos);
+    pos = end;
+
+    if (token == "?" || token == "??") {
+      out.add_byte(0, 0x00);
+      continue;
+    }
+    if (token.size() > 2) return false;
+
+    // Single digits are a full byte ("A" == "0A"), pairs may wildcard either nibble
+    uint8_t byte = 0, byte_mask = 0;
+    for (char c : token) {
+      byte <<= 4;
+      byte_mask <<= 4;
+      if (c == '?') continue;
+      const int value = hex_value(c);
+      if (value < 0) return false;
+      byte |= static_cast<uint8_t>(value);
+      byte_mask |= 0x0F;
+    }
+    if (token.size() == 1) byte_mask = 0xFF;
+    out.add_byte(byte, byte_mask);
+  }
+  return true;
+}
+
+size_t skip_spaces(const std::string& text, size_t pos) {
+  while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+    ++pos;
+  }
+  return pos;
+}
+
+bool compile_code(const std::string& text, CompiledPattern& out) {
+  size_t pos = skip_spaces(text, 0);
+  while (text.compare(pos, 2, "\\x") == 0) {
+    if (pos + 3 >= text.size()) return false;
+    const int hi = hex_value(text[pos + 2]);
+    const int lo = hex_value(text[pos + 3]);
+    if (hi < 0 || lo < 0) return false;
+    out.add_byte(static_cast<uint8_t>(hi << 4 | lo));
+    pos += 4;
+  }
+
+  pos = skip_spaces(text, pos);
+  if (pos == text.size()) {
+    const uint8_t wildcard = g_settings.has(UseAltWildcard) ? 0x2A : 0x00;
+    for (size_t i = 0; i < out.size(); ++i) {
+      if (out.bytes[i] == wildcard) {
+        out.bytes[i] = 0;
+        out.mask[i] = 0x00;
+      }
+    }
+    return true;
+  }
+
+  // Explicit xx?x mask, one character per byte
+  std::string mask = text.substr(pos);
+  while (!mask.empty() && std::isspace(static_cast<unsigned char>(mask.back()))) {
+    mask.pop_back();
+  }
+  if (mask.size() != out.size()) return false;
+  for (size_t i = 0; i < mask.size(); ++i) {
+    if (mask[i] == '?') {
+      out.bytes[i] = 0;
+      out.mask[i] = 0x00;
+    } else if (mask[i] != 'x') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parse the inside of a `[min-max]` or `[n]` gap
+bool parse_gap(const std::string& text, PatternGap& out) {
+  const size_t dash = text.find('-');
+  const auto parse = [](const std::string& digits, uint32_t& value) {
+    if (digits.empty() || digits.size() > 6) return false;
+    value = 0;
+    for (char c : digits) {
+      if (!std::isdigit(static_cast<unsigned char>(c))) return false;
+      value = value * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return true;
+  };
+
+  if (dash == std::string::npos) {
+    if (!parse(text, out.min)) return false;
+    out.max = out.min;
+  } else if (!parse(text.substr(0, dash), out.min) || !parse(text.substr(dash + 1), out.max)) {
+    return false;
+  }
+  return out.min <= out.max && out.max <= max_pattern_gap;
+}
+} // namespace
+
+bool compile_pattern(const std::string& text, CompiledPattern& out) {
+  FUSION_PHASE(Parse);
+  out = {};
+  const bool ok = text.find("\\x") != std::string::npos ? compile_code(text, out)
+                                                         : compile_ida(text, out);
+  if (!ok) out = {};
+  return ok && !out.empty();
+}
+
+bool has_pattern_gaps(const std::string& text) {
+  return text.find('[') != std::string::npos;
+}
+
+bool compile_composite_pattern(const std::string& text, CompositePattern& out) {
+  FUSION_PHASE(Parse);
+  out = {};
+  if (text.find("\\x") != std::string::npos) return false;
+
+  // Split at each bracketed gap and compile the IDA-style text between them
+  std::string fragment;
+  const auto add_fragment = [&] {
+    CompiledPattern compiled;
+    if (!compile_ida(fragment, compiled) || compiled.empty()) return false;
+    out.fragments.push_back(std::move(compiled));
+    fragment.clear();
+    return true;
+  };
+
+  for (size_t pos = 0; pos < text.size(); ++pos) {
+    if (text[pos] != '[') {
+      fragment += text[pos];
+      continue;
+    }
+
+    const size_t close = text.find(']', pos);
+    PatternGap gap;
+    if (close == std::string::npos || !add_fragment()
+        || !parse_gap(text.substr(pos + 1, close - pos - 1), gap)) {
+      out = {};
+      return false;
+    }
+    out.gaps.push_back(gap);
+    pos = close;
+  }
+
+  if (!add_fragment()) {
+    out = {};
+    return false;
+  }
+  return true;
+}
+} // namespace fusion
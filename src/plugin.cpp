@@ -1,30 +1,131 @@
 ﻿#include "fusion/plugin.h"
+#include "fusion/common_pattern.h"
+#include "fusion/database.h"
+#include "fusion/export.h"
+#include "fusion/library.h"
+#include "fusion/revalidate.h"
 #include "fusion/settings.h"
 #include "fusion/signature.h"
+#include "fusion/similarity.h"
+#include "fusion/source.h"
+#include "fusion/tokens.h"
+#include "fusion/x86_decoder.h"
 
+#include <funcs.hpp>
 #include <idp.hpp>
 #include <kernwin.hpp>
 #include <loader.hpp>
+#include <name.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
 
 namespace fusion {
+// Start of every function that begins in the selected range, or of the one at the cursor
+static std::vector<ea_t> selected_function_starts() {
+  ea_t start = 0, end = 0;
+  if (!read_range_selection(nullptr, &start, &end)) {
+    start = get_screen_ea();
+    end = start + 1;
+  }
+
+  std::vector<ea_t> starts;
+  func_t* func = get_func(start);
+  if (!func || func->start_ea < start) func = get_next_func(start);
+  for (; func && func->start_ea < end; func = get_next_func(func->start_ea)) {
+    starts.push_back(func->start_ea);
+  }
+  return starts;
+}
+
+// Names or hex addresses separated by spaces or commas. Returns false, after a warning, if one
+// is neither.
+static bool parse_address_list(const char* text, std::vector<ea_t>& out) {
+  std::string list = text;
+  std::replace(list.begin(), list.end(), ',', ' ');
+
+  std::istringstream words(list);
+  std::string word;
+  while (words >> word) {
+    ea_t ea = get_name_ea(BADADDR, word.c_str());
+    if (ea == BADADDR) {
+      char* end = nullptr;
+      ea = static_cast<ea_t>(std::strtoull(word.c_str(), &end, 16));
+      if (*end != '\0') {
+        warning("[Fusion] Unknown address or name: %s", word.c_str());
+        return false;
+      }
+    }
+    out.push_back(ea);
+  }
+  return true;
+}
+
 void show_settings_dialog() {
-  if (ask_form("Fusion — Settings\n"
-               "<#Auto jump to found signatures:C>\n"
-               "<#Use selected range for signature creation:C>\n"
-               "<#Show mnemonic opcodes when creating signatures:C>\n"
-               "<#Copy created signatures to clipboard:C>\n"
-               "<#Include mask for CODE signatures (xx??xx):C>\n"
-               "<#Allow signature creation in dangerous regions:C>\n"
-               "<#Stop at first match when searching:C>\n"
-               "<#Use \"??\" as wildcard for IDA style:C>\n"
-               "<#Use \"2A\" as wildcard for CODE style:C>>\n",
-          &g_settings.flags)) {
+  static char segments[256] = {};
+  uint32_t flags = g_settings.flags;
+  qsnprintf(segments, sizeof(segments), "%s", g_settings.scope_segments.c_str());
+  int scope = static_cast<int>(g_settings.scope);
+  uval_t scope_start = g_settings.scope_start;
+  uval_t scope_end = g_settings.scope_end;
+
+  while (ask_form("Fusion — Settings\n"
+                  "<#Auto jump to found signatures:C>\n"
+                  "<#Use selected range for signature creation:C>\n"
+                  "<#Show mnemonic opcodes when creating signatures:C>\n"
+                  "<#Copy created signatures to clipboard:C>\n"
+                  "<#Include mask for CODE signatures (xx??xx):C>\n"
+                  "<#Allow signature creation in dangerous regions:C>\n"
+                  "<#Stop at first match when searching:C>\n"
+                  "<#Use \"??\" as wildcard for IDA style:C>\n"
+                  "<#Use \"2A\" as wildcard for CODE style:C>\n"
+                  "<#Use built-in x86 decoder for signature creation:C>\n"
+                  "<#Print per-phase timings after each operation:C>\n"
+                  "<#Allow IDA signatures of two fragments with a gap:C>\n"
+                  "<#Only match function starts when searching and checking uniqueness:C>>\n"
+                  "Search and uniqueness scope\n"
+                  "<#Whole database:R>\n"
+                  "<#Code segments:R>\n"
+                  "<#Named segments:R>\n"
+                  "<#Address range:R>>\n"
+                  "<Segment names:A5:256:40>\n"
+                  "<Range start:N:20:20::>\n"
+                  "<Range end:N:20:20::>\n",
+             &flags,
+             &scope,
+             &segments,
+             &scope_start,
+             &scope_end)) {
+    Settings scoped = g_settings;
+    scoped.flags = flags;
+    scoped.scope = static_cast<SearchScope>(scope);
+    scoped.scope_segments = segments;
+    scoped.scope_start = scope_start;
+    scoped.scope_end = scope_end;
+
+    // An empty scope would make every create fail and every search find nothing
+    if (scoped.scope == SearchScope::Range && scope_start >= scope_end) {
+      warning("[Fusion] The range end must be above the range start.");
+      continue;
+    }
+    if (scope_ranges(ida_segments(), scoped).empty()) {
+      if (scoped.scope == SearchScope::Segments) {
+        warning("[Fusion] No segment is named any of: %s", segments);
+      } else {
+        warning("[Fusion] The search scope covers no segment.");
+      }
+      continue;
+    }
+
+    g_settings = std::move(scoped);
     run_plugin();
+    return;
   }
 }
 
 void run_plugin() {
-  char form_str[512];
+  char form_str[2048];
   qsnprintf(form_str,
       sizeof(form_str),
       "IDA-Fusion for %.1f+\n"
@@ -33,6 +134,17 @@ void run_plugin() {
       "<#Generate CRC-32 hash:R>\n"
       "<#Generate FNV-1a hash:R>\n"
       "<#Search for signature:R>\n"
+      "<#Search for CRC-32 hash:R>\n"
+      "<#Find similar functions:R>\n"
+      "<#Export function sketches:R>\n"
+      "<#Signature library:R>\n"
+      "<#Export signatures as C++ header:R>\n"
+      "<#Verify built-in x86 decoder:R>\n"
+      "<#Export mock database fixture:R>\n"
+      "<#Generate IDA signature unique across builds:R>\n"
+      "<#Generate instruction token signature (T:...):R>\n"
+      "<#Generate IDA signature matching several addresses:R>\n"
+      "<#Find longest common pattern of selected functions:R>\n"
       "<#Settings:R>>\n",
       static_cast<float>(IDA_SDK_VERSION) / 100.0f);
 
@@ -68,8 +180,50 @@ void run_plugin() {
 
   case 4: {
     static char pattern[8192] = {};
-    if (ask_form("Fusion — Search\n<Signature:A5:8192:100>", &pattern)) {
-      find_signature(pattern,
+    static sval_t distance = 0;
+    static sval_t max_matches = 1000;
+    if (!ask_form("Fusion — Search\n"
+                  "<Signature:A5:8192:100>\n"
+                  "<Allowed differing bytes (0 = exact):D:10:10::>\n"
+                  "<Maximum approximate matches (0 = all):D:10:10::>\n",
+             &pattern,
+             &distance,
+             &max_matches)) {
+      break;
+    }
+
+    // With as many differences as fixed bytes every address would match
+    if (CompiledPattern compiled; distance > 0 && !has_pattern_gaps(pattern)
+        && compile_pattern(pattern, compiled)
+        && static_cast<size_t>(distance) >= compiled.view().fixed_bytes()) {
+      warning("[Fusion] Allow fewer differing bytes than the %zu fixed bytes of the signature.",
+          compiled.view().fixed_bytes());
+      break;
+    }
+
+    find_signature(pattern,
+        {.silent = false,
+            .stop_at_first = g_settings.has(StopAtFirst),
+            .ignore_addr = 0,
+            .start_addr = 0,
+            .jump_to_found = g_settings.has(AutoJumpToFound),
+            .max_distance = static_cast<uint32_t>(std::max<sval_t>(distance, 0)),
+            .max_matches = static_cast<size_t>(std::max<sval_t>(max_matches, 0)),
+            .function_starts_only = g_settings.has(FunctionStartsOnly)});
+    break;
+  }
+
+  case 5: {
+    static uval_t hash = 0;
+    static sval_t length = 0;
+    if (ask_form("Fusion — Search CRC-32\n"
+                 "<CRC-32 hash:N:10:10::>\n"
+                 "<Length in bytes:D:10:10::>\n",
+            &hash,
+            &length)
+        && length > 0) {
+      find_crc32_signature(static_cast<uint32_t>(hash),
+          static_cast<size_t>(length),
           {.silent = false,
               .stop_at_first = g_settings.has(StopAtFirst),
               .ignore_addr = 0,
@@ -79,7 +233,146 @@ void run_plugin() {
     break;
   }
 
-  case 5:
+  case 6: {
+    static int source = 0;
+    if (ask_form("Fusion — Similar functions\n"
+                 "<#Search this database:R>\n"
+                 "<#Search exported function sketches:R>>\n",
+            &source)) {
+      if (source == 0) {
+        find_similar_functions(nullptr);
+      } else if (const char* path = ask_file(false, "*.fsk", "Select exported function sketches")) {
+        find_similar_functions(path);
+      }
+    }
+    break;
+  }
+
+  case 7:
+    if (const char* path = ask_file(true, "*.fsk", "Export function sketches")) {
+      export_function_sketches(path);
+    }
+    break;
+
+  case 8: {
+    static int action = 0;
+    if (!ask_form("Fusion — Signature library\n"
+                  "<#Apply signature library:R>\n"
+                  "<#Build library from text list:R>\n"
+                  "<#Revalidate library against this database:R>>\n",
+            &action)) {
+      break;
+    }
+
+    if (action == 0) {
+      if (const char* path = ask_file(false, "*.fsl", "Select signature library")) {
+        apply_signature_library(path);
+      }
+    } else if (action == 2) {
+      if (const char* input = ask_file(false, "*.fsl", "Select signature library")) {
+        const std::string input_path = input;
+        if (const char* path = ask_file(true, "*.fsl", "Save updated signature library")) {
+          revalidate_signature_library(input_path.c_str(), path);
+        }
+      }
+    } else if (const char* list = ask_file(false, "*.txt", "Select signature list")) {
+      const std::string list_path = list;
+      if (const char* path = ask_file(true, "*.fsl", "Save signature library")) {
+        build_signature_library(list_path.c_str(), path);
+      }
+    }
+    break;
+  }
+
+  case 9: {
+    static int source = 0;
+    if (ask_form("Fusion — Export C++ header\n"
+                 "<#Create signatures for selected functions:R>\n"
+                 "<#Signatures created this session:R>>\n",
+            &source)) {
+      if (const char* path = ask_file(true, "*.h", "Export signatures as C++ header")) {
+        export_cpp_header(path, source == 1);
+      }
+    }
+    break;
+  }
+
+  case 10:
+    verify_builtin_decoder();
+    break;
+
+  case 11:
+    if (const char* path = ask_file(true, "*.fdb", "Export mock database fixture")) {
+      export_mock_database(path);
+    }
+    break;
+
+  case 12: {
+    // Other builds are picked one file at a time until the dialog is cancelled
+    std::vector<std::string> references;
+    while (const char* path = ask_file(false,
+               "*.*",
+               "Select reference build %zu (cancel when done)",
+               references.size() + 1)) {
+      references.emplace_back(path);
+    }
+    if (references.empty()) break;
+
+    show_wait_box("[Fusion] Creating IDA signature for %zu builds...", references.size() + 1);
+    create_multi_image_signature(SignatureStyle::IDA, references);
+    hide_wait_box();
+    break;
+  }
+
+  case 13:
+    show_wait_box("[Fusion] Creating instruction token signature...");
+    create_token_signature();
+    hide_wait_box();
+    break;
+
+  case 14: {
+    static int source = 0;
+    static char addresses[8192] = {};
+    if (!ask_form("Fusion — Group signature\n"
+                  "<#Functions starting in the selected range:R>\n"
+                  "<#Listed addresses or names:R>>\n"
+                  "<Addresses or names:A5:8192:100>\n",
+            &source,
+            &addresses)) {
+      break;
+    }
+
+    std::vector<ea_t> targets;
+    if (source == 0) {
+      targets = selected_function_starts();
+    } else if (!parse_address_list(addresses, targets)) {
+      break;
+    }
+    if (targets.size() < 2) {
+      warning("[Fusion] Select at least two addresses for a group signature.");
+      break;
+    }
+
+    show_wait_box("[Fusion] Creating IDA signature for %zu addresses...", targets.size());
+    create_group_signature(targets);
+    hide_wait_box();
+    break;
+  }
+
+  case 15: {
+    const std::vector<ea_t> functions = selected_function_starts();
+    if (functions.size() < 2) {
+      warning("[Fusion] Select a range with at least two functions.");
+      break;
+    }
+
+    show_wait_box("[Fusion] Comparing %zu functions...", functions.size());
+    find_common_pattern(functions);
+    hide_wait_box();
+    break;
+  }
+
+  case 16:
     show_settings_dialog();
     break;
 
@@ -99,13 +392,18 @@ static bool idaapi plugin_run(size_t) {
 }
 
 static plugmod_t* idaapi plugin_init() {
+  fusion::watch_database_changes();
   return PLUGIN_OK;
 }
 
+static void idaapi plugin_term() {
+  fusion::unwatch_database_changes();
+}
+
 extern "C" plugin_t PLUGIN = {IDP_INTERFACE_VERSION,
     PLUGIN_PROC,
     plugin_init,
-    nullptr,
+    plugin_term,
     plugin_run,
     "Fast signature scanner & creator for IDA 9.0+",
     "https://github.com/coconutbird/IDA-Fusion",
@@ -0,0 +1,110 @@
+﻿#include "fusion/process.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+namespace fusion {
+bool parse_process_maps(const std::string& text, std::vector<ProcessMapping>& out) {
+  out.clear();
+  std::istringstream lines(text);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.empty()) continue;
+
+    // start-end perms offset dev inode [path]
+    std::istringstream fields(line);
+    ProcessMapping mapping;
+    std::string range, device, inode;
+    if (!(fields >> range >> mapping.permissions >> std::hex >> mapping.file_offset >> device
+            >> inode)) {
+      return false;
+    }
+
+    const size_t dash = range.find('-');
+    if (dash == std::string::npos) return false;
+    try {
+      mapping.start = std::stoull(range.substr(0, dash), nullptr, 16);
+      mapping.end = std::stoull(range.substr(dash + 1), nullptr, 16);
+    } catch (const std::exception&) {
+      return false;
+    }
+    if (mapping.end < mapping.start) return false;
+
+    // The path may contain spaces and runs to the end of the line
+    std::getline(fields >> std::ws, mapping.path);
+    out.push_back(std::move(mapping));
+  }
+  return true;
+}
+
+bool read_process_maps(int pid, std::vector<ProcessMapping>& out) {
+  std::ifstream in("/proc/" + std::to_string(pid) + "/maps");
+  if (!in) return false;
+
+  std::ostringstream text;
+  text << in.rdbuf();
+  return parse_process_maps(text.str(), out) && !out.empty();
+}
+
+std::optional<ModuleAddress> module_address(
+    const std::vector<ProcessMapping>& mappings, uint64_t address) {
+  const auto containing = std::find_if(mappings.begin(), mappings.end(), [&](const auto& m) {
+    return address >= m.start && address < m.end;
+  });
+  if (containing == mappings.end() || containing->path.empty() || containing->path[0] == '[') {
+    return std::nullopt;
+  }
+
+  // Offsets are relative to where the file's first mapping starts, like a module base
+  uint64_t base = containing->start;
+  for (const auto& mapping : mappings) {
+    if (mapping.path == containing->path) base = std::min(base, mapping.start);
+  }
+
+  const size_t slash = containing->path.find_last_of('/');
+  return ModuleAddress{
+      slash == std::string::npos ? containing->path : containing->path.substr(slash + 1),
+      address - base};
+}
+
+ProcessByteSource::ProcessByteSource(int pid, std::vector<ProcessMapping> mappings)
+    : pid_(pid), mappings_(std::move(mappings)) {
+  std::erase_if(mappings_, [](const auto& m) { return !m.readable() || m.end == m.start; });
+  std::sort(mappings_.begin(), mappings_.end(), [](const auto& a, const auto& b) {
+    return a.start < b.start;
+  });
+}
+
+std::vector<AddressRange> ProcessByteSource::segments() const {
+  std::vector<AddressRange> segments;
+  segments.reserve(mappings_.size());
+  for (const auto& mapping : mappings_) {
+    segments.push_back({mapping.start, mapping.end});
+  }
+  return segments;
+}
+
+size_t ProcessByteSource::read(uint64_t address, uint8_t* out, size_t size) const {
+#ifdef __linux__
+  size_t total = 0;
+  while (total < size) {
+    const iovec local{out + total, size - total};
+    const iovec remote{reinterpret_cast<void*>(address + total), size - total};
+    const ssize_t read = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+    if (read <= 0) break;
+    total += static_cast<size_t>(read);
+  }
+  return total;
+#else
+  static_cast<void>(address);
+  static_cast<void>(out);
+  static_cast<void>(size);
+  return 0;
+#endif
+}
+} // namespace fusion
@@ -0,0 +1,178 @@
+﻿#include "fusion/profile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+namespace fusion {
+namespace {
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Totals {
+  std::array<std::atomic<uint64_t>, phase_count> nanoseconds{};
+  std::array<std::atomic<uint64_t>, phase_count> calls{};
+  std::array<std::atomic<uint64_t>, counter_count> counters{};
+  std::atomic<int64_t> started_ns{now_ns()};
+};
+
+Totals& totals() {
+  static Totals instance;
+  return instance;
+}
+
+/// Milliseconds with precision matching the magnitude, e.g. "0.042 ms", "12.3 ms", "1840 ms"
+std::string format_ms(uint64_t nanoseconds) {
+  const double ms = static_cast<double>(nanoseconds) / 1e6;
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), ms < 1 ? "%.3f ms" : ms < 100 ? "%.1f ms" : "%.0f ms", ms);
+  return buf;
+}
+
+std::string format_bytes(uint64_t bytes) {
+  char buf[32];
+  if (bytes >= (1ull << 30)) {
+    std::snprintf(buf, sizeof(buf), "%.2f GiB", static_cast<double>(bytes) / (1ull << 30));
+  } else if (bytes >= (1ull << 20)) {
+    std::snprintf(buf, sizeof(buf), "%.1f MiB", static_cast<double>(bytes) / (1ull << 20));
+  } else {
+    std::snprintf(buf, sizeof(buf), "%llu bytes", static_cast<unsigned long long>(bytes));
+  }
+  return buf;
+}
+} // namespace
+
+const char* phase_name(Phase phase) {
+  switch (phase) {
+  case Phase::Fetch:
+    return "fetch";
+  case Phase::Decode:
+    return "decode";
+  case Phase::Parse:
+    return "parse";
+  case Phase::Scan:
+    return "scan";
+  case Phase::Render:
+    return "render";
+  case Phase::Ui:
+    return "ui";
+  }
+  return "?";
+}
+
+const char* counter_name(Counter counter) {
+  switch (counter) {
+  case Counter::BytesScanned:
+    return "bytes_scanned";
+  case Counter::Candidates:
+    return "candidates";
+  case Counter::Scans:
+    return "scans";
+  case Counter::Instructions:
+    return "instructions";
+  case Counter::Matches:
+    return "matches";
+  }
+  return "?";
+}
+
+void profile_reset() {
+  Totals& t = totals();
+  for (size_t i = 0; i < phase_count; ++i) {
+    t.nanoseconds[i] = 0;
+    t.calls[i] = 0;
+  }
+  for (auto& counter : t.counters) {
+    counter = 0;
+  }
+  t.started_ns = now_ns();
+}
+
+ProfileSnapshot profile_snapshot() {
+  const Totals& t = totals();
+  ProfileSnapshot snapshot;
+  for (size_t i = 0; i < phase_count; ++i) {
+    snapshot.nanoseconds[i] = t.nanoseconds[i].load(std::memory_order_relaxed);
+    snapshot.calls[i] = t.calls[i].load(std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < counter_count; ++i) {
+    snapshot.counters[i] = t.counters[i].load(std::memory_order_relaxed);
+  }
+  snapshot.elapsed_ns = static_cast<uint64_t>(now_ns() - t.started_ns.load());
+  return snapshot;
+}
+
+void profile_add_time(Phase phase, uint64_t nanoseconds) {
+  Totals& t = totals();
+  t.nanoseconds[static_cast<size_t>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+  t.calls[static_cast<size_t>(phase)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void profile_add(Counter counter, uint64_t value) {
+  totals().counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+std::string format_profile(const ProfileSnapshot& snapshot) {
+  std::string text = format_ms(snapshot.elapsed_ns);
+
+  const char* separator = ": ";
+  for (size_t i = 0; i < phase_count; ++i) {
+    if (!snapshot.calls[i]) continue;
+    text += separator;
+    text += phase_name(static_cast<Phase>(i));
+    text += ' ';
+    text += format_ms(snapshot.nanoseconds[i]);
+    separator = ", ";
+  }
+
+  separator = "; ";
+  for (size_t i = 0; i < counter_count; ++i) {
+    const uint64_t value = snapshot.counters[i];
+    if (!value) continue;
+
+    const auto counter = static_cast<Counter>(i);
+    text += separator;
+    if (counter == Counter::BytesScanned) {
+      text += format_bytes(value) + " scanned";
+    } else {
+      text += std::to_string(value) + ' ' + counter_name(counter);
+    }
+    separator = ", ";
+  }
+  return text;
+}
+
+std::string profile_json(const std::string& operation, const ProfileSnapshot& snapshot) {
+  // Operation names are plain identifiers chosen by the caller, so they need no escaping
+  std::string json = "{\"operation\": \"" + operation + "\", \"elapsed_ns\": ";
+  json += std::to_string(snapshot.elapsed_ns);
+
+  json += ", \"phases\": {";
+  for (size_t i = 0; i < phase_count; ++i) {
+    json += i ? ", \"" : "\"";
+    json += phase_name(static_cast<Phase>(i));
+    json += "\": {\"ns\": " + std::to_string(snapshot.nanoseconds[i]);
+    json += ", \"calls\": " + std::to_string(snapshot.calls[i]) + "}";
+  }
+
+  json += "}, \"counters\": {";
+  for (size_t i = 0; i < counter_count; ++i) {
+    json += i ? ", \"" : "\"";
+    json += counter_name(static_cast<Counter>(i));
+    json += "\": " + std::to_string(snapshot.counters[i]);
+  }
+  json += "}}";
+  return json;
+}
+
+bool append_profile_json(
+    const std::string& path, const std::string& operation, const ProfileSnapshot& snapshot) {
+  std::ofstream out(path, std::ios::app);
+  if (!out) return false;
+  out << profile_json(operation, snapshot) << '\n';
+  return static_cast<bool>(out);
+}
+} // namespace fusion
@@ -0,0 +1,141 @@
+﻿#include "fusion/revalidate.h"
+#include "fusion/export.h"
+#include "fusion/parallel.h"
+#include "fusion/scanner.h"
+#include "fusion/signature.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace fusion {
+namespace {
+SignatureRecord library_record(const SignatureLibrary& library, size_t index) {
+  SignatureRecord record;
+  record.name = library.name(index);
+  record.offset = library.entry(index).target_offset;
+
+  const PatternView view = library.pattern(index);
+  for (size_t i = 0; i < view.size; ++i) {
+    record.pattern.add_byte(view.bytes[i], view.mask[i]);
+  }
+  return record;
+}
+
+const char* status_text(EntryStatus status) {
+  switch (status) {
+  case EntryStatus::Unique:
+    return "unique";
+  case EntryStatus::Multiple:
+    return "multiple";
+  case EntryStatus::Missing:
+    return "missing";
+  }
+  return "?";
+}
+} // namespace
+
+size_t RevalidationReport::count(EntryStatus status) const {
+  return std::count_if(entries.begin(), entries.end(), [&](const auto& e) {
+    return e.status == status;
+  });
+}
+
+size_t RevalidationReport::regenerated() const {
+  return std::count_if(entries.begin(), entries.end(), [](const auto& e) {
+    return e.regenerated.has_value();
+  });
+}
+
+std::vector<SignatureRecord> RevalidationReport::updated_records() const {
+  std::vector<SignatureRecord> records;
+  records.reserve(entries.size());
+  for (const auto& entry : entries) {
+    records.push_back(entry.regenerated ? *entry.regenerated : entry.original);
+  }
+  return records;
+}
+
+RevalidationReport revalidate_library(const SignatureLibrary& library,
+    const Database& db,
+    const EntryLocator& locate,
+    unsigned max_threads) {
+  RevalidationReport report;
+  report.entries.resize(library.size());
+  for (size_t i = 0; i < library.size(); ++i) {
+    report.entries[i].original = library_record(library, i);
+  }
+
+  // One pass over the image for the whole library; matches come grouped by entry
+  for (const auto& match : scan_library(db.image(), library, max_threads)) {
+    RevalidatedEntry& entry = report.entries[match.entry];
+    if (++entry.matches == 1) {
+      entry.target = match.address + entry.original.offset;
+    }
+  }
+
+  std::vector<size_t> broken;
+  for (size_t i = 0; i < report.entries.size(); ++i) {
+    RevalidatedEntry& entry = report.entries[i];
+    entry.status = entry.matches == 1 ? EntryStatus::Unique
+                   : entry.matches  ? EntryStatus::Multiple
+                                    : EntryStatus::Missing;
+    if (entry.status == EntryStatus::Unique) continue;
+
+    entry.target = locate ? locate(entry.original.name) : std::nullopt;
+    if (entry.target && entry.original.offset == 0) broken.push_back(i);
+  }
+
+  // Each regeneration scans single-threaded so that entries, not chunks, are spread over cores
+  parallel_for(broken.size(), max_threads, [&](size_t i) {
+    RevalidatedEntry& entry = report.entries[broken[i]];
+    SignatureBuilder builder;
+    if (!build_unique_signature(db.image(), db.decoder(), *entry.target, builder, {}, 1)) return;
+
+    builder.trim_wildcards();
+    entry.regenerated = SignatureRecord{entry.original.name, builder.compile(), 0};
+  });
+
+  return report;
+}
+
+std::string format_revalidation_report(const RevalidationReport& report) {
+  char line[256];
+  std::snprintf(line,
+      sizeof(line),
+      "%zu signatures: %zu unique, %zu multiple, %zu missing; %zu regenerated\n",
+      report.entries.size(),
+      report.count(EntryStatus::Unique),
+      report.count(EntryStatus::Multiple),
+      report.count(EntryStatus::Missing),
+      report.regenerated());
+  std::string text = line;
+
+  for (const auto& entry : report.entries) {
+    if (entry.status == EntryStatus::Unique) continue;
+
+    text += '\n' + entry.original.name + ": " + status_text(entry.status);
+    if (entry.status == EntryStatus::Multiple) {
+      text += " (" + std::to_string(entry.matches) + " matches)";
+    }
+
+    if (entry.regenerated) {
+      std::snprintf(line, sizeof(line), ", regenerated at 0x%llX\n",
+          static_cast<unsigned long long>(*entry.target));
+      text += line;
+      text += "- " + render_ida_pattern(entry.original.pattern) + '\n';
+      text += "+ " + render_ida_pattern(entry.regenerated->pattern) + '\n';
+    } else if (entry.target && entry.original.offset != 0) {
+      std::snprintf(line, sizeof(line), ", located at 0x%llX but has a target offset\n",
+          static_cast<unsigned long long>(*entry.target));
+      text += line;
+    } else if (entry.target) {
+      std::snprintf(line, sizeof(line), ", located at 0x%llX but no unique signature there\n",
+          static_cast<unsigned long long>(*entry.target));
+      text += line;
+    } else {
+      text += ", not located\n";
+    }
+  }
+  return text;
+}
+} // namespace fusion
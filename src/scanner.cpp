@@ -0,0 +1,544 @@
+﻿#include "fusion/scanner.h"
+#include "fusion/parallel.h"
+#include "fusion/profile.h"
+#include "fusion/trace.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace fusion {
+namespace {
+// Candidate start positions per work item
+constexpr size_t chunk_positions = 1 << 20;
+
+// Rough frequency of each byte value in x86-64 code; higher means more common.
+// Only used to steer anchors away from bytes that would produce many false candidates.
+constexpr std::array<uint8_t, 256> make_byte_weights() {
+  std::array<uint8_t, 256> weights{};
+  weights[0x00] = 8;
+  weights[0x48] = 7;
+  weights[0xFF] = 6;
+  weights[0x8B] = 6;
+  weights[0xCC] = 6;
+  weights[0x89] = 5;
+  for (uint8_t b : {0x24, 0x4C, 0x0F, 0xE8, 0x8D, 0x90}) {
+    weights[b] = 4;
+  }
+  for (uint8_t b : {0x85, 0xC0, 0x44, 0x83, 0x41, 0x01}) {
+    weights[b] = 3;
+  }
+  for (uint8_t b : {0x08, 0x10, 0x20, 0x28, 0x30, 0x38, 0x40, 0x45, 0x49, 0x4D, 0x74, 0x75,
+           0xC3, 0x33, 0xEB, 0x18}) {
+    weights[b] = 2;
+  }
+  return weights;
+}
+
+constexpr auto byte_weights = make_byte_weights();
+
+struct Chunk {
+  const SnapshotRegion* region;
+  size_t first;
+  size_t count;
+};
+
+// Split every region into chunks of candidate start positions for a `length`-byte window
+std::vector<Chunk> make_chunks(const ImageSnapshot& snapshot, size_t length) {
+  std::vector<Chunk> chunks;
+  for (const auto& region : snapshot.regions) {
+    if (region.bytes.size() < length) continue;
+    const size_t positions = region.bytes.size() - length + 1;
+    for (size_t first = 0; first < positions; first += chunk_positions) {
+      chunks.push_back({&region, first, std::min(chunk_positions, positions - first)});
+    }
+  }
+  return chunks;
+}
+
+template <typename T>
+std::vector<T> concat(std::vector<std::vector<T>>& parts) {
+  size_t total = 0;
+  for (const auto& part : parts) {
+    total += part.size();
+  }
+
+  std::vector<T> result;
+  result.reserve(total);
+  for (auto& part : parts) {
+    result.insert(result.end(), part.begin(), part.end());
+  }
+  return result;
+}
+
+void scan_chunk(const Chunk& chunk,
+    const PatternView& pattern,
+    size_t anchor,
+    std::vector<uint64_t>& results) {
+  const uint8_t* data = chunk.region->bytes.data();
+  const uint8_t needle = pattern.bytes[anchor];
+
+  [[maybe_unused]] uint64_t candidates = 0;
+  const uint8_t* cur = data + chunk.first + anchor;
+  const uint8_t* const stop = cur + chunk.count;
+  while (cur < stop) {
+    cur = static_cast<const uint8_t*>(std::memchr(cur, needle, static_cast<size_t>(stop - cur)));
+    if (!cur) break;
+
+    ++candidates;
+    const uint8_t* start = cur - anchor;
+    if (pattern.matches(start)) {
+      results.push_back(chunk.region->start + static_cast<uint64_t>(start - data));
+    }
+    ++cur;
+  }
+  FUSION_COUNT(Candidates, candidates);
+}
+
+// Fragment of `pattern` least likely to occur: most fixed bits, less what common bytes give away
+size_t rarest_fragment(const CompositePattern& pattern) {
+  size_t best = 0;
+  int best_score = -1;
+  for (size_t i = 0; i < pattern.fragments.size(); ++i) {
+    const CompiledPattern& fragment = pattern.fragments[i];
+    int score = 0;
+    for (size_t j = 0; j < fragment.size(); ++j) {
+      score += std::popcount(fragment.mask[j]);
+      if (fragment.mask[j] == 0xFF) score -= byte_weights[fragment.bytes[j]];
+    }
+    if (score > best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+// Offsets in `region` where `fragment` matches and one of the sorted `anchors` lies within
+// [offset + low, offset + high]
+std::vector<size_t> place_fragment(const SnapshotRegion& region,
+    const CompiledPattern& fragment,
+    const std::vector<size_t>& anchors,
+    int64_t low,
+    int64_t high) {
+  std::vector<size_t> placed;
+  const auto limit = static_cast<int64_t>(region.bytes.size() - fragment.size());
+  const int64_t first = std::max<int64_t>(static_cast<int64_t>(anchors.front()) - high, 0);
+  const int64_t last = std::min(static_cast<int64_t>(anchors.back()) - low, limit);
+
+  auto next = anchors.begin();
+  for (int64_t offset = first; offset <= last; ++offset) {
+    // Both window bounds only grow, so anchors that fell behind never come back
+    while (next != anchors.end() && static_cast<int64_t>(*next) < offset + low) ++next;
+    if (next == anchors.end()) break;
+    if (static_cast<int64_t>(*next) > offset + high) continue;
+    if (fragment.matches(region.bytes.data() + offset)) placed.push_back(offset);
+  }
+  return placed;
+}
+
+// Add the starts of every match of `pattern` whose fragment `anchor` is at `hit` in `region`
+void verify_composite(const SnapshotRegion& region,
+    const CompositePattern& pattern,
+    size_t anchor,
+    size_t hit,
+    std::vector<uint64_t>& results) {
+  const auto& fragments = pattern.fragments;
+  if (hit + fragments[anchor].size() > region.bytes.size()) return;
+
+  // Later fragments: every placement starting a gap after some end of the previous one. All
+  // ends are kept, since with variable gaps any of them may be the one the next fragment needs.
+  // Only whether some chain reaches the last fragment matters, not which one.
+  std::vector<size_t> ends = {hit + fragments[anchor].size()};
+  for (size_t i = anchor + 1; i < fragments.size() && !ends.empty(); ++i) {
+    const PatternGap gap = pattern.gaps[i - 1];
+    ends = place_fragment(region, fragments[i], ends, -int64_t{gap.max}, -int64_t{gap.min});
+    for (size_t& end : ends) {
+      end += fragments[i].size();
+    }
+  }
+  if (ends.empty()) return;
+
+  // Earlier fragments: every placement ending a gap before some start of the next one
+  std::vector<size_t> starts = {hit};
+  for (size_t i = anchor; i-- > 0 && !starts.empty();) {
+    const auto size = static_cast<int64_t>(fragments[i].size());
+    const PatternGap gap = pattern.gaps[i];
+    starts = place_fragment(region, fragments[i], starts, size + gap.min, size + gap.max);
+  }
+  for (const size_t start : starts) {
+    results.push_back(region.start + start);
+  }
+}
+
+// Pattern as little-endian 8-byte words for the fuzzy kernel; padding bytes have mask 0
+struct PatternWords {
+  std::vector<uint64_t> bytes;
+  std::vector<uint64_t> mask;
+  size_t size = 0;
+
+  explicit PatternWords(const PatternView& pattern) : size(pattern.size) {
+    const size_t words = (pattern.size + 7) / 8;
+    std::vector<uint8_t> padded_bytes(words * 8), padded_mask(words * 8);
+    std::memcpy(padded_bytes.data(), pattern.bytes, pattern.size);
+    std::memcpy(padded_mask.data(), pattern.mask, pattern.size);
+
+    bytes.resize(words);
+    mask.resize(words);
+    std::memcpy(bytes.data(), padded_bytes.data(), words * 8);
+    std::memcpy(mask.data(), padded_mask.data(), words * 8);
+  }
+};
+
+// Number of non-zero bytes in `x`: the high bit of each byte is set if any of its bits are
+uint32_t count_nonzero_bytes(uint64_t x) {
+  constexpr uint64_t low7 = 0x7F7F7F7F7F7F7F7F;
+  return static_cast<uint32_t>(std::popcount((((x & low7) + low7) | x) & ~low7));
+}
+
+// Differing bytes of `pattern` at `window`; any value above `max_distance` means too many
+uint32_t fuzzy_distance(const uint8_t* window, const PatternWords& pattern, uint32_t max_distance) {
+  const size_t full_words = pattern.size / 8;
+  const size_t tail = pattern.size % 8;
+
+  uint32_t distance = 0;
+  size_t word = 0;
+  for (; word < full_words && distance <= max_distance; ++word) {
+    uint64_t value;
+    std::memcpy(&value, window + word * 8, 8);
+    distance += count_nonzero_bytes((value & pattern.mask[word]) ^ pattern.bytes[word]);
+  }
+  // The window ends inside the last word, so only its own bytes are read
+  if (tail && distance <= max_distance) {
+    uint64_t value = 0;
+    std::memcpy(&value, window + word * 8, tail);
+    distance += count_nonzero_bytes((value & pattern.mask[word]) ^ pattern.bytes[word]);
+  }
+  return distance;
+}
+
+// Closer first, then lower addresses
+bool closer(const FuzzyMatch& a, const FuzzyMatch& b) {
+  return a.distance != b.distance ? a.distance < b.distance : a.address < b.address;
+}
+
+// Positions of `chunk` from `start_addr` on within `max_distance`. Once `max_matches` are
+// found, `results` is a max-heap on `closer`: later positions have higher addresses, so they
+// only get in by being strictly closer than the worst kept one, and the cutoff drops to match.
+void fuzzy_chunk(const Chunk& chunk,
+    const PatternWords& pattern,
+    uint32_t max_distance,
+    size_t max_matches,
+    uint64_t start_addr,
+    std::vector<FuzzyMatch>& results) {
+  if (max_matches == 0) return;
+  const uint8_t* data = chunk.region->bytes.data();
+  const uint64_t base = chunk.region->start;
+  const size_t end = chunk.first + chunk.count;
+  size_t pos = chunk.first;
+  if (start_addr > base + pos) pos = static_cast<size_t>(std::min<uint64_t>(start_addr - base, end));
+
+  uint32_t cutoff = max_distance;
+  for (; pos < end; ++pos) {
+    const uint32_t distance = fuzzy_distance(data + pos, pattern, cutoff);
+    if (distance > cutoff) continue;
+
+    if (results.size() < max_matches) {
+      results.push_back({base + pos, distance});
+      if (results.size() < max_matches) continue;
+      std::make_heap(results.begin(), results.end(), closer);
+    } else {
+      std::pop_heap(results.begin(), results.end(), closer);
+      results.back() = {base + pos, distance};
+      std::push_heap(results.begin(), results.end(), closer);
+    }
+
+    if (results.front().distance == 0) break;
+    cutoff = results.front().distance - 1;
+  }
+}
+
+[[maybe_unused]] uint64_t snapshot_bytes(const ImageSnapshot& snapshot) {
+  uint64_t bytes = 0;
+  for (const auto& region : snapshot.regions) {
+    bytes += region.bytes.size();
+  }
+  return bytes;
+}
+
+void scan_library_chunk(const Chunk& chunk,
+    const SignatureLibrary& library,
+    std::vector<LibraryMatch>& results) {
+  const auto& bytes = chunk.region->bytes;
+  const uint8_t* data = bytes.data();
+
+  for (size_t pos = chunk.first; pos < chunk.first + chunk.count; ++pos) {
+    const auto [begin, end] = library.bucket(static_cast<uint16_t>(data[pos] | data[pos + 1] << 8));
+    for (uint32_t index = begin; index < end; ++index) {
+      const LibraryEntry& entry = library.entry(index);
+      if (pos < entry.anchor_offset) continue;
+
+      const size_t start = pos - entry.anchor_offset;
+      if (start + entry.pattern_size > bytes.size()) continue;
+
+      if (library.pattern(index).matches(data + start)) {
+        results.push_back({index, chunk.region->start + start});
+      }
+    }
+  }
+}
+} // namespace
+
+std::optional<size_t> choose_anchor_byte(const PatternView& pattern) {
+  std::optional<size_t> best;
+  for (size_t i = 0; i < pattern.size; ++i) {
+    if (pattern.mask[i] != 0xFF) continue;
+    if (!best || byte_weights[pattern.bytes[i]] < byte_weights[pattern.bytes[*best]]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+std::optional<size_t> choose_anchor_pair(const PatternView& pattern) {
+  std::optional<size_t> best;
+  int best_weight = 0;
+  for (size_t i = 0; i + 1 < pattern.size; ++i) {
+    if (pattern.mask[i] != 0xFF || pattern.mask[i + 1] != 0xFF) continue;
+    const int weight = byte_weights[pattern.bytes[i]] + byte_weights[pattern.bytes[i + 1]];
+    if (!best || weight < best_weight) {
+      best = i;
+      best_weight = weight;
+    }
+  }
+  return best;
+}
+
+std::vector<uint64_t> scan_pattern(
+    const ImageSnapshot& snapshot, const PatternView& pattern, unsigned max_threads) {
+  if (pattern.size == 0) return {};
+
+  FUSION_PHASE(Scan);
+  FUSION_TRACE("scan_pattern", "pattern_bytes", pattern.size);
+  FUSION_COUNT(Scans, 1);
+  FUSION_COUNT(BytesScanned, snapshot_bytes(snapshot));
+
+  const auto chunks = make_chunks(snapshot, pattern.size);
+  std::vector<std::vector<uint64_t>> chunk_results(chunks.size());
+
+  const auto anchor = choose_anchor_byte(pattern);
+  parallel_for(chunks.size(), max_threads, [&](size_t i) {
+    const Chunk& chunk = chunks[i];
+    FUSION_TRACE("scan_chunk", "positions", chunk.count);
+    if (anchor) {
+      scan_chunk(chunk, pattern, *anchor, chunk_results[i]);
+      return;
+    }
+
+    // Nothing to anchor on: every position is a candidate
+    FUSION_COUNT(Candidates, chunk.count);
+    const uint8_t* data = chunk.region->bytes.data();
+    for (size_t pos = chunk.first; pos < chunk.first + chunk.count; ++pos) {
+      if (pattern.matches(data + pos)) {
+        chunk_results[i].push_back(chunk.region->start + pos);
+      }
+    }
+  });
+
+  return concat(chunk_results);
+}
+
+std::vector<uint64_t> scan_composite(
+    const ImageSnapshot& snapshot, const CompositePattern& pattern, unsigned max_threads) {
+  if (pattern.fragments.empty()) return {};
+  if (pattern.fragments.size() == 1) {
+    return scan_pattern(snapshot, pattern.fragments[0].view(), max_threads);
+  }
+
+  FUSION_TRACE("scan_composite", "fragments", pattern.fragments.size());
+  const size_t anchor = rarest_fragment(pattern);
+  const auto hits = scan_pattern(snapshot, pattern.fragments[anchor].view(), max_threads);
+
+  FUSION_PHASE(Scan);
+  constexpr size_t hits_per_task = 1024;
+  const size_t tasks = (hits.size() + hits_per_task - 1) / hits_per_task;
+  std::vector<std::vector<uint64_t>> task_results(tasks);
+  parallel_for(tasks, max_threads, [&](size_t i) {
+    const size_t end = std::min(hits.size(), (i + 1) * hits_per_task);
+    for (size_t h = i * hits_per_task; h < end; ++h) {
+      const SnapshotRegion* region = find_region(snapshot, hits[h]);
+      verify_composite(*region, pattern, anchor, hits[h] - region->start, task_results[i]);
+    }
+  });
+
+  // Hits of a later fragment can share a start when the gaps before it vary
+  auto matches = concat(task_results);
+  std::sort(matches.begin(), matches.end());
+  matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+  return matches;
+}
+
+std::vector<uint64_t> match_at(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    const std::vector<uint64_t>& candidates) {
+  FUSION_PHASE(Scan);
+  FUSION_COUNT(Candidates, candidates.size());
+  std::vector<uint64_t> matches;
+  for (const uint64_t candidate : candidates) {
+    const SnapshotRegion* region = find_region(snapshot, candidate);
+    if (region && pattern.size <= region->end() - candidate
+        && pattern.matches(region->bytes.data() + (candidate - region->start))) {
+      matches.push_back(candidate);
+    }
+  }
+  return matches;
+}
+
+std::vector<uint64_t> match_at(const ImageSnapshot& snapshot,
+    const CompositePattern& pattern,
+    const std::vector<uint64_t>& candidates) {
+  FUSION_PHASE(Scan);
+  FUSION_COUNT(Candidates, candidates.size());
+  std::vector<uint64_t> matches;
+  if (pattern.fragments.empty()) return matches;
+
+  for (const uint64_t candidate : candidates) {
+    // With the first fragment as the anchor, a match can only start at the candidate itself
+    if (const SnapshotRegion* region = find_region(snapshot, candidate)) {
+      verify_composite(*region, pattern, 0, candidate - region->start, matches);
+    }
+  }
+  return matches;
+}
+
+std::vector<FuzzyMatch> fuzzy_scan(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    uint32_t max_distance,
+    unsigned max_threads,
+    size_t max_matches,
+    uint64_t start_addr) {
+  if (pattern.size == 0) return {};
+
+  FUSION_PHASE(Scan);
+  FUSION_TRACE("fuzzy_scan", "max_distance", max_distance);
+  FUSION_COUNT(Scans, 1);
+  FUSION_COUNT(BytesScanned, snapshot_bytes(snapshot));
+
+  const PatternWords words(pattern);
+  const auto chunks = make_chunks(snapshot, pattern.size);
+  std::vector<std::vector<FuzzyMatch>> chunk_results(chunks.size());
+  parallel_for(chunks.size(), max_threads, [&](size_t i) {
+    FUSION_TRACE("fuzzy_chunk", "positions", chunks[i].count);
+    fuzzy_chunk(chunks[i], words, max_distance, max_matches, start_addr, chunk_results[i]);
+  });
+
+  auto results = concat(chunk_results);
+  std::sort(results.begin(), results.end(), closer);
+  if (results.size() > max_matches) results.resize(max_matches);
+  return results;
+}
+
+std::vector<FuzzyMatch> fuzzy_match_at(const ImageSnapshot& snapshot,
+    const PatternView& pattern,
+    uint32_t max_distance,
+    const std::vector<uint64_t>& candidates) {
+  FUSION_PHASE(Scan);
+  FUSION_COUNT(Candidates, candidates.size());
+  std::vector<FuzzyMatch> matches;
+  if (pattern.size == 0) return matches;
+
+  const PatternWords words(pattern);
+  for (const uint64_t candidate : candidates) {
+    const SnapshotRegion* region = find_region(snapshot, candidate);
+    if (!region || pattern.size > region->end() - candidate) continue;
+
+    const uint8_t* window = region->bytes.data() + (candidate - region->start);
+    const uint32_t distance = fuzzy_distance(window, words, max_distance);
+    if (distance <= max_distance) matches.push_back({candidate, distance});
+  }
+  std::sort(matches.begin(), matches.end(), closer);
+  return matches;
+}
+
+std::vector<std::vector<uint64_t>> scan_source(const ByteSource& source,
+    const std::vector<PatternView>& patterns,
+    size_t chunk_size,
+    unsigned max_threads) {
+  // Skipping past an unreadable byte resumes at the next page
+  constexpr uint64_t page_size = 0x1000;
+
+  std::vector<std::vector<uint64_t>> results(patterns.size());
+  size_t overlap = 0;
+  for (const auto& pattern : patterns) {
+    overlap = std::max(overlap, pattern.size ? pattern.size - 1 : 0);
+  }
+  chunk_size = std::max<size_t>(chunk_size, 1);
+
+  ImageSnapshot window;
+  auto& region = window.regions.emplace_back();
+  for (const AddressRange& segment : source.segments()) {
+    for (uint64_t start = segment.start; start < segment.end;) {
+      const size_t wanted =
+          static_cast<size_t>(std::min<uint64_t>(chunk_size + overlap, segment.end - start));
+      region.start = start;
+      region.bytes.resize(wanted);
+      {
+        FUSION_PHASE(Fetch);
+        region.bytes.resize(source.read(start, region.bytes.data(), wanted));
+      }
+
+      // A match starting in the overlap is found again by the next chunk, unless this chunk
+      // is the last one or the read stopped early
+      const bool complete = region.bytes.size() == wanted && start + wanted < segment.end;
+      const uint64_t accept_end = complete ? start + chunk_size : segment.end;
+      for (size_t i = 0; i < patterns.size(); ++i) {
+        for (uint64_t address : scan_pattern(window, patterns[i], max_threads)) {
+          if (address < accept_end) results[i].push_back(address);
+        }
+      }
+
+      if (complete) {
+        start += chunk_size;
+      } else if (region.bytes.size() == wanted) {
+        break;
+      } else {
+        // Resume on the page after the first unreadable byte
+        start = (start + region.bytes.size() + page_size) & ~(page_size - 1);
+      }
+    }
+  }
+  return results;
+}
+
+std::vector<LibraryMatch> scan_library(
+    const ImageSnapshot& snapshot, const SignatureLibrary& library, unsigned max_threads) {
+  FUSION_PHASE(Scan);
+  FUSION_TRACE("scan_library", "entries", library.size());
+  FUSION_COUNT(Scans, 1);
+  FUSION_COUNT(BytesScanned, snapshot_bytes(snapshot));
+
+  // Anchor pairs are read at every position that has a following byte
+  const auto chunks = make_chunks(snapshot, 2);
+  std::vector<std::vector<LibraryMatch>> chunk_results(chunks.size());
+
+  parallel_for(chunks.size(), max_threads, [&](size_t i) {
+    FUSION_TRACE("library_chunk", "positions", chunks[i].count);
+    scan_library_chunk(chunks[i], library, chunk_results[i]);
+  });
+
+  auto results = concat(chunk_results);
+
+  // Entries without an anchor pair fall back to individual scans
+  for (size_t index = library.anchored_count(); index < library.size(); ++index) {
+    for (uint64_t address : scan_pattern(snapshot, library.pattern(index), max_threads)) {
+      results.push_back({static_cast<uint32_t>(index), address});
+    }
+  }
+
+  std::sort(results.begin(), results.end(), [](const auto& a, const auto& b) {
+    return a.entry != b.entry ? a.entry < b.entry : a.address < b.address;
+  });
+  return results;
+}
+} // namespace fusion
@@ -0,0 +1,180 @@
+﻿#include "fusion/serialize.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Record layout:
+//   varint  pattern length
+//   u8      flags (RecordFlag)
+//   u8[n]   pattern bytes, wildcarded bits zeroed
+//   mask    u8[n] if RawMask, otherwise alternating exact/wildcard run lengths as varints
+//   varint  zigzag offset             (HasOffset)
+//   varint  name length, u8[] name    (HasName)
+//
+// Set layout: "FSIG", u8 version, varint record count, records.
+
+namespace fusion {
+namespace {
+enum RecordFlag : uint8_t {
+  HasOffset = 1 << 0,
+  HasName = 1 << 1,
+  RawMask = 1 << 2, // Pattern has nibble wildcards, so the mask is not just 0x00/0xFF runs
+};
+
+constexpr uint8_t known_flags = HasOffset | HasName | RawMask;
+constexpr char set_magic[4] = {'F', 'S', 'I', 'G'};
+
+void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+bool read_varint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (data == end) return false;
+    const uint8_t byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// Sizes and counts each need at least one byte per unit, so anything larger is corrupt
+bool read_size(const uint8_t*& data, const uint8_t* end, size_t& size) {
+  uint64_t value = 0;
+  if (!read_varint(data, end, value)) return false;
+  if (value > static_cast<uint64_t>(end - data)) return false;
+  size = static_cast<size_t>(value);
+  return true;
+}
+} // namespace
+
+void serialize_signature(const SignatureRecord& record, std::vector<uint8_t>& out) {
+  const auto& pattern = record.pattern;
+  const size_t length = pattern.size();
+
+  const bool raw_mask = std::any_of(
+      pattern.mask.begin(), pattern.mask.end(), [](uint8_t m) { return m != 0x00 && m != 0xFF; });
+
+  uint8_t flags = 0;
+  if (record.offset != 0) flags |= HasOffset;
+  if (!record.name.empty()) flags |= HasName;
+  if (raw_mask) flags |= RawMask;
+
+  write_varint(out, length);
+  out.push_back(flags);
+  out.insert(out.end(), pattern.bytes.begin(), pattern.bytes.end());
+
+  if (raw_mask) {
+    out.insert(out.end(), pattern.mask.begin(), pattern.mask.end());
+  } else {
+    // Runs alternate exact/wildcard, starting with a (possibly empty) exact run
+    bool exact = true;
+    for (size_t i = 0; i < length;) {
+      size_t run = 0;
+      while (i + run < length && (pattern.mask[i + run] == 0xFF) == exact) {
+        ++run;
+      }
+      write_varint(out, run);
+      i += run;
+      exact = !exact;
+    }
+  }
+
+  if (flags & HasOffset) {
+    const auto value = static_cast<uint64_t>(record.offset);
+    write_varint(out, (value << 1) ^ static_cast<uint64_t>(record.offset >> 63));
+  }
+  if (flags & HasName) {
+    write_varint(out, record.name.size());
+    out.insert(out.end(), record.name.begin(), record.name.end());
+  }
+}
+
+bool deserialize_signature(const uint8_t*& data, const uint8_t* end, SignatureRecord& out) {
+  out = {};
+
+  size_t length = 0;
+  if (!read_size(data, end, length) || data == end) return false;
+  const uint8_t flags = *data++;
+  if (flags & ~known_flags) return false;
+
+  if (static_cast<size_t>(end - data) < length) return false;
+  out.pattern.bytes.resize(length);
+  std::memcpy(out.pattern.bytes.data(), data, length);
+  data += length;
+
+  out.pattern.mask.resize(length);
+  if (flags & RawMask) {
+    if (static_cast<size_t>(end - data) < length) return false;
+    std::memcpy(out.pattern.mask.data(), data, length);
+    data += length;
+  } else {
+    bool exact = true;
+    for (size_t i = 0; i < length;) {
+      uint64_t run = 0;
+      if (!read_varint(data, end, run) || run > length - i) return false;
+      std::fill_n(out.pattern.mask.begin() + static_cast<ptrdiff_t>(i), run, exact ? 0xFF : 0x00);
+      i += static_cast<size_t>(run);
+      exact = !exact;
+    }
+  }
+  // Matching compares masked image bytes with the pattern bytes, so a set bit under a wildcard
+  // would make the record match nothing
+  for (size_t i = 0; i < length; ++i) {
+    if (out.pattern.bytes[i] & ~out.pattern.mask[i]) return false;
+  }
+
+  if (flags & HasOffset) {
+    uint64_t value = 0;
+    if (!read_varint(data, end, value)) return false;
+    out.offset = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+  if (flags & HasName) {
+    size_t name_size = 0;
+    if (!read_size(data, end, name_size) || static_cast<size_t>(end - data) < name_size) {
+      return false;
+    }
+    out.name.assign(reinterpret_cast<const char*>(data), name_size);
+    data += name_size;
+  }
+  return true;
+}
+
+std::vector<uint8_t> serialize_signatures(const std::vector<SignatureRecord>& records) {
+  std::vector<uint8_t> out(set_magic, set_magic + sizeof(set_magic));
+  out.push_back(signature_format_version);
+  write_varint(out, records.size());
+  for (const auto& record : records) {
+    serialize_signature(record, out);
+  }
+  return out;
+}
+
+bool deserialize_signatures(const uint8_t* data, size_t size, std::vector<SignatureRecord>& out) {
+  out.clear();
+  const uint8_t* end = data + size;
+
+  if (size < sizeof(set_magic) + 1 || std::memcmp(data, set_magic, sizeof(set_magic)) != 0) {
+    return false;
+  }
+  data += sizeof(set_magic);
+  if (*data++ != signature_format_version) return false;
+
+  size_t count = 0;
+  if (!read_size(data, end, count)) return false;
+
+  out.resize(count);
+  for (auto& record : out) {
+    if (!deserialize_signature(data, end, record)) {
+      out.clear();
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace fusion
@@ -1,14 +1,15 @@
 ﻿#include "fusion/signature.h"
+#include "fusion/crc32.h"
+#include "fusion/parallel.h"
+#include "fusion/profile.h"
+#include "fusion/scanner.h"
+#include "fusion/trace.h"
 #include "fusion/settings.h"
-#include "fusion/utils.h"
 
-#include <bytes.hpp>
-#include <funcs.hpp>
-#include <kernwin.hpp>
-#include <search.hpp>
-
-#include <regex>
+#include <algorithm>
+#include <cstdio>
 #include <sstream>
+#include <thread>
 
 namespace fusion {
 void SignatureBuilder::clear() {
@@ -35,6 +36,7 @@ void SignatureBuilder::trim_wildcards() {
 }
 
 std::string SignatureBuilder::render(SignatureStyle style) const {
+  FUSION_PHASE(Render);
   switch (style) {
   case SignatureStyle::Code:
     return render_code();
@@ -42,12 +44,12 @@ std::string SignatureBuilder::render(SignatureStyle style) const {
     return render_ida();
   case SignatureStyle::FNV1A: {
     char buf[16];
-    qsnprintf(buf, sizeof(buf), "0x%08X", hash_fnv1a());
+    snprintf(buf, sizeof(buf), "0x%08X", hash_fnv1a());
     return buf;
   }
   case SignatureStyle::CRC32: {
     char buf[16];
-    qsnprintf(buf, sizeof(buf), "0x%08X", hash_crc32());
+    snprintf(buf, sizeof(buf), "0x%08X", hash_crc32());
     return buf;
   }
   }
@@ -64,7 +66,7 @@ std::string SignatureBuilder::render_code() const {
       ss << wildcard;
     } else {
       char buf[8];
-      qsnprintf(buf, sizeof(buf), "\\x%02X", bytes_[i]);
+      snprintf(buf, sizeof(buf), "\\x%02X", bytes_[i]);
       ss << buf;
     }
   }
@@ -90,7 +92,7 @@ std::string SignatureBuilder::render_ida() const {
       ss << wildcard;
     } else {
       char buf[4];
-      qsnprintf(buf, sizeof(buf), "%02X", bytes_[i]);
+      snprintf(buf, sizeof(buf), "%02X", bytes_[i]);
       ss << buf;
     }
   }
@@ -98,6 +100,16 @@ std::string SignatureBuilder::render_ida() const {
   return ss.str();
 }
 
+CompiledPattern SignatureBuilder::compile() const {
+  CompiledPattern pattern;
+  pattern.bytes.reserve(bytes_.size());
+  pattern.mask.reserve(bytes_.size());
+  for (size_t i = 0; i < bytes_.size(); ++i) {
+    pattern.add_byte(bytes_[i], wildcards_[i] ? 0x00 : 0xFF);
+  }
+  return pattern;
+}
+
 uint32_t SignatureBuilder::hash_fnv1a() const {
   uint32_t hash = 0x811c9dc5;
   for (uint8_t byte : bytes_) {
@@ -107,195 +119,521 @@ uint32_t SignatureBuilder::hash_fnv1a() const {
 }
 
 uint32_t SignatureBuilder::hash_crc32() const {
-  uint32_t crc = 0xFFFFFFFF;
-  for (uint8_t byte : bytes_) {
-    crc ^= byte;
-    for (int i = 0; i < 8; ++i) {
-      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
-    }
-  }
-  return ~crc;
+  return crc32(bytes_.data(), bytes_.size());
 }
 
-// Convert CODE-style signature to IDA-style for searching
-static std::string normalize_pattern(std::string pattern) {
-  if (pattern.find("\\x") == std::string::npos) {
-    return pattern;
+void add_instruction(SignatureBuilder& builder, const uint8_t* bytes, const InsnInfo& insn) {
+  for (uint32_t i = 0; i < insn.size; ++i) {
+    builder.add_byte(bytes[i], insn.is_wildcard(i));
   }
+}
 
-  // Convert \x to space, remove mask chars, convert 00 to ?
-  pattern = std::regex_replace(pattern, std::regex("\\\\x"), " ");
-  pattern = std::regex_replace(pattern, std::regex("[x?]"), "");
-  pattern = std::regex_replace(pattern, std::regex("00"), "?");
+namespace {
+bool decode_instruction(
+    const InsnDecoder& decoder, uint64_t addr, const uint8_t* bytes, size_t size, InsnInfo& insn) {
+  FUSION_PHASE(Decode);
+  FUSION_COUNT(Instructions, 1);
+  return decoder.decode(addr, bytes, size, insn) && insn.size != 0;
+}
 
-  // Trim leading space
-  if (!pattern.empty() && pattern[0] == ' ') {
-    pattern.erase(0, 1);
-  }
-  return pattern;
+// Keep the candidates `pattern` still matches at
+void refine_candidates(
+    const ImageSnapshot& image, const CompiledPattern& pattern, std::vector<uint64_t>& candidates) {
+  FUSION_PHASE(Scan);
+  FUSION_COUNT(Candidates, candidates.size());
+  std::erase_if(candidates, [&](uint64_t candidate) {
+    const SnapshotRegion* other = find_region(image, candidate);
+    return !other || candidate + pattern.size() > other->end()
+           || !pattern.matches(other->bytes.data() + (candidate - other->start));
+  });
 }
 
-std::vector<ea_t> find_signature(const std::string& pattern, const FindSettings& settings) {
-  std::vector<ea_t> results;
-  const std::string normalized = normalize_pattern(pattern);
+// Threads for each of `images` scans running side by side
+unsigned threads_per_image(size_t images) {
+  const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+  return std::max(cores / static_cast<unsigned>(std::max<size_t>(images, 1)), 1u);
+}
 
-  if (!settings.silent) {
-    hide_wait_box();
-    show_wait_box("[Fusion] Searching...");
-  }
+ReferenceStatus reference_status(size_t matches, bool matched_once) {
+  if (matches == 1) return ReferenceStatus::Unique;
+  if (matches > 1) return ReferenceStatus::Ambiguous;
+  return matched_once ? ReferenceStatus::Lost : ReferenceStatus::Missing;
+}
 
-  auto [ea_min, ea_max] = utils::get_address_range();
-  ea_t addr = (settings.start_addr > 0 ? static_cast<ea_t>(settings.start_addr) : ea_min) - 1;
+// Longest fragment build_composite_signature creates, and how far from the target it looks
+// for the second one. Checking a tail costs time proportional to its distance.
+constexpr size_t composite_fragment_bytes = 16;
+constexpr uint64_t composite_max_span = 4096;
+
+struct DecodedInsn {
+  uint64_t address;
+  const uint8_t* bytes;
+  InsnInfo info;
+};
+
+// Whether `pattern` matches anywhere from `first` to `last` in `image`
+bool matches_in_window(
+    const ImageSnapshot& image, const CompiledPattern& pattern, uint64_t first, uint64_t last) {
+  const SnapshotRegion* region = find_region(image, first);
+  if (!region || region->bytes.size() < pattern.size()) return false;
+
+  last = std::min(last, region->end() - pattern.size());
+  for (uint64_t addr = first; addr <= last; ++addr) {
+    if (pattern.matches(region->bytes.data() + (addr - region->start))) return true;
+  }
+  return false;
+}
 
-#if IDA_SDK_VERSION >= 900
-  compiled_binpat_vec_t compiled;
-  parse_binpat_str(&compiled, addr, normalized.c_str(), 16);
-#endif
+// Drop wildcards at the end of `pattern`; they only keep it from matching near a region end
+void trim_trailing_wildcards(CompiledPattern& pattern) {
+  while (!pattern.empty() && pattern.mask.back() == 0x00) {
+    pattern.bytes.pop_back();
+    pattern.mask.pop_back();
+  }
+}
 
-  while (true) {
-#if IDA_SDK_VERSION >= 900
-    addr = bin_search(addr + 1, ea_max, compiled, BIN_SEARCH_NOCASE | BIN_SEARCH_FORWARD);
-#else
-    addr = find_binary(addr + 1, ea_max, normalized.c_str(), 16, SEARCH_DOWN);
-#endif
+// build_unique_signature, with the other matches taken from `starts` instead of a scan if given
+bool grow_unique_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    const std::vector<uint64_t>* starts,
+    SignatureBuilder& builder,
+    const InsnCallback& on_instruction,
+    unsigned max_threads) {
+  FUSION_TRACE("create_signature", "address", target);
+  const SnapshotRegion* region = find_region(image, target);
+  if (!region) return false;
+
+  // A longer signature can only match where its prefix did, so after one full scan
+  // only the surviving candidates need to be rechecked
+  std::vector<uint64_t> candidates;
+  bool scanned = false;
+
+  for (uint64_t addr = target; addr < region->end();) {
+    const size_t offset = addr - region->start;
+    const uint8_t* bytes = region->bytes.data() + offset;
+
+    InsnInfo insn;
+    if (!decode_instruction(decoder, addr, bytes, region->bytes.size() - offset, insn)) {
+      return false;
+    }
 
-    if (addr == 0 || addr == BADADDR) break;
-    if (addr == static_cast<ea_t>(settings.ignore_addr)) continue;
+    add_instruction(builder, bytes, insn);
+    if (on_instruction) on_instruction(addr);
+    addr += insn.size;
 
-    if (settings.jump_to_found && results.empty()) {
-      jumpto(addr);
+    const CompiledPattern pattern = builder.compile();
+    if (!scanned) {
+      candidates = starts ? match_at(image, pattern.view(), *starts)
+                          : scan_pattern(image, pattern.view(), max_threads);
+      std::erase(candidates, target);
+      scanned = true;
+    } else {
+      refine_candidates(image, pattern, candidates);
     }
 
-    results.push_back(addr);
+    if (candidates.empty()) return true;
+  }
+
+  return false;
+}
+} // namespace
+
+bool build_unique_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    SignatureBuilder& builder,
+    const InsnCallback& on_instruction,
+    unsigned max_threads) {
+  return grow_unique_signature(
+      image, decoder, target, nullptr, builder, on_instruction, max_threads);
+}
 
-    if (!settings.silent) {
-      replace_wait_box(
-          "[Fusion] Found %zu match%s", results.size(), results.size() > 1 ? "es" : "");
-      msg("[Fusion] %zu. Found at 0x%llX\n", results.size(), static_cast<uint64_t>(addr));
+bool build_unique_signature_among(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    const std::vector<uint64_t>& starts,
+    SignatureBuilder& builder,
+    const InsnCallback& on_instruction) {
+  return grow_unique_signature(image, decoder, target, &starts, builder, on_instruction, 0);
+}
+
+bool build_multi_image_signature(const ImageSnapshot& image,
+    const std::vector<const ImageSnapshot*>& references,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    SignatureBuilder& builder,
+    std::vector<ReferenceResult>& results,
+    const InsnCallback& on_instruction) {
+  FUSION_TRACE("create_signature", "references", references.size());
+  results.assign(references.size(), {});
+  const SnapshotRegion* region = find_region(image, target);
+  if (!region) return false;
+
+  // The database itself comes first; candidates are tracked per image as in
+  // build_unique_signature
+  std::vector<const ImageSnapshot*> images{&image};
+  images.insert(images.end(), references.begin(), references.end());
+  std::vector<std::vector<uint64_t>> candidates(images.size());
+  std::vector<bool> matched_once(references.size());
+  const unsigned threads = threads_per_image(images.size());
+  bool scanned = false;
+
+  for (uint64_t addr = target; addr < region->end();) {
+    const size_t offset = addr - region->start;
+    const uint8_t* bytes = region->bytes.data() + offset;
+
+    InsnInfo insn;
+    if (!decode_instruction(decoder, addr, bytes, region->bytes.size() - offset, insn)) {
+      return false;
     }
 
-    if (settings.stop_at_first) break;
-  }
+    add_instruction(builder, bytes, insn);
+    if (on_instruction) on_instruction(addr);
+    addr += insn.size;
 
-  if (!settings.silent) {
-    hide_wait_box();
-    if (results.empty()) {
-      msg("[Fusion] No matches found\n");
-    } else if (results.size() > 1) {
-      msg("[Fusion] Found %zu matches\n", results.size());
+    const CompiledPattern pattern = builder.compile();
+    parallel_for(images.size(), 0, [&](size_t i) {
+      if (!scanned) {
+        candidates[i] = scan_pattern(*images[i], pattern.view(), threads);
+      } else {
+        refine_candidates(*images[i], pattern, candidates[i]);
+      }
+    });
+    if (!scanned) std::erase(candidates[0], target);
+    scanned = true;
+
+    bool unique = candidates[0].empty();
+    for (size_t r = 0; r < references.size(); ++r) {
+      const auto& found = candidates[r + 1];
+      matched_once[r] = matched_once[r] || found.size() == 1;
+      results[r] = {reference_status(found.size(), matched_once[r]), found.empty() ? 0 : found[0]};
+
+      if (results[r].status == ReferenceStatus::Lost) return false;
+      unique = unique && found.size() <= 1;
     }
-    beep(beep_default);
+
+    if (unique) return true;
   }
 
-  return results;
+  return false;
 }
 
-// Helper to add instruction bytes to signature builder
-static void add_instruction_bytes(SignatureBuilder& builder, ea_t addr, const insn_t& insn) {
-  const int imm_offset = utils::get_immediate_offset(insn);
-  for (ea_t i = addr; i < addr + insn.size; ++i) {
-    const bool is_wildcard = imm_offset > 0 && (i - addr) >= imm_offset;
-    builder.add_byte(get_byte(i), is_wildcard);
+bool build_composite_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t target,
+    uint64_t end,
+    CompositePattern& out) {
+  FUSION_TRACE("create_composite", "address", target);
+  const SnapshotRegion* region = find_region(image, target);
+  if (!region) return false;
+
+  std::vector<DecodedInsn> insns;
+  end = std::min({end, region->end(), target + composite_max_span});
+  for (uint64_t addr = target; addr < end;) {
+    const size_t offset = addr - region->start;
+    const uint8_t* bytes = region->bytes.data() + offset;
+
+    InsnInfo insn;
+    if (!decode_instruction(decoder, addr, bytes, region->bytes.size() - offset, insn)) break;
+    insns.push_back({addr, bytes, insn});
+    addr += insn.size;
   }
-}
 
-std::string create_signature(SignatureStyle style) {
-  const ea_t target = get_screen_ea();
+  SignatureBuilder head;
+  size_t next = 0;
+  for (; next < insns.size(); ++next) {
+    if (head.size() + insns[next].info.size > composite_fragment_bytes) break;
+    add_instruction(head, insns[next].bytes, insns[next].info);
+  }
+  if (head.empty()) return false;
+
+  // Every match of a composite starts with a match of its head, so the tail only has to be
+  // absent from the gap window after each other head
+  const CompiledPattern head_pattern = head.compile();
+  std::vector<uint64_t> others = scan_pattern(image, head_pattern.view());
+  std::erase(others, target);
+  if (others.empty()) return false;
+
+  // The shortest tail wins, and the nearest of equally short ones, since less code between
+  // the fragments can change
+  const uint64_t head_end = target + head_pattern.size();
+  std::optional<CompiledPattern> best;
+  PatternGap best_gap;
+  for (size_t first = next; first < insns.size(); ++first) {
+    const size_t limit = best ? best->size() - 1 : composite_fragment_bytes;
+    const auto distance = static_cast<uint32_t>(insns[first].address - head_end);
+    const PatternGap gap{distance - distance / 4, distance + distance / 4};
+
+    std::vector<uint64_t> remaining = others;
+    SignatureBuilder tail;
+    for (size_t last = first; last < insns.size(); ++last) {
+      if (tail.size() + insns[last].info.size > limit) break;
+      add_instruction(tail, insns[last].bytes, insns[last].info);
+
+      CompiledPattern tail_pattern = tail.compile();
+      std::erase_if(remaining, [&](uint64_t other) {
+        const uint64_t window = other + head_pattern.size();
+        return !matches_in_window(image, tail_pattern, window + gap.min, window + gap.max);
+      });
+      if (remaining.empty()) {
+        best = std::move(tail_pattern);
+        best_gap = gap;
+        break;
+      }
+    }
+  }
+  if (!best) return false;
+
+  out.fragments = {head_pattern, std::move(*best)};
+  out.gaps = {best_gap};
+  return true;
+}
 
-  // Validate we're in a valid region (get_func_num returns -1 if not in a function)
-  if (!g_settings.has(AllowDangerousRegions) && get_func_num(target) == -1) {
-    hide_wait_box();
-    warning("[Fusion] 0x%llX is not in a valid function.\n"
-            "Enable 'Allow dangerous regions' in settings to override.",
-        static_cast<uint64_t>(target));
-    return {};
+bool build_group_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    std::vector<uint64_t> targets,
+    CompiledPattern& out,
+    const InsnCallback& on_instruction) {
+  FUSION_TRACE("create_group_signature", "targets", targets.size());
+  std::sort(targets.begin(), targets.end());
+  targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+  if (targets.empty()) return false;
+
+  // The copies are compared byte by byte up to the first region end among them
+  std::vector<const uint8_t*> copies;
+  size_t length = SIZE_MAX;
+  for (uint64_t target : targets) {
+    const SnapshotRegion* region = find_region(image, target);
+    if (!region) return false;
+    copies.push_back(region->bytes.data() + (target - region->start));
+    length = std::min<size_t>(length, region->end() - target);
   }
 
-  SignatureBuilder builder;
-  auto [ea_min, ea_max] = utils::get_address_range();
+  // Every target matches the pattern by construction, so it is exact once the candidates
+  // are down to as many as there are targets
+  std::vector<uint64_t> candidates;
+  bool scanned = false;
+  out = {};
+
+  for (size_t offset = 0; offset < length;) {
+    InsnInfo insn;
+    if (!decode_instruction(decoder, targets[0] + offset, copies[0] + offset, length - offset, insn)
+        || offset + insn.size > length) {
+      return false;
+    }
 
-  ea_t region_start = 0, region_end = 0;
+    for (size_t i = offset; i < offset + insn.size; ++i) {
+      uint8_t differ = 0;
+      for (const uint8_t* copy : copies) {
+        differ |= copy[i] ^ copies[0][i];
+      }
+      uint8_t mask = insn.is_wildcard(static_cast<uint32_t>(i - offset)) ? 0x00 : 0xFF;
+      if (differ & 0xF0) mask &= 0x0F;
+      if (differ & 0x0F) mask &= 0xF0;
+      out.add_byte(copies[0][i], mask);
+    }
+    if (on_instruction) on_instruction(targets[0] + offset);
+    offset += insn.size;
 
-  // Check if user selected a range
-  if (g_settings.has(UseSelectedRange)
-      && read_range_selection(nullptr, &region_start, &region_end)) {
-    // Build signature from selected range only
-    replace_wait_box("[Fusion] Creating signature for 0x%llX", static_cast<uint64_t>(target));
+    if (!scanned) {
+      candidates = scan_pattern(image, out.view());
+      scanned = true;
+    } else {
+      refine_candidates(image, out, candidates);
+    }
 
-    func_item_iterator_t iter;
-    iter.set_range(region_start, region_end);
+    if (candidates.size() == targets.size()) {
+      trim_trailing_wildcards(out);
+      // Dropping the trailing wildcards may let a match near a region end back in
+      return scan_pattern(image, out.view()) == targets;
+    }
+  }
 
-    for (ea_t addr = iter.current();; addr = iter.current()) {
-      insn_t insn;
-      if (!decode_insn(&insn, addr)) break;
+  return false;
+}
 
-      add_instruction_bytes(builder, addr, insn);
+std::vector<ReferenceResult> check_references(
+    const PatternView& pattern, const std::vector<const ImageSnapshot*>& references) {
+  std::vector<ReferenceResult> results(references.size());
+  const unsigned threads = threads_per_image(references.size());
+  parallel_for(references.size(), 0, [&](size_t i) {
+    const auto matches = scan_pattern(*references[i], pattern, threads);
+    results[i] = {reference_status(matches.size(), false), matches.empty() ? 0 : matches[0]};
+  });
+  return results;
+}
 
-      // Handle int3/nop which IDA doesn't iterate correctly
-      if (get_byte(addr) == 0xCC || get_byte(addr) == 0x90) {
-        iter.set_range(addr + 1, ea_max);
-        continue;
-      }
+void build_range_signature(const ImageSnapshot& image,
+    const InsnDecoder& decoder,
+    uint64_t start,
+    uint64_t end,
+    SignatureBuilder& builder) {
+  const SnapshotRegion* region = find_region(image, start);
+  if (!region) return;
 
-      if (!iter.next_not_tail()) break;
-    }
-  } else {
-    // Build unique signature iteratively
-    ea_t last_found = ea_min;
+  end = std::min(end, region->end());
+  for (uint64_t addr = start; addr < end;) {
+    const size_t offset = addr - region->start;
+    const uint8_t* bytes = region->bytes.data() + offset;
 
-    // Buffer for mnemonic display (if enabled)
-    std::string mnemonics;
+    InsnInfo insn;
+    if (!decode_instruction(decoder, addr, bytes, region->bytes.size() - offset, insn)) return;
 
-    func_item_iterator_t iter;
-    iter.set_range(target, ea_max);
+    add_instruction(builder, bytes, insn);
+    addr += insn.size;
+  }
+}
 
-    for (ea_t addr = iter.current();; addr = iter.current()) {
-      insn_t insn;
-      if (!decode_insn(&insn, addr)) break;
+CreateResult create_signature(
+    const Database& db, const CreateSettings& settings, const InsnCallback& on_instruction) {
+  return create_multi_image_signature(db, {}, settings, on_instruction);
+}
 
-      add_instruction_bytes(builder, addr, insn);
+CreateResult create_multi_image_signature(const Database& db,
+    const std::vector<const ImageSnapshot*>& references,
+    const CreateSettings& settings,
+    const InsnCallback& on_instruction) {
+  CreateResult result;
+  const uint64_t target = db.cursor();
+
+  if (!settings.allow_dangerous_regions && !db.function_at(target)) {
+    result.status = CreateStatus::NotInFunction;
+    return result;
+  }
 
-      // Show mnemonic opcodes if enabled
-      if (g_settings.has(ShowMnemonics)) {
-        mnemonics += "+ ";
-        mnemonics += insn.get_canon_mnem(PH);
-        mnemonics += "\n";
-        replace_wait_box("[Fusion] Creating signature for 0x%llX\n\n%s",
-            static_cast<uint64_t>(target), mnemonics.c_str());
+  if (const auto selection = db.selection(); settings.use_selection && selection) {
+    build_range_signature(
+        db.image(), db.decoder(), selection->start, selection->end, result.builder);
+    result.builder.trim_wildcards();
+    result.references = check_references(result.builder.compile().view(), references);
+    result.status = CreateStatus::FromSelection;
+  } else if (!references.empty()) {
+    const bool unique = build_multi_image_signature(db.image(),
+        references,
+        db.decoder(),
+        target,
+        result.builder,
+        result.references,
+        on_instruction);
+    result.status = unique ? CreateStatus::Unique : CreateStatus::NotUnique;
+  } else {
+    // A function start only has to differ from the other starts, where searches then look
+    std::vector<uint64_t> starts;
+    if (settings.function_starts_only) starts = db.function_starts();
+
+    bool unique = false;
+    if (std::binary_search(starts.begin(), starts.end(), target)) {
+      unique = build_unique_signature_among(
+          db.image(), db.decoder(), target, starts, result.builder, on_instruction);
+    } else {
+      unique =
+          build_unique_signature(db.image(), db.decoder(), target, result.builder, on_instruction);
+    }
+    result.status = unique ? CreateStatus::Unique : CreateStatus::NotUnique;
+
+    // A long contiguous signature may be replaced by two short fragments with a gap
+    if (settings.allow_composite && (!unique || result.builder.size() > composite_threshold)) {
+      const auto function = db.function_at(target);
+      const uint64_t end = function ? function->end : UINT64_MAX;
+      CompositePattern composite;
+      if (build_composite_signature(db.image(), db.decoder(), target, end, composite)
+          && (!unique || composite.fragment_bytes() < result.builder.size())) {
+        result.composite = std::move(composite);
+        result.status = CreateStatus::Unique;
       }
+    }
+  }
 
-      // Check if signature is unique
-      std::string test_sig = builder.render(SignatureStyle::IDA);
-      auto matches = find_signature(test_sig, {true, true, target, last_found, false});
+  result.builder.trim_wildcards();
+  return result;
+}
 
-      if (matches.empty()) break; // Unique!
+GroupResult create_group_signature(const Database& db,
+    const std::vector<uint64_t>& targets,
+    const CreateSettings& settings,
+    const InsnCallback& on_instruction) {
+  GroupResult result;
+  if (!settings.allow_dangerous_regions) {
+    for (uint64_t target : targets) {
+      if (!db.function_at(target)) {
+        result.outside = target;
+        return result;
+      }
+    }
+  }
 
-      last_found = matches[0];
+  const bool exact =
+      build_group_signature(db.image(), db.decoder(), targets, result.pattern, on_instruction);
+  result.status = exact ? CreateStatus::Unique : CreateStatus::NotUnique;
+  trim_trailing_wildcards(result.pattern);
+  return result;
+}
 
-      // Handle int3/nop
-      if (get_byte(addr) == 0xCC || get_byte(addr) == 0x90) {
-        iter.set_range(addr + 1, ea_max);
-        continue;
-      }
+std::vector<uint64_t> filter_matches(
+    const std::vector<uint64_t>& matches, const FindSettings& settings) {
+  std::vector<uint64_t> results;
+  for (uint64_t address : matches) {
+    if (address < settings.start_addr) continue;
+    if (address == settings.ignore_addr) continue;
 
-      if (!iter.next_not_tail()) break;
-    }
+    results.push_back(address);
+    if (settings.stop_at_first) break;
   }
+  return results;
+}
 
-  if (builder.empty()) {
-    return {};
+std::optional<std::vector<uint64_t>> find_signature(
+    const Database& db, const std::string& pattern, const FindSettings& settings) {
+  FUSION_TRACE("find_signature");
+  std::vector<uint64_t> found;
+  std::vector<uint64_t> starts;
+  if (settings.function_starts_only) starts = db.function_starts();
+  if (has_pattern_gaps(pattern)) {
+    CompositePattern composite;
+    if (!compile_composite_pattern(pattern, composite)) return std::nullopt;
+    found = settings.function_starts_only ? match_at(db.image(), composite, starts)
+                                          : scan_composite(db.image(), composite);
+  } else {
+    CompiledPattern compiled;
+    if (!compile_pattern(pattern, compiled)) return std::nullopt;
+    found = settings.function_starts_only ? match_at(db.image(), compiled.view(), starts)
+                                          : scan_pattern(db.image(), compiled.view());
   }
 
-  builder.trim_wildcards();
-  std::string result = builder.render(style);
+  auto matches = filter_matches(found, settings);
+  FUSION_COUNT(Matches, matches.size());
+  return matches;
+}
 
-  msg("[Fusion] %s\n", result.c_str());
+std::optional<std::vector<FuzzyMatch>> find_fuzzy_signature(
+    const Database& db, const std::string& pattern, const FindSettings& settings) {
+  FUSION_TRACE("find_fuzzy_signature");
+  CompiledPattern compiled;
+  if (!compile_pattern(pattern, compiled)) return std::nullopt;
 
-  if (g_settings.has(CopyToClipboard)) {
-    utils::copy_to_clipboard(result.c_str());
-  }
+  const size_t fixed = compiled.view().fixed_bytes();
+  const uint32_t max_distance =
+      static_cast<uint32_t>(std::min<size_t>(settings.max_distance, fixed ? fixed - 1 : 0));
 
-  beep(beep_default);
-  return result;
+  // The scan keeps only as many as are wanted, plus one in case it is the ignored address
+  size_t wanted = settings.max_matches ? settings.max_matches : SIZE_MAX;
+  if (settings.stop_at_first) wanted = 1;
+  const size_t kept = wanted == SIZE_MAX ? SIZE_MAX : wanted + 1;
+
+  // Function starts are measured one by one instead of scanning the image
+  const std::vector<FuzzyMatch> found = settings.function_starts_only
+      ? fuzzy_match_at(db.image(), compiled.view(), max_distance, db.function_starts())
+      : fuzzy_scan(db.image(), compiled.view(), max_distance, 0, kept, settings.start_addr);
+
+  std::vector<FuzzyMatch> matches;
+  for (const auto& match : found) {
+    if (match.address < settings.start_addr || match.address == settings.ignore_addr) continue;
+
+    matches.push_back(match);
+    if (matches.size() == wanted) break;
+  }
+  FUSION_COUNT(Matches, matches.size());
+  return matches;
 }
 } // namespace fusion
@@ -0,0 +1,215 @@
+﻿#include "fusion/similarity.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fusion {
+namespace {
+constexpr uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EB;
+  x ^= x >> 31;
+  return x;
+}
+
+constexpr std::array<uint64_t, MinHashSketch::size> make_seeds() {
+  std::array<uint64_t, MinHashSketch::size> seeds{};
+  uint64_t state = 0x46555349; // "FUSI"
+  for (auto& seed : seeds) {
+    state += 0x9E3779B97F4A7C15;
+    seed = mix64(state);
+  }
+  return seeds;
+}
+
+// Changing the seeds invalidates every exported sketch file
+constexpr auto minhash_seeds = make_seeds();
+
+// Marks wildcarded bytes so they hash independently of their value
+constexpr uint64_t wildcard_token = 0x100;
+
+constexpr char sketch_magic[4] = {'F', 'S', 'K', 'T'};
+constexpr uint32_t sketch_version = 1;
+
+uint64_t band_key(const MinHashSketch& sketch, size_t band) {
+  uint64_t key = band;
+  for (size_t row = 0; row < MinHashSketch::rows; ++row) {
+    key = mix64(key ^ sketch.values[band * MinHashSketch::rows + row]);
+  }
+  return key;
+}
+
+template <typename T>
+void write_value(std::ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool read_value(std::ifstream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+// Whether `count` items of at least `item_size` bytes each fit before `end`
+bool fits(std::ifstream& in, uint64_t end, uint64_t count, uint64_t item_size) {
+  const auto position = in.tellg();
+  if (position < 0 || static_cast<uint64_t>(position) > end) return false;
+  return count <= (end - static_cast<uint64_t>(position)) / item_size;
+}
+} // namespace
+
+double MinHashSketch::similarity(const MinHashSketch& other) const {
+  size_t equal = 0;
+  for (size_t i = 0; i < size; ++i) {
+    equal += values[i] == other.values[i];
+  }
+  return static_cast<double>(equal) / size;
+}
+
+bool MinHashSketch::empty() const {
+  return std::all_of(values.begin(), values.end(), [](uint32_t v) { return v == UINT32_MAX; });
+}
+
+void SketchBuilder::clear() {
+  instructions_.clear();
+  current_ = 0;
+  current_size_ = 0;
+}
+
+void SketchBuilder::add_byte(uint8_t byte, bool is_wildcard) {
+  current_ = (current_ ^ (is_wildcard ? wildcard_token : byte)) * 0x100000001B3;
+  ++current_size_;
+}
+
+void SketchBuilder::end_instruction() {
+  if (current_size_ == 0) return;
+  instructions_.push_back(mix64(current_ ^ current_size_));
+  current_ = 0;
+  current_size_ = 0;
+}
+
+MinHashSketch SketchBuilder::finish() const {
+  MinHashSketch sketch;
+  if (instructions_.empty()) return sketch;
+
+  // Functions shorter than one n-gram are sketched as a single shingle
+  const size_t width = std::min(ngram, instructions_.size());
+  for (size_t i = 0; i + width <= instructions_.size(); ++i) {
+    uint64_t shingle = 0;
+    for (size_t j = 0; j < width; ++j) {
+      shingle = mix64(shingle ^ instructions_[i + j]);
+    }
+    for (size_t slot = 0; slot < MinHashSketch::size; ++slot) {
+      const auto value = static_cast<uint32_t>(mix64(shingle ^ minhash_seeds[slot]));
+      sketch.values[slot] = std::min(sketch.values[slot], value);
+    }
+  }
+  return sketch;
+}
+
+void SimilarityIndex::clear() {
+  functions_.clear();
+  for (auto& band : buckets_) {
+    band.clear();
+  }
+}
+
+void SimilarityIndex::add(FunctionSketch function) {
+  if (function.sketch.empty()) return;
+
+  const auto index = static_cast<uint32_t>(functions_.size());
+  for (size_t band = 0; band < MinHashSketch::bands; ++band) {
+    buckets_[band][band_key(function.sketch, band)].push_back(index);
+  }
+  functions_.push_back(std::move(function));
+}
+
+std::vector<SimilarityMatch> SimilarityIndex::query(
+    const MinHashSketch& sketch, double min_similarity, size_t max_results) const {
+  std::vector<SimilarityMatch> matches;
+  if (sketch.empty()) return matches;
+
+  std::vector<bool> seen(functions_.size());
+  for (size_t band = 0; band < MinHashSketch::bands; ++band) {
+    const auto bucket = buckets_[band].find(band_key(sketch, band));
+    if (bucket == buckets_[band].end()) continue;
+
+    for (uint32_t index : bucket->second) {
+      if (seen[index]) continue;
+      seen[index] = true;
+
+      const double similarity = sketch.similarity(functions_[index].sketch);
+      if (similarity >= min_similarity) {
+        matches.push_back({&functions_[index], similarity});
+      }
+    }
+  }
+
+  std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+    if (a.similarity != b.similarity) return a.similarity > b.similarity;
+    return a.function->address < b.function->address;
+  });
+  if (matches.size() > max_results) {
+    matches.resize(max_results);
+  }
+  return matches;
+}
+
+bool save_sketches(const std::string& path, const std::vector<FunctionSketch>& sketches) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+
+  out.write(sketch_magic, sizeof(sketch_magic));
+  write_value(out, sketch_version);
+  write_value(out, static_cast<uint32_t>(sketches.size()));
+
+  for (const auto& function : sketches) {
+    write_value(out, function.address);
+    write_value(out, static_cast<uint32_t>(function.name.size()));
+    out.write(function.name.data(), static_cast<std::streamsize>(function.name.size()));
+    write_value(out, function.sketch.values);
+  }
+  return static_cast<bool>(out);
+}
+
+bool load_sketches(const std::string& path, std::vector<FunctionSketch>& sketches) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  const auto end = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+
+  char magic[sizeof(sketch_magic)];
+  uint32_t version = 0, count = 0;
+  if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), sketch_magic)) {
+    return false;
+  }
+  if (!read_value(in, version) || version != sketch_version || !read_value(in, count)) {
+    return false;
+  }
+
+  // Reject damaged counts before allocating for them
+  constexpr uint64_t record_size =
+      sizeof(uint64_t) + sizeof(uint32_t) + sizeof(MinHashSketch::values);
+  if (!fits(in, end, count, record_size)) return false;
+
+  sketches.clear();
+  sketches.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    FunctionSketch function;
+    uint32_t name_size = 0;
+    if (!read_value(in, function.address) || !read_value(in, name_size)
+        || !fits(in, end, name_size, 1)) {
+      return false;
+    }
+
+    function.name.resize(name_size);
+    if (!in.read(function.name.data(), name_size)) return false;
+    if (!read_value(in, function.sketch.values)) return false;
+
+    sketches.push_back(std::move(function));
+  }
+  return true;
+}
+} // namespace fusion
+
@@ -0,0 +1,84 @@
+﻿#include "fusion/source.h"
+#include "fusion/profile.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace fusion {
+std::vector<AddressRange> scope_ranges(
+    const std::vector<SegmentInfo>& segments, const Settings& settings) {
+  std::vector<std::string> names;
+  if (settings.scope == SearchScope::Segments) {
+    std::string list = settings.scope_segments;
+    std::replace(list.begin(), list.end(), ',', ' ');
+    std::istringstream words(list);
+    for (std::string name; words >> name;) {
+      names.push_back(name);
+    }
+  }
+
+  std::vector<AddressRange> ranges;
+  for (const auto& segment : segments) {
+    AddressRange range = segment.range;
+    switch (settings.scope) {
+    case SearchScope::All:
+      break;
+    case SearchScope::Code:
+      if (!segment.code) continue;
+      break;
+    case SearchScope::Segments:
+      if (std::find(names.begin(), names.end(), segment.name) == names.end()) continue;
+      break;
+    case SearchScope::Range:
+      range.start = std::max(range.start, settings.scope_start);
+      range.end = std::min(range.end, settings.scope_end);
+      if (range.start >= range.end) continue;
+      break;
+    }
+    ranges.push_back(range);
+  }
+  return ranges;
+}
+
+ImageSnapshot read_snapshot(const ByteSource& source) {
+  FUSION_PHASE(Fetch);
+  ImageSnapshot snapshot;
+  const auto segments = source.segments();
+  snapshot.regions.reserve(segments.size());
+
+  for (const auto& segment : segments) {
+    if (segment.size() == 0) continue;
+
+    SnapshotRegion region;
+    region.start = segment.start;
+    region.bytes.resize(segment.size());
+
+    const size_t read = source.read(segment.start, region.bytes.data(), region.bytes.size());
+    if (read == 0) continue;
+
+    region.bytes.resize(read);
+    snapshot.regions.push_back(std::move(region));
+  }
+
+  return snapshot;
+}
+
+uint32_t make_token(const uint8_t* data, size_t size) {
+  uint32_t hash = 0x811c9dc5;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x01000193;
+  }
+  return hash ? hash : 1;
+}
+
+const SnapshotRegion* find_region(const ImageSnapshot& snapshot, uint64_t address) {
+  // Regions are in address order, so the candidate is the last one starting at or before `address`
+  auto it = std::upper_bound(snapshot.regions.begin(), snapshot.regions.end(), address,
+      [](uint64_t value, const SnapshotRegion& region) { return value < region.start; });
+  if (it == snapshot.regions.begin()) return nullptr;
+
+  --it;
+  return address < it->end() ? &*it : nullptr;
+}
+} // namespace fusion
+
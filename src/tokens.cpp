@@ -0,0 +1,264 @@
+﻿#include "fusion/tokens.h"
+#include "fusion/profile.h"
+#include "fusion/trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdio>
+
+namespace fusion {
+namespace {
+uint32_t gram_hash(const uint32_t* tokens) {
+  uint32_t hash = 0;
+  for (size_t i = 0; i < TokenIndex::ngram; ++i) {
+    hash = (hash ^ tokens[i]) * 0x9E3779B1;
+    hash ^= hash >> 15;
+  }
+  return hash;
+}
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+} // namespace
+
+void TokenIndex::add_break(uint64_t address) {
+  if (!tokens_.empty() && tokens_.back() == 0) return;
+  tokens_.push_back(0);
+  addresses_.push_back(address);
+}
+
+void TokenIndex::build(const ImageSnapshot& image, const InsnDecoder& decoder) {
+  std::vector<const SnapshotRegion*> regions;
+  regions.reserve(image.regions.size());
+  for (const auto& region : image.regions) {
+    regions.push_back(&region);
+  }
+  build(regions, decoder);
+}
+
+void TokenIndex::build(std::span<const SnapshotRegion* const> regions, const InsnDecoder& decoder) {
+  FUSION_PHASE(Decode);
+  FUSION_TRACE("build_token_index", "regions", regions.size());
+  tokens_.clear();
+  addresses_.clear();
+
+  for (const SnapshotRegion* region : regions) {
+    const uint8_t* bytes = region->bytes.data();
+    const size_t size = region->bytes.size();
+    for (size_t offset = 0; offset < size;) {
+      const uint64_t address = region->start + offset;
+      InsnInfo insn;
+      if (decoder.decode(address, bytes + offset, size - offset, insn) && insn.size
+          && insn.token) {
+        tokens_.push_back(insn.token);
+        addresses_.push_back(address);
+        offset += insn.size;
+      } else {
+        add_break(address);
+        ++offset;
+      }
+    }
+    add_break(region->end());
+  }
+  FUSION_COUNT(Instructions, tokens_.size());
+
+  // Bucket every n-gram that does not span a break by the top bits of its hash with a counting
+  // sort, which keeps each bucket in position order. About eight n-grams per bucket keep the
+  // bucket offsets small enough to stay in cache while they are counted and filled.
+  const unsigned bits = std::clamp<unsigned>(std::bit_width(tokens_.size() >> 3), 1, 30);
+  bucket_shift_ = 32 - bits;
+  bucket_offsets_.assign((size_t{1} << bits) + 1, 0);
+
+  std::vector<uint32_t> buckets(tokens_.size(), UINT32_MAX);
+  size_t run = 0;
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    run = tokens_[i] ? run + 1 : 0;
+    if (run < ngram) continue;
+    const size_t position = i + 1 - ngram;
+    buckets[position] = gram_hash(&tokens_[position]) >> bucket_shift_;
+    ++bucket_offsets_[buckets[position] + 1];
+  }
+  for (size_t i = 1; i < bucket_offsets_.size(); ++i) {
+    bucket_offsets_[i] += bucket_offsets_[i - 1];
+  }
+
+  positions_.resize(bucket_offsets_.back());
+  std::vector<uint32_t> next(bucket_offsets_.begin(), bucket_offsets_.end() - 1);
+  for (size_t position = 0; position < buckets.size(); ++position) {
+    if (buckets[position] == UINT32_MAX) continue;
+    positions_[next[buckets[position]]++] = static_cast<uint32_t>(position);
+  }
+}
+
+std::span<const uint32_t> TokenIndex::bucket(const uint32_t* tokens) const {
+  if (positions_.empty()) return {};
+  const uint32_t index = gram_hash(tokens) >> bucket_shift_;
+  return {positions_.data() + bucket_offsets_[index],
+      positions_.data() + bucket_offsets_[index + 1]};
+}
+
+std::vector<uint64_t> TokenIndex::find(
+    const std::vector<uint32_t>& tokens, size_t max_matches) const {
+  FUSION_PHASE(Scan);
+  FUSION_COUNT(Scans, 1);
+  std::vector<uint64_t> matches;
+  if (tokens.empty() || std::find(tokens.begin(), tokens.end(), 0u) != tokens.end()) {
+    return matches;
+  }
+
+  const auto matches_at = [&](size_t position) {
+    return position + tokens.size() <= tokens_.size()
+           && std::equal(tokens.begin(), tokens.end(), tokens_.begin() + position);
+  };
+
+  if (tokens.size() < ngram) {
+    // Too short for the index
+    for (size_t i = 0; i + tokens.size() <= tokens_.size() && matches.size() < max_matches; ++i) {
+      if (matches_at(i)) matches.push_back(addresses_[i]);
+    }
+    return matches;
+  }
+
+  // Only the positions in the smallest bucket of an n-gram of `tokens` need verifying
+  size_t best_offset = 0;
+  std::span<const uint32_t> best = bucket(tokens.data());
+  for (size_t offset = 1; offset + ngram <= tokens.size() && !best.empty(); ++offset) {
+    const auto candidates = bucket(&tokens[offset]);
+    if (candidates.size() < best.size()) {
+      best = candidates;
+      best_offset = offset;
+    }
+  }
+  FUSION_COUNT(Candidates, best.size());
+
+  for (const uint32_t position : best) {
+    if (matches.size() >= max_matches) break;
+    if (position < best_offset) continue;
+    if (matches_at(position - best_offset)) matches.push_back(addresses_[position - best_offset]);
+  }
+  return matches;
+}
+
+std::vector<uint32_t> TokenIndex::unique_sequence(uint64_t address, size_t max_tokens) const {
+  FUSION_PHASE(Scan);
+  const auto it = std::lower_bound(addresses_.begin(), addresses_.end(), address);
+  if (it == addresses_.end() || *it != address) return {};
+
+  const size_t start = it - addresses_.begin();
+  if (start + ngram > tokens_.size() || max_tokens < ngram) return {};
+  const auto first = tokens_.begin() + start;
+  if (std::find(first, first + ngram, 0u) != first + ngram) return {};
+
+  // Candidates share the first n-gram, then are narrowed one token at a time as it grows
+  std::vector<size_t> candidates;
+  for (const uint32_t position : bucket(&tokens_[start])) {
+    if (position != start && std::equal(first, first + ngram, tokens_.begin() + position)) {
+      candidates.push_back(position);
+    }
+  }
+  FUSION_COUNT(Candidates, candidates.size());
+
+  size_t length = ngram;
+  while (!candidates.empty()) {
+    if (length >= max_tokens || start + length >= tokens_.size()) return {};
+    const uint32_t next = tokens_[start + length];
+    if (next == 0) return {};
+
+    std::erase_if(candidates, [&](size_t position) {
+      return position + length >= tokens_.size() || tokens_[position + length] != next;
+    });
+    ++length;
+  }
+  return {first, first + length};
+}
+
+std::vector<uint32_t> TokenIndex::sequence(const AddressRange& range) const {
+  std::vector<uint32_t> tokens;
+  auto it = std::lower_bound(addresses_.begin(), addresses_.end(), range.start);
+  for (; it != addresses_.end() && *it < range.end; ++it) {
+    const uint32_t token = tokens_[it - addresses_.begin()];
+    if (token == 0) break;
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+std::string format_token_signature(const std::vector<uint32_t>& tokens) {
+  std::string text = "T:";
+  char buf[16];
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    snprintf(buf, sizeof(buf), i ? " %08X" : "%08X", tokens[i]);
+    text += buf;
+  }
+  return text;
+}
+
+bool is_token_signature(std::string_view text) {
+  while (!text.empty() && is_space(text.front())) text.remove_prefix(1);
+  return text.starts_with("T:") || text.starts_with("t:");
+}
+
+std::optional<std::vector<uint32_t>> parse_token_signature(std::string_view text) {
+  if (!is_token_signature(text)) return std::nullopt;
+  text.remove_prefix(text.find(':') + 1);
+
+  std::vector<uint32_t> tokens;
+  while (true) {
+    while (!text.empty() && is_space(text.front())) text.remove_prefix(1);
+    if (text.empty()) break;
+
+    uint32_t token = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), token, 16);
+    const size_t length = end - text.data();
+    if (error != std::errc() || token == 0) return std::nullopt;
+    if (length < text.size() && !is_space(text[length])) return std::nullopt;
+
+    tokens.push_back(token);
+    text.remove_prefix(length);
+  }
+  if (tokens.empty()) return std::nullopt;
+  return tokens;
+}
+
+TokenSignature create_token_signature(
+    const Database& db, const TokenIndex& index, const CreateSettings& settings) {
+  FUSION_TRACE("create_token_signature");
+  TokenSignature result;
+  const uint64_t target = db.cursor();
+
+  if (!settings.allow_dangerous_regions && !db.function_at(target)) {
+    return result;
+  }
+
+  if (const auto selection = db.selection(); settings.use_selection && selection) {
+    result.status = CreateStatus::FromSelection;
+    result.tokens = index.sequence(*selection);
+    return result;
+  }
+
+  result.tokens = index.unique_sequence(target, max_token_signature);
+  result.status = result.tokens.empty() ? CreateStatus::NotUnique : CreateStatus::Unique;
+  return result;
+}
+
+std::optional<std::vector<uint64_t>> find_token_signature(const TokenIndex& index,
+    std::string_view pattern,
+    const FindSettings& settings,
+    std::span<const uint64_t> function_starts) {
+  FUSION_TRACE("find_token_signature");
+  const auto tokens = parse_token_signature(pattern);
+  if (!tokens) return std::nullopt;
+
+  std::vector<uint64_t> found = index.find(*tokens);
+  if (settings.function_starts_only) {
+    std::erase_if(found, [&](uint64_t address) {
+      return !std::binary_search(function_starts.begin(), function_starts.end(), address);
+    });
+  }
+  auto matches = filter_matches(found, settings);
+  FUSION_COUNT(Matches, matches.size());
+  return matches;
+}
+} // namespace fusion
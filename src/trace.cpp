@@ -0,0 +1,177 @@
+﻿#include "fusion/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fusion {
+namespace {
+int64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct TraceRecord {
+  const char* name;
+  const char* arg_name;
+  uint64_t arg;
+  int64_t begin_ns;
+  int64_t end_ns;
+};
+
+// Written only by the thread that owns it; `written` publishes records to the reader
+struct TraceBuffer {
+  std::vector<TraceRecord> records;
+  std::atomic<uint64_t> written{0};
+  std::atomic<bool> in_use{false};
+};
+
+struct Tracer {
+  std::mutex mutex; // Guards `buffers` and `capacity`, never taken while recording
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+  size_t capacity = default_trace_capacity;
+  std::atomic<bool> enabled{false};
+  std::atomic<int64_t> origin_ns{0};
+};
+
+Tracer& tracer() {
+  static Tracer instance;
+  return instance;
+}
+
+// Threads are created per parallel_for, so a buffer is handed to the next new thread once its
+// owner exits. That keeps the number of buffers, and Chrome trace rows, at the peak thread count.
+struct ThreadSlot {
+  TraceBuffer* buffer = nullptr;
+
+  ~ThreadSlot() {
+    if (buffer) buffer->in_use.store(false, std::memory_order_release);
+  }
+};
+
+thread_local ThreadSlot thread_slot;
+
+TraceBuffer& thread_buffer() {
+  if (thread_slot.buffer) return *thread_slot.buffer;
+
+  Tracer& t = tracer();
+  const std::lock_guard lock(t.mutex);
+  for (const auto& buffer : t.buffers) {
+    bool expected = false;
+    if (buffer->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      thread_slot.buffer = buffer.get();
+      return *buffer;
+    }
+  }
+
+  auto& buffer = t.buffers.emplace_back(std::make_unique<TraceBuffer>());
+  buffer->records.resize(t.capacity);
+  buffer->in_use = true;
+  thread_slot.buffer = buffer.get();
+  return *buffer;
+}
+
+void append_microseconds(std::string& json, int64_t nanoseconds) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(nanoseconds) / 1e3);
+  json += buf;
+}
+} // namespace
+
+void trace_start(size_t capacity_per_thread) {
+  Tracer& t = tracer();
+  const std::lock_guard lock(t.mutex);
+  t.capacity = std::max<size_t>(capacity_per_thread, 1);
+  for (auto& buffer : t.buffers) {
+    buffer->records.assign(t.capacity, {});
+    buffer->written = 0;
+  }
+  t.origin_ns = steady_ns();
+  t.enabled = true;
+}
+
+void trace_stop() {
+  tracer().enabled = false;
+}
+
+bool trace_enabled() {
+  return tracer().enabled.load(std::memory_order_relaxed);
+}
+
+int64_t trace_clock() {
+  return steady_ns() - tracer().origin_ns.load(std::memory_order_relaxed);
+}
+
+void trace_event(
+    const char* name, const char* arg_name, uint64_t arg, int64_t begin_ns, int64_t end_ns) {
+  TraceBuffer& buffer = thread_buffer();
+  const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+  buffer.records[index % buffer.records.size()] = {name, arg_name, arg, begin_ns, end_ns};
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+uint64_t trace_dropped() {
+  Tracer& t = tracer();
+  const std::lock_guard lock(t.mutex);
+  uint64_t dropped = 0;
+  for (const auto& buffer : t.buffers) {
+    const uint64_t written = buffer->written.load(std::memory_order_acquire);
+    dropped += written - std::min<uint64_t>(written, buffer->records.size());
+  }
+  return dropped;
+}
+
+std::string chrome_trace_json() {
+  const uint64_t dropped = trace_dropped();
+
+  Tracer& t = tracer();
+  const std::lock_guard lock(t.mutex);
+  std::string json = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+  bool first = true;
+
+  for (size_t tid = 0; tid < t.buffers.size(); ++tid) {
+    const TraceBuffer& buffer = *t.buffers[tid];
+    const uint64_t written = buffer.written.load(std::memory_order_acquire);
+    if (written == 0) continue;
+
+    json += first ? "" : ",\n";
+    first = false;
+    json += "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": ";
+    json += std::to_string(tid) + ", \"args\": {\"name\": \"";
+    json += "thread " + std::to_string(tid);
+    json += "\"}}";
+
+    const uint64_t oldest = written - std::min<uint64_t>(written, buffer.records.size());
+    for (uint64_t i = oldest; i < written; ++i) {
+      const TraceRecord& record = buffer.records[i % buffer.records.size()];
+      json += ",\n{\"name\": \"";
+      json += record.name;
+      json += "\", \"cat\": \"fusion\", \"ph\": \"X\", \"pid\": 1, \"tid\": " + std::to_string(tid);
+      json += ", \"ts\": ";
+      append_microseconds(json, record.begin_ns);
+      json += ", \"dur\": ";
+      append_microseconds(json, record.end_ns - record.begin_ns);
+      if (record.arg_name) {
+        json += ", \"args\": {\"";
+        json += record.arg_name;
+        json += "\": " + std::to_string(record.arg) + "}";
+      }
+      json += "}";
+    }
+  }
+
+  json += "\n], \"otherData\": {\"dropped_events\": " + std::to_string(dropped) + "}}\n";
+  return json;
+}
+
+bool write_chrome_trace(const std::string& path) {
+  std::ofstream out(path, std::ios::binary);
+  out << chrome_trace_json();
+  return static_cast<bool>(out);
+}
+} // namespace fusion
@@ -0,0 +1,448 @@
+﻿#include "fusion/x86_decoder.h"
+
+namespace fusion {
+namespace {
+// Opcode table entries: bit 0 is a ModRM byte, bits 1-4 the immediate kind, then validity
+enum : uint8_t {
+  M = 0x01,     // ModRM (plus optional SIB and displacement)
+  IB = 1 << 1,  // imm8
+  IW = 2 << 1,  // imm16
+  IZ = 3 << 1,  // imm16/32 by operand size
+  IV = 4 << 1,  // imm16/32/64 by operand size (mov r, imm)
+  JB = 5 << 1,  // rel8
+  JZ = 6 << 1,  // rel16/32
+  IWB = 7 << 1, // imm16 + imm8 (enter)
+  AP = 8 << 1,  // far pointer
+  OV = 9 << 1,  // moffs, sized by address size
+  G3 = 10 << 1, // imm only for /0 and /1 (test)
+  I64 = 0x40,   // Invalid in 64-bit mode
+  BAD = 0x80,   // Invalid in every mode
+};
+
+constexpr uint8_t imm_mask = 0x1E;
+
+// Prefixes and the 0F escape are handled before the tables are consulted
+// clang-format off
+constexpr uint8_t one_byte[256] = {
+  M,         M,         M,         M,         IB,        IZ,        I64,       I64,        // 00
+  M,         M,         M,         M,         IB,        IZ,        I64,       0,          // 08
+  M,         M,         M,         M,         IB,        IZ,        I64,       I64,        // 10
+  M,         M,         M,         M,         IB,        IZ,        I64,       I64,        // 18
+  M,         M,         M,         M,         IB,        IZ,        0,         I64,        // 20
+  M,         M,         M,         M,         IB,        IZ,        0,         I64,        // 28
+  M,         M,         M,         M,         IB,        IZ,        0,         I64,        // 30
+  M,         M,         M,         M,         IB,        IZ,        0,         I64,        // 38
+  0,         0,         0,         0,         0,         0,         0,         0,          // 40
+  0,         0,         0,         0,         0,         0,         0,         0,          // 48
+  0,         0,         0,         0,         0,         0,         0,         0,          // 50
+  0,         0,         0,         0,         0,         0,         0,         0,          // 58
+  I64,       I64,       M|I64,     M,         0,         0,         0,         0,          // 60
+  IZ,        M|IZ,      IB,        M|IB,      0,         0,         0,         0,          // 68
+  JB,        JB,        JB,        JB,        JB,        JB,        JB,        JB,         // 70
+  JB,        JB,        JB,        JB,        JB,        JB,        JB,        JB,         // 78
+  M|IB,      M|IZ,      M|IB|I64,  M|IB,      M,         M,         M,         M,          // 80
+  M,         M,         M,         M,         M,         M,         M,         M,          // 88
+  0,         0,         0,         0,         0,         0,         0,         0,          // 90
+  0,         0,         AP|I64,    0,         0,         0,         0,         0,          // 98
+  OV,        OV,        OV,        OV,        0,         0,         0,         0,          // A0
+  IB,        IZ,        0,         0,         0,         0,         0,         0,          // A8
+  IB,        IB,        IB,        IB,        IB,        IB,        IB,        IB,         // B0
+  IV,        IV,        IV,        IV,        IV,        IV,        IV,        IV,         // B8
+  M|IB,      M|IB,      IW,        0,         M|I64,     M|I64,     M|IB,      M|IZ,       // C0
+  IWB,       0,         IW,        0,         0,         IB,        I64,       0,          // C8
+  M,         M,         M,         M,         IB|I64,    IB|I64,    I64,       0,          // D0
+  M,         M,         M,         M,         M,         M,         M,         M,          // D8
+  JB,        JB,        JB,        JB,        IB,        IB,        IB,        IB,         // E0
+  JZ,        JZ,        AP|I64,    JB,        0,         0,         0,         0,          // E8
+  0,         0,         0,         0,         0,         0,         M|G3,      M|G3,       // F0
+  0,         0,         0,         0,         0,         0,         M,         M,          // F8
+};
+
+constexpr uint8_t two_byte[256] = {
+  M,     M,     M,     M,     BAD,   0,     0,     0,      // 00
+  0,     0,     BAD,   0,     BAD,   M,     0,     M,      // 08
+  M,     M,     M,     M,     M,     M,     M,     M,      // 10
+  M,     M,     M,     M,     M,     M,     M,     M,      // 18
+  M,     M,     M,     M,     BAD,   BAD,   BAD,   BAD,    // 20
+  M,     M,     M,     M,     M,     M,     M,     M,      // 28
+  0,     0,     0,     0,     0,     0,     BAD,   0,      // 30
+  0,     BAD,   0,     BAD,   BAD,   BAD,   BAD,   BAD,    // 38
+  M,     M,     M,     M,     M,     M,     M,     M,      // 40
+  M,     M,     M,     M,     M,     M,     M,     M,      // 48
+  M,     M,     M,     M,     M,     M,     M,     M,      // 50
+  M,     M,     M,     M,     M,     M,     M,     M,      // 58
+  M,     M,     M,     M,     M,     M,     M,     M,      // 60
+  M,     M,     M,     M,     M,     M,     M,     M,      // 68
+  M|IB,  M|IB,  M|IB,  M|IB,  M,     M,     M,     0,      // 70
+  M,     M,     BAD,   BAD,   M,     M,     M,     M,      // 78
+  JZ,    JZ,    JZ,    JZ,    JZ,    JZ,    JZ,    JZ,     // 80
+  JZ,    JZ,    JZ,    JZ,    JZ,    JZ,    JZ,    JZ,     // 88
+  M,     M,     M,     M,     M,     M,     M,     M,      // 90
+  M,     M,     M,     M,     M,     M,     M,     M,      // 98
+  0,     0,     0,     M,     M|IB,  M,     BAD,   BAD,    // A0
+  0,     0,     0,     M,     M|IB,  M,     M,     M,      // A8
+  M,     M,     M,     M,     M,     M,     M,     M,      // B0
+  M,     M,     M|IB,  M,     M,     M,     M,     M,      // B8
+  M,     M,     M|IB,  M,     M|IB,  M|IB,  M|IB,  M,      // C0
+  0,     0,     0,     0,     0,     0,     0,     0,      // C8
+  M,     M,     M,     M,     M,     M,     M,     M,      // D0
+  M,     M,     M,     M,     M,     M,     M,     M,      // D8
+  M,     M,     M,     M,     M,     M,     M,     M,      // E0
+  M,     M,     M,     M,     M,     M,     M,     M,      // E8
+  M,     M,     M,     M,     M,     M,     M,     M,      // F0
+  M,     M,     M,     M,     M,     M,     M,     M,      // F8
+};
+// clang-format on
+
+/// Opcode maps reached through an escape; they differ only in which opcodes take an imm8
+enum class OpcodeMap { Vex1, Map0F38, Map0F3A, Xop8, Xop9, XopA, Other };
+
+constexpr bool is_legacy_prefix(uint8_t byte) {
+  switch (byte) {
+  case 0x26:
+  case 0x2E:
+  case 0x36:
+  case 0x3E:
+  case 0x64:
+  case 0x65:
+  case 0x66:
+  case 0x67:
+  case 0xF0:
+  case 0xF2:
+  case 0xF3:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// VEX/EVEX map 1 opcodes with an imm8 (pshufd/shifts, cmpps, pinsrw, pextrw, shufps)
+constexpr bool vex_map1_has_imm(uint8_t opcode) {
+  return (opcode >= 0x70 && opcode <= 0x73) || opcode == 0xC2 || opcode == 0xC4
+         || opcode == 0xC5 || opcode == 0xC6;
+}
+
+struct Decoder {
+  const uint8_t* bytes;
+  size_t available;
+  bool x64;
+  X86Insn& out;
+
+  size_t pos = 0;
+  bool opsize16 = false;
+  bool addr_override = false;
+  bool rex_w = false;
+  bool has_f2 = false;
+
+  /// Longest encoding the CPU accepts
+  static constexpr size_t max_size = 15;
+
+  bool has(size_t count) const {
+    return pos + count <= available && pos + count <= max_size;
+  }
+
+  bool modrm(bool register_only) {
+    if (!has(1)) return false;
+    out.modrm_offset = static_cast<uint8_t>(pos);
+    const uint8_t value = bytes[pos++];
+    const uint8_t mod = value >> 6;
+    const uint8_t rm = value & 7;
+    if (register_only || mod == 3) return true;
+
+    size_t disp = 0;
+    if (!x64 && addr_override) {
+      // 16-bit addressing has no SIB byte
+      disp = mod == 1 ? 1 : mod == 2 ? 2 : (mod == 0 && rm == 6) ? 2 : 0;
+    } else {
+      if (rm == 4) {
+        if (!has(1)) return false;
+        const uint8_t sib = bytes[pos++];
+        if (mod == 0 && (sib & 7) == 5) disp = 4;
+      } else if (mod == 0 && rm == 5) {
+        disp = 4;
+        out.rip_relative = x64;
+      }
+      if (mod == 1) disp = 1;
+      if (mod == 2) disp = 4;
+    }
+
+    if (disp) {
+      if (!has(disp)) return false;
+      out.disp_offset = static_cast<uint8_t>(pos);
+      out.disp_size = static_cast<uint8_t>(disp);
+      pos += disp;
+    }
+    return true;
+  }
+
+  bool immediate(size_t size, bool relative) {
+    if (!has(size)) return false;
+    out.imm_offset = static_cast<uint8_t>(pos);
+    out.imm_size = static_cast<uint8_t>(size);
+    out.relative = relative;
+    pos += size;
+    return true;
+  }
+
+  /// Size of an immediate of `kind` under the current prefixes
+  size_t immediate_size(uint8_t kind) const {
+    const size_t z = opsize16 ? 2 : 4;
+    switch (kind) {
+    case IB:
+    case JB:
+      return 1;
+    case IW:
+      return 2;
+    case IZ:
+      return z;
+    case IV:
+      return rex_w ? 8 : z;
+    case JZ:
+      // 64-bit mode ignores the operand-size prefix on near branches
+      return x64 ? 4 : z;
+    case IWB:
+      return 3;
+    case AP:
+      return z + 2;
+    case OV:
+      return x64 ? (addr_override ? 4 : 8) : (addr_override ? 2 : 4);
+    default:
+      return 0;
+    }
+  }
+
+  /// ModRM and immediate of an instruction from one of the VEX/EVEX/XOP maps
+  bool extended(OpcodeMap map) {
+    if (!has(1)) return false;
+    const uint8_t opcode = bytes[pos++];
+
+    // vzeroupper/vzeroall are the only operand-less VEX instructions
+    if (map == OpcodeMap::Vex1 && opcode == 0x77) return true;
+    if (!modrm(false)) return false;
+
+    switch (map) {
+    case OpcodeMap::Vex1:
+      return vex_map1_has_imm(opcode) ? immediate(1, false) : true;
+    case OpcodeMap::Map0F3A:
+    case OpcodeMap::Xop8:
+      return immediate(1, false);
+    case OpcodeMap::XopA:
+      return immediate(4, false);
+    default:
+      return true;
+    }
+  }
+
+  bool run() {
+    // Legacy prefixes, then REX, which only counts if it directly precedes the opcode
+    for (;; ++pos) {
+      if (!has(1)) return false;
+      const uint8_t byte = bytes[pos];
+      if (is_legacy_prefix(byte)) {
+        opsize16 |= byte == 0x66;
+        addr_override |= byte == 0x67;
+        has_f2 |= byte == 0xF2;
+        rex_w = false;
+      } else if (x64 && (byte & 0xF0) == 0x40) {
+        rex_w = (byte & 0x08) != 0;
+      } else {
+        break;
+      }
+    }
+    if (rex_w) opsize16 = false;
+
+    const uint8_t opcode = bytes[pos];
+    out.opcode_offset = static_cast<uint8_t>(pos);
+
+    // VEX, EVEX and XOP reuse opcodes that are only valid with a memory operand outside 64-bit
+    // mode, so there the next byte's mod field tells them apart
+    const bool escape_ok = has(2) && (x64 || (bytes[pos + 1] & 0xC0) == 0xC0);
+    if (opcode == 0xC5 && escape_ok) {
+      if (!has(2)) return false;
+      pos += 2;
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      return extended(OpcodeMap::Vex1);
+    }
+    if (opcode == 0xC4 && escape_ok) {
+      if (!has(3)) return false;
+      const uint8_t map = bytes[pos + 1] & 0x1F;
+      pos += 3;
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      if (map == 1) return extended(OpcodeMap::Vex1);
+      if (map == 2) return extended(OpcodeMap::Map0F38);
+      if (map == 3) return extended(OpcodeMap::Map0F3A);
+      return false;
+    }
+    if (opcode == 0x62 && escape_ok) {
+      if (!has(4)) return false;
+      const uint8_t map = bytes[pos + 1] & 0x07;
+      pos += 4;
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      if (map == 1) return extended(OpcodeMap::Vex1);
+      if (map == 2) return extended(OpcodeMap::Map0F38);
+      if (map == 3) return extended(OpcodeMap::Map0F3A);
+      if (map == 5 || map == 6) return extended(OpcodeMap::Other); // AVX512-FP16
+      return false;
+    }
+    if (opcode == 0x8F && has(2) && (bytes[pos + 1] & 0x1F) >= 8) {
+      if (!has(3)) return false;
+      const uint8_t map = bytes[pos + 1] & 0x1F;
+      pos += 3;
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      if (map == 8) return extended(OpcodeMap::Xop8);
+      if (map == 9) return extended(OpcodeMap::Xop9);
+      if (map == 10) return extended(OpcodeMap::XopA);
+      return false;
+    }
+
+    ++pos;
+    if (opcode != 0x0F) return legacy(one_byte[opcode], opcode, false);
+
+    if (!has(1)) return false;
+    const uint8_t second = bytes[pos++];
+    if (second == 0x38) {
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      return extended(OpcodeMap::Map0F38);
+    }
+    if (second == 0x3A) {
+      out.opcode_offset = static_cast<uint8_t>(pos);
+      return extended(OpcodeMap::Map0F3A);
+    }
+
+    if (second == 0x0F) {
+      // 3DNow! puts its opcode after the operands, where an imm8 would go
+      if (!modrm(false) || !has(1)) return false;
+      ++pos;
+      return true;
+    }
+    if (second == 0x78 && (opsize16 || has_f2)) {
+      // SSE4a extrq/insertq take two imm8 operands
+      return modrm(false) && immediate(2, false);
+    }
+    return legacy(two_byte[second], second, true);
+  }
+
+  /// Operands of an instruction from the one- or two-byte opcode tables
+  bool legacy(uint8_t entry, uint8_t opcode, bool two_byte_map) {
+    if (entry & BAD) return false;
+    if (x64 && (entry & I64)) return false;
+
+    uint8_t reg = 0;
+    if (entry & M) {
+      if (!has(1)) return false;
+      reg = (bytes[pos] >> 3) & 7;
+      // mov to/from control and debug registers always uses the register form
+      const bool register_only = two_byte_map && opcode >= 0x20 && opcode <= 0x23;
+      if (!modrm(register_only)) return false;
+    }
+
+    const uint8_t kind = entry & imm_mask;
+    if (kind == G3) {
+      if (reg > 1) return true;
+      return immediate(opcode == 0xF6 ? 1 : immediate_size(IZ), false);
+    }
+    if (kind == 0) return true;
+    return immediate(immediate_size(kind), kind == JB || kind == JZ);
+  }
+};
+
+// Opcodes whose ModRM reg field selects the operation instead of a register
+constexpr bool is_group_opcode(uint8_t opcode, bool two_byte_map) {
+  if (two_byte_map) {
+    return opcode <= 0x01 || opcode == 0x18 || (opcode >= 0x71 && opcode <= 0x73)
+           || opcode == 0xAE || opcode == 0xBA || opcode == 0xC7;
+  }
+  return (opcode >= 0x80 && opcode <= 0x83) || opcode == 0x8F || opcode == 0xC0 || opcode == 0xC1
+         || opcode == 0xC6 || opcode == 0xC7 || (opcode >= 0xD0 && opcode <= 0xDF)
+         || opcode == 0xF6 || opcode == 0xF7 || opcode == 0xFE || opcode == 0xFF;
+}
+
+// Opcode with any register number in its low three bits cleared (push r, mov r, imm, bswap r)
+constexpr uint8_t opcode_without_register(uint8_t opcode, bool two_byte_map, bool x64) {
+  if (two_byte_map) return opcode >= 0xC8 ? 0xC8 : opcode;
+  // nop is 90, so xchg with eax keeps a key of its own
+  if (opcode >= 0x91 && opcode <= 0x97) return 0x91;
+  const bool inc_dec = !x64 && opcode >= 0x40 && opcode <= 0x4F;
+  if (inc_dec || (opcode >= 0x50 && opcode <= 0x5F) || (opcode >= 0xB0 && opcode <= 0xBF)) {
+    return opcode & 0xF8;
+  }
+  return opcode;
+}
+
+// Everything that selects the operation: prefixes, opcode map and opcode, group extension, and
+// whether the ModRM operand is a register, RIP-relative or other memory. Register numbers,
+// displacements and immediates are left out.
+uint32_t x86_token(const uint8_t* bytes, const X86Insn& insn, bool x64) {
+  uint8_t key[32];
+  size_t size = 0;
+
+  size_t pos = 0;
+  for (; pos < insn.opcode_offset; ++pos) {
+    const uint8_t byte = bytes[pos];
+    if (is_legacy_prefix(byte)) {
+      key[size++] = byte;
+    } else if (x64 && (byte & 0xF0) == 0x40) {
+      // REX.W changes the operand size; R, X and B only extend register numbers
+      if (byte & 0x08) key[size++] = 0x48;
+    } else {
+      break;
+    }
+  }
+
+  // VEX, EVEX and XOP keep their map, W, L and implied prefix but not their register fields
+  const bool escaped = pos < insn.opcode_offset;
+  if (escaped) {
+    const uint8_t escape = bytes[pos];
+    key[size++] = escape;
+    if (escape == 0xC5) {
+      key[size++] = bytes[pos + 1] & 0x07;
+    } else if (escape == 0xC4 || escape == 0x8F) {
+      key[size++] = bytes[pos + 1] & 0x1F;
+      key[size++] = bytes[pos + 2] & 0x87;
+    } else if (escape == 0x62) {
+      key[size++] = bytes[pos + 1] & 0x07;
+      key[size++] = bytes[pos + 2] & 0x83;
+      key[size++] = bytes[pos + 3] & 0x60;
+    } else {
+      key[size++] = bytes[pos + 1]; // 0F 38 or 0F 3A
+    }
+    pos = insn.opcode_offset;
+  }
+
+  const bool two_byte_map = !escaped && bytes[pos] == 0x0F;
+  if (two_byte_map) key[size++] = bytes[pos++];
+
+  const uint8_t opcode = bytes[pos];
+  key[size++] = escaped ? opcode : opcode_without_register(opcode, two_byte_map, x64);
+
+  if (insn.modrm_offset) {
+    const uint8_t modrm = bytes[insn.modrm_offset];
+    key[size++] = (modrm >> 6) == 3 ? 1 : insn.rip_relative ? 2 : 3;
+    if (!escaped && is_group_opcode(opcode, two_byte_map)) {
+      key[size++] = (modrm >> 3) & 7;
+    }
+  }
+  return make_token(key, size);
+}
+} // namespace
+
+bool decode_x86(const uint8_t* bytes, size_t available, bool x64, X86Insn& out) {
+  out = {};
+  Decoder decoder{bytes, available, x64, out};
+  if (!decoder.run()) return false;
+  out.size = static_cast<uint8_t>(decoder.pos);
+  return true;
+}
+
+bool X86Decoder::decode(
+    uint64_t /*address*/, const uint8_t* bytes, size_t available, InsnInfo& out) const {
+  X86Insn insn;
+  if (!decode_x86(bytes, available, x64_, insn)) return false;
+
+  out.size = insn.size;
+  out.wildcard_begin = insn.operand_offset();
+  out.wildcard_end = insn.size;
+  out.token = x86_token(bytes, insn, x64_);
+  return true;
+}
+} // namespace fusion
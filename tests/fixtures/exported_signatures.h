@@ -0,0 +1,67 @@
+// Generated by IDA-Fusion. Scan with fusion::runtime::PatternSet from fusion/runtime_scan.h.
+#pragma once
+
+#include <fusion/runtime_scan.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace signatures {
+inline constexpr uint8_t bytes[] = {
+    0x48, 0x8B, 0x05, 0x00, 0x00, 0x00, 0x00, 0x48, 0x8B, 0x0D, 0x00, 0x00,
+    0x00, 0x00, 0x33, 0xD2, 0x40, 0x53, 0x48, 0x83, 0xEC, 0x20, 0x8B, 0x40,
+    0x00, 0x00, 0x00, 0x00, 0x48, 0x89, 0x5C, 0x24, 0x00, 0x57, 0x48, 0x83,
+    0xEC, 0x20, 0xE8, 0x00, 0x00, 0x00, 0x00, 0x90,
+};
+
+inline constexpr uint8_t masks[] = {
+    0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00,
+    0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0,
+    0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF,
+};
+
+inline constexpr fusion::runtime::PatternEntry entries[] = {
+    {0, 7, 2, 3, "g_pWorld"}, // 48 8B 05 ? ? ? ?
+    {7, 9, 2, 0, "g_pWorld"}, // 48 8B 0D ? ? ? ? 33 D2
+    {16, 12, 1, 0, "Player::Tick"}, // 40 53 48 83 EC 20 8B 4? ? ? ? 00
+    {28, 10, 2, 0, "CGame::Update"}, // 48 89 5C 24 ? 57 48 83 EC 20
+    {38, 6, 0, 0, "sub_1234+0x10"}, // E8 ? ? ? ? 90
+};
+
+inline constexpr uint32_t buckets[257] = {
+    0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+    1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5,
+};
+
+inline constexpr fusion::runtime::PatternSet set = {bytes, masks, entries, 5, buckets};
+
+/// Index of each signature in `entries`
+enum Signature : size_t {
+  g_pWorld = 0,
+  g_pWorld_2 = 1,
+  Player__Tick = 2,
+  CGame__Update = 3,
+  sub_1234_0x10 = 4,
+};
+} // namespace signatures
@@ -0,0 +1,19 @@
+﻿// Entry point of fusion_tests_avx2, which builds the runtime scanner tests with AVX2 so the
+// AVX2 kernel of find_from is checked as well as the SSE2 one in fusion_tests
+
+#define DOCTEST_CONFIG_IMPLEMENT
+#include "doctest.h"
+
+#include "fusion/runtime_scan.h"
+
+#ifndef FUSION_RUNTIME_AVX2
+#error "fusion_tests_avx2 must be built with AVX2 enabled"
+#endif
+
+int main(int argc, char** argv) {
+  // Reported to CTest as skipped on CPUs without AVX2
+  if (!__builtin_cpu_supports("avx2")) return 77;
+
+  doctest::Context context(argc, argv);
+  return context.run();
+}
@@ -0,0 +1,122 @@
+﻿#include "doctest.h"
+#include "test_util.h"
+
+#include "fusion/common_pattern.h"
+#include "fusion/export.h"
+#include "fusion/x86_decoder.h"
+
+#include <algorithm>
+
+namespace {
+// int3 padding with each function copied to the start of its own 0x40 bytes from 0x1000
+fusion::ImageSnapshot place_functions(
+    const std::vector<std::vector<uint8_t>>& code, std::vector<fusion::AddressRange>& ranges) {
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  region.bytes.assign(code.size() * 0x40, 0xCC);
+  for (size_t i = 0; i < code.size(); ++i) {
+    std::copy(code[i].begin(), code[i].end(), region.bytes.begin() + i * 0x40);
+    ranges.push_back({0x1000 + i * 0x40, 0x1000 + i * 0x40 + code[i].size()});
+  }
+
+  fusion::ImageSnapshot image;
+  image.regions.push_back(std::move(region));
+  return image;
+}
+} // namespace
+
+TEST_CASE("find_common_pattern finds a helper inlined with other registers") {
+  // mov rax, [rcx]; add rax, rdx; xor eax, eax, and the same with rdx and rcx swapped
+  const std::vector<uint8_t> helper = {0x48, 0x8B, 0x01, 0x48, 0x01, 0xD0, 0x31, 0xC0};
+  const std::vector<uint8_t> swapped = {0x48, 0x8B, 0x02, 0x48, 0x01, 0xC8, 0x31, 0xC0};
+
+  std::vector<std::vector<uint8_t>> code(3);
+  code[0] = {0x90}; // nop; helper; ret
+  code[0].insert(code[0].end(), helper.begin(), helper.end());
+  code[0].push_back(0xC3);
+  code[1] = {0x53, 0x48, 0x83, 0xEC, 0x20}; // push rbx; sub rsp, 0x20; swapped; pop rbx; ret
+  code[1].insert(code[1].end(), swapped.begin(), swapped.end());
+  code[1].insert(code[1].end(), {0x5B, 0xC3});
+  code[2] = helper; // helper; leave; ret
+  code[2].insert(code[2].end(), {0xC9, 0xC3});
+
+  std::vector<fusion::AddressRange> ranges;
+  const auto image = place_functions(code, ranges);
+  const auto common = fusion::find_common_pattern(image, fusion::X86Decoder{}, ranges);
+  REQUIRE(common);
+  CHECK(common->instructions == 3);
+  CHECK(fusion::render_ida_pattern(common->pattern) == "48 8B 0? 48 01 ? 31 C0");
+  CHECK(common->addresses == std::vector<uint64_t>{0x1001, 0x1045, 0x1080});
+
+  // Nothing in common, or nothing to compare with
+  ranges.clear();
+  const auto other = place_functions({{0x90, 0xC3}, {0x31, 0xC0}}, ranges);
+  CHECK_FALSE(fusion::find_common_pattern(other, fusion::X86Decoder{}, ranges));
+  CHECK_FALSE(fusion::find_common_pattern(other, fusion::X86Decoder{}, {ranges[0]}));
+}
+
+TEST_CASE("find_common_pattern agrees with a brute-force search") {
+  // nop, xor eax/ecx, mov rbp/rbx, rsp, sub rsp, imm8: four shapes of different lengths
+  const std::vector<std::vector<uint8_t>> alphabet = {{0x90},
+      {0x31, 0xC0},
+      {0x31, 0xC9},
+      {0x48, 0x89, 0xE5},
+      {0x48, 0x89, 0xE3},
+      {0x48, 0x83, 0xEC, 0x20}};
+  const auto shape = [](size_t letter) { return letter == 2 ? 1 : letter == 4 ? 3 : letter; };
+
+  for (uint32_t seed = 1; seed <= 20; ++seed) {
+    std::vector<uint8_t> choices(8 * 12);
+    test::fill_random(choices, seed);
+
+    std::vector<std::vector<size_t>> letters(8);
+    std::vector<std::vector<uint8_t>> code(8);
+    for (size_t f = 0; f < letters.size(); ++f) {
+      for (size_t i = 0; i < 12; ++i) {
+        const size_t letter = choices[f * 12 + i] % alphabet.size();
+        letters[f].push_back(letter);
+        code[f].insert(code[f].end(), alphabet[letter].begin(), alphabet[letter].end());
+      }
+    }
+
+    // Longest run of shapes in the first function that every other one contains, in bytes
+    size_t expected = 0;
+    for (size_t start = 0; start < 12; ++start) {
+      for (size_t length = 1; start + length <= 12; ++length) {
+        const auto contains = [&](const std::vector<size_t>& function) {
+          for (size_t at = 0; at + length <= function.size(); ++at) {
+            if (std::equal(letters[0].begin() + start,
+                    letters[0].begin() + start + length,
+                    function.begin() + at,
+                    [&](size_t a, size_t b) { return shape(a) == shape(b); })) {
+              return true;
+            }
+          }
+          return false;
+        };
+        if (!std::all_of(letters.begin() + 1, letters.end(), contains)) break;
+
+        size_t bytes = 0;
+        for (size_t i = start; i < start + length; ++i) {
+          bytes += alphabet[letters[0][i]].size();
+        }
+        expected = std::max(expected, bytes);
+      }
+    }
+
+    std::vector<fusion::AddressRange> ranges;
+    const auto image = place_functions(code, ranges);
+    const auto common = fusion::find_common_pattern(image, fusion::X86Decoder{}, ranges);
+    CAPTURE(seed);
+    REQUIRE(common.has_value() == (expected > 0));
+    if (!common) continue;
+
+    // No shape starts with a wildcard, so only trailing ones may have been trimmed
+    CHECK(common->pattern.size() <= expected);
+    CHECK(common->pattern.size() + 1 >= expected);
+    const auto& bytes = image.regions[0].bytes;
+    for (const uint64_t address : common->addresses) {
+      CHECK(common->pattern.matches(bytes.data() + (address - 0x1000)));
+    }
+  }
+}
@@ -0,0 +1,121 @@
+﻿#include "doctest.h"
+
+#include "fusion/corpus.h"
+#include "fusion/signature.h"
+
+namespace {
+/// Decode every function of `db` front to back; returns the instruction count, 0 on failure
+size_t decode_functions(const fusion::MockDatabase& db, size_t* rip_relative = nullptr) {
+  const auto& code = db.snapshot.regions.front();
+  size_t count = 0;
+  for (const auto& function : db.functions) {
+    for (uint64_t address = function.start; address < function.end;) {
+      const size_t offset = address - code.start;
+      fusion::X86Insn insn;
+      if (!fusion::decode_x86(code.bytes.data() + offset, function.end - address, true, insn)) {
+        return 0;
+      }
+      if (rip_relative && insn.rip_relative) ++*rip_relative;
+      address += insn.size;
+      ++count;
+    }
+    if (code.bytes[function.end - 1 - code.start] != 0xC3) return 0;
+  }
+  return count;
+}
+} // namespace
+
+TEST_CASE("Corpus generation is deterministic") {
+  fusion::CorpusSettings settings;
+  settings.size = 256 << 10;
+
+  fusion::MockDatabase a, b, c;
+  fusion::generate_corpus(settings, a);
+  fusion::generate_corpus(settings, b);
+  settings.seed = 2;
+  fusion::generate_corpus(settings, c);
+
+  CHECK(a.snapshot.regions[0].bytes == b.snapshot.regions[0].bytes);
+  CHECK(a.snapshot.regions[1].bytes == b.snapshot.regions[1].bytes);
+  CHECK(a.functions == b.functions);
+  CHECK(a.snapshot.regions[0].bytes != c.snapshot.regions[0].bytes);
+}
+
+TEST_CASE("Corpus functions are valid x86-64") {
+  for (const auto padding : {fusion::CorpusPadding::Int3, fusion::CorpusPadding::Nop}) {
+    fusion::CorpusSettings settings;
+    settings.size = 512 << 10;
+    settings.padding = padding;
+
+    fusion::MockDatabase db;
+    const auto stats = fusion::generate_corpus(settings, db);
+
+    REQUIRE(db.snapshot.regions.size() == 2);
+    const auto& code = db.snapshot.regions[0];
+    CHECK(code.start == settings.base);
+    CHECK(code.bytes.size() == settings.size);
+    CHECK(db.snapshot.regions[1].start >= code.end());
+
+    CHECK(stats.functions == db.functions.size());
+    CHECK(stats.duplicates > 0);
+    CHECK(stats.inlined > 0);
+    CHECK(decode_functions(db) == stats.instructions);
+
+    uint64_t previous_end = 0;
+    for (const auto& function : db.functions) {
+      CHECK(function.start % settings.alignment == 0);
+      CHECK(function.start >= previous_end);
+      previous_end = function.end;
+    }
+    CHECK(previous_end <= code.end());
+  }
+}
+
+TEST_CASE("Corpus opcode mix is tunable") {
+  fusion::CorpusSettings settings;
+  settings.size = 64 << 10;
+  settings.mix = {};
+  settings.mix.mov_reg = 0;
+  settings.mix.mov_imm = 0;
+  settings.mix.load_store = 0;
+  settings.mix.call = 0;
+  settings.mix.branch = 0;
+  settings.mix.alu = 0;
+  settings.mix.sse = 0;
+  settings.mix.rip_load = 1;
+
+  fusion::MockDatabase db;
+  const auto stats = fusion::generate_corpus(settings, db);
+
+  size_t rip_relative = 0;
+  REQUIRE(decode_functions(db, &rip_relative) == stats.instructions);
+  // Everything but the prologue and epilogue reads through rip
+  CHECK(rip_relative > stats.instructions * 3 / 4);
+}
+
+TEST_CASE("Duplicated corpus functions match more than once") {
+  fusion::CorpusSettings settings;
+  settings.size = 64 << 10;
+  settings.duplicate_rate = 1.0;
+
+  // Every function after the first copies an earlier one, so all of them are the same
+  fusion::MockDatabase db;
+  const auto stats = fusion::generate_corpus(settings, db);
+  REQUIRE(stats.functions > 2);
+  CHECK(stats.duplicates + 2 >= stats.functions);
+
+  // A signature covering a whole function finds every copy
+  auto whole_function = [&db](size_t index) {
+    db.selected = fusion::AddressRange{db.functions[index].start, db.functions[index].end};
+    const auto created = fusion::create_signature(db, {});
+    REQUIRE(created.status == fusion::CreateStatus::FromSelection);
+    return fusion::find_signature(db, created.builder.render(fusion::SignatureStyle::IDA), {})
+        ->size();
+  };
+  CHECK(whole_function(1) >= stats.duplicates);
+
+  settings.duplicate_rate = 0;
+  settings.inline_rate = 0;
+  fusion::generate_corpus(settings, db);
+  CHECK(whole_function(1) == 1);
+}
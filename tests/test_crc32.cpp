@@ -0,0 +1,67 @@
+﻿#include "doctest.h"
+
+#include "fusion/crc32.h"
+#include "test_util.h"
+
+#include <cstring>
+
+namespace {
+std::vector<uint64_t> naive_find(const fusion::ImageSnapshot& snapshot, uint32_t hash, size_t length) {
+  std::vector<uint64_t> results;
+  for (const auto& region : snapshot.regions) {
+    for (size_t i = 0; i + length <= region.bytes.size(); ++i) {
+      if (fusion::crc32(region.bytes.data() + i, length) == hash) {
+        results.push_back(region.start + i);
+      }
+    }
+  }
+  return results;
+}
+} // namespace
+
+TEST_CASE("crc32 known values") {
+  const char* check = "123456789";
+  CHECK(fusion::crc32(reinterpret_cast<const uint8_t*>(check), strlen(check)) == 0xCBF43926);
+  CHECK(fusion::crc32(nullptr, 0) == 0);
+}
+
+TEST_CASE("find_crc32 locates every matching window") {
+  auto snapshot = test::make_snapshot(0x140001000, 4096, 1);
+  auto& bytes = snapshot.regions[0].bytes;
+
+  // Plant the same 12-byte sequence three times, including at both region edges
+  const uint8_t needle[] = {0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20, 0xCC, 0x90};
+  for (size_t offset : {size_t{0}, size_t{1234}, bytes.size() - sizeof(needle)}) {
+    memcpy(bytes.data() + offset, needle, sizeof(needle));
+  }
+
+  const uint32_t hash = fusion::crc32(needle, sizeof(needle));
+  const auto results = fusion::find_crc32(snapshot, hash, sizeof(needle));
+
+  REQUIRE(results.size() == 3);
+  CHECK(results[0] == 0x140001000);
+  CHECK(results[1] == 0x140001000 + 1234);
+  CHECK(results[2] == 0x140001000 + bytes.size() - sizeof(needle));
+}
+
+TEST_CASE("find_crc32 matches a naive scan across lanes and threads") {
+  // Spans two work chunks and uses interleaved lanes; short windows give natural collisions
+  auto snapshot = test::make_snapshot(0x1000, (1 << 20) + 5000, 7);
+  snapshot.regions.push_back(test::make_snapshot(0x900000, 3, 9).regions[0]); // shorter than window
+
+  const auto& bytes = snapshot.regions[0].bytes;
+  for (size_t length : {size_t{1}, size_t{4}, size_t{33}}) {
+    const uint32_t hash = fusion::crc32(bytes.data() + 777, length);
+    const auto expected = naive_find(snapshot, hash, length);
+
+    CHECK(fusion::find_crc32(snapshot, hash, length, 1) == expected);
+    CHECK(fusion::find_crc32(snapshot, hash, length, 4) == expected);
+  }
+}
+
+TEST_CASE("find_crc32 handles empty inputs") {
+  auto snapshot = test::make_snapshot(0x1000, 16, 3);
+  CHECK(fusion::find_crc32(snapshot, 0, 0).empty());
+  CHECK(fusion::find_crc32(snapshot, 0, 17).empty());
+  CHECK(fusion::find_crc32(fusion::ImageSnapshot{}, 0, 4).empty());
+}
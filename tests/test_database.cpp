@@ -0,0 +1,399 @@
+﻿#include "doctest.h"
+
+#include "fusion/database.h"
+#include "fusion/export.h"
+#include "fusion/signature.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+// Two x64 functions sharing a prologue, padded with int3:
+//   0x1000: push rbp; mov rbp, rsp; sub rsp, 0x20; xor eax, eax; leave; ret
+//   0x1010: push rbp; mov rbp, rsp; sub rsp, 0x20; xor ecx, ecx; leave; ret
+fusion::MockDatabase make_database() {
+  static constexpr uint8_t prologue[] = {0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20};
+  static constexpr uint8_t body_a[] = {0x31, 0xC0, 0xC9, 0xC3};
+  static constexpr uint8_t body_b[] = {0x31, 0xC9, 0xC9, 0xC3};
+
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  region.bytes.assign(0x100, 0xCC);
+
+  auto place = [&](size_t offset, const uint8_t* body) {
+    std::copy(std::begin(prologue), std::end(prologue), region.bytes.begin() + offset);
+    std::copy(body, body + 4, region.bytes.begin() + offset + sizeof(prologue));
+  };
+  place(0x00, body_a);
+  place(0x10, body_b);
+
+  fusion::MockDatabase db;
+  db.snapshot.regions.push_back(std::move(region));
+  db.functions = {{0x1000, 0x100C, "func_a"}, {0x1010, 0x101C, "func_b"}};
+  db.cursor_ea = 0x1000;
+  return db;
+}
+
+// Another build: int3 padding with the given code copied to each offset from 0x5000
+fusion::ImageSnapshot make_build(
+    std::initializer_list<std::pair<size_t, std::vector<uint8_t>>> functions) {
+  fusion::SnapshotRegion region;
+  region.start = 0x5000;
+  region.bytes.assign(0x100, 0xCC);
+  for (const auto& [offset, code] : functions) {
+    std::copy(code.begin(), code.end(), region.bytes.begin() + offset);
+  }
+
+  fusion::ImageSnapshot image;
+  image.regions.push_back(std::move(region));
+  return image;
+}
+
+const std::vector<uint8_t> func_a = {
+    0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0x31, 0xC0, 0xC9, 0xC3};
+// Same start as func_a, but returns with pop rbp instead of leave
+const std::vector<uint8_t> func_a_pop = {
+    0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0x31, 0xC0, 0x5D, 0xC3};
+} // namespace
+
+TEST_CASE("MockDatabase function lookup") {
+  const auto db = make_database();
+
+  CHECK_FALSE(db.function_at(0x0FFF));
+  CHECK(db.function_at(0x1000)->name == "func_a");
+  CHECK(db.function_at(0x100B)->name == "func_a");
+  CHECK_FALSE(db.function_at(0x100C));
+  CHECK(db.function_at(0x1010)->name == "func_b");
+  CHECK_FALSE(db.function_at(0x1020));
+}
+
+TEST_CASE("create_signature grows past a shared prologue") {
+  const auto db = make_database();
+
+  size_t instructions = 0;
+  const auto result = fusion::create_signature(db, {}, [&](uint64_t) { ++instructions; });
+
+  CHECK(result.status == fusion::CreateStatus::Unique);
+  CHECK(instructions == 4);
+  CHECK(result.builder.render(fusion::SignatureStyle::IDA) == "55 48 89 E5 48 83 EC ? 31 C0");
+
+  // The created signature finds the cursor and nothing else
+  const auto pattern = result.builder.render(fusion::SignatureStyle::IDA);
+  const auto found = fusion::find_signature(db, pattern, {});
+  REQUIRE(found);
+  CHECK(*found == std::vector<uint64_t>{0x1000});
+}
+
+TEST_CASE("create_signature from the selection") {
+  auto db = make_database();
+  db.selected = fusion::AddressRange{0x1010, 0x1014};
+
+  auto result = fusion::create_signature(db, {});
+  CHECK(result.status == fusion::CreateStatus::FromSelection);
+  CHECK(result.builder.render(fusion::SignatureStyle::IDA) == "55 48 89 E5");
+
+  fusion::CreateSettings settings;
+  settings.use_selection = false;
+  result = fusion::create_signature(db, settings);
+  CHECK(result.status == fusion::CreateStatus::Unique);
+}
+
+TEST_CASE("create_signature grows until unique in every build") {
+  const auto db = make_database();
+  const auto next = make_build({{0x20, func_a_pop}, {0x40, func_a}});
+  const auto unrelated = make_build({});
+
+  const auto result = fusion::create_multi_image_signature(db, {&next, &unrelated}, {});
+  CHECK(result.status == fusion::CreateStatus::Unique);
+  CHECK(result.builder.render(fusion::SignatureStyle::IDA) == "55 48 89 E5 48 83 EC ? 31 C0 C9");
+
+  REQUIRE(result.references.size() == 2);
+  CHECK(result.references[0].status == fusion::ReferenceStatus::Unique);
+  CHECK(result.references[0].address == 0x5040);
+  CHECK(result.references[1].status == fusion::ReferenceStatus::Missing);
+
+  // Without references the shorter signature is enough
+  CHECK(fusion::create_signature(db, {}).builder.size() == 10);
+}
+
+TEST_CASE("create_signature fails when growing loses a build") {
+  const auto db = make_database();
+  // Forces growth past `xor eax, eax`, which drops the only match in `changed`
+  const auto ambiguous = make_build({{0x20, func_a_pop}, {0x40, func_a}});
+  const auto changed = make_build({{0x60, func_a_pop}});
+
+  const auto result = fusion::create_multi_image_signature(db, {&ambiguous, &changed}, {});
+  CHECK(result.status == fusion::CreateStatus::NotUnique);
+  REQUIRE(result.references.size() == 2);
+  CHECK(result.references[0].status == fusion::ReferenceStatus::Unique);
+  CHECK(result.references[1].status == fusion::ReferenceStatus::Lost);
+
+  // A build where the signature still matches twice is reported, not hidden
+  const auto twice = make_build({{0x20, func_a}, {0x40, func_a}});
+  auto selected = db;
+  selected.selected = fusion::AddressRange{0x1000, 0x100C};
+  const auto checked = fusion::create_multi_image_signature(selected, {&twice, &changed}, {});
+  CHECK(checked.status == fusion::CreateStatus::FromSelection);
+  CHECK(checked.references[0].status == fusion::ReferenceStatus::Ambiguous);
+  CHECK(checked.references[1].status == fusion::ReferenceStatus::Missing);
+}
+
+TEST_CASE("load_reference_image reads fixtures and raw files") {
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto fixture = (dir / "fusion_reference.fdb").string();
+  const auto raw = (dir / "fusion_reference.bin").string();
+
+  const auto db = make_database();
+  REQUIRE(fusion::save_mock_database(fixture, db));
+  {
+    std::ofstream out(raw, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(func_a.data()), func_a.size());
+  }
+
+  fusion::ImageSnapshot image;
+  REQUIRE(fusion::load_reference_image(fixture, image));
+  REQUIRE(image.regions.size() == 1);
+  CHECK(image.regions[0].start == 0x1000);
+  CHECK(image.regions[0].bytes == db.snapshot.regions[0].bytes);
+
+  REQUIRE(fusion::load_reference_image(raw, image));
+  REQUIRE(image.regions.size() == 1);
+  CHECK(image.regions[0].start == 0);
+  CHECK(image.regions[0].bytes == func_a);
+
+  CHECK_FALSE(fusion::load_reference_image((dir / "fusion_missing.bin").string(), image));
+  std::filesystem::remove(fixture);
+  std::filesystem::remove(raw);
+}
+
+TEST_CASE("create_signature uses two fragments instead of a long run") {
+  // Three functions that differ only in the xor after a long shared body:
+  //   push rbp; mov rbp, rsp; sub rsp, 0x20; 14 x mov rax, rcx; xor r, r; leave; ret
+  static constexpr uint8_t xors[] = {0xC0, 0xC9, 0xD2};
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  region.bytes.assign(0x300, 0xCC);
+  for (size_t i = 0; i < 3; ++i) {
+    std::vector<uint8_t> code = {0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20};
+    for (int j = 0; j < 14; ++j) {
+      code.insert(code.end(), {0x48, 0x89, 0xC8});
+    }
+    code.insert(code.end(), {0x31, xors[i], 0xC9, 0xC3});
+    std::copy(code.begin(), code.end(), region.bytes.begin() + i * 0x100);
+  }
+
+  fusion::MockDatabase db;
+  db.snapshot.regions.push_back(std::move(region));
+  db.functions = {{0x1000, 0x1036, "a"}, {0x1100, 0x1136, "b"}, {0x1200, 0x1236, "c"}};
+  db.cursor_ea = 0x1000;
+
+  const auto contiguous = fusion::create_signature(db, {.use_selection = false});
+  CHECK(contiguous.status == fusion::CreateStatus::Unique);
+  CHECK(contiguous.builder.size() == 52);
+  CHECK_FALSE(contiguous.composite);
+
+  const auto created =
+      fusion::create_signature(db, {.use_selection = false, .allow_composite = true});
+  CHECK(created.status == fusion::CreateStatus::Unique);
+  REQUIRE(created.composite);
+  const std::string text = fusion::render_composite_pattern(*created.composite);
+  CHECK(text == "55 48 89 E5 48 83 EC ? 48 89 C8 48 89 C8 [27-45] 31 C0");
+  CHECK(*fusion::find_signature(db, text, {}) == std::vector<uint64_t>{0x1000});
+
+  CHECK(*fusion::find_signature(db, "55 48 89 E5 [40-50] 31 ?", {})
+        == std::vector<uint64_t>{0x1000, 0x1100, 0x1200});
+  CHECK_FALSE(fusion::find_signature(db, "55 [4", {}));
+}
+
+TEST_CASE("create_group_signature matches exactly the given addresses") {
+  // Four vtable thunks, mov r, [r]; jmp [rax + 0x10], that load through different registers:
+  // rax from rcx, rax from rdx, rdx from rcx and rbx from rcx
+  static constexpr uint8_t loads[] = {0x01, 0x02, 0x11, 0x19};
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  region.bytes.assign(0x400, 0xCC);
+  for (size_t i = 0; i < 4; ++i) {
+    const uint8_t thunk[] = {0x48, 0x8B, loads[i], 0xFF, 0x60, 0x10};
+    std::copy(std::begin(thunk), std::end(thunk), region.bytes.begin() + i * 0x100);
+  }
+
+  fusion::MockDatabase db;
+  db.snapshot.regions.push_back(std::move(region));
+  db.functions = {
+      {0x1000, 0x1006, "a"}, {0x1100, 0x1106, "b"}, {0x1200, 0x1206, "c"}, {0x1300, 0x1306, "d"}};
+  using Matches = std::vector<uint64_t>;
+
+  // 0x01 and 0x02 share their high nibble, which keeps out the other two
+  auto created = fusion::create_group_signature(db, {0x1100, 0x1000}, {});
+  CHECK(created.status == fusion::CreateStatus::Unique);
+  CHECK(fusion::render_ida_pattern(created.pattern) == "48 8B 0?");
+  CHECK(*fusion::find_signature(db, "48 8B 0?", {}) == Matches{0x1000, 0x1100});
+
+  created = fusion::create_group_signature(db, {0x1000, 0x1100, 0x1200, 0x1300}, {});
+  CHECK(created.status == fusion::CreateStatus::Unique);
+  CHECK(fusion::render_ida_pattern(created.pattern) == "48 8B");
+
+  // 0x01 and 0x19 differ in both nibbles, so nothing tells them from the other two
+  created = fusion::create_group_signature(db, {0x1000, 0x1300}, {});
+  CHECK(created.status == fusion::CreateStatus::NotUnique);
+
+  created = fusion::create_group_signature(db, {0x1000, 0x1080}, {});
+  CHECK(created.status == fusion::CreateStatus::NotInFunction);
+  CHECK(created.outside == 0x1080);
+}
+
+TEST_CASE("create_signature outside functions") {
+  auto db = make_database();
+  db.cursor_ea = 0x1080;
+
+  auto result = fusion::create_signature(db, {});
+  CHECK(result.status == fusion::CreateStatus::NotInFunction);
+  CHECK(result.builder.empty());
+
+  // Padding repeats until the region ends, so it never becomes unique
+  fusion::CreateSettings settings;
+  settings.allow_dangerous_regions = true;
+  result = fusion::create_signature(db, settings);
+  CHECK(result.status == fusion::CreateStatus::NotUnique);
+}
+
+TEST_CASE("find_signature filters matches") {
+  const auto db = make_database();
+  using Matches = std::vector<uint64_t>;
+
+  CHECK(*fusion::find_signature(db, "55 48 89 E5", {}) == Matches{0x1000, 0x1010});
+  CHECK(*fusion::find_signature(db, "\\x55\\x48\\x89\\xE5", {}) == Matches{0x1000, 0x1010});
+  CHECK(*fusion::find_signature(db, "55 48 89 E5", {.stop_at_first = true}) == Matches{0x1000});
+  CHECK(*fusion::find_signature(db, "55 48 89 E5", {.ignore_addr = 0x1000}) == Matches{0x1010});
+  CHECK(*fusion::find_signature(db, "55 48 89 E5", {.start_addr = 0x1001}) == Matches{0x1010});
+  CHECK_FALSE(fusion::find_signature(db, "55 XY", {}));
+}
+
+TEST_CASE("function_starts_only checks only function starts") {
+  // func_a's code is no longer a function, so its copy of the prologue stops counting
+  auto db = make_database();
+  db.functions = {{0x1010, 0x101C, "func_b"}, {0x1020, 0x1030, "padding"}};
+  db.cursor_ea = 0x1010;
+  using Matches = std::vector<uint64_t>;
+
+  CHECK(fusion::create_signature(db, {}).builder.size() == 10);
+  const auto result = fusion::create_signature(db, {.function_starts_only = true});
+  CHECK(result.status == fusion::CreateStatus::Unique);
+  CHECK(result.builder.render(fusion::SignatureStyle::IDA) == "55");
+
+  CHECK(*fusion::find_signature(db, "55 48 89 E5", {}) == Matches{0x1000, 0x1010});
+  CHECK(*fusion::find_signature(db, "55", {.function_starts_only = true}) == Matches{0x1010});
+  CHECK(*fusion::find_signature(db, "CC CC", {.function_starts_only = true}) == Matches{0x1020});
+  CHECK(fusion::find_signature(db, "48 83 EC", {.function_starts_only = true})->empty());
+
+  const std::string broken = "55 48 89 E5 48 83 EC ? 31 D2";
+  CHECK(fusion::find_fuzzy_signature(db, broken, {.max_distance = 1})->size() == 2);
+  CHECK(*fusion::find_fuzzy_signature(db, broken, {.max_distance = 1, .function_starts_only = true})
+        == std::vector<fusion::FuzzyMatch>{{0x1010, 1}});
+
+  // Cursor inside a function: every address still counts
+  db.cursor_ea = 0x1014;
+  CHECK(fusion::create_signature(db, {.function_starts_only = true}).builder.size() > 1);
+}
+
+TEST_CASE("find_fuzzy_signature re-anchors a broken signature") {
+  const auto db = make_database();
+  // func_b's signature from a build where it used xor edx, edx
+  const std::string broken = "55 48 89 E5 48 83 EC ? 31 D2";
+
+  CHECK(fusion::find_signature(db, broken, {})->empty());
+
+  const auto found = fusion::find_fuzzy_signature(db, broken, {.max_distance = 1});
+  REQUIRE(found);
+  CHECK(*found == std::vector<fusion::FuzzyMatch>{{0x1000, 1}, {0x1010, 1}});
+
+  const auto best =
+      fusion::find_fuzzy_signature(db, "55 48 89 E5 48 83 EC ? 31 C9", {.max_distance = 2});
+  REQUIRE(best);
+  REQUIRE(best->size() == 2);
+  CHECK(best->front() == fusion::FuzzyMatch{0x1010, 0});
+  CHECK(best->back() == fusion::FuzzyMatch{0x1000, 1});
+
+  const auto filtered = fusion::find_fuzzy_signature(
+      db, broken, {.stop_at_first = true, .start_addr = 0x1001, .max_distance = 1});
+  CHECK(*filtered == std::vector<fusion::FuzzyMatch>{{0x1010, 1}});
+  CHECK_FALSE(fusion::find_fuzzy_signature(db, "55 XY", {.max_distance = 1}));
+}
+
+TEST_CASE("find_fuzzy_signature bounds the distance and the number of matches") {
+  const auto db = make_database();
+
+  // Two fixed bytes allow at most one difference, so one of them still has to match
+  const auto clamped = fusion::find_fuzzy_signature(db, "55 ? 89", {.max_distance = 100});
+  REQUIRE(clamped);
+  CHECK(clamped->size() == 2);
+  CHECK(std::all_of(clamped->begin(), clamped->end(), [](const auto& match) {
+    return match.distance == 0;
+  }));
+
+  const auto capped =
+      fusion::find_fuzzy_signature(db, "CC CC CC", {.max_distance = 2, .max_matches = 3});
+  REQUIRE(capped);
+  REQUIRE(capped->size() == 3);
+  CHECK(capped->back().distance == 0);
+}
+
+TEST_CASE("Mock database round trip") {
+  auto db = make_database();
+  db.selected = fusion::AddressRange{0x1010, 0x1014};
+  db.cursor_ea = 0x1004;
+  db.x64 = false;
+
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_mock.fdb").string();
+  REQUIRE(fusion::save_mock_database(path, db));
+
+  fusion::MockDatabase loaded;
+  REQUIRE(fusion::load_mock_database(path, loaded));
+  CHECK(loaded.cursor_ea == db.cursor_ea);
+  CHECK(loaded.x64 == db.x64);
+  REQUIRE(loaded.selected);
+  CHECK(loaded.selected->start == 0x1010);
+  CHECK(loaded.selected->end == 0x1014);
+  CHECK(loaded.functions == db.functions);
+  REQUIRE(loaded.snapshot.regions.size() == 1);
+  CHECK(loaded.snapshot.regions[0].start == 0x1000);
+  CHECK(loaded.snapshot.regions[0].bytes == db.snapshot.regions[0].bytes);
+
+  // Truncated fixtures are rejected
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  CHECK_FALSE(fusion::load_mock_database(path, loaded));
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Mock database rejects damaged counts without allocating") {
+  auto db = make_database();
+  db.selected.reset();
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_damaged.fdb").string();
+
+  // Without a selection the region count is at offset 18 and the first region's size at 30
+  const auto damage = [&](std::streamoff offset, auto value) {
+    REQUIRE(fusion::save_mock_database(path, db));
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  fusion::MockDatabase loaded;
+  damage(18, uint32_t{0xFFFFFFFF});
+  CHECK_FALSE(fusion::load_mock_database(path, loaded));
+  damage(30, uint64_t{0x7FFFFFFFFFFFFFFF});
+  CHECK_FALSE(fusion::load_mock_database(path, loaded));
+  damage(30, uint64_t{0x1000});
+  CHECK_FALSE(fusion::load_mock_database(path, loaded));
+
+  // Truncated inside the region bytes
+  REQUIRE(fusion::save_mock_database(path, db));
+  std::filesystem::resize_file(path, 64);
+  CHECK_FALSE(fusion::load_mock_database(path, loaded));
+
+  fusion::ImageSnapshot image;
+  damage(18, uint32_t{0xFFFFFFFF});
+  CHECK(fusion::load_reference_image(path, image)); // Falls back to the raw file bytes
+  std::filesystem::remove(path);
+}
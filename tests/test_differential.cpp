@@ -0,0 +1,114 @@
+﻿#include "doctest.h"
+
+#include "fusion/differential.h"
+#include "fusion/rng.h"
+#include "test_util.h"
+
+namespace {
+std::vector<uint8_t> random_input(uint64_t seed, size_t max_size) {
+  fusion::Rng rng(seed);
+  std::vector<uint8_t> input(rng.below(static_cast<uint32_t>(max_size) + 1));
+  for (auto& byte : input) {
+    byte = static_cast<uint8_t>(rng.next());
+  }
+  return input;
+}
+
+void check_engines_agree(const fusion::DiffWorkload& workload) {
+  const auto report = fusion::diff_engines(workload);
+  INFO(fusion::describe_mismatches(workload, report));
+  CHECK(report.agree());
+}
+} // namespace
+
+TEST_CASE("Scan engines agree on random workloads") {
+  for (uint64_t seed = 0; seed < 1500; ++seed) {
+    const auto input = random_input(seed, 1024);
+    const auto workload = fusion::make_diff_workload(input.data(), input.size());
+    CAPTURE(seed);
+    check_engines_agree(workload);
+  }
+}
+
+TEST_CASE("Scan engines agree across scanner chunk boundaries") {
+  // scan_pattern splits regions into work items of 1 MiB candidate positions
+  constexpr size_t chunk = 1 << 20;
+  fusion::DiffWorkload workload;
+  workload.image = test::make_snapshot(0x400000, chunk * 2 + 100, 7);
+  auto& bytes = workload.image.regions[0].bytes;
+
+  const uint8_t needle[] = {0xDE, 0xAD, 0xBE, 0xEF, 0x13, 0x37, 0xC0, 0xDE};
+  for (const size_t at : {chunk - 20, chunk - 4, chunk + 8, 2 * chunk - 3, bytes.size() - 8}) {
+    std::copy(std::begin(needle), std::end(needle), bytes.begin() + at);
+  }
+
+  fusion::SignatureRecord exact, nibbles;
+  for (size_t i = 0; i < sizeof(needle); ++i) {
+    exact.pattern.add_byte(needle[i]);
+    nibbles.pattern.add_byte(needle[i], i % 3 == 1 ? 0xF0 : i % 3 == 2 ? 0x00 : 0xFF);
+  }
+  workload.patterns = {exact, nibbles};
+
+  const auto report = fusion::diff_engines(workload);
+  INFO(fusion::describe_mismatches(workload, report));
+  CHECK(report.agree());
+  CHECK(fusion::naive_scan(workload.image, exact.pattern.view()).size() == 5);
+}
+
+TEST_CASE("Differential workloads are reproducible") {
+  const auto input = random_input(42, 512);
+  const auto a = fusion::make_diff_workload(input.data(), input.size());
+  const auto b = fusion::make_diff_workload(input.data(), input.size());
+
+  REQUIRE(a.image.regions.size() == b.image.regions.size());
+  for (size_t i = 0; i < a.image.regions.size(); ++i) {
+    CHECK(a.image.regions[i].start == b.image.regions[i].start);
+    CHECK(a.image.regions[i].bytes == b.image.regions[i].bytes);
+  }
+  CHECK(a.patterns == b.patterns);
+
+  // An image byte only changes that byte, not the regions or where patterns were cut
+  auto mutated = input;
+  REQUIRE(input.size() > 4 + 6 + 16 * 15);
+  mutated[4] ^= 0x10;
+  const auto c = fusion::make_diff_workload(mutated.data(), mutated.size());
+  REQUIRE(c.image.regions.size() == a.image.regions.size());
+  for (size_t i = 0; i < a.image.regions.size(); ++i) {
+    CHECK(c.image.regions[i].start == a.image.regions[i].start);
+    CHECK(c.image.regions[i].bytes.size() == a.image.regions[i].bytes.size());
+  }
+  REQUIRE(c.patterns.size() == a.patterns.size());
+  for (size_t i = 0; i < a.patterns.size(); ++i) {
+    CHECK(c.patterns[i].pattern.mask == a.patterns[i].pattern.mask);
+  }
+
+  // Degenerate inputs still give a usable workload
+  const auto empty = fusion::make_diff_workload(nullptr, 0);
+  CHECK_FALSE(empty.patterns.empty());
+  check_engines_agree(empty);
+}
+
+TEST_CASE("diff_engines reports a disagreeing engine") {
+  fusion::DiffWorkload workload;
+  workload.image = test::make_snapshot(0x1000, 256, 3);
+  workload.image.regions[0].bytes[10] = 0xAA;
+  workload.image.regions[0].bytes[200] = 0xAA;
+  fusion::SignatureRecord record;
+  record.pattern.add_byte(0xAA);
+  workload.patterns = {record};
+
+  auto engines = fusion::scan_engines();
+  engines.push_back({"drops-last",
+      [](const fusion::ImageSnapshot& image, const std::vector<fusion::SignatureRecord>& patterns,
+          const fusion::FindSettings& settings) {
+        auto matches = fusion::naive_scan(image, patterns[0].pattern.view(), settings);
+        matches.pop_back();
+        return fusion::PatternMatches{matches};
+      }});
+
+  const auto report = fusion::diff_engines(workload, engines);
+  REQUIRE(report.mismatches.size() == 1);
+  CHECK(report.mismatches[0].engine == "drops-last");
+  CHECK(report.seconds.size() == engines.size());
+  CHECK(fusion::describe_mismatches(workload, report).find("misses") != std::string::npos);
+}
@@ -0,0 +1,77 @@
+﻿#include "doctest.h"
+
+#include "fixtures/exported_signatures.h"
+#include "fusion/export.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace {
+fusion::SignatureRecord make_record(const std::string& name, const std::string& text, int64_t offset = 0) {
+  fusion::SignatureRecord record;
+  record.name = name;
+  record.offset = offset;
+  REQUIRE(fusion::compile_pattern(text, record.pattern));
+  return record;
+}
+
+// The signatures behind tests/fixtures/exported_signatures.h
+std::vector<fusion::SignatureRecord> fixture_records() {
+  return {
+      make_record("CGame::Update", "48 89 5C 24 ? 57 48 83 EC 20"),
+      make_record("g_pWorld", "48 8B 05 ? ? ? ?", 3),
+      make_record("Player::Tick", "40 53 48 83 EC 20 8B 4? ? ? ? 00"),
+      make_record("sub_1234+0x10", "E8 ? ? ? ? 90"),
+      make_record("g_pWorld", "48 8B 0D ? ? ? ? 33 D2"),
+  };
+}
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+} // namespace
+
+TEST_CASE("render_ida_pattern round trips compile_pattern") {
+  for (const char* text : {"48 8B ? C3", "4? ?5 ? 00", "E8"}) {
+    fusion::CompiledPattern pattern;
+    REQUIRE(fusion::compile_pattern(text, pattern));
+    CHECK(fusion::render_ida_pattern(pattern) == text);
+  }
+}
+
+TEST_CASE("C++ header export matches the checked-in fixture") {
+  std::string header;
+  REQUIRE(fusion::render_cpp_header(fixture_records(), "signatures", header));
+  CHECK(header == read_file(FUSION_TEST_FIXTURES "/exported_signatures.h"));
+
+  CHECK_FALSE(fusion::render_cpp_header({}, "signatures", header));
+  CHECK_FALSE(fusion::render_cpp_header({make_record("wild", "? ?")}, "signatures", header));
+}
+
+TEST_CASE("Exported headers scan with PatternSet") {
+  std::vector<uint8_t> image(4096, 0xCC);
+  const uint8_t update[] = {0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20};
+  const uint8_t tick[] = {0x40, 0x53, 0x48, 0x83, 0xEC, 0x20, 0x8B, 0x41, 0x10, 0x11, 0x12, 0x00};
+  const uint8_t call[] = {0xE8, 0x01, 0x02, 0x03, 0x04, 0x90};
+  std::memcpy(image.data() + 100, update, sizeof(update));
+  std::memcpy(image.data() + 2000, tick, sizeof(tick));
+  std::memcpy(image.data() + 4090, call, sizeof(call));
+
+  const uint8_t* results[std::size(signatures::entries)];
+  const size_t found =
+      signatures::set.find_first(image.data(), image.data() + image.size(), results);
+
+  CHECK(found == 3);
+  CHECK(results[signatures::CGame__Update] == image.data() + 100);
+  CHECK(results[signatures::Player__Tick] == image.data() + 2000);
+  CHECK(results[signatures::sub_1234_0x10] == image.data() + 4090);
+  CHECK(results[signatures::g_pWorld] == nullptr);
+  CHECK(results[signatures::g_pWorld_2] == nullptr);
+  CHECK(std::strcmp(signatures::entries[signatures::g_pWorld].name, "g_pWorld") == 0);
+  CHECK(signatures::entries[signatures::g_pWorld].target_offset == 3);
+}
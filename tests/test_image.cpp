@@ -0,0 +1,273 @@
+﻿#include "doctest.h"
+
+#include "fusion/image.h"
+#include "fusion/scanner.h"
+
+#include <cstring>
+
+namespace {
+/// Little-endian file image assembled field by field
+struct FileBuilder {
+  std::vector<uint8_t> bytes;
+
+  explicit FileBuilder(size_t size) : bytes(size) {}
+
+  template <typename T>
+  void put(size_t offset, T value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+  }
+
+  void put_text(size_t offset, const char* text) {
+    std::memcpy(bytes.data() + offset, text, std::strlen(text));
+  }
+};
+
+const uint8_t code[] = {0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20};
+
+/// ELF64 with .text at 0x401000 (file 0x200), .bss and one PT_LOAD
+FileBuilder make_elf() {
+  FileBuilder file(0x400);
+  file.put_text(0, "\x7F" "ELF");
+  file.put<uint8_t>(4, 2); // ELFCLASS64
+  file.put<uint8_t>(5, 1); // Little-endian
+  file.put<uint64_t>(0x20, 0x40);  // e_phoff
+  file.put<uint64_t>(0x28, 0x100); // e_shoff
+  file.put<uint16_t>(0x36, 56);
+  file.put<uint16_t>(0x38, 1);
+  file.put<uint16_t>(0x3A, 64);
+  file.put<uint16_t>(0x3C, 4);
+  file.put<uint16_t>(0x3E, 3);
+
+  file.put<uint32_t>(0x40, 1);           // PT_LOAD
+  file.put<uint64_t>(0x48, 0);           // p_offset
+  file.put<uint64_t>(0x50, 0x400000);    // p_vaddr
+  file.put<uint64_t>(0x60, 0x400);       // p_filesz
+
+  // Section 1: .text
+  file.put<uint32_t>(0x140, 1);
+  file.put<uint32_t>(0x144, 1);          // SHT_PROGBITS
+  file.put<uint64_t>(0x148, 0x6);        // SHF_ALLOC | SHF_EXECINSTR
+  file.put<uint64_t>(0x150, 0x401000);
+  file.put<uint64_t>(0x158, 0x200);
+  file.put<uint64_t>(0x160, sizeof(code));
+  // Section 2: .bss
+  file.put<uint32_t>(0x180, 7);
+  file.put<uint32_t>(0x184, 8);          // SHT_NOBITS
+  file.put<uint64_t>(0x188, 0x3);
+  file.put<uint64_t>(0x190, 0x402000);
+  file.put<uint64_t>(0x1A0, 0x100);
+  // Section 3: .shstrtab
+  file.put<uint32_t>(0x1C0, 12);
+  file.put<uint32_t>(0x1C4, 3);
+  file.put<uint64_t>(0x1D8, 0x300);
+  file.put<uint64_t>(0x1E0, 0x20);
+  std::memcpy(file.bytes.data() + 0x300, "\0.text\0.bss\0.shstrtab\0", 23);
+
+  std::memcpy(file.bytes.data() + 0x200, code, sizeof(code));
+  return file;
+}
+
+/// PE32+ with .text at RVA 0x1000 (file 0x400); raw data is padded past the virtual size
+FileBuilder make_pe() {
+  FileBuilder file(0x600);
+  file.put_text(0, "MZ");
+  file.put<uint32_t>(0x3C, 0x80);
+  file.put_text(0x80, "PE");
+  file.put<uint16_t>(0x86, 1);           // NumberOfSections
+  file.put<uint16_t>(0x94, 0xF0);        // SizeOfOptionalHeader
+  file.put<uint16_t>(0x98, 0x20B);       // PE32+
+  file.put<uint64_t>(0x98 + 24, 0x140000000);
+
+  const size_t section = 0x98 + 0xF0;
+  file.put_text(section, ".text");
+  file.put<uint32_t>(section + 8, sizeof(code));
+  file.put<uint32_t>(section + 12, 0x1000);
+  file.put<uint32_t>(section + 16, 0x200);
+  file.put<uint32_t>(section + 20, 0x400);
+
+  std::memcpy(file.bytes.data() + 0x400, code, sizeof(code));
+  return file;
+}
+
+/// Mach-O 64 with __TEXT,__text at 0x100000F00 (file 0xF00) and a zero-fill __DATA,__bss
+FileBuilder make_macho() {
+  FileBuilder file(0x1000);
+  file.put<uint32_t>(0, 0xFEEDFACF);
+  file.put<uint32_t>(4, 0x01000007);
+  file.put<uint32_t>(16, 2);             // ncmds
+
+  size_t command = 32;
+  file.put<uint32_t>(command, 0x19);     // LC_SEGMENT_64
+  file.put<uint32_t>(command + 4, 72 + 80);
+  file.put_text(command + 8, "__TEXT");
+  file.put<uint64_t>(command + 24, 0x100000000);
+  file.put<uint64_t>(command + 40, 0);
+  file.put<uint64_t>(command + 48, 0x1000);
+  file.put<uint32_t>(command + 64, 1);
+  file.put_text(command + 72, "__text");
+  file.put_text(command + 72 + 16, "__TEXT");
+  file.put<uint64_t>(command + 72 + 32, 0x100000F00);
+  file.put<uint64_t>(command + 72 + 40, sizeof(code));
+  file.put<uint32_t>(command + 72 + 48, 0xF00);
+
+  command += 72 + 80;
+  file.put<uint32_t>(command, 0x19);
+  file.put<uint32_t>(command + 4, 72 + 80);
+  file.put_text(command + 8, "__DATA");
+  file.put<uint64_t>(command + 24, 0x100001000);
+  file.put<uint32_t>(command + 64, 1);
+  file.put_text(command + 72, "__bss");
+  file.put_text(command + 72 + 16, "__DATA");
+  file.put<uint64_t>(command + 72 + 32, 0x100001000);
+  file.put<uint64_t>(command + 72 + 40, 0x100);
+  file.put<uint32_t>(command + 72 + 64, 0x1); // S_ZEROFILL
+
+  std::memcpy(file.bytes.data() + 0xF00, code, sizeof(code));
+  return file;
+}
+
+/// Scan a file image for `48 83 EC 20`
+std::vector<uint64_t> scan_file(const FileBuilder& file, const fusion::ImageLayout& layout) {
+  const auto image = fusion::read_snapshot(
+      fusion::FileImageSource(file.bytes.data(), file.bytes.size(), layout));
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern("48 83 EC 20", pattern));
+  return fusion::scan_pattern(image, pattern.view());
+}
+} // namespace
+
+TEST_CASE("parse_image ELF") {
+  const auto file = make_elf();
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+
+  CHECK(layout.format == fusion::ImageFormat::ELF);
+  CHECK(layout.image_base == 0x400000);
+  REQUIRE(layout.sections.size() == 1);
+  CHECK(layout.sections[0].name == ".text");
+  CHECK(layout.sections[0].address == 0x401000);
+  CHECK(layout.file_offset(0x401006) == 0x206);
+  CHECK_FALSE(layout.file_offset(0x402000));
+
+  CHECK(scan_file(file, layout) == std::vector<uint64_t>{0x401006});
+}
+
+TEST_CASE("parse_image PE") {
+  const auto file = make_pe();
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+
+  CHECK(layout.format == fusion::ImageFormat::PE);
+  CHECK(layout.image_base == 0x140000000);
+  REQUIRE(layout.sections.size() == 1);
+  CHECK(layout.sections[0].name == ".text");
+  CHECK(layout.sections[0].address == 0x140001000);
+  CHECK(layout.sections[0].size == sizeof(code));
+  CHECK(layout.file_offset(0x140001006) == 0x406);
+
+  CHECK(scan_file(file, layout) == std::vector<uint64_t>{0x140001006});
+}
+
+TEST_CASE("parse_image Mach-O") {
+  const auto file = make_macho();
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+
+  CHECK(layout.format == fusion::ImageFormat::MachO);
+  CHECK(layout.image_base == 0x100000000);
+  REQUIRE(layout.sections.size() == 1);
+  CHECK(layout.sections[0].name == "__TEXT,__text");
+  CHECK(layout.file_offset(0x100000F06) == 0xF06);
+
+  CHECK(scan_file(file, layout) == std::vector<uint64_t>{0x100000F06});
+}
+
+TEST_CASE("parse_image fat Mach-O picks the x86-64 slice") {
+  const auto thin = make_macho();
+  FileBuilder file(0x1000 + thin.bytes.size());
+  const uint8_t header[] = {
+      0xCA, 0xFE, 0xBA, 0xBE, 0, 0, 0, 2,                    // FAT_MAGIC, 2 archs
+      0x01, 0x00, 0x00, 0x0C, 0, 0, 0, 0, 0, 0, 0x00, 0x00,  // arm64 at offset 0
+      0, 0, 0, 0, 0, 0, 0, 0,                                //
+      0x01, 0x00, 0x00, 0x07, 0, 0, 0, 3, 0, 0, 0x10, 0x00}; // x86_64 at offset 0x1000
+  std::memcpy(file.bytes.data(), header, sizeof(header));
+  std::memcpy(file.bytes.data() + 0x1000, thin.bytes.data(), thin.bytes.size());
+
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+  REQUIRE(layout.sections.size() == 1);
+  CHECK(layout.file_offset(0x100000F06) == 0x1F06);
+}
+
+TEST_CASE("parse_image rejects unknown and truncated files") {
+  fusion::ImageLayout layout;
+  const uint8_t text[] = "not an executable";
+  CHECK_FALSE(fusion::parse_image(text, sizeof(text), layout));
+
+  auto pe = make_pe();
+  pe.bytes.resize(0x90);
+  CHECK_FALSE(fusion::parse_image(pe.bytes.data(), pe.bytes.size(), layout));
+}
+
+TEST_CASE("read_function_starts ELF symbols") {
+  auto file = make_elf();
+  file.bytes.resize(0x700);
+
+  // Move the section headers to 0x400 to make room for section 4: .symtab
+  std::memmove(file.bytes.data() + 0x400, file.bytes.data() + 0x100, 4 * 64);
+  file.put<uint64_t>(0x28, 0x400);
+  file.put<uint16_t>(0x3C, 5);
+  file.put<uint32_t>(0x504, 2);          // SHT_SYMTAB
+  file.put<uint64_t>(0x518, 0x580);
+  file.put<uint64_t>(0x520, 6 * 24);
+
+  const auto symbol = [&](size_t index, uint8_t info, uint16_t section, uint64_t value) {
+    const size_t entry = 0x580 + index * 24;
+    file.put<uint8_t>(entry + 4, info);
+    file.put<uint16_t>(entry + 6, section);
+    file.put<uint64_t>(entry + 8, value);
+  };
+  symbol(1, 0x12, 1, 0x401006);          // STB_GLOBAL | STT_FUNC
+  symbol(2, 0x02, 1, 0x401000);
+  symbol(3, 0x01, 1, 0x401004);          // STT_OBJECT
+  symbol(4, 0x12, 0, 0x401008);          // Undefined
+  symbol(5, 0x12, 1, 0x500000);          // Outside every section
+
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+  const auto starts = fusion::read_function_starts(file.bytes.data(), file.bytes.size(), layout);
+  CHECK(starts == std::vector<uint64_t>{0x401000, 0x401006});
+
+  const auto image = fusion::read_snapshot(
+      fusion::FileImageSource(file.bytes.data(), file.bytes.size(), layout));
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern("48 83 EC 20", pattern));
+  CHECK(fusion::match_at(image, pattern.view(), starts) == std::vector<uint64_t>{0x401006});
+  CHECK(fusion::match_at(image, pattern.view(), {0x401000}).empty());
+}
+
+TEST_CASE("read_function_starts PE unwind table") {
+  auto file = make_pe();
+  file.bytes.resize(0x800);
+  file.put<uint16_t>(0x86, 2);
+
+  const size_t section = 0x98 + 0xF0 + 40;
+  file.put_text(section, ".pdata");
+  file.put<uint32_t>(section + 8, 3 * 12);
+  file.put<uint32_t>(section + 12, 0x2000);
+  file.put<uint32_t>(section + 16, 0x200);
+  file.put<uint32_t>(section + 20, 0x600);
+  file.put<uint32_t>(0x600, 0x1006);     // RUNTIME_FUNCTION entries
+  file.put<uint32_t>(0x604, 0x100A);
+  file.put<uint32_t>(0x60C, 0x1000);
+  file.put<uint32_t>(0x610, 0x1006);
+
+  fusion::ImageLayout layout;
+  REQUIRE(fusion::parse_image(file.bytes.data(), file.bytes.size(), layout));
+  CHECK(fusion::read_function_starts(file.bytes.data(), file.bytes.size(), layout)
+        == std::vector<uint64_t>{0x140001000, 0x140001006});
+
+  const auto macho = make_macho();
+  REQUIRE(fusion::parse_image(macho.bytes.data(), macho.bytes.size(), layout));
+  CHECK(fusion::read_function_starts(macho.bytes.data(), macho.bytes.size(), layout).empty());
+}
@@ -0,0 +1,132 @@
+﻿#include "doctest.h"
+
+#include "fusion/library.h"
+#include "fusion/scanner.h"
+#include "test_util.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+fusion::SignatureRecord make_record(const std::string& name, const std::string& text, int64_t offset = 0) {
+  fusion::SignatureRecord record;
+  record.name = name;
+  record.offset = offset;
+  REQUIRE(fusion::compile_pattern(text, record.pattern));
+  return record;
+}
+
+std::vector<fusion::SignatureRecord> sample_records() {
+  return {
+      make_record("first", "3A ? 7C"),
+      make_record("second", "? 12 34 ? 56", 4),
+      make_record("unanchored", "9E ? 4C ? 21", -2),
+      make_record("same_anchor", "12 34 99"),
+      make_record("nibble", "1? 34"),
+  };
+}
+} // namespace
+
+TEST_CASE("Library images round trip every record") {
+  const auto records = sample_records();
+
+  std::vector<uint8_t> image;
+  REQUIRE(fusion::build_library(records, image));
+
+  fusion::SignatureLibrary library;
+  REQUIRE(library.attach(image.data(), image.size()));
+  REQUIRE(library.size() == records.size());
+  CHECK(library.anchored_count() == 2); // Only "second" and "same_anchor" have an exact pair
+
+  // Entries are reordered by anchor; look them up by name
+  for (const auto& record : records) {
+    bool found = false;
+    for (size_t i = 0; i < library.size(); ++i) {
+      if (library.name(i) != record.name) continue;
+      found = true;
+
+      const auto view = library.pattern(i);
+      CHECK(std::vector<uint8_t>(view.bytes, view.bytes + view.size) == record.pattern.bytes);
+      CHECK(std::vector<uint8_t>(view.mask, view.mask + view.size) == record.pattern.mask);
+      CHECK(library.entry(i).target_offset == record.offset);
+    }
+    CHECK(found);
+  }
+}
+
+TEST_CASE("scan_library agrees with individual pattern scans") {
+  auto snapshot = test::make_snapshot(0x400000, 300000, 3);
+  snapshot.regions.push_back(test::make_snapshot(0x800000, 1000, 4).regions[0]);
+
+  std::vector<uint8_t> image;
+  REQUIRE(fusion::build_library(sample_records(), image));
+  fusion::SignatureLibrary library;
+  REQUIRE(library.attach(image.data(), image.size()));
+
+  std::vector<fusion::LibraryMatch> expected;
+  for (uint32_t i = 0; i < library.size(); ++i) {
+    for (uint64_t address : fusion::scan_pattern(snapshot, library.pattern(i))) {
+      expected.push_back({i, address});
+    }
+  }
+
+  CHECK_FALSE(expected.empty());
+  CHECK(fusion::scan_library(snapshot, library, 1) == expected);
+  CHECK(fusion::scan_library(snapshot, library, 4) == expected);
+}
+
+TEST_CASE("Library files are used from a memory mapping") {
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_library.fsl").string();
+  REQUIRE(fusion::write_library(path, sample_records()));
+
+  {
+    fusion::SignatureLibrary library;
+    REQUIRE(library.open(path));
+    CHECK(library.size() == 5);
+  }
+
+  // Truncated files are rejected
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  fusion::SignatureLibrary truncated;
+  CHECK_FALSE(truncated.open(path));
+  std::filesystem::remove(path);
+
+  fusion::SignatureLibrary missing;
+  CHECK_FALSE(missing.open(path));
+}
+
+TEST_CASE("Unmatchable records are rejected") {
+  std::vector<uint8_t> image;
+  CHECK_FALSE(fusion::build_library({fusion::SignatureRecord{}}, image));
+  CHECK_FALSE(fusion::build_library({make_record("wild", "? ? ?")}, image));
+  CHECK(fusion::build_library({}, image));
+}
+
+TEST_CASE("Signature lists are parsed line by line") {
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_list.txt").string();
+  {
+    std::ofstream out(path);
+    out << "# Game signatures\n"
+        << "CGame::Update 48 89 5C 24 ? 57\n"
+        << "\n"
+        << "g_pWorld 48 8B 05 ? ? ? ? +3 # RIP-relative load\n"
+        << "code_style \\x48\\x8B\\x00 xx?\n";
+  }
+
+  std::vector<fusion::SignatureRecord> records;
+  REQUIRE(fusion::read_signature_list(path, records));
+  REQUIRE(records.size() == 3);
+  CHECK(records[0] == make_record("CGame::Update", "48 89 5C 24 ? 57"));
+  CHECK(records[1] == make_record("g_pWorld", "48 8B 05 ? ? ? ?", 3));
+  CHECK(records[2] == make_record("code_style", "48 8B ?"));
+
+  {
+    std::ofstream out(path);
+    out << "ok 48 8B\n"
+        << "bad 48 8G\n";
+  }
+  size_t error_line = 0;
+  CHECK_FALSE(fusion::read_signature_list(path, records, &error_line));
+  CHECK(error_line == 2);
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,100 @@
+﻿#include "doctest.h"
+
+#include "fusion/pattern.h"
+#include "fusion/signature.h"
+
+namespace {
+fusion::CompiledPattern compile(const std::string& text) {
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern(text, pattern));
+  return pattern;
+}
+} // namespace
+
+TEST_CASE("compile_pattern parses IDA style") {
+  const auto pattern = compile("48 8B ? ?? 4? ?5 C");
+
+  CHECK(pattern.bytes == std::vector<uint8_t>{0x48, 0x8B, 0x00, 0x00, 0x40, 0x05, 0x0C});
+  CHECK(pattern.mask == std::vector<uint8_t>{0xFF, 0xFF, 0x00, 0x00, 0xF0, 0x0F, 0xFF});
+
+  const uint8_t hit[] = {0x48, 0x8B, 0x11, 0x22, 0x4F, 0xA5, 0x0C};
+  const uint8_t miss[] = {0x48, 0x8B, 0x11, 0x22, 0x5F, 0xA5, 0x0C};
+  CHECK(pattern.matches(hit));
+  CHECK_FALSE(pattern.matches(miss));
+}
+
+TEST_CASE("compile_pattern parses CODE style") {
+  CHECK(compile("\\x48\\x89\\x00\\x24") == compile("48 89 ? 24"));
+  CHECK(compile("\\x48\\x89\\x5C\\x24 xx?x") == compile("48 89 ? 24"));
+  CHECK(compile("\\x48\\x00\\x5C xxx") == compile("48 00 5C"));
+
+  fusion::g_settings.flags |= fusion::UseAltWildcard;
+  CHECK(compile("\\x48\\x2A\\x00") == compile("48 ? 00"));
+  fusion::g_settings.flags &= ~fusion::UseAltWildcard;
+}
+
+TEST_CASE("compile_pattern rejects malformed signatures") {
+  fusion::CompiledPattern pattern;
+  CHECK_FALSE(fusion::compile_pattern("", pattern));
+  CHECK_FALSE(fusion::compile_pattern("48 8G", pattern));
+  CHECK_FALSE(fusion::compile_pattern("488B", pattern));
+  CHECK_FALSE(fusion::compile_pattern("\\x48\\x8", pattern));
+  CHECK_FALSE(fusion::compile_pattern("\\x48\\x8B xx?", pattern));
+  CHECK_FALSE(fusion::compile_pattern("\\x48\\x8B xy", pattern));
+  CHECK(pattern.empty());
+}
+
+TEST_CASE("compile_composite_pattern splits fragments at gaps") {
+  fusion::CompositePattern pattern;
+  REQUIRE(fusion::compile_composite_pattern("55 48 8B EC [16-64] E8 ? ? ? ? [4] C3", pattern));
+  CHECK(pattern.fragments
+        == std::vector{compile("55 48 8B EC"), compile("E8 ? ? ? ?"), compile("C3")});
+  CHECK(pattern.gaps == std::vector<fusion::PatternGap>{{16, 64}, {4, 4}});
+  CHECK(pattern.fragment_bytes() == 10);
+
+  // Without gaps there is one fragment, which compile_pattern also accepts
+  CHECK_FALSE(fusion::has_pattern_gaps("48 8B ? 4?"));
+  REQUIRE(fusion::compile_composite_pattern("48 8B ? 4?", pattern));
+  CHECK(pattern.fragments == std::vector{compile("48 8B ? 4?")});
+  CHECK(pattern.gaps.empty());
+
+  REQUIRE(fusion::compile_composite_pattern("55[0-2]C3", pattern));
+  CHECK(pattern.gaps == std::vector<fusion::PatternGap>{{0, 2}});
+
+  fusion::CompiledPattern contiguous;
+  CHECK(fusion::has_pattern_gaps("55 [1] C3"));
+  CHECK_FALSE(fusion::compile_pattern("55 [1] C3", contiguous));
+}
+
+TEST_CASE("compile_composite_pattern rejects malformed gaps") {
+  fusion::CompositePattern pattern;
+  for (const char* text : {"[4] 55",
+           "55 [4]",
+           "55 [4] [4] C3",
+           "55 [] C3",
+           "55 [-4] C3",
+           "55 [4-2] C3",
+           "55 [x] C3",
+           "55 [4 C3",
+           "55 [1-65537] C3",
+           "\\x55\\xC3 [4] C3",
+           "55 [4] GG"}) {
+    CAPTURE(text);
+    CHECK_FALSE(fusion::compile_composite_pattern(text, pattern));
+    CHECK(pattern.fragments.empty());
+  }
+}
+
+TEST_CASE("SignatureBuilder compile matches its rendered text") {
+  fusion::SignatureBuilder builder;
+  builder.add_byte(0x48);
+  builder.add_byte(0x8D);
+  builder.add_byte(0x0D);
+  builder.add_byte(0x78, true);
+  builder.add_byte(0x56, true);
+  builder.add_byte(0xE8);
+
+  const auto pattern = builder.compile();
+  CHECK(pattern == compile(builder.render(fusion::SignatureStyle::IDA)));
+  CHECK(pattern == compile(builder.render(fusion::SignatureStyle::Code)));
+}
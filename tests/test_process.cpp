@@ -0,0 +1,103 @@
+﻿#include "doctest.h"
+
+#include "fusion/process.h"
+#include "fusion/scanner.h"
+#include "test_util.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr const char* sample_maps =
+    "55d0c0a00000-55d0c0a2c000 r--p 00000000 08:01 1048602                    /usr/bin/server\n"
+    "55d0c0a2c000-55d0c0b10000 r-xp 0002c000 08:01 1048602                    /usr/bin/server\n"
+    "55d0c1d3e000-55d0c1d5f000 rw-p 00000000 00:00 0                          [heap]\n"
+    "7f1a2b000000-7f1a2b021000 rw-p 00000000 00:00 0 \n"
+    "7f1a2b400000-7f1a2b428000 r--p 00000000 08:01 1050123                    "
+    "/opt/game/lib game.so\n"
+    "7f1a2b428000-7f1a2b5bd000 r-xp 00028000 08:01 1050123                    "
+    "/opt/game/lib game.so\n"
+    "7f1a2b5bd000-7f1a2b5be000 ---p 001bd000 08:01 1050123                    "
+    "/opt/game/lib game.so\n";
+} // namespace
+
+TEST_CASE("parse_process_maps reads every field") {
+  std::vector<fusion::ProcessMapping> mappings;
+  REQUIRE(fusion::parse_process_maps(sample_maps, mappings));
+  REQUIRE(mappings.size() == 7);
+
+  CHECK(mappings[1].start == 0x55d0c0a2c000);
+  CHECK(mappings[1].end == 0x55d0c0b10000);
+  CHECK(mappings[1].permissions == "r-xp");
+  CHECK(mappings[1].file_offset == 0x2c000);
+  CHECK(mappings[1].path == "/usr/bin/server");
+  CHECK(mappings[2].path == "[heap]");
+  CHECK(mappings[3].path.empty());
+  CHECK(mappings[4].path == "/opt/game/lib game.so");
+  CHECK(mappings[5].readable());
+  CHECK_FALSE(mappings[6].readable());
+
+  CHECK_FALSE(fusion::parse_process_maps("55d0c0a00000 r--p 0 08:01 1 /bin/x\n", mappings));
+  CHECK_FALSE(fusion::parse_process_maps("zz-55d0c0a00000 r--p 0 08:01 1\n", mappings));
+}
+
+TEST_CASE("module_address is relative to the first mapping of the file") {
+  std::vector<fusion::ProcessMapping> mappings;
+  REQUIRE(fusion::parse_process_maps(sample_maps, mappings));
+
+  const auto in_text = fusion::module_address(mappings, 0x7f1a2b428010);
+  REQUIRE(in_text);
+  CHECK(in_text->module == "lib game.so");
+  CHECK(in_text->offset == 0x28010);
+
+  const auto in_server = fusion::module_address(mappings, 0x55d0c0a00000);
+  REQUIRE(in_server);
+  CHECK(in_server->module == "server");
+  CHECK(in_server->offset == 0);
+
+  CHECK_FALSE(fusion::module_address(mappings, 0x55d0c1d3e100)); // [heap]
+  CHECK_FALSE(fusion::module_address(mappings, 0x7f1a2b000100)); // Anonymous
+  CHECK_FALSE(fusion::module_address(mappings, 0x1000));         // Unmapped
+}
+
+TEST_CASE("ProcessByteSource only exposes readable mappings") {
+  std::vector<fusion::ProcessMapping> mappings;
+  REQUIRE(fusion::parse_process_maps(sample_maps, mappings));
+
+  const fusion::ProcessByteSource source(0, mappings);
+  const auto segments = source.segments();
+  CHECK(segments.size() == 6);
+  CHECK(std::none_of(segments.begin(), segments.end(), [](const auto& s) {
+    return s.start == 0x7f1a2b5bd000;
+  }));
+}
+
+#ifdef __linux__
+TEST_CASE("scan_source finds a marker in this process") {
+  std::vector<uint8_t> marker(24);
+  test::fill_random(marker, 0xF0510);
+
+  std::vector<fusion::ProcessMapping> mappings;
+  REQUIRE(fusion::read_process_maps(getpid(), mappings));
+  const fusion::ProcessByteSource source(getpid(), mappings);
+
+  uint8_t probe = 0;
+  if (source.read(reinterpret_cast<uint64_t>(marker.data()), &probe, 1) != 1) {
+    MESSAGE("process_vm_readv is not permitted here, skipping");
+    return;
+  }
+
+  fusion::CompiledPattern pattern;
+  for (uint8_t byte : marker) {
+    pattern.add_byte(byte, 0xFF);
+  }
+  // The pattern's own copy of the bytes matches too, so only check that the marker is found
+  const auto found = fusion::scan_source(source, {pattern.view()});
+  REQUIRE(found.size() == 1);
+  const auto address = reinterpret_cast<uint64_t>(marker.data());
+  CHECK(std::find(found[0].begin(), found[0].end(), address) != found[0].end());
+}
+#endif
@@ -0,0 +1,65 @@
+﻿#include "doctest.h"
+
+#include "fusion/profile.h"
+#include "fusion/scanner.h"
+#include "test_util.h"
+
+#include <cstring>
+
+TEST_CASE("format_profile lists phases that ran and non-zero counters") {
+  fusion::ProfileSnapshot snapshot;
+  snapshot.elapsed_ns = 12'300'000;
+  snapshot.nanoseconds[static_cast<size_t>(fusion::Phase::Decode)] = 42'000;
+  snapshot.calls[static_cast<size_t>(fusion::Phase::Decode)] = 7;
+  snapshot.nanoseconds[static_cast<size_t>(fusion::Phase::Scan)] = 11'000'000;
+  snapshot.calls[static_cast<size_t>(fusion::Phase::Scan)] = 1;
+  snapshot.counters[static_cast<size_t>(fusion::Counter::BytesScanned)] = 3 << 20;
+  snapshot.counters[static_cast<size_t>(fusion::Counter::Scans)] = 1;
+
+  CHECK(fusion::format_profile(snapshot)
+        == "12.3 ms: decode 0.042 ms, scan 11.0 ms; 3.0 MiB scanned, 1 scans");
+  CHECK(fusion::format_profile({}) == "0.000 ms");
+}
+
+TEST_CASE("profile_json includes every phase and counter") {
+  fusion::ProfileSnapshot snapshot;
+  snapshot.nanoseconds[static_cast<size_t>(fusion::Phase::Parse)] = 500;
+  snapshot.calls[static_cast<size_t>(fusion::Phase::Parse)] = 2;
+  snapshot.counters[static_cast<size_t>(fusion::Counter::Matches)] = 3;
+
+  const std::string json = fusion::profile_json("find", snapshot);
+  CHECK(json.find("\"operation\": \"find\"") != std::string::npos);
+  CHECK(json.find("\"parse\": {\"ns\": 500, \"calls\": 2}") != std::string::npos);
+  CHECK(json.find("\"ui\": {\"ns\": 0, \"calls\": 0}") != std::string::npos);
+  CHECK(json.find("\"matches\": 3") != std::string::npos);
+  CHECK(json.find("\"bytes_scanned\": 0") != std::string::npos);
+}
+
+#ifdef FUSION_PROFILE
+TEST_CASE("scan_pattern records bytes, candidates and scans") {
+  auto snapshot = test::make_snapshot(0x1000, 4096, 3);
+  auto& bytes = snapshot.regions[0].bytes;
+  std::memset(bytes.data(), 0x90, bytes.size());
+  const uint8_t needle[] = {0xDE, 0xAD, 0xBE, 0xEF};
+  std::memcpy(bytes.data() + 100, needle, sizeof(needle));
+  std::memcpy(bytes.data() + 2000, needle, sizeof(needle));
+  bytes[3000] = 0xDE; // Anchor candidate that does not match
+
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern("DE AD BE EF", pattern));
+
+  fusion::profile_reset();
+  CHECK(fusion::scan_pattern(snapshot, pattern.view(), 1).size() == 2);
+
+  const auto profile = fusion::profile_snapshot();
+  CHECK(profile.count(fusion::Counter::Scans) == 1);
+  CHECK(profile.count(fusion::Counter::BytesScanned) == 4096);
+  CHECK(profile.count(fusion::Counter::Candidates) >= 2);
+  CHECK(profile.count(fusion::Counter::Candidates) <= 3);
+  CHECK(profile.calls[static_cast<size_t>(fusion::Phase::Scan)] == 1);
+  CHECK(profile.calls[static_cast<size_t>(fusion::Phase::Parse)] == 0);
+
+  fusion::profile_reset();
+  CHECK(fusion::profile_snapshot().count(fusion::Counter::Scans) == 0);
+}
+#endif
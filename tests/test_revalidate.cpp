@@ -0,0 +1,152 @@
+﻿#include "doctest.h"
+
+#include "fusion/revalidate.h"
+#include "fusion/scanner.h"
+
+#include <algorithm>
+
+namespace {
+fusion::SignatureRecord make_record(
+    const std::string& name, const std::string& text, int64_t offset = 0) {
+  fusion::SignatureRecord record;
+  record.name = name;
+  record.offset = offset;
+  REQUIRE(fusion::compile_pattern(text, record.pattern));
+  return record;
+}
+
+// The new build of a program whose library was made from an older build. Padded with int3:
+//   0x1000 func_a:  push rbp; mov rbp, rsp; xor eax, eax; pop rbp; ret   (unchanged)
+//   0x1040 func_b:  push rbp; mov rbp, rsp; xor ecx, ecx; pop rbp; ret   (unchanged)
+//   0x1080 func_c:  push rdi; xor edx, edx; pop rdi; ret                 (was push rsi)
+//   0x10C0 func_b2: push rbp; mov rbp, rsp; xor ecx, ecx; nop; pop rbp; ret   (new)
+//   0x1100 g_thing: int3 padding, named but no longer referenced
+fusion::MockDatabase make_new_build() {
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  region.bytes.assign(0x140, 0xCC);
+
+  auto place = [&](uint64_t address, std::initializer_list<uint8_t> code) {
+    std::copy(code.begin(), code.end(), region.bytes.begin() + (address - region.start));
+  };
+  place(0x1000, {0x55, 0x48, 0x89, 0xE5, 0x31, 0xC0, 0x5D, 0xC3});
+  place(0x1040, {0x55, 0x48, 0x89, 0xE5, 0x31, 0xC9, 0x5D, 0xC3});
+  place(0x1080, {0x57, 0x31, 0xD2, 0x5F, 0xC3});
+  place(0x10C0, {0x55, 0x48, 0x89, 0xE5, 0x31, 0xC9, 0x90, 0x5D, 0xC3});
+
+  fusion::MockDatabase db;
+  db.snapshot.regions.push_back(std::move(region));
+  db.functions = {{0x1000, 0x1008, "func_a"},
+      {0x1040, 0x1048, "func_b"},
+      {0x1080, 0x1085, "func_c"},
+      {0x10C0, 0x10C9, "func_b2"},
+      {0x1100, 0x1101, "g_thing"}};
+  return db;
+}
+
+fusion::EntryLocator locate_by_name(const fusion::MockDatabase& db) {
+  return [&db](std::string_view name) -> std::optional<uint64_t> {
+    for (const auto& function : db.functions) {
+      if (function.name == name) return function.start;
+    }
+    return std::nullopt;
+  };
+}
+
+const fusion::RevalidatedEntry& find_entry(
+    const fusion::RevalidationReport& report, const std::string& name) {
+  const auto it = std::find_if(report.entries.begin(), report.entries.end(), [&](const auto& e) {
+    return e.original.name == name;
+  });
+  REQUIRE(it != report.entries.end());
+  return *it;
+}
+} // namespace
+
+TEST_CASE("revalidate_library classifies and regenerates entries") {
+  const std::vector<fusion::SignatureRecord> old_records = {
+      make_record("func_a", "55 48 89 E5 31 C0"),
+      make_record("func_b", "55 48 89 E5 31 C9"),
+      make_record("func_c", "56 31 D2"),
+      make_record("ghost", "DE AD BE EF"),
+      make_record("g_thing", "48 8B 05 ? ? ? ?", 3),
+  };
+  std::vector<uint8_t> image;
+  REQUIRE(fusion::build_library(old_records, image));
+  fusion::SignatureLibrary library;
+  REQUIRE(library.attach(image.data(), image.size()));
+
+  const auto db = make_new_build();
+  const auto report = fusion::revalidate_library(library, db, locate_by_name(db), 2);
+  REQUIRE(report.entries.size() == 5);
+  CHECK(report.count(fusion::EntryStatus::Unique) == 1);
+  CHECK(report.count(fusion::EntryStatus::Multiple) == 1);
+  CHECK(report.count(fusion::EntryStatus::Missing) == 3);
+  CHECK(report.regenerated() == 2);
+
+  const auto& a = find_entry(report, "func_a");
+  CHECK(a.status == fusion::EntryStatus::Unique);
+  CHECK(a.target == 0x1000);
+  CHECK_FALSE(a.regenerated);
+
+  // Matches func_b2 as well; regrown at func_b until it tells the two apart
+  const auto& b = find_entry(report, "func_b");
+  CHECK(b.status == fusion::EntryStatus::Multiple);
+  CHECK(b.matches == 2);
+  REQUIRE(b.regenerated);
+  CHECK(fusion::scan_pattern(db.image(), b.regenerated->pattern.view())
+        == std::vector<uint64_t>{0x1040});
+
+  const auto& c = find_entry(report, "func_c");
+  CHECK(c.status == fusion::EntryStatus::Missing);
+  REQUIRE(c.regenerated);
+  CHECK(fusion::scan_pattern(db.image(), c.regenerated->pattern.view())
+        == std::vector<uint64_t>{0x1080});
+
+  const auto& ghost = find_entry(report, "ghost");
+  CHECK_FALSE(ghost.target);
+  CHECK_FALSE(ghost.regenerated);
+
+  // Located, but an offset signature cannot be regrown from its target
+  const auto& thing = find_entry(report, "g_thing");
+  CHECK(thing.target == 0x1100);
+  CHECK_FALSE(thing.regenerated);
+
+  // The updated library keeps every entry, with the regenerated ones replaced
+  const auto updated = report.updated_records();
+  REQUIRE(updated.size() == 5);
+  CHECK(std::count(updated.begin(), updated.end(), *b.regenerated) == 1);
+  CHECK(std::count(updated.begin(), updated.end(), thing.original) == 1);
+  CHECK(std::count(updated.begin(), updated.end(), b.original) == 0);
+
+  std::vector<uint8_t> updated_image;
+  REQUIRE(fusion::build_library(updated, updated_image));
+  fusion::SignatureLibrary updated_library;
+  REQUIRE(updated_library.attach(updated_image.data(), updated_image.size()));
+  const auto recheck = fusion::revalidate_library(updated_library, db);
+  CHECK(recheck.count(fusion::EntryStatus::Unique) == 3);
+}
+
+TEST_CASE("format_revalidation_report lists what changed") {
+  const std::vector<fusion::SignatureRecord> old_records = {
+      make_record("func_a", "55 48 89 E5 31 C0"),
+      make_record("func_b", "55 48 89 E5 31 C9"),
+      make_record("ghost", "DE AD BE EF"),
+  };
+  std::vector<uint8_t> image;
+  REQUIRE(fusion::build_library(old_records, image));
+  fusion::SignatureLibrary library;
+  REQUIRE(library.attach(image.data(), image.size()));
+
+  const auto db = make_new_build();
+  const auto report = fusion::revalidate_library(library, db, locate_by_name(db));
+  const auto text = fusion::format_revalidation_report(report);
+
+  CHECK(text.rfind("3 signatures: 1 unique, 1 multiple, 1 missing; 1 regenerated\n", 0) == 0);
+  CHECK(text.find("func_b: multiple (2 matches), regenerated at 0x1040\n"
+                  "- 55 48 89 E5 31 C9\n"
+                  "+ 55 48 89 E5 31 C9 5D\n")
+        != std::string::npos);
+  CHECK(text.find("ghost: missing, not located\n") != std::string::npos);
+  CHECK(text.find("func_a") == std::string::npos);
+}
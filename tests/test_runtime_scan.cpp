@@ -0,0 +1,91 @@
+﻿#include "doctest.h"
+
+#include "fusion/pattern.h"
+#include "fusion/runtime_scan.h"
+#include "test_util.h"
+
+#include <cstring>
+
+using namespace fusion::runtime::literals;
+
+namespace {
+constexpr auto prologue = "48 89 5C 24 ? 57 48 83 EC 20"_sig;
+constexpr auto nibbles = "4? 8B ?5 12"_sig;
+constexpr auto code = "\\x48\\x8B\\x05\\x00\\x00\\x00\\x00\\xC3"_sig;
+constexpr auto code_masked = "\\x48\\x8B\\x05\\x00\\x11 xxx?x"_sig;
+constexpr auto single = "E8"_sig;
+
+// Parsing happens entirely at compile time
+static_assert(prologue.size() == 10);
+static_assert(prologue.bytes[4] == 0 && prologue.mask[4] == 0x00);
+static_assert(prologue.anchor == 2); // 0x5C is the first uncommon byte
+static_assert(prologue.guard == 9);
+static_assert(nibbles.mask[0] == 0xF0 && nibbles.mask[2] == 0x0F && nibbles.bytes[2] == 0x05);
+static_assert(code.size() == 8 && code.mask[3] == 0x00 && code.mask[7] == 0xFF);
+static_assert(code_masked.mask[3] == 0x00 && code_masked.mask[4] == 0xFF);
+static_assert(single.size() == 1 && single.anchor == 0 && single.guard == 0);
+
+template <auto P>
+std::vector<size_t> runtime_offsets(const std::vector<uint8_t>& bytes) {
+  std::vector<size_t> offsets;
+  for (const uint8_t* hit : fusion::runtime::find_all<P>(bytes.data(), bytes.data() + bytes.size())) {
+    offsets.push_back(static_cast<size_t>(hit - bytes.data()));
+  }
+  return offsets;
+}
+
+template <auto P>
+std::vector<size_t> naive_offsets(const std::vector<uint8_t>& bytes) {
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i + P.size() <= bytes.size(); ++i) {
+    if (P.matches(bytes.data() + i)) offsets.push_back(i);
+  }
+  return offsets;
+}
+} // namespace
+
+TEST_CASE("Pattern literals match the plugin's parser") {
+  fusion::CompiledPattern expected;
+  REQUIRE(fusion::compile_pattern("48 89 5C 24 ? 57 48 83 EC 20", expected));
+  CHECK(std::vector<uint8_t>(prologue.bytes.begin(), prologue.bytes.end()) == expected.bytes);
+  CHECK(std::vector<uint8_t>(prologue.mask.begin(), prologue.mask.end()) == expected.mask);
+
+  REQUIRE(fusion::compile_pattern("\\x48\\x8B\\x05\\x00\\x11 xxx?x", expected));
+  CHECK(std::vector<uint8_t>(code_masked.mask.begin(), code_masked.mask.end()) == expected.mask);
+}
+
+TEST_CASE("find locates planted signatures at every alignment") {
+  const uint8_t bytes[] = {0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20};
+
+  for (size_t offset : {size_t{0}, size_t{1}, size_t{15}, size_t{31}, size_t{33}, size_t{90}}) {
+    std::vector<uint8_t> buffer(100, 0xCC);
+    std::memcpy(buffer.data() + offset, bytes, sizeof(bytes));
+
+    const uint8_t* hit = fusion::runtime::find<prologue>(buffer.data(), buffer.data() + buffer.size());
+    REQUIRE(hit != nullptr);
+    CHECK(hit - buffer.data() == static_cast<ptrdiff_t>(offset));
+  }
+
+  // A match must fit entirely inside the range
+  std::vector<uint8_t> short_buffer(bytes, bytes + sizeof(bytes) - 1);
+  CHECK(fusion::runtime::find<prologue>(short_buffer.data(), short_buffer.data() + short_buffer.size())
+        == nullptr);
+}
+
+TEST_CASE("find_all agrees with a naive scan") {
+  std::vector<uint8_t> bytes(100000);
+  test::fill_random(bytes, 42);
+
+  // Plant a few overlapping copies so every pattern has matches
+  for (size_t i = 1000; i < bytes.size(); i += 7919) {
+    const uint8_t planted[] = {0x4F, 0x8B, 0xA5, 0x12, 0x48, 0x8B, 0x05, 0xAA, 0xBB, 0xCC, 0xDD, 0xC3};
+    std::memcpy(bytes.data() + i, planted, sizeof(planted));
+  }
+
+  CHECK(runtime_offsets<nibbles>(bytes) == naive_offsets<nibbles>(bytes));
+  CHECK_FALSE(naive_offsets<nibbles>(bytes).empty());
+  CHECK(runtime_offsets<code>(bytes) == naive_offsets<code>(bytes));
+  CHECK_FALSE(naive_offsets<code>(bytes).empty());
+  CHECK(runtime_offsets<single>(bytes) == naive_offsets<single>(bytes));
+  CHECK(runtime_offsets<prologue>(bytes) == naive_offsets<prologue>(bytes));
+}
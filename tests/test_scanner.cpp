@@ -0,0 +1,323 @@
+﻿#include "doctest.h"
+
+#include "fusion/scanner.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+fusion::CompiledPattern compile(const std::string& text) {
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern(text, pattern));
+  return pattern;
+}
+
+std::vector<uint64_t> naive_scan(
+    const fusion::ImageSnapshot& snapshot, const fusion::CompiledPattern& pattern) {
+  std::vector<uint64_t> results;
+  for (const auto& region : snapshot.regions) {
+    for (size_t i = 0; i + pattern.size() <= region.bytes.size(); ++i) {
+      if (pattern.matches(region.bytes.data() + i)) results.push_back(region.start + i);
+    }
+  }
+  return results;
+}
+
+std::vector<fusion::FuzzyMatch> naive_fuzzy_scan(const fusion::ImageSnapshot& snapshot,
+    const fusion::CompiledPattern& pattern,
+    uint32_t max_distance) {
+  std::vector<fusion::FuzzyMatch> results;
+  for (uint32_t distance = 0; distance <= max_distance; ++distance) {
+    for (const auto& region : snapshot.regions) {
+      for (size_t i = 0; i + pattern.size() <= region.bytes.size(); ++i) {
+        uint32_t differ = 0;
+        for (size_t j = 0; j < pattern.size(); ++j) {
+          differ += (region.bytes[i + j] & pattern.mask[j]) != pattern.bytes[j];
+        }
+        if (differ == distance) results.push_back({region.start + i, distance});
+      }
+    }
+  }
+  return results;
+}
+
+// Whether fragments [index, end) of `pattern` fit at `offset` with some choice of gaps
+bool naive_place(const fusion::SnapshotRegion& region,
+    const fusion::CompositePattern& pattern,
+    size_t index,
+    size_t offset) {
+  const auto& fragment = pattern.fragments[index];
+  if (offset + fragment.size() > region.bytes.size()) return false;
+  if (!fragment.matches(region.bytes.data() + offset)) return false;
+  if (index + 1 == pattern.fragments.size()) return true;
+
+  for (uint32_t gap = pattern.gaps[index].min; gap <= pattern.gaps[index].max; ++gap) {
+    if (naive_place(region, pattern, index + 1, offset + fragment.size() + gap)) return true;
+  }
+  return false;
+}
+
+std::vector<uint64_t> naive_composite_scan(
+    const fusion::ImageSnapshot& snapshot, const fusion::CompositePattern& pattern) {
+  std::vector<uint64_t> results;
+  for (const auto& region : snapshot.regions) {
+    for (size_t i = 0; i < region.bytes.size(); ++i) {
+      if (naive_place(region, pattern, 0, i)) results.push_back(region.start + i);
+    }
+  }
+  return results;
+}
+
+/// Serves a snapshot's bytes, except for one unreadable page in the first region
+struct SnapshotSource : fusion::ByteSource {
+  const fusion::ImageSnapshot& snapshot;
+  uint64_t hole;
+
+  SnapshotSource(const fusion::ImageSnapshot& snapshot, uint64_t hole)
+      : snapshot(snapshot), hole(hole) {}
+
+  std::vector<fusion::AddressRange> segments() const override {
+    std::vector<fusion::AddressRange> segments;
+    for (const auto& region : snapshot.regions) {
+      segments.push_back({region.start, region.end()});
+    }
+    return segments;
+  }
+
+  size_t read(uint64_t address, uint8_t* out, size_t size) const override {
+    const auto* region = fusion::find_region(snapshot, address);
+    if (!region || (address >= hole && address < hole + 0x1000)) return 0;
+
+    size = std::min<size_t>(size, region->end() - address);
+    if (address < hole && address + size > hole) size = hole - address;
+    std::memcpy(out, region->bytes.data() + (address - region->start), size);
+    return size;
+  }
+};
+} // namespace
+
+TEST_CASE("Anchors avoid common x86 bytes") {
+  CHECK(fusion::choose_anchor_byte(compile("48 8B ? 5C 00").view()) == 3);
+  CHECK(fusion::choose_anchor_pair(compile("48 8B 05 ? ? ? ? 48 85 C0 74 12").view()) == 10);
+  CHECK(fusion::choose_anchor_pair(compile("48 ? 8B ? 5C").view()) == std::nullopt);
+  CHECK(fusion::choose_anchor_byte(compile("? ?").view()) == std::nullopt);
+}
+
+TEST_CASE("scan_pattern finds matches at region edges") {
+  auto snapshot = test::make_snapshot(0x140001000, 4096, 5);
+  snapshot.regions.push_back(test::make_snapshot(0x140010000, 64, 6).regions[0]);
+
+  const uint8_t bytes[] = {0x40, 0x53, 0x48, 0x83, 0xEC, 0x20};
+  auto& first = snapshot.regions[0].bytes;
+  auto& second = snapshot.regions[1].bytes;
+  std::memcpy(first.data(), bytes, sizeof(bytes));
+  std::memcpy(first.data() + first.size() - sizeof(bytes), bytes, sizeof(bytes));
+  std::memcpy(second.data() + 10, bytes, sizeof(bytes));
+  // Split across the two regions: must not match
+  std::memcpy(second.data(), bytes + 3, 3);
+
+  const auto results = fusion::scan_pattern(snapshot, compile("40 53 48 ? EC 20").view());
+  CHECK(results
+        == std::vector<uint64_t>{
+            0x140001000, 0x140001000 + first.size() - sizeof(bytes), 0x140010000 + 10});
+}
+
+TEST_CASE("scan_pattern agrees with a naive scan") {
+  // Two work chunks, so matches from several threads are merged
+  const auto snapshot = test::make_snapshot(0x10000, (1 << 20) + 333, 11);
+  const auto& bytes = snapshot.regions[0].bytes;
+
+  for (const char* text : {"? 12", "7F ? ? 3?", "A1 B2", "?? ??", "00"}) {
+    const auto pattern = compile(text);
+    const auto expected = naive_scan(snapshot, pattern);
+    CHECK(fusion::scan_pattern(snapshot, pattern.view(), 1) == expected);
+    CHECK(fusion::scan_pattern(snapshot, pattern.view(), 3) == expected);
+  }
+
+  // A pattern copied from the image matches at least where it was copied from
+  fusion::CompiledPattern copied;
+  for (size_t i = 0; i < 12; ++i) {
+    copied.add_byte(bytes[5000 + i], i % 4 == 2 ? 0x00 : 0xFF);
+  }
+  const auto results = fusion::scan_pattern(snapshot, copied.view());
+  CHECK(std::find(results.begin(), results.end(), 0x10000 + 5000) != results.end());
+  CHECK(results == naive_scan(snapshot, copied));
+}
+
+TEST_CASE("scan_source finds matches across chunk edges once") {
+  auto snapshot = test::make_snapshot(0x10000, 0x6000, 12);
+  snapshot.regions.push_back(test::make_snapshot(0x40000, 0x1234, 13).regions[0]);
+
+  // Page 0x12000 cannot be read, like a guard page in a live process
+  const SnapshotSource source(snapshot, 0x12000);
+
+  std::vector<fusion::CompiledPattern> compiled;
+  std::vector<fusion::PatternView> patterns;
+  for (const char* text : {"? 12", "7F ? ? 3?", "A1 B2 ? C3", "00 11"}) {
+    compiled.push_back(compile(text));
+  }
+  for (const auto& pattern : compiled) {
+    patterns.push_back(pattern.view());
+  }
+
+  for (size_t chunk : {1u, 3u, 100u, 0x1000u, 0x10000u}) {
+    CAPTURE(chunk);
+    const auto results = fusion::scan_source(source, patterns, chunk, 2);
+    REQUIRE(results.size() == patterns.size());
+    for (size_t i = 0; i < patterns.size(); ++i) {
+      // Matches touching the unreadable page cannot be found
+      auto expected = naive_scan(snapshot, compiled[i]);
+      std::erase_if(expected, [&](uint64_t address) {
+        return address + compiled[i].size() > 0x12000 && address < 0x13000;
+      });
+      CHECK(results[i] == expected);
+    }
+  }
+}
+
+TEST_CASE("fuzzy_scan finds damaged copies, closest first") {
+  auto snapshot = test::make_snapshot(0x20000, 70000, 21);
+  auto& bytes = snapshot.regions[0].bytes;
+
+  // 19 bytes: two full words and a tail, with a wildcard and a nibble
+  const auto pattern = compile("48 89 5C 24 ? 57 48 83 EC 20 48 8B 05 4? 11 22 33 48 85");
+  auto plant = [&](size_t offset, std::initializer_list<size_t> damaged) {
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      bytes[offset + i] = pattern.bytes[i];
+    }
+    for (size_t i : damaged) {
+      bytes[offset + i] ^= 0x01;
+    }
+  };
+  plant(1000, {});
+  plant(2000, {3});
+  plant(3000, {0, 18});
+  plant(4000, {4});  // Wildcard byte, still exact
+  plant(5000, {13}); // Low nibble of "4?", still exact
+  plant(6000, {1, 2, 17});
+  plant(70000 - 19, {16}); // Ends at the region edge
+
+  for (uint32_t k : {0u, 1u, 2u, 3u}) {
+    CAPTURE(k);
+    const auto expected = naive_fuzzy_scan(snapshot, pattern, k);
+    CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), k, 1) == expected);
+    CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), k, 3) == expected);
+  }
+
+  const auto two = fusion::fuzzy_scan(snapshot, pattern.view(), 2);
+  REQUIRE(two.size() == 6);
+  CHECK(two[0] == fusion::FuzzyMatch{0x20000 + 1000, 0});
+  CHECK(two[1] == fusion::FuzzyMatch{0x20000 + 4000, 0});
+  CHECK(two[2] == fusion::FuzzyMatch{0x20000 + 5000, 0});
+  CHECK(two[3] == fusion::FuzzyMatch{0x20000 + 2000, 1});
+  CHECK(two[4] == fusion::FuzzyMatch{0x20000 + 70000 - 19, 1});
+  CHECK(two[5] == fusion::FuzzyMatch{0x20000 + 3000, 2});
+}
+
+TEST_CASE("fuzzy_scan agrees with a naive scan on short patterns") {
+  const auto snapshot = test::make_snapshot(0x1000, 20000, 22);
+  for (const char* text : {"12", "7F ? 3?", "A1 B2 C3 D4 E5 F6 07 18", "00 ? 11 22 ? 33 44 55 66"}) {
+    CAPTURE(text);
+    const auto pattern = compile(text);
+    CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), 1) == naive_fuzzy_scan(snapshot, pattern, 1));
+  }
+}
+
+TEST_CASE("fuzzy_scan keeps only the closest matches") {
+  auto snapshot = test::make_snapshot(0x1000, 20000, 23);
+  snapshot.regions.push_back(test::make_snapshot(0x10000, 5000, 24).regions[0]);
+  const auto pattern = compile("7F ? 3? 41");
+  const auto all = naive_fuzzy_scan(snapshot, pattern, 2);
+  REQUIRE(all.size() > 100);
+
+  for (size_t limit : {size_t{0}, size_t{1}, size_t{7}, size_t{100}, all.size() + 1}) {
+    CAPTURE(limit);
+    const std::vector<fusion::FuzzyMatch> expected(
+        all.begin(), all.begin() + static_cast<ptrdiff_t>(std::min(limit, all.size())));
+    CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), 2, 1, limit) == expected);
+    CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), 2, 3, limit) == expected);
+  }
+
+  // Positions before the start address are left out before the limit applies
+  auto later = all;
+  std::erase_if(later, [](const auto& match) { return match.address < 0x3000; });
+  later.resize(10);
+  CHECK(fusion::fuzzy_scan(snapshot, pattern.view(), 2, 0, 10, 0x3000) == later);
+}
+
+TEST_CASE("fuzzy_match_at measures only the candidates") {
+  auto snapshot = test::make_snapshot(0x1000, 20000, 25);
+  snapshot.regions.push_back(test::make_snapshot(0x10000, 5000, 26).regions[0]);
+  const auto pattern = compile("7F ? 3? 41");
+  const auto all = naive_fuzzy_scan(snapshot, pattern, 2);
+  REQUIRE(all.size() > 10);
+
+  // Every match, every tenth position, the region ends and addresses outside the image
+  std::vector<uint64_t> candidates = {0x0, 0x1000 + 20000 - 3, 0x10000 + 5000 - 4, 0x20000};
+  for (const auto& match : all) {
+    candidates.push_back(match.address);
+  }
+  for (uint64_t address = 0x1000; address < 0x1000 + 20000; address += 10) {
+    candidates.push_back(address);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  CHECK(fusion::fuzzy_match_at(snapshot, pattern.view(), 2, candidates) == all);
+  CHECK(fusion::fuzzy_match_at(snapshot, pattern.view(), 2, {all.back().address})
+        == std::vector<fusion::FuzzyMatch>{all.back()});
+}
+
+TEST_CASE("fuzzy_scan stays bounded when every position matches") {
+  // 16 MiB of one byte: with one difference allowed, every position of every chunk is in range
+  fusion::ImageSnapshot snapshot;
+  snapshot.regions.push_back({0x10000, std::vector<uint8_t>(16 << 20, 0xCC)});
+  const auto pattern = compile("CC CC 90");
+
+  const auto found = fusion::fuzzy_scan(snapshot, pattern.view(), 1, 0, 5);
+  REQUIRE(found.size() == 5);
+  for (size_t i = 0; i < found.size(); ++i) {
+    CHECK(found[i] == fusion::FuzzyMatch{0x10000 + i, 1});
+  }
+}
+
+TEST_CASE("scan_composite agrees with a naive scan") {
+  auto snapshot = test::make_snapshot(0x1000, 20000, 31);
+  snapshot.regions.push_back(test::make_snapshot(0x10000, 3000, 32).regions[0]);
+
+  for (const char* text : {"12 [0-40] 34",
+           "? 5? [3-9] 7F [0-100] ?",
+           "A1 [10] B2",
+           "0? [0-300] 1? 2? [2-5] 3?",
+           "AB CD"}) {
+    CAPTURE(text);
+    fusion::CompositePattern pattern;
+    REQUIRE(fusion::compile_composite_pattern(text, pattern));
+    const auto expected = naive_composite_scan(snapshot, pattern);
+    CHECK(fusion::scan_composite(snapshot, pattern, 1) == expected);
+    CHECK(fusion::scan_composite(snapshot, pattern, 3) == expected);
+  }
+}
+
+TEST_CASE("scan_composite verifies fragments around the rarest one") {
+  fusion::SnapshotRegion region;
+  region.start = 0x4000;
+  region.bytes.assign(0x400, 0x90);
+  const auto plant = [&](size_t offset, std::initializer_list<uint8_t> bytes) {
+    std::copy(bytes.begin(), bytes.end(), region.bytes.begin() + offset);
+  };
+  // Two heads sharing one tail, and a tail too far from the third head
+  plant(0x000, {0x55, 0x48});
+  plant(0x010, {0x55, 0x48});
+  plant(0x030, {0xE8, 0x11, 0x22, 0x33, 0x44});
+  plant(0x100, {0x55, 0x48});
+  plant(0x200, {0xE8, 0x11, 0x22, 0x33, 0x44});
+
+  fusion::ImageSnapshot snapshot;
+  snapshot.regions.push_back(std::move(region));
+
+  fusion::CompositePattern pattern;
+  REQUIRE(fusion::compile_composite_pattern("55 48 [16-64] E8 11 22 33 44", pattern));
+  CHECK(fusion::scan_composite(snapshot, pattern) == std::vector<uint64_t>{0x4000, 0x4010});
+}
@@ -0,0 +1,74 @@
+﻿#include "doctest.h"
+
+#include "fusion/serialize.h"
+
+namespace {
+fusion::SignatureRecord make_record(const std::string& name, const std::string& text, int64_t offset) {
+  fusion::SignatureRecord record;
+  record.name = name;
+  record.offset = offset;
+  REQUIRE(fusion::compile_pattern(text, record.pattern));
+  return record;
+}
+} // namespace
+
+TEST_CASE("Signature sets survive a round trip") {
+  const std::vector<fusion::SignatureRecord> records = {
+      make_record("CGame::Update", "48 89 5C 24 ? 57 48 83 EC 20 E8 ? ? ? ?", 0),
+      make_record("", "? ? 8B 05 ? ? ? ? 85 C0", -7),
+      make_record("nibbles", "4? 8B ?5 C3", 0x12345678),
+      make_record("trailing", "E8 ? ? ? ?", 1),
+  };
+
+  const auto blob = fusion::serialize_signatures(records);
+
+  std::vector<fusion::SignatureRecord> loaded;
+  REQUIRE(fusion::deserialize_signatures(blob.data(), blob.size(), loaded));
+  CHECK(loaded == records);
+}
+
+TEST_CASE("Binary signatures are smaller than their text form") {
+  const std::string text = "48 89 5C 24 ? 48 89 74 24 ? 57 48 83 EC 20 48 8B 05 ? ? ? ? 48 33 C4";
+  const auto record = make_record("", text, 0);
+
+  std::vector<uint8_t> encoded;
+  fusion::serialize_signature(record, encoded);
+
+  // Length, flags, bytes and a handful of mask runs
+  CHECK(encoded.size() == 2 + record.pattern.size() + 7);
+  CHECK(encoded.size() * 2 <= text.size());
+}
+
+TEST_CASE("Corrupt signature sets are rejected") {
+  const auto blob = fusion::serialize_signatures({make_record("name", "48 8B ? C3", 4)});
+  std::vector<fusion::SignatureRecord> loaded;
+
+  for (size_t size = 0; size < blob.size(); ++size) {
+    CHECK_FALSE(fusion::deserialize_signatures(blob.data(), size, loaded));
+  }
+
+  auto bad_version = blob;
+  bad_version[4] = fusion::signature_format_version + 1;
+  CHECK_FALSE(fusion::deserialize_signatures(bad_version.data(), bad_version.size(), loaded));
+
+  auto bad_magic = blob;
+  bad_magic[0] = 'X';
+  CHECK_FALSE(fusion::deserialize_signatures(bad_magic.data(), bad_magic.size(), loaded));
+  CHECK(loaded.empty());
+}
+
+TEST_CASE("Signatures with bytes under a wildcard are rejected") {
+  const auto record = make_record("", "48 8B ? C3", 0);
+  std::vector<uint8_t> encoded;
+  fusion::serialize_signature(record, encoded);
+
+  const uint8_t* data = encoded.data();
+  fusion::SignatureRecord loaded;
+  REQUIRE(fusion::deserialize_signature(data, encoded.data() + encoded.size(), loaded));
+  CHECK(loaded == record);
+
+  // Length and flags come first, then the pattern bytes
+  encoded[2 + 2] = 0x05;
+  data = encoded.data();
+  CHECK_FALSE(fusion::deserialize_signature(data, encoded.data() + encoded.size(), loaded));
+}
@@ -1,114 +1,9 @@
 ﻿#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
-// Mock IDA SDK functions for testing
-#define qsnprintf snprintf
-
-// Include settings first (it defines the flags)
-#include "fusion/settings.h"
-
-// Now include the signature header (without __IDP__ so no IDA deps)
+#include "fusion/scanner.h"
 #include "fusion/signature.h"
-
-// Include the implementation directly for testing
-// (We can't link against the real .cpp because it has IDA dependencies)
-#include <sstream>
-
-namespace fusion {
-void SignatureBuilder::clear() {
-  bytes_.clear();
-  wildcards_.clear();
-}
-
-void SignatureBuilder::add_byte(uint8_t byte, bool is_wildcard) {
-  bytes_.push_back(byte);
-  wildcards_.push_back(is_wildcard);
-}
-
-void SignatureBuilder::trim_wildcards() {
-  while (!wildcards_.empty() && wildcards_.back()) {
-    bytes_.pop_back();
-    wildcards_.pop_back();
-  }
-  while (!wildcards_.empty() && wildcards_.front()) {
-    bytes_.erase(bytes_.begin());
-    wildcards_.erase(wildcards_.begin());
-  }
-}
-
-std::string SignatureBuilder::render(SignatureStyle style) const {
-  switch (style) {
-  case SignatureStyle::Code:
-    return render_code();
-  case SignatureStyle::IDA:
-    return render_ida();
-  case SignatureStyle::FNV1A: {
-    char buf[16];
-    qsnprintf(buf, sizeof(buf), "0x%08X", hash_fnv1a());
-    return buf;
-  }
-  case SignatureStyle::CRC32: {
-    char buf[16];
-    qsnprintf(buf, sizeof(buf), "0x%08X", hash_crc32());
-    return buf;
-  }
-  }
-  return {};
-}
-
-std::string SignatureBuilder::render_code() const {
-  std::ostringstream ss;
-  const char* wildcard = g_settings.has(UseAltWildcard) ? "\\x2A" : "\\x00";
-  for (size_t i = 0; i < bytes_.size(); ++i) {
-    if (wildcards_[i]) {
-      ss << wildcard;
-    } else {
-      char buf[8];
-      qsnprintf(buf, sizeof(buf), "\\x%02X", bytes_[i]);
-      ss << buf;
-    }
-  }
-  if (g_settings.has(IncludeMask)) {
-    ss << ' ';
-    for (bool wc : wildcards_)
-      ss << (wc ? '?' : 'x');
-  }
-  return ss.str();
-}
-
-std::string SignatureBuilder::render_ida() const {
-  std::ostringstream ss;
-  const char* wildcard = g_settings.has(UseDoubleWildcard) ? "??" : "?";
-  for (size_t i = 0; i < bytes_.size(); ++i) {
-    if (i > 0) ss << ' ';
-    if (wildcards_[i]) {
-      ss << wildcard;
-    } else {
-      char buf[4];
-      qsnprintf(buf, sizeof(buf), "%02X", bytes_[i]);
-      ss << buf;
-    }
-  }
-  return ss.str();
-}
-
-uint32_t SignatureBuilder::hash_fnv1a() const {
-  uint32_t hash = 0x811c9dc5;
-  for (uint8_t byte : bytes_)
-    hash = (hash ^ byte) * 0x01000193;
-  return hash;
-}
-
-uint32_t SignatureBuilder::hash_crc32() const {
-  uint32_t crc = 0xFFFFFFFF;
-  for (uint8_t byte : bytes_) {
-    crc ^= byte;
-    for (int i = 0; i < 8; ++i)
-      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
-  }
-  return ~crc;
-}
-} // namespace fusion
+#include "test_util.h"
 
 // ============================================================================
 // Tests
@@ -181,3 +76,78 @@ TEST_CASE("SignatureBuilder hash functions") {
   CHECK(builder.render(fusion::SignatureStyle::FNV1A).substr(0, 2) == "0x");
   CHECK(builder.render(fusion::SignatureStyle::CRC32).substr(0, 2) == "0x");
 }
+
+namespace {
+/// Every instruction is two bytes; the second is an operand
+struct TwoByteDecoder : fusion::InsnDecoder {
+  bool decode(uint64_t /*address*/,
+      const uint8_t* /*bytes*/,
+      size_t available,
+      fusion::InsnInfo& out) const override {
+    if (available < 2) return false;
+    out = {2, 1, 2};
+    return true;
+  }
+};
+} // namespace
+
+TEST_CASE("add_instruction wildcards operand bytes") {
+  const uint8_t bytes[] = {0xE8, 0x11, 0x22, 0x33, 0x44};
+  fusion::SignatureBuilder builder;
+  fusion::add_instruction(builder, bytes, {5, 1, 5});
+
+  CHECK(builder.render(fusion::SignatureStyle::IDA) == "E8 ? ? ? ?");
+}
+
+TEST_CASE("build_unique_signature grows until unique") {
+  // Opcodes repeat every 8 bytes, so the signature has to reach the one that differs
+  fusion::SnapshotRegion region;
+  region.start = 0x1000;
+  for (int i = 0; i < 64; ++i) {
+    region.bytes.push_back(static_cast<uint8_t>(0x10 + i % 4));
+    region.bytes.push_back(static_cast<uint8_t>(i));
+  }
+  region.bytes[0x23 * 2] = 0x99;
+
+  fusion::ImageSnapshot image;
+  image.regions.push_back(region);
+
+  const TwoByteDecoder decoder;
+  std::vector<uint64_t> visited;
+  fusion::SignatureBuilder builder;
+  REQUIRE(fusion::build_unique_signature(image, decoder, 0x1000 + 0x20 * 2, builder,
+      [&](uint64_t address) { visited.push_back(address); }));
+
+  CHECK(builder.render(fusion::SignatureStyle::IDA) == "10 ? 11 ? 12 ? 99 ?");
+  CHECK(visited == std::vector<uint64_t>{0x1040, 0x1042, 0x1044, 0x1046});
+
+  // The signature only matches where it was created
+  builder.trim_wildcards();
+  const auto matches = fusion::scan_pattern(image, builder.compile().view());
+  CHECK(matches == std::vector<uint64_t>{0x1040});
+}
+
+TEST_CASE("build_unique_signature fails when the region runs out") {
+  const auto image = test::make_snapshot(0x1000, 256, 1);
+  auto doubled = image;
+  doubled.regions.push_back(image.regions[0]);
+  doubled.regions[1].start = 0x2000;
+
+  const TwoByteDecoder decoder;
+  fusion::SignatureBuilder builder;
+  CHECK_FALSE(fusion::build_unique_signature(doubled, decoder, 0x1000, builder));
+  CHECK(builder.size() == 256);
+
+  builder.clear();
+  CHECK(fusion::build_unique_signature(image, decoder, 0x1000, builder));
+  CHECK_FALSE(fusion::build_unique_signature(image, decoder, 0x5000, builder));
+}
+
+TEST_CASE("build_range_signature stops at the range end") {
+  const auto image = test::make_snapshot(0x1000, 64, 2);
+  const TwoByteDecoder decoder;
+
+  fusion::SignatureBuilder builder;
+  fusion::build_range_signature(image, decoder, 0x1010, 0x1017, builder);
+  CHECK(builder.size() == 8);
+}
@@ -0,0 +1,121 @@
+﻿#include "doctest.h"
+
+#include "fusion/similarity.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+// Deterministic pseudo-function: `count` instructions of 1-7 bytes with a wildcard tail.
+// The instruction at `patch_at` is replaced by an int3.
+fusion::SketchBuilder make_function(uint32_t seed, size_t count, size_t patch_at = SIZE_MAX) {
+  fusion::SketchBuilder builder;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    if (i == patch_at) {
+      builder.add_byte(0xCC);
+    } else {
+      const size_t size = 1 + (seed >> 16) % 7;
+      for (size_t j = 0; j < size; ++j) {
+        builder.add_byte(static_cast<uint8_t>(seed >> (j % 4 * 8)), j >= 3);
+      }
+    }
+    builder.end_instruction();
+  }
+  return builder;
+}
+
+fusion::FunctionSketch named(uint64_t address, const fusion::SketchBuilder& builder) {
+  return {address, "sub_" + std::to_string(address), builder.finish()};
+}
+} // namespace
+
+TEST_CASE("SketchBuilder ignores wildcarded byte values") {
+  fusion::SketchBuilder a, b;
+  for (uint8_t imm : {0x10, 0x20}) {
+    auto& builder = imm == 0x10 ? a : b;
+    for (int i = 0; i < 8; ++i) {
+      builder.add_byte(0x48);
+      builder.add_byte(0x8D);
+      builder.add_byte(static_cast<uint8_t>(i));
+      builder.add_byte(imm, true);
+      builder.end_instruction();
+    }
+  }
+
+  CHECK(a.instruction_count() == 8);
+  CHECK(a.finish().similarity(b.finish()) == 1.0);
+}
+
+TEST_CASE("MinHash similarity tracks shared instructions") {
+  const auto base = make_function(1, 200);
+
+  const auto patched = make_function(1, 200, 100);
+  const auto unrelated = make_function(99, 200);
+
+  CHECK(base.finish().similarity(base.finish()) == 1.0);
+  CHECK(base.finish().similarity(patched.finish()) > 0.8);
+  CHECK(base.finish().similarity(unrelated.finish()) < 0.2);
+  CHECK(fusion::SketchBuilder{}.finish().empty());
+}
+
+TEST_CASE("SimilarityIndex returns near duplicates only") {
+  fusion::SimilarityIndex index;
+  for (uint32_t seed = 100; seed < 400; ++seed) {
+    index.add(named(seed, make_function(seed, 60)));
+  }
+  index.add(named(0x1000, make_function(7, 60)));
+  index.add(fusion::FunctionSketch{}); // empty sketches are not indexed
+
+  CHECK(index.size() == 301);
+
+  const auto matches = index.query(make_function(7, 60).finish(), 0.5, 10);
+  REQUIRE(matches.size() == 1);
+  CHECK(matches[0].function->address == 0x1000);
+  CHECK(matches[0].similarity == 1.0);
+}
+
+TEST_CASE("Function sketches survive a save/load round trip") {
+  const std::vector<fusion::FunctionSketch> sketches = {
+      named(0x140001000, make_function(1, 40)),
+      named(0x140002000, make_function(2, 3)),
+  };
+
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_sketches.fsk").string();
+  REQUIRE(fusion::save_sketches(path, sketches));
+
+  std::vector<fusion::FunctionSketch> loaded;
+  REQUIRE(fusion::load_sketches(path, loaded));
+  std::filesystem::remove(path);
+
+  REQUIRE(loaded.size() == sketches.size());
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    CHECK(loaded[i].address == sketches[i].address);
+    CHECK(loaded[i].name == sketches[i].name);
+    CHECK(loaded[i].sketch.values == sketches[i].sketch.values);
+  }
+
+  CHECK_FALSE(fusion::load_sketches(path, loaded));
+}
+
+TEST_CASE("Damaged sketch files are rejected without allocating") {
+  const std::vector<fusion::FunctionSketch> sketches = {named(0x140001000, make_function(1, 40))};
+  const auto path = (std::filesystem::temp_directory_path() / "fusion_damaged.fsk").string();
+
+  // The count follows the magic and version; the first name length follows the first address
+  const auto damage = [&](std::streamoff offset, uint32_t value) {
+    REQUIRE(fusion::save_sketches(path, sketches));
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  std::vector<fusion::FunctionSketch> loaded;
+  damage(8, 0xFFFFFFFF);
+  CHECK_FALSE(fusion::load_sketches(path, loaded));
+  damage(8, 2);
+  CHECK_FALSE(fusion::load_sketches(path, loaded));
+  damage(20, 0xFFFFFFFF);
+  CHECK_FALSE(fusion::load_sketches(path, loaded));
+  std::filesystem::remove(path);
+}
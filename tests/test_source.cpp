@@ -0,0 +1,75 @@
+﻿#include "doctest.h"
+
+#include "fusion/source.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+/// Two segments, the second only partly backed by data
+struct FakeSource : fusion::ByteSource {
+  std::vector<fusion::AddressRange> segments() const override {
+    return {{0x1000, 0x1010}, {0x2000, 0x2100}, {0x3000, 0x3000}};
+  }
+
+  size_t read(uint64_t address, uint8_t* out, size_t size) const override {
+    const size_t available = address == 0x2000 ? 0x20 : size;
+    const size_t count = std::min(size, available);
+    std::memset(out, static_cast<int>(address >> 12), count);
+    return count;
+  }
+};
+} // namespace
+
+TEST_CASE("read_snapshot copies every non-empty segment") {
+  const auto snapshot = fusion::read_snapshot(FakeSource{});
+
+  REQUIRE(snapshot.regions.size() == 2);
+  CHECK(snapshot.regions[0].start == 0x1000);
+  CHECK(snapshot.regions[0].bytes == std::vector<uint8_t>(0x10, 0x01));
+  CHECK(snapshot.regions[1].start == 0x2000);
+  CHECK(snapshot.regions[1].bytes == std::vector<uint8_t>(0x20, 0x02));
+}
+
+TEST_CASE("find_region") {
+  const auto snapshot = fusion::read_snapshot(FakeSource{});
+
+  CHECK(fusion::find_region(snapshot, 0x0FFF) == nullptr);
+  CHECK(fusion::find_region(snapshot, 0x1000) == &snapshot.regions[0]);
+  CHECK(fusion::find_region(snapshot, 0x100F) == &snapshot.regions[0]);
+  CHECK(fusion::find_region(snapshot, 0x1010) == nullptr);
+  CHECK(fusion::find_region(snapshot, 0x201F) == &snapshot.regions[1]);
+  CHECK(fusion::find_region(snapshot, 0x2020) == nullptr);
+}
+
+TEST_CASE("scope_ranges keeps the segments in the search scope") {
+  const std::vector<fusion::SegmentInfo> segments = {{{0x1000, 0x2000}, ".text", true},
+      {{0x2000, 0x3000}, ".rdata", false},
+      {{0x3000, 0x4000}, ".data", false},
+      {{0x4000, 0x4800}, ".init", true}};
+  using Ranges = std::vector<std::pair<uint64_t, uint64_t>>;
+  const auto scoped = [&](const fusion::Settings& settings) {
+    Ranges ranges;
+    for (const auto& range : fusion::scope_ranges(segments, settings)) {
+      ranges.emplace_back(range.start, range.end);
+    }
+    return ranges;
+  };
+
+  fusion::Settings settings;
+  CHECK(scoped(settings).size() == 4);
+
+  settings.scope = fusion::SearchScope::Code;
+  CHECK(scoped(settings) == Ranges{{0x1000, 0x2000}, {0x4000, 0x4800}});
+
+  settings.scope = fusion::SearchScope::Segments;
+  settings.scope_segments = ".data, .text .bss";
+  CHECK(scoped(settings) == Ranges{{0x1000, 0x2000}, {0x3000, 0x4000}});
+
+  settings.scope = fusion::SearchScope::Range;
+  settings.scope_start = 0x1800;
+  settings.scope_end = 0x2800;
+  CHECK(scoped(settings) == Ranges{{0x1800, 0x2000}, {0x2000, 0x2800}});
+  settings.scope_end = 0x1800;
+  CHECK(scoped(settings).empty());
+}
@@ -0,0 +1,209 @@
+﻿#include "doctest.h"
+#include "test_util.h"
+
+#include "fusion/tokens.h"
+#include "fusion/x86_decoder.h"
+
+#include <algorithm>
+
+namespace {
+uint32_t token(std::initializer_list<uint8_t> bytes) {
+  const std::vector<uint8_t> code(bytes);
+  fusion::InsnInfo insn;
+  REQUIRE(fusion::X86Decoder{}.decode(0, code.data(), code.size(), insn));
+  REQUIRE(insn.size == code.size());
+  return insn.token;
+}
+
+// push rbp; mov rbp, rsp; sub rsp, 0x20; mov [rbp-8], rdi; xor eax, eax; leave; ret
+const std::vector<uint8_t> func_a = {0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0x48, 0x89,
+    0x7D, 0xF8, 0x31, 0xC0, 0xC9, 0xC3};
+// push rbp; mov rbp, rsp; sub rsp, 0x20; call $+5; leave; ret
+const std::vector<uint8_t> func_b = {
+    0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0xE8, 0x00, 0x00, 0x00, 0x00, 0xC9, 0xC3};
+// func_a with other registers and frame size:
+// push rbx; mov rbx, rsp; sub rsp, 0x30; mov [rbx-8], rsi; xor ecx, ecx; leave; ret
+const std::vector<uint8_t> func_a_rebuilt = {0x53, 0x48, 0x89, 0xE3, 0x48, 0x83, 0xEC, 0x30,
+    0x48, 0x89, 0x73, 0xF8, 0x31, 0xC9, 0xC9, 0xC3};
+
+// int3 padding with func_a at `start` and func_b 0x40 bytes later
+fusion::MockDatabase make_database(uint64_t start, const std::vector<uint8_t>& a) {
+  fusion::SnapshotRegion region;
+  region.start = start;
+  region.bytes.assign(0x80, 0xCC);
+  std::copy(a.begin(), a.end(), region.bytes.begin());
+  std::copy(func_b.begin(), func_b.end(), region.bytes.begin() + 0x40);
+
+  fusion::MockDatabase db;
+  db.snapshot.regions.push_back(std::move(region));
+  db.functions = {{start, start + a.size(), "func_a"},
+      {start + 0x40, start + 0x40 + func_b.size(), "func_b"}};
+  db.cursor_ea = start;
+  return db;
+}
+
+fusion::TokenIndex make_index(const fusion::Database& db) {
+  fusion::TokenIndex index;
+  index.build(db.image(), db.decoder());
+  return index;
+}
+} // namespace
+
+TEST_CASE("x86 tokens ignore registers, displacements and immediates") {
+  CHECK(token({0x48, 0x89, 0xE5}) == token({0x48, 0x89, 0xE3}));       // mov rbp/rbx, rsp
+  CHECK(token({0x55}) == token({0x41, 0x54}));                         // push rbp/r12
+  CHECK(token({0x48, 0x83, 0xEC, 0x20}) == token({0x48, 0x83, 0xE9, 0x08})); // sub rsp/rcx
+  CHECK(token({0x8B, 0x45, 0xF8}) == token({0x8B, 0x8C, 0x24, 0x00, 0x01, 0x00, 0x00}));
+  CHECK(token({0xE8, 0, 0, 0, 0}) == token({0xE8, 0x10, 0x20, 0x30, 0x40}));
+
+  CHECK(token({0x48, 0x89, 0xE5}) != token({0x89, 0xE5}));             // operand size
+  CHECK(token({0x48, 0x89, 0xE5}) != token({0x48, 0x89, 0x45, 0xF8})); // register vs memory
+  CHECK(token({0x48, 0x83, 0xEC, 0x20}) != token({0x48, 0x83, 0xC4, 0x20})); // sub vs add
+  CHECK(token({0x8B, 0x05, 0, 0, 0, 0}) != token({0x8B, 0x45, 0xF8}));      // rip-relative
+  CHECK(token({0x90}) != token({0x91}));                               // nop vs xchg
+  CHECK(token({0x50}) != token({0x58}));                               // push vs pop
+}
+
+TEST_CASE("token signatures round-trip through text") {
+  const std::vector<uint32_t> tokens = {0x1A2B3C4D, 0x5E, 0xFFFFFFFF};
+  const std::string text = fusion::format_token_signature(tokens);
+  CHECK(text == "T:1A2B3C4D 0000005E FFFFFFFF");
+  CHECK(fusion::is_token_signature("  T:1"));
+  CHECK_FALSE(fusion::is_token_signature("48 89 ? ?"));
+  CHECK(fusion::parse_token_signature(text) == tokens);
+  CHECK(fusion::parse_token_signature("t: 1a2b3c4d\t5e  ffffffff ") == tokens);
+
+  CHECK_FALSE(fusion::parse_token_signature("T:"));
+  CHECK_FALSE(fusion::parse_token_signature("T:00000000"));
+  CHECK_FALSE(fusion::parse_token_signature("T:12 XY"));
+  CHECK_FALSE(fusion::parse_token_signature("T:123456789"));
+  CHECK_FALSE(fusion::parse_token_signature("48 89"));
+}
+
+TEST_CASE("token signatures survive register reallocation") {
+  const auto db = make_database(0x1000, func_a);
+  const auto index = make_index(db);
+
+  // The prologue is shared with func_b, so the signature runs into the store that differs
+  const auto created = fusion::create_token_signature(db, index, {.use_selection = false});
+  REQUIRE(created.status == fusion::CreateStatus::Unique);
+  CHECK(created.tokens.size() == fusion::TokenIndex::ngram);
+  CHECK(index.find(created.tokens) == std::vector<uint64_t>{0x1000});
+
+  const auto rebuilt = make_database(0x5000, func_a_rebuilt);
+  const std::string text = fusion::format_token_signature(created.tokens);
+  CHECK(*fusion::find_token_signature(make_index(rebuilt), text, {})
+        == std::vector<uint64_t>{0x5000});
+
+  // Shorter than an n-gram: found without the index
+  const std::vector<uint32_t> prologue(created.tokens.begin(), created.tokens.begin() + 3);
+  CHECK(index.find(prologue) == std::vector<uint64_t>{0x1000, 0x1040});
+  CHECK(index.find(prologue, 1) == std::vector<uint64_t>{0x1000});
+  CHECK(*fusion::find_token_signature(index,
+            fusion::format_token_signature(prologue),
+            {.stop_at_first = false, .ignore_addr = 0x1000})
+        == std::vector<uint64_t>{0x1040});
+  CHECK_FALSE(fusion::find_token_signature(index, "T:XYZ", {}));
+}
+
+TEST_CASE("create_token_signature follows the create settings") {
+  auto db = make_database(0x1000, func_a);
+  const auto index = make_index(db);
+
+  db.cursor_ea = 0x1030;
+  CHECK(fusion::create_token_signature(db, index, {}).status
+        == fusion::CreateStatus::NotInFunction);
+
+  // Only int3 padding follows, and one byte earlier is the same again
+  db.cursor_ea = 0x1050;
+  const auto padding =
+      fusion::create_token_signature(db, index, {.allow_dangerous_regions = true});
+  CHECK(padding.status == fusion::CreateStatus::NotUnique);
+  CHECK(padding.tokens.empty());
+
+  // Mid-instruction addresses are not on the sweep
+  db.cursor_ea = 0x1002;
+  CHECK(fusion::create_token_signature(db, index, {}).tokens.empty());
+
+  db.cursor_ea = 0x1040;
+  db.selected = fusion::AddressRange{0x1040, 0x1048};
+  const auto selected = fusion::create_token_signature(db, index, {});
+  CHECK(selected.status == fusion::CreateStatus::FromSelection);
+  CHECK(selected.tokens.size() == 3);
+  CHECK(index.find(selected.tokens) == std::vector<uint64_t>{0x1000, 0x1040});
+}
+
+TEST_CASE("TokenIndex::find matches a linear search") {
+  // Random bytes decode into a long stream with breaks wherever they are invalid
+  fusion::MockDatabase db;
+  db.snapshot = test::make_snapshot(0x400000, 1 << 16, 7);
+  const auto index = make_index(db);
+  REQUIRE(index.size() > 10000);
+
+  std::vector<uint32_t> stream;
+  std::vector<uint64_t> addresses;
+  const fusion::X86Decoder decoder;
+  const auto& bytes = db.snapshot.regions[0].bytes;
+  for (size_t offset = 0; offset < bytes.size();) {
+    fusion::InsnInfo insn;
+    if (decoder.decode(0, &bytes[offset], bytes.size() - offset, insn)) {
+      stream.push_back(insn.token);
+      addresses.push_back(0x400000 + offset);
+      offset += insn.size;
+    } else {
+      stream.push_back(0);
+      addresses.push_back(0);
+      ++offset;
+    }
+  }
+
+  for (size_t length : {1, 3, 4, 6}) {
+    for (size_t start = 0; start < stream.size(); start += 997) {
+      const std::vector<uint32_t> query(
+          stream.begin() + start, stream.begin() + std::min(start + length, stream.size()));
+      if (std::find(query.begin(), query.end(), 0u) != query.end()) continue;
+
+      std::vector<uint64_t> expected;
+      for (size_t i = 0; i + query.size() <= stream.size(); ++i) {
+        if (std::equal(query.begin(), query.end(), stream.begin() + i)) {
+          expected.push_back(addresses[i]);
+        }
+      }
+      CHECK(index.find(query) == expected);
+    }
+  }
+}
+
+TEST_CASE("find_token_signature can keep only function starts") {
+  const auto db = make_database(0x1000, func_a);
+  const auto index = make_index(db);
+  // push rbp; mov rbp, rsp; sub rsp, 0x20 starts both functions, and sub rsp also ends it
+  const auto prologue = fusion::format_token_signature(index.sequence({0x1000, 0x1008}));
+  const std::vector<uint64_t> starts = {0x1040};
+
+  CHECK(*fusion::find_token_signature(index, prologue, {}) == std::vector<uint64_t>{0x1000, 0x1040});
+  CHECK(*fusion::find_token_signature(index, prologue, {.function_starts_only = true}, starts)
+        == std::vector<uint64_t>{0x1040});
+}
+
+TEST_CASE("TokenIndex builds from some regions of a snapshot in place") {
+  auto db = make_database(0x1000, func_a);
+  db.snapshot.regions.push_back(make_database(0x2000, func_a_rebuilt).snapshot.regions[0]);
+  db.snapshot.regions.push_back(make_database(0x3000, func_a).snapshot.regions[0]);
+
+  // Only the first and last regions, as code segments are picked out of a database image
+  fusion::ImageSnapshot copied;
+  copied.regions = {db.snapshot.regions[0], db.snapshot.regions[2]};
+  const std::vector<const fusion::SnapshotRegion*> picked = {
+      &db.snapshot.regions[0], &db.snapshot.regions[2]};
+
+  fusion::TokenIndex in_place, from_copy;
+  in_place.build(picked, db.decoder());
+  from_copy.build(copied, db.decoder());
+  REQUIRE(in_place.size() == from_copy.size());
+
+  const auto tokens = in_place.sequence({0x1000, 0x1010});
+  REQUIRE_FALSE(tokens.empty());
+  CHECK(in_place.find(tokens) == from_copy.find(tokens));
+  CHECK(in_place.find(tokens) == std::vector<uint64_t>{0x1000, 0x3000});
+}
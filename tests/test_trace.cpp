@@ -0,0 +1,86 @@
+﻿#include "doctest.h"
+
+#include "fusion/parallel.h"
+#include "fusion/scanner.h"
+#include "fusion/trace.h"
+#include "test_util.h"
+
+#include <set>
+#include <string>
+
+namespace {
+size_t count_events(const std::string& json, const std::string& name) {
+  const std::string key = "{\"name\": \"" + name + "\"";
+  size_t count = 0;
+  for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+std::set<std::string> thread_ids(const std::string& json, const std::string& name) {
+  const std::string key = "{\"name\": \"" + name + "\"";
+  std::set<std::string> tids;
+  for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + 1)) {
+    const size_t tid = json.find("\"tid\": ", pos) + 7;
+    tids.insert(json.substr(tid, json.find_first_of(",}", tid) - tid));
+  }
+  return tids;
+}
+} // namespace
+
+TEST_CASE("Trace events are recorded per thread") {
+  fusion::trace_start();
+  fusion::parallel_for(64, 4, [](size_t i) {
+    const fusion::ScopedTrace trace("task", "index", i);
+  });
+  fusion::trace_stop();
+
+  // Recording stopped, so this is not part of the trace
+  { const fusion::ScopedTrace trace("late"); }
+
+  const std::string json = fusion::chrome_trace_json();
+  CHECK(json.find("\"traceEvents\"") != std::string::npos);
+  CHECK(count_events(json, "task") == 64);
+  CHECK(count_events(json, "late") == 0);
+  CHECK(count_events(json, "thread_name") >= thread_ids(json, "task").size());
+  CHECK(json.find("\"args\": {\"index\": 63}") != std::string::npos);
+  CHECK(fusion::trace_dropped() == 0);
+}
+
+TEST_CASE("Full trace buffers keep the newest events") {
+  fusion::trace_start(4);
+  for (uint64_t i = 0; i < 10; ++i) {
+    const fusion::ScopedTrace trace("step", "i", i);
+  }
+  fusion::trace_stop();
+
+  const std::string json = fusion::chrome_trace_json();
+  CHECK(count_events(json, "step") == 4);
+  CHECK(json.find("\"args\": {\"i\": 5}") == std::string::npos);
+  CHECK(json.find("\"args\": {\"i\": 9}") != std::string::npos);
+  CHECK(fusion::trace_dropped() == 6);
+  CHECK(json.find("\"dropped_events\": 6") != std::string::npos);
+
+  // Restarting discards everything recorded before
+  fusion::trace_start();
+  fusion::trace_stop();
+  CHECK(count_events(fusion::chrome_trace_json(), "step") == 0);
+}
+
+#ifdef FUSION_PROFILE
+TEST_CASE("scan_pattern traces the scan and each work chunk") {
+  const auto snapshot = test::make_snapshot(0x1000, 3 << 20, 9);
+  fusion::CompiledPattern pattern;
+  REQUIRE(fusion::compile_pattern("48 8B ? 5C", pattern));
+
+  fusion::trace_start();
+  (void) fusion::scan_pattern(snapshot, pattern.view(), 2);
+  fusion::trace_stop();
+
+  const std::string json = fusion::chrome_trace_json();
+  CHECK(count_events(json, "scan_pattern") == 1);
+  CHECK(count_events(json, "scan_chunk") == 3);
+  CHECK(json.find("\"args\": {\"pattern_bytes\": 4}") != std::string::npos);
+}
+#endif
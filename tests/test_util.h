@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "fusion/snapshot.h"
+
+#include <cstdint>
+#include <utility>
+
+namespace test {
+/// Deterministic pseudo-random bytes
+inline void fill_random(std::vector<uint8_t>& bytes, uint32_t seed) {
+  for (auto& byte : bytes) {
+    seed = seed * 1103515245 + 12345;
+    byte = static_cast<uint8_t>(seed >> 16);
+  }
+}
+
+/// Single-region snapshot of `size` pseudo-random bytes at `start`
+inline fusion::ImageSnapshot make_snapshot(uint64_t start, size_t size, uint32_t seed) {
+  fusion::SnapshotRegion region;
+  region.start = start;
+  region.bytes.resize(size);
+  fill_random(region.bytes, seed);
+
+  fusion::ImageSnapshot snapshot;
+  snapshot.regions.push_back(std::move(region));
+  return snapshot;
+}
+} // namespace test
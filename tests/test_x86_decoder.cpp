@@ -0,0 +1,162 @@
+﻿#include "doctest.h"
+
+#include "fusion/x86_decoder.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+struct CorpusEntry {
+  std::vector<uint8_t> bytes;
+  std::string text;
+};
+
+/// Instructions disassembled by objdump, as `bytes # disassembly` lines.
+/// fwait-prefixed FPU instructions and 66-prefixed near jumps are left out: objdump merges the
+/// former and follows AMD for the latter, where IDA and Intel CPUs do not.
+std::vector<CorpusEntry> read_corpus(const std::string& path) {
+  std::vector<CorpusEntry> corpus;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    const size_t comment = line.find('#');
+    std::istringstream hex(line.substr(0, comment));
+
+    CorpusEntry entry;
+    for (std::string token; hex >> token;) {
+      entry.bytes.push_back(static_cast<uint8_t>(std::stoul(token, nullptr, 16)));
+    }
+    if (entry.bytes.empty()) continue;
+    if (comment != std::string::npos) entry.text = line.substr(comment + 1);
+    corpus.push_back(std::move(entry));
+  }
+  return corpus;
+}
+
+void check_corpus(const char* path, bool x64) {
+  const auto corpus = read_corpus(path);
+  REQUIRE(corpus.size() > 1000);
+
+  for (const auto& entry : corpus) {
+    CAPTURE(entry.text);
+
+    // Trailing bytes must not be consumed, and a truncated instruction must be rejected
+    auto padded = entry.bytes;
+    padded.resize(entry.bytes.size() + 16, 0x90);
+
+    fusion::X86Insn insn;
+    REQUIRE(fusion::decode_x86(padded.data(), padded.size(), x64, insn));
+    CHECK(insn.size == entry.bytes.size());
+    CHECK_FALSE(fusion::decode_x86(padded.data(), entry.bytes.size() - 1, x64, insn));
+  }
+}
+
+fusion::X86Insn decode(std::initializer_list<uint8_t> bytes, bool x64 = true) {
+  const std::vector<uint8_t> data(bytes);
+  fusion::X86Insn insn;
+  REQUIRE(fusion::decode_x86(data.data(), data.size(), x64, insn));
+  CHECK(insn.size == data.size());
+  return insn;
+}
+} // namespace
+
+TEST_CASE("decode_x86 matches objdump lengths in 64-bit mode") {
+  check_corpus(FUSION_TEST_FIXTURES "/x86_64.txt", true);
+}
+
+TEST_CASE("decode_x86 matches objdump lengths in 32-bit mode") {
+  check_corpus(FUSION_TEST_FIXTURES "/x86_32.txt", false);
+}
+
+TEST_CASE("decode_x86 operand layout") {
+  // call rel32
+  auto insn = decode({0xE8, 0x11, 0x22, 0x33, 0x44});
+  CHECK(insn.imm_offset == 1);
+  CHECK(insn.imm_size == 4);
+  CHECK(insn.relative);
+
+  // mov rax, [rip+disp32]
+  insn = decode({0x48, 0x8B, 0x05, 0x11, 0x22, 0x33, 0x44});
+  CHECK(insn.opcode_offset == 1);
+  CHECK(insn.disp_offset == 3);
+  CHECK(insn.disp_size == 4);
+  CHECK(insn.rip_relative);
+
+  // mov dword [rsp+8], imm32
+  insn = decode({0xC7, 0x44, 0x24, 0x08, 0x01, 0x00, 0x00, 0x00});
+  CHECK(insn.disp_offset == 3);
+  CHECK(insn.disp_size == 1);
+  CHECK(insn.imm_offset == 4);
+  CHECK(insn.imm_size == 4);
+  CHECK(insn.operand_offset() == 3);
+
+  // mov rax, imm64
+  insn = decode({0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8});
+  CHECK(insn.imm_size == 8);
+
+  // test cl, 1 has an immediate, not cl does not
+  CHECK(decode({0xF6, 0xC1, 0x01}).imm_size == 1);
+  CHECK(decode({0xF6, 0xD1}).imm_size == 0);
+
+  // vmovups zmm0, [rsp+0x40] with a compressed disp8
+  insn = decode({0x62, 0xF1, 0x7C, 0x48, 0x10, 0x44, 0x24, 0x01});
+  CHECK(insn.opcode_offset == 4);
+  CHECK(insn.disp_offset == 7);
+
+  // vpalignr xmm0, xmm0, xmm1, 8
+  insn = decode({0xC4, 0xE3, 0x79, 0x0F, 0xC1, 0x08});
+  CHECK(insn.imm_offset == 5);
+
+  // vzeroupper
+  CHECK(decode({0xC5, 0xF8, 0x77}).operand_offset() == 3);
+}
+
+TEST_CASE("decode_x86 mode differences") {
+  const uint8_t push_es[] = {0x06};
+  fusion::X86Insn insn;
+  CHECK_FALSE(fusion::decode_x86(push_es, sizeof(push_es), true, insn));
+  CHECK(fusion::decode_x86(push_es, sizeof(push_es), false, insn));
+
+  // inc eax in 32-bit mode, a REX prefix in 64-bit mode
+  const uint8_t inc[] = {0x40, 0x90};
+  REQUIRE(fusion::decode_x86(inc, sizeof(inc), false, insn));
+  CHECK(insn.size == 1);
+  REQUIRE(fusion::decode_x86(inc, sizeof(inc), true, insn));
+  CHECK(insn.size == 2);
+
+  // lds in 32-bit mode has a memory operand, VEX has mod == 3
+  const uint8_t lds[] = {0xC5, 0x05, 0x11, 0x22, 0x33, 0x44};
+  REQUIRE(fusion::decode_x86(lds, sizeof(lds), false, insn));
+  CHECK(insn.size == 6);
+
+  // 16-bit addressing: mov ax, [bp+si+disp16]
+  insn = decode({0x67, 0x8B, 0x82, 0x34, 0x12}, false);
+  CHECK(insn.disp_size == 2);
+}
+
+TEST_CASE("decode_x86 rejects overlong instructions") {
+  std::vector<uint8_t> bytes(15, 0x66);
+  bytes.push_back(0x90);
+  fusion::X86Insn insn;
+  CHECK_FALSE(fusion::decode_x86(bytes.data(), bytes.size(), true, insn));
+
+  bytes.erase(bytes.begin());
+  CHECK(fusion::decode_x86(bytes.data(), bytes.size(), true, insn));
+  CHECK(insn.size == 15);
+}
+
+TEST_CASE("X86Decoder wildcards from the first operand byte") {
+  const fusion::X86Decoder decoder;
+  fusion::InsnInfo info;
+
+  const uint8_t load[] = {0x48, 0x8B, 0x0D, 0x11, 0x22, 0x33, 0x44};
+  REQUIRE(decoder.decode(0, load, sizeof(load), info));
+  CHECK(info.size == 7);
+  CHECK(info.wildcard_begin == 3);
+  CHECK(info.wildcard_end == 7);
+
+  const uint8_t ret[] = {0xC3};
+  REQUIRE(decoder.decode(0, ret, sizeof(ret), info));
+  CHECK_FALSE(info.is_wildcard(0));
+}
@@ -0,0 +1,259 @@
+﻿// fusion-scan: search an executable file or a running Linux process for signatures without IDA.
+// Uses the same scanner as the plugin's "Search signature", so both report the same matches.
+
+#include "fusion/image.h"
+#include "fusion/library.h"
+#include "fusion/mapped_file.h"
+#include "fusion/pattern.h"
+#include "fusion/process.h"
+#include "fusion/profile.h"
+#include "fusion/scanner.h"
+#include "fusion/trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr int exit_ok = 0;
+constexpr int exit_missing = 1;
+constexpr int exit_error = 2;
+
+void print_usage() {
+  std::fprintf(stderr,
+      "usage: fusion-scan [options] <binary> [signature...]\n"
+      "       fusion-scan [options] --pid <pid> [signature...]\n"
+      "\n"
+      "Signatures are IDA style (\"48 8B ? 4?\") or CODE style (\"\\x48\\x8B\\x00 xx?\").\n"
+      "\n"
+      "options:\n"
+      "  -l, --list <file>    also scan for every `name pattern [+offset]` line of <file>\n"
+      "  -u, --unique         fail unless every signature matches exactly once\n"
+      "  -f, --function-starts  only report matches at function starts (PE .pdata or ELF\n"
+      "                       function symbols)\n"
+      "  -j, --threads <n>    worker threads (default: one per core)\n"
+      "  -p, --pid <pid>      scan the memory of a running Linux process instead of a file;\n"
+      "                       matches are reported as module+offset\n"
+      "  --profile            print per-phase timings to stderr\n"
+      "  --profile-json <f>   append per-phase timings to <f> as a JSON line\n"
+      "  --trace <file>       write a Chrome trace of every pattern and work chunk to <file>\n");
+}
+
+const char* format_name(fusion::ImageFormat format) {
+  switch (format) {
+  case fusion::ImageFormat::ELF:
+    return "ELF";
+  case fusion::ImageFormat::PE:
+    return "PE";
+  case fusion::ImageFormat::MachO:
+    return "Mach-O";
+  }
+  return "?";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  fusion::profile_reset();
+  std::string binary_path;
+  std::vector<fusion::SignatureRecord> records;
+  bool require_unique = false;
+  bool function_starts_only = false;
+  unsigned threads = 0;
+  bool profile = false;
+  std::string profile_json;
+  std::string trace_path;
+  int pid = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if ((arg == "-l" || arg == "--list") && i + 1 < argc) {
+      size_t error_line = 0;
+      std::vector<fusion::SignatureRecord> list;
+      if (!fusion::read_signature_list(argv[++i], list, &error_line)) {
+        if (error_line) {
+          std::fprintf(stderr, "fusion-scan: invalid signature on line %zu of %s\n", error_line,
+              argv[i]);
+        } else {
+          std::fprintf(stderr, "fusion-scan: cannot read %s\n", argv[i]);
+        }
+        return exit_error;
+      }
+      records.insert(records.end(), list.begin(), list.end());
+    } else if (arg == "-u" || arg == "--unique") {
+      require_unique = true;
+    } else if (arg == "-f" || arg == "--function-starts") {
+      function_starts_only = true;
+    } else if ((arg == "-j" || arg == "--threads") && i + 1 < argc) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if ((arg == "-p" || arg == "--pid") && i + 1 < argc) {
+      pid = std::atoi(argv[++i]);
+      if (pid <= 0) {
+        std::fprintf(stderr, "fusion-scan: invalid process id %s\n", argv[i]);
+        return exit_error;
+      }
+    } else if (arg == "--profile") {
+      profile = true;
+    } else if (arg == "--profile-json" && i + 1 < argc) {
+      profile_json = argv[++i];
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage();
+      return exit_ok;
+    } else if (!arg.empty() && arg[0] == '-' && arg.size() > 1) {
+      std::fprintf(stderr, "fusion-scan: unknown option %s\n", arg.c_str());
+      print_usage();
+      return exit_error;
+    } else if (binary_path.empty() && !pid) {
+      binary_path = arg;
+    } else {
+      fusion::SignatureRecord record;
+      record.name = arg;
+      if (!fusion::compile_pattern(arg, record.pattern) || record.pattern.empty()) {
+        std::fprintf(stderr, "fusion-scan: invalid signature: %s\n", arg.c_str());
+        return exit_error;
+      }
+      records.push_back(std::move(record));
+    }
+  }
+
+  if ((binary_path.empty() == !pid) || records.empty()) {
+    print_usage();
+    return exit_error;
+  }
+  if (pid && function_starts_only) {
+    std::fprintf(stderr, "fusion-scan: --function-starts needs a binary, not --pid\n");
+    return exit_error;
+  }
+
+#ifndef FUSION_PROFILE
+  if (profile || !profile_json.empty() || !trace_path.empty()) {
+    std::fprintf(
+        stderr, "fusion-scan: built without FUSION_PROFILING, ignoring --profile and --trace\n");
+  }
+#endif
+
+  fusion::TraceSession trace(trace_path);
+  std::vector<std::vector<uint64_t>> found;
+  std::function<void(uint64_t)> print_location;
+
+  fusion::MappedFile file;
+  fusion::ImageLayout layout;
+  std::vector<fusion::ProcessMapping> mappings;
+  if (pid) {
+    if (!fusion::read_process_maps(pid, mappings)) {
+      std::fprintf(stderr, "fusion-scan: cannot read the memory map of process %d\n", pid);
+      return exit_error;
+    }
+
+    // Process memory is streamed rather than copied, so every pattern shares each read
+    const fusion::ProcessByteSource source(pid, mappings);
+    uint64_t total = 0;
+    for (const auto& segment : source.segments()) {
+      total += segment.size();
+    }
+    std::printf("process %d: %zu readable regions, %llu bytes\n", pid, source.segments().size(),
+        static_cast<unsigned long long>(total));
+
+    std::vector<fusion::PatternView> patterns;
+    for (const auto& record : records) {
+      patterns.push_back(record.pattern.view());
+    }
+    found = fusion::scan_source(source, patterns, fusion::default_stream_chunk, threads);
+
+    print_location = [&](uint64_t address) {
+      std::printf("0x%llX", static_cast<unsigned long long>(address));
+      if (const auto module = fusion::module_address(mappings, address)) {
+        std::printf("  %s+0x%llX", module->module.c_str(),
+            static_cast<unsigned long long>(module->offset));
+      }
+      std::printf("\n");
+    };
+  } else {
+    if (!file.open(binary_path)) {
+      std::fprintf(stderr, "fusion-scan: cannot open %s\n", binary_path.c_str());
+      return exit_error;
+    }
+    if (!fusion::parse_image(file.data(), file.size(), layout)) {
+      std::fprintf(stderr, "fusion-scan: %s is not an ELF, PE or Mach-O file\n",
+          binary_path.c_str());
+      return exit_error;
+    }
+    if (layout.sections.empty()) {
+      std::fprintf(stderr, "fusion-scan: %s has no loadable sections\n", binary_path.c_str());
+      return exit_error;
+    }
+
+    const fusion::ImageSnapshot image =
+        fusion::read_snapshot(fusion::FileImageSource(file.data(), file.size(), layout));
+    std::printf("%s: %s, %zu sections, %zu bytes, base 0x%llX\n", binary_path.c_str(),
+        format_name(layout.format), layout.sections.size(), image.total_size(),
+        static_cast<unsigned long long>(layout.image_base));
+
+    std::vector<uint64_t> starts;
+    if (function_starts_only) {
+      starts = fusion::read_function_starts(file.data(), file.size(), layout);
+      if (starts.empty()) {
+        std::fprintf(stderr, "fusion-scan: %s has no function table\n", binary_path.c_str());
+        return exit_error;
+      }
+      std::printf("%zu function starts\n", starts.size());
+    }
+
+    for (size_t index = 0; index < records.size(); ++index) {
+      FUSION_TRACE("pattern", "index", index);
+      const fusion::PatternView pattern = records[index].pattern.view();
+      found.push_back(function_starts_only ? fusion::match_at(image, pattern, starts)
+                                           : fusion::scan_pattern(image, pattern, threads));
+    }
+
+    print_location = [&](uint64_t address) {
+      const auto offset = layout.file_offset(address);
+      std::printf("VA 0x%llX  RVA 0x%llX  file ", static_cast<unsigned long long>(address),
+          static_cast<unsigned long long>(address - layout.image_base));
+      if (offset) {
+        std::printf("0x%llX\n", static_cast<unsigned long long>(*offset));
+      } else {
+        std::printf("-\n");
+      }
+    };
+  }
+
+  int status = exit_ok;
+  for (size_t index = 0; index < records.size(); ++index) {
+    const auto& record = records[index];
+    const auto& matches = found[index];
+    if (matches.empty() || (require_unique && matches.size() > 1)) {
+      status = exit_missing;
+    }
+
+    if (matches.empty()) {
+      std::printf("%s: no matches\n", record.name.c_str());
+      continue;
+    }
+
+    for (uint64_t match : matches) {
+      std::printf("%s: ", record.name.c_str());
+      print_location(match + record.offset);
+    }
+    FUSION_COUNT(Matches, matches.size());
+  }
+
+  if (!trace.finish()) {
+    std::fprintf(stderr, "fusion-scan: cannot write %s\n", trace_path.c_str());
+    return exit_error;
+  }
+
+  const fusion::ProfileSnapshot snapshot = fusion::profile_snapshot();
+  if (profile) {
+    std::fprintf(stderr, "fusion-scan: %s\n", fusion::format_profile(snapshot).c_str());
+  }
+  if (!profile_json.empty() && !fusion::append_profile_json(profile_json, "scan", snapshot)) {
+    std::fprintf(stderr, "fusion-scan: cannot write %s\n", profile_json.c_str());
+    return exit_error;
+  }
+
+  return status;
+}
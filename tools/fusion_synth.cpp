@@ -0,0 +1,200 @@
+﻿// fusion-synth: write a seeded synthetic x86-64 code image as a mock database fixture.
+// Benchmarks and tests load it in place of proprietary binaries that cannot be shared.
+
+#include "fusion/corpus.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+constexpr size_t min_size = size_t{1} << 20;
+constexpr size_t max_size = size_t{1} << 30;
+
+void print_usage() {
+  std::fprintf(stderr,
+      "usage: fusion-synth [options] <output.fdb>\n"
+      "\n"
+      "options:\n"
+      "  -s, --size <n>[K|M|G]     bytes of code (default: 1M)\n"
+      "      --seed <n>            generator seed (default: 1)\n"
+      "      --duplicates <f>      share of functions copied from an earlier one (default: 0.04)\n"
+      "      --inline <f>          share of functions with inlined code (default: 0.10)\n"
+      "      --padding int3|nop    filler between functions (default: int3)\n"
+      "      --mix <kind=weight,...>\n"
+      "                            instruction weights; kinds are mov_reg, mov_imm, load_store,\n"
+      "                            rip_load, call, branch, alu and sse\n");
+}
+
+/// Parses an unsigned integer; strtoull alone wraps "-1" and turns garbage into 0.
+bool parse_unsigned(const char* text, char*& end, unsigned long long& out) {
+  if (!std::isdigit(static_cast<unsigned char>(*text))) return false;
+  errno = 0;
+  out = std::strtoull(text, &end, 0);
+  return errno == 0 && end != text;
+}
+
+bool parse_size(const std::string& text, size_t& out) {
+  char* end = nullptr;
+  unsigned long long value = 0;
+  if (!parse_unsigned(text.c_str(), end, value)) return false;
+
+  unsigned shift = 0;
+  switch (*end) {
+  case 'G':
+  case 'g':
+    shift = 30;
+    ++end;
+    break;
+  case 'M':
+  case 'm':
+    shift = 20;
+    ++end;
+    break;
+  case 'K':
+  case 'k':
+    shift = 10;
+    ++end;
+    break;
+  default:
+    break;
+  }
+  if (*end != '\0' || value > (max_size >> shift)) return false;
+  out = static_cast<size_t>(value << shift);
+  return out >= min_size;
+}
+
+bool parse_seed(const std::string& text, uint64_t& out) {
+  char* end = nullptr;
+  unsigned long long value = 0;
+  if (!parse_unsigned(text.c_str(), end, value) || *end != '\0') return false;
+  out = value;
+  return true;
+}
+
+/// Parses a share between 0 and 1.
+bool parse_rate(const std::string& text, double& out) {
+  char* end = nullptr;
+  out = std::strtod(text.c_str(), &end);
+  return end != text.c_str() && *end == '\0' && out >= 0.0 && out <= 1.0;
+}
+
+bool parse_mix(const std::string& text, fusion::OpcodeMix& mix) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t next = text.find(',', pos);
+    if (next == std::string::npos) next = text.size();
+
+    const std::string item = text.substr(pos, next - pos);
+    const size_t eq = item.find('=');
+    if (eq == std::string::npos) return false;
+    const std::string kind = item.substr(0, eq);
+    char* end = nullptr;
+    unsigned long long value = 0;
+    if (!parse_unsigned(item.c_str() + eq + 1, end, value) || *end != '\0' || value > UINT32_MAX) {
+      return false;
+    }
+    const auto weight = static_cast<uint32_t>(value);
+
+    if (kind == "mov_reg") {
+      mix.mov_reg = weight;
+    } else if (kind == "mov_imm") {
+      mix.mov_imm = weight;
+    } else if (kind == "load_store") {
+      mix.load_store = weight;
+    } else if (kind == "rip_load") {
+      mix.rip_load = weight;
+    } else if (kind == "call") {
+      mix.call = weight;
+    } else if (kind == "branch") {
+      mix.branch = weight;
+    } else if (kind == "alu") {
+      mix.alu = weight;
+    } else if (kind == "sse") {
+      mix.sse = weight;
+    } else {
+      return false;
+    }
+    pos = next + 1;
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  fusion::CorpusSettings settings;
+  std::string output_path;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if ((arg == "-s" || arg == "--size") && i + 1 < argc) {
+      if (!parse_size(argv[++i], settings.size)) {
+        std::fprintf(stderr, "fusion-synth: invalid size %s (expected 1M to 1G)\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      if (!parse_seed(argv[++i], settings.seed)) {
+        std::fprintf(stderr, "fusion-synth: invalid seed %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--duplicates" && i + 1 < argc) {
+      if (!parse_rate(argv[++i], settings.duplicate_rate)) {
+        std::fprintf(stderr, "fusion-synth: invalid duplicate rate %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--inline" && i + 1 < argc) {
+      if (!parse_rate(argv[++i], settings.inline_rate)) {
+        std::fprintf(stderr, "fusion-synth: invalid inline rate %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--padding" && i + 1 < argc) {
+      const std::string padding = argv[++i];
+      if (padding == "int3") {
+        settings.padding = fusion::CorpusPadding::Int3;
+      } else if (padding == "nop") {
+        settings.padding = fusion::CorpusPadding::Nop;
+      } else {
+        std::fprintf(stderr, "fusion-synth: invalid padding %s\n", padding.c_str());
+        return 1;
+      }
+    } else if (arg == "--mix" && i + 1 < argc) {
+      if (!parse_mix(argv[++i], settings.mix)) {
+        std::fprintf(stderr, "fusion-synth: invalid mix %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (!arg.empty() && arg[0] == '-' && arg.size() > 1) {
+      std::fprintf(stderr, "fusion-synth: unknown option %s\n", arg.c_str());
+      print_usage();
+      return 1;
+    } else if (output_path.empty()) {
+      output_path = arg;
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (output_path.empty()) {
+    print_usage();
+    return 1;
+  }
+
+  fusion::MockDatabase db;
+  const fusion::CorpusStats stats = fusion::generate_corpus(settings, db);
+  if (!fusion::save_mock_database(output_path, db)) {
+    std::fprintf(stderr, "fusion-synth: cannot write %s\n", output_path.c_str());
+    return 1;
+  }
+
+  std::printf("%s: %zu bytes of code, %zu functions (%zu duplicated, %zu with inlined code), "
+              "%zu instructions\n",
+      output_path.c_str(), settings.size, stats.functions, stats.duplicates, stats.inlined,
+      stats.instructions);
+  return 0;
+}